@@ -90,6 +90,13 @@ int main(int argc, char **argv) {
         blurx.compute_root().gpu_tile(x, y, z, 8, 8, 1);
         blury.compute_root().gpu_tile(x, y, z, 8, 8, 1);
         bilateral_grid.compute_root().gpu_tile(x, y, s_sigma, s_sigma);
+    } else if (getenv("HL_AUTO_SCHEDULE")) {
+        // Let the auto-scheduler pick a schedule, for comparison
+        // against the hand-written one below.
+        r_sigma.set(0.1f);
+        bilateral_grid.estimate(x, 0, 1536).estimate(y, 0, 2560);
+        std::string schedule = Pipeline(bilateral_grid).auto_schedule(target);
+        printf("%s", schedule.c_str());
     } else {
         // The CPU schedule.
         blurz.compute_root().reorder(c, z, x, y).parallel(y).vectorize(x, 8).unroll(c);
@@ -1,4 +1,5 @@
 #include "Halide.h"
+#include <stdio.h>
 using namespace Halide;
 
 int main(int argc, char **argv) {
@@ -11,9 +12,17 @@ int main(int argc, char **argv) {
     blur_x(x, y) = (input(x, y) + input(x+1, y) + input(x+2, y))/3;
     blur_y(x, y) = (blur_x(x, y) + blur_x(x, y+1) + blur_x(x, y+2))/3;
 
-    // How to schedule it
-    blur_y.split(y, y, yi, 8).parallel(y).vectorize(x, 8);
-    blur_x.store_at(blur_y, y).compute_at(blur_y, yi).vectorize(x, 8);
+    if (getenv("HL_AUTO_SCHEDULE")) {
+        // Let the auto-scheduler pick a schedule, for comparison
+        // against the one below.
+        blur_y.estimate(x, 0, 6400).estimate(y, 0, 4800);
+        std::string schedule = Pipeline(blur_y).auto_schedule(get_target_from_environment());
+        printf("%s", schedule.c_str());
+    } else {
+        // How to schedule it
+        blur_y.split(y, y, yi, 8).parallel(y).vectorize(x, 8);
+        blur_x.store_at(blur_y, y).compute_at(blur_y, yi).vectorize(x, 8);
+    }
 
     blur_y.compile_to_static_library("halide_blur", {input}, "halide_blur");
 
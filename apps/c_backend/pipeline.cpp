@@ -6,22 +6,36 @@ using namespace Halide;
 HalideExtern_2(int, an_extern_func, int, int);
 
 int main(int argc, char **argv) {
-    Func f, g, h;
+    Func f, g, h, r;
     ImageParam input(UInt(16), 2);
+    Param<int> max_width("max_width");
     Var x, y;
 
     f(x, y) = (input(clamp(x+2, 0, input.width()-1), clamp(y-2, 0, input.height()-1)) * 17)/13;
 
     h.define_extern("an_extern_stage", {f}, Int(16), 0);
 
-    g(x, y) = f(y, x) + f(x, y) + cast<uint16_t>(an_extern_func(x, y)) + h();
+    r(x, y) = f(x, y) / 2;
+
+    g(x, y) = f(y, x) + f(x, y) + cast<uint16_t>(an_extern_func(x, y)) + h() + r(x, y);
 
     h.compute_root();
     f.compute_root();
     f.debug_to_file("f.tiff");
 
+    // Exercise vector code in the C backend too.
+    f.vectorize(x, 8);
+    g.vectorize(x, 8);
+
+    // And parallel loops. r is computed per row of g, and the bound
+    // on it is checked there, so a max_width narrower than the output
+    // makes an assertion fail inside the parallel loop.
+    g.parallel(y);
+    r.compute_at(g, y).bound(x, 0, max_width);
+
     std::vector<Argument> args;
     args.push_back(input);
+    args.push_back(max_width);
 
     g.compile_to_header("pipeline_native.h", args, "pipeline_native");
     g.compile_to_header("pipeline_c.h", args, "pipeline_c");
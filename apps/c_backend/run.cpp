@@ -48,9 +48,11 @@ int main(int argc, char **argv) {
     Image<uint16_t> out_native(423, 633);
     Image<uint16_t> out_c(423, 633);
 
-    pipeline_native(in, out_native);
-
-    pipeline_c(in, out_c);
+    if (pipeline_native(in, 1024, out_native) != 0 ||
+        pipeline_c(in, 1024, out_c) != 0) {
+        printf("Pipeline failed\n");
+        return -1;
+    }
 
     for (int y = 0; y < out_native.height(); y++) {
         for (int x = 0; x < out_native.width(); x++) {
@@ -62,6 +64,16 @@ int main(int argc, char **argv) {
         }
     }
 
+    // An assertion that fails inside a parallel loop must make both
+    // versions return an error.
+    int native_result = pipeline_native(in, 16, out_native);
+    int c_result = pipeline_c(in, 16, out_c);
+    if (native_result == 0 || c_result == 0) {
+        printf("Expected an error from both versions, got %d and %d\n",
+               native_result, c_result);
+        return -1;
+    }
+
     printf("Success!\n");
     return 0;
 }
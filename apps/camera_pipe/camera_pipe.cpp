@@ -1,9 +1,13 @@
 #include "Halide.h"
 #include <stdint.h>
+#include <stdio.h>
 
 using namespace Halide;
 
 Target target;
+// Leave scheduling to Pipeline::auto_schedule, for comparison
+// against the hand-written schedule.
+bool auto_schedule = false;
 
 Var x, y, yi("yi"), yo("yo"), c("c");
 Func processed("processed");
@@ -146,6 +150,10 @@ Func demosaic(Func deinterleaved) {
                                      b(x, y));
 
 
+    if (auto_schedule) {
+        return output;
+    }
+
     /* THE SCHEDULE */
     int vec = target.natural_vector_size(UInt(16));
     if (target.has_feature(Target::HVX_64)) {
@@ -184,7 +192,9 @@ Func color_correct(Func input, ImageParam matrix_3200, ImageParam matrix_7000, P
     Expr alpha = (1.0f/kelvin - 1.0f/3200) / (1.0f/7000 - 1.0f/3200);
     Expr val =  (matrix_3200(x, y) * alpha + matrix_7000(x, y) * (1 - alpha));
     matrix(x, y) = cast<int16_t>(val * 256.0f); // Q8.8 fixed point
-    matrix.compute_root();
+    if (!auto_schedule) {
+        matrix.compute_root();
+    }
 
     Func corrected;
     Expr ir = cast<int32_t>(input(x, y, 0));
@@ -243,7 +253,9 @@ Func apply_curve(Func input, Type result_type, Expr gamma, Expr contrast,
     // makeLUT add guard band outside of (minRaw, maxRaw]:
     curve(x) = select(x <= minRaw, 0, select(x > maxRaw, 255, val));
 
-    curve.compute_root(); // It's a LUT, compute it once ahead of time.
+    if (!auto_schedule) {
+        curve.compute_root(); // It's a LUT, compute it once ahead of time.
+    }
 
     Func curved;
 
@@ -277,6 +289,11 @@ Func process(Func raw, Type result_type,
 
     processed(x, y, c) = curved(x, y, c);
 
+    if (auto_schedule) {
+        processed.estimate(x, 0, 2560).estimate(y, 0, 1920).estimate(c, 0, 3);
+        return processed;
+    }
+
     // Schedule
     Expr out_width = processed.output_buffer().width();
     Expr out_height = processed.output_buffer().height();
@@ -351,11 +368,17 @@ int main(int argc, char **argv) {
 
     // Pick a target
     target = get_target_from_environment();
+    auto_schedule = getenv("HL_AUTO_SCHEDULE") != nullptr;
 
     // Build the pipeline
     Func processed = process(shifted, result_type, matrix_3200, matrix_7000,
                              color_temp, gamma, contrast, blackLevel, whiteLevel);
 
+    if (auto_schedule) {
+        std::string schedule = Pipeline(processed).auto_schedule(target);
+        printf("%s", schedule.c_str());
+    }
+
     std::vector<Argument> args = {color_temp, gamma, contrast, blackLevel, whiteLevel,
                                   input, matrix_3200, matrix_7000};
     // TODO: it would be more efficient to call compile_to() a single time with the right arguments
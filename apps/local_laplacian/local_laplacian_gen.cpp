@@ -1,4 +1,5 @@
 #include "Halide.h"
+#include <stdio.h>
 using namespace Halide;
 
 Var x, y;
@@ -114,11 +115,10 @@ int main(int argc, char **argv) {
 
 
     /* THE SCHEDULE */
-    remap.compute_root();
-
     Target target = get_target_from_environment();
     if (target.has_gpu_feature()) {
         // gpu schedule
+        remap.compute_root();
         output.compute_root().gpu_tile(x, y, 16, 8);
         for (int j = 0; j < J; j++) {
             int blockw = 16, blockh = 8;
@@ -132,8 +132,16 @@ int main(int argc, char **argv) {
             }
             outGPyramid[j].compute_root().gpu_tile(x, y, blockw, blockh);
         }
+    } else if (getenv("HL_AUTO_SCHEDULE")) {
+        // Let the auto-scheduler pick a schedule, for comparison
+        // against the hand-written one below.
+        levels.set(8);
+        output.estimate(x, 0, 1536).estimate(y, 0, 2560).estimate(c, 0, 3);
+        std::string schedule = Pipeline(output).auto_schedule(target);
+        printf("%s", schedule.c_str());
     } else {
         // cpu schedule
+        remap.compute_root();
         Var yo;
         output.reorder(c, x, y).split(y, yo, y, 64).parallel(yo).vectorize(x, 8);
         gray.compute_root().parallel(y, 32).vectorize(x, 8);
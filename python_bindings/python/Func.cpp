@@ -662,7 +662,11 @@ void defineFunc() {
              "calls to halide_trace. If the Func is inlined, this call has no effect.")
         .def("trace_realizations", &Func::trace_realizations, p::arg("self"),
              p::return_internal_reference<1>(),
-             "Trace all realizations of this Func by emitting calls to halide_trace.");
+             "Trace all realizations of this Func by emitting calls to halide_trace.")
+        .def("trace_regions", &Func::trace_regions, p::arg("self"),
+             p::return_internal_reference<1>(),
+             "Trace the boxes of this Func stored to and loaded from by each vectorized "
+             "loop iteration, production and consumption, rather than each load and store.");
 
     func_class.def("specialize", &Func::specialize, p::args("self", "condition"),
                    "Specialize a Func. This creates a special-case version of the "
@@ -99,6 +99,11 @@ void defineTarget() {
         .value("FMA", Target::Feature::FMA)
         .value("FMA4", Target::Feature::FMA4)
         .value("F16C", Target::Feature::F16C)
+        .value("AVX512", Target::Feature::AVX512)
+        .value("AVX512_BW", Target::Feature::AVX512_BW)
+        .value("AVX512_DQ", Target::Feature::AVX512_DQ)
+        .value("AVX512_VL", Target::Feature::AVX512_VL)
+        .value("AVX512_VNNI", Target::Feature::AVX512_VNNI)
 
         .value("ARMv7s", Target::Feature::ARMv7s)
         .value("NoNEON", Target::Feature::NoNEON)
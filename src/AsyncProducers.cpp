@@ -0,0 +1,479 @@
+#include <set>
+#include <string.h>
+
+#include "AsyncProducers.h"
+#include "Debug.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Scope.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Does a statement read the values of a Func, either by calling it
+// or by handing its buffer to an extern stage?
+class UsesFunc : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        if (op->name == func) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const Variable *op) {
+        if (op->name == func + ".buffer") {
+            result = true;
+        }
+    }
+
+public:
+    bool result = false;
+    UsesFunc(const string &f) : func(f) {}
+};
+
+bool uses_func(Stmt s, const string &func) {
+    UsesFunc u(func);
+    s.accept(&u);
+    return u.result;
+}
+
+// Does a statement contain the production of a Func?
+class ProducesFunc : public IRVisitor {
+    const string &func;
+
+    using IRVisitor::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (op->is_producer && op->name == func) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    bool result = false;
+    ProducesFunc(const string &f) : func(f) {}
+};
+
+bool produces_func(Stmt s, const string &func) {
+    ProducesFunc p(func);
+    s.accept(&p);
+    return p.result;
+}
+
+// If a statement is a wait on or a signal of one of the semaphores
+// of an async Func, return the name of the semaphore.
+class FindSemaphoreOp : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        const Variable *v = op->args.empty() ? nullptr : op->args[0].as<Variable>();
+        if ((op->name == "halide_semaphore_acquire" ||
+             op->name == "halide_semaphore_release") && v) {
+            result = v->name;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    string result;
+};
+
+string semaphore_op(Stmt s) {
+    if (!s.as<AssertStmt>() && !s.as<Evaluate>()) {
+        return "";
+    }
+    FindSemaphoreOp f;
+    s.accept(&f);
+    return f.result;
+}
+
+// The Func a semaphore belongs to.
+string semaphore_owner(const string &sem) {
+    for (const char *suffix : {".folding_semaphore", ".semaphore"}) {
+        if (ends_with(sem, suffix)) {
+            return sem.substr(0, sem.size() - strlen(suffix));
+        }
+    }
+    return "";
+}
+
+// Remove the waits on and signals of the semaphores of a Func.
+class RemoveSemaphoreOps : public IRMutator {
+    const string &func;
+
+    using IRMutator::visit;
+
+    void visit(const AssertStmt *op) {
+        if (semaphore_owner(semaphore_op(op)) == func) {
+            stmt = Evaluate::make(0);
+        } else {
+            stmt = op;
+        }
+    }
+
+    void visit(const Evaluate *op) {
+        if (semaphore_owner(semaphore_op(op)) == func) {
+            stmt = Evaluate::make(0);
+        } else {
+            stmt = op;
+        }
+    }
+
+public:
+    RemoveSemaphoreOps(const string &f) : func(f) {}
+};
+
+// Find the semaphores a statement waits on or signals.
+class FindSemaphores : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const AssertStmt *op) {
+        string sem = semaphore_op(op);
+        if (!sem.empty()) {
+            result.insert(sem);
+        }
+    }
+
+    void visit(const Evaluate *op) {
+        string sem = semaphore_op(op);
+        if (!sem.empty()) {
+            result.insert(sem);
+        }
+    }
+
+public:
+    set<string> result;
+};
+
+Stmt acquire_semaphore(const string &sem, Expr n) {
+    Expr call = Call::make(Int(32), "halide_semaphore_acquire",
+                           {Variable::make(Handle(), sem), n}, Call::Extern);
+    return AssertStmt::make(call == 0, -1);
+}
+
+Stmt release_semaphore(const string &sem, Expr n) {
+    return Evaluate::make(Call::make(Int(32), "halide_semaphore_release",
+                                     {Variable::make(Handle(), sem), n}, Call::Extern));
+}
+
+Stmt close_semaphore_on_exit(const string &sem) {
+    return Evaluate::make(Call::make(Int(32), Call::register_destructor,
+                                     {Expr("halide_semaphore_close"), Variable::make(Handle(), sem)},
+                                     Call::Intrinsic));
+}
+
+// Concatenate two statements, dropping either if it does nothing.
+Stmt make_block(Stmt first, Stmt rest) {
+    if (is_no_op(first)) {
+        return rest;
+    } else if (is_no_op(rest)) {
+        return first;
+    } else {
+        return Block::make(first, rest);
+    }
+}
+
+// Keep only the parts of the realization of an async Func that its
+// producer needs: the production itself, the productions of other
+// Funcs that it reads, the control flow around them, and the waits
+// on the folding semaphore.
+class GenerateProducerBody : public IRMutator {
+    const string &func;
+    set<string> &needs;
+
+    using IRMutator::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (op->name == func) {
+            if (op->is_producer) {
+                stmt = Block::make(op, release_semaphore(func + ".semaphore", 1));
+            } else {
+                stmt = Evaluate::make(0);
+            }
+        } else if (op->is_producer && !produces_func(op->body, func)) {
+            // Productions of other Funcs are only kept by visit(Block)
+            // if something after them reads them.
+            stmt = Evaluate::make(0);
+        } else {
+            Stmt body = mutate(op->body);
+            if (is_no_op(body)) {
+                stmt = Evaluate::make(0);
+            } else {
+                stmt = ProducerConsumer::make(op->name, op->is_producer, body);
+            }
+        }
+    }
+
+    void visit(const Block *op) {
+        Stmt rest = mutate(op->rest);
+        const ProducerConsumer *pc = op->first.as<ProducerConsumer>();
+        Stmt first;
+        if (pc && pc->is_producer && pc->name != func &&
+            !produces_func(pc->body, func) && uses_func(rest, pc->name)) {
+            needs.insert(pc->name);
+            first = op->first;
+        } else {
+            first = mutate(op->first);
+        }
+        stmt = make_block(first, rest);
+    }
+
+    // Keep the waits on the folding semaphore, and, for now, the
+    // semaphore operations of other async Funcs. Those are sorted out
+    // once both sides are known.
+    void visit(const AssertStmt *op) {
+        string sem = semaphore_op(op);
+        if (sem == func + ".folding_semaphore" ||
+            (!sem.empty() && semaphore_owner(sem) != func)) {
+            stmt = op;
+        } else {
+            stmt = Evaluate::make(0);
+        }
+    }
+
+    void visit(const Evaluate *op) {
+        string sem = semaphore_op(op);
+        if (!sem.empty() && semaphore_owner(sem) != func) {
+            stmt = op;
+        } else {
+            stmt = Evaluate::make(0);
+        }
+    }
+
+    void visit(const Provide *op) {
+        stmt = Evaluate::make(0);
+    }
+
+    void visit(const Store *op) {
+        stmt = Evaluate::make(0);
+    }
+
+    void visit(const For *op) {
+        Stmt body = mutate(op->body);
+        if (is_no_op(body)) {
+            stmt = body;
+        } else {
+            stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        Stmt body = mutate(op->body);
+        if (is_no_op(body)) {
+            stmt = body;
+        } else {
+            stmt = LetStmt::make(op->name, op->value, body);
+        }
+    }
+
+    void visit(const IfThenElse *op) {
+        Stmt then_case = mutate(op->then_case);
+        Stmt else_case = op->else_case.defined() ? mutate(op->else_case) : Stmt();
+        if (is_no_op(then_case) && (!else_case.defined() || is_no_op(else_case))) {
+            stmt = then_case;
+        } else {
+            stmt = IfThenElse::make(op->condition, then_case, else_case);
+        }
+    }
+
+    void visit(const Realize *op) {
+        Stmt body = mutate(op->body);
+        if (!uses_func(body, op->name) && !produces_func(body, op->name)) {
+            stmt = body;
+        } else {
+            stmt = Realize::make(op->name, op->types, op->bounds, op->condition, body);
+        }
+    }
+
+public:
+    GenerateProducerBody(const string &f, set<string> &n) : func(f), needs(n) {}
+};
+
+// Move a wait on a semaphore down into a statement, past everything
+// that doesn't read the Func the semaphore guards. Only moves it
+// through statements that run exactly once, so that the number of
+// waits doesn't change.
+Stmt sink_acquire(Stmt acquire, Stmt s, const string &func) {
+    if (const Block *b = s.as<Block>()) {
+        if (uses_func(b->first, func)) {
+            return Block::make(sink_acquire(acquire, b->first, func), b->rest);
+        } else {
+            return Block::make(b->first, sink_acquire(acquire, b->rest, func));
+        }
+    } else if (const LetStmt *l = s.as<LetStmt>()) {
+        return LetStmt::make(l->name, l->value, sink_acquire(acquire, l->body, func));
+    } else if (const ProducerConsumer *pc = s.as<ProducerConsumer>()) {
+        return ProducerConsumer::make(pc->name, pc->is_producer, sink_acquire(acquire, pc->body, func));
+    } else if (const Realize *r = s.as<Realize>()) {
+        return Realize::make(r->name, r->types, r->bounds, r->condition, sink_acquire(acquire, r->body, func));
+    } else {
+        return Block::make(acquire, s);
+    }
+}
+
+// Turn the realization of an async Func into the part that runs on
+// the current thread: wait for each production instead of doing it,
+// and drop the productions that only the producer needs.
+class GenerateConsumerBody : public IRMutator {
+    const string &func;
+    const set<string> &producer_needs;
+
+    using IRMutator::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (op->name == func && op->is_producer) {
+            stmt = acquire_semaphore(func + ".semaphore", 1);
+        } else if (!op->is_producer && producer_needs.count(op->name)) {
+            // Funcs computed only on the producer's thread aren't
+            // consumed here.
+            stmt = mutate(op->body);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Block *op) {
+        const ProducerConsumer *pc = op->first.as<ProducerConsumer>();
+        Stmt rest = mutate(op->rest);
+        if (pc && pc->is_producer && pc->name == func) {
+            stmt = sink_acquire(mutate(op->first), rest, func);
+        } else if (pc && pc->is_producer && producer_needs.count(pc->name) &&
+                   !produces_func(pc->body, func)) {
+            user_assert(!uses_func(rest, pc->name))
+                << "Func " << pc->name << " is used both by the producer of " << func
+                << ", which is scheduled async(), and by its consumers, so it would be computed "
+                << "on two threads at once. Compute " << pc->name << " at a loop level of " << func
+                << " instead, or outside of the loops over which " << func << " is stored.\n";
+            stmt = rest;
+        } else {
+            stmt = make_block(mutate(op->first), rest);
+        }
+    }
+
+    void visit(const AssertStmt *op) {
+        if (semaphore_op(op) == func + ".folding_semaphore") {
+            stmt = Evaluate::make(0);
+        } else {
+            stmt = op;
+        }
+    }
+
+    void visit(const Realize *op) {
+        Stmt body = mutate(op->body);
+        if (!uses_func(body, op->name) && !produces_func(body, op->name)) {
+            stmt = body;
+        } else {
+            stmt = Realize::make(op->name, op->types, op->bounds, op->condition, body);
+        }
+    }
+
+public:
+    GenerateConsumerBody(const string &f, const set<string> &n) : func(f), producer_needs(n) {}
+};
+
+class ForkAsyncProducers : public IRMutator {
+    const map<string, Function> &env;
+
+    using IRMutator::visit;
+
+    void visit(const Realize *op) {
+        auto it = env.find(op->name);
+        if (it == env.end() || !it->second.schedule().async()) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        // Lets at the top of the realization (including the
+        // folding semaphore) are shared by both sides.
+        vector<const LetStmt *> lets;
+        Stmt body = op->body;
+        while (const LetStmt *l = body.as<LetStmt>()) {
+            lets.push_back(l);
+            body = l->body;
+        }
+
+        debug(3) << "Forking the producer of " << op->name << "\n";
+
+        set<string> producer_needs;
+        Stmt producer = GenerateProducerBody(op->name, producer_needs).mutate(body);
+        Stmt consumer = GenerateConsumerBody(op->name, producer_needs).mutate(body);
+
+        // Other async Funcs realized outside this one may be waited
+        // on here. Those waits (and the signals that go with them)
+        // belong to whichever side reads them.
+        FindSemaphores producer_sems;
+        producer.accept(&producer_sems);
+        set<string> others;
+        for (const string &sem : producer_sems.result) {
+            others.insert(semaphore_owner(sem));
+        }
+        others.erase(op->name);
+        others.erase("");
+        for (const string &other : others) {
+            bool producer_uses = uses_func(producer, other) || produces_func(producer, other);
+            bool consumer_uses = uses_func(consumer, other) || produces_func(consumer, other);
+            user_assert(!(producer_uses && consumer_uses))
+                << "Func " << other << " is scheduled async(), and is used both by the producer of "
+                << op->name << ", which is also scheduled async(), and by its consumers.\n";
+            if (producer_uses) {
+                consumer = RemoveSemaphoreOps(other).mutate(consumer);
+            } else {
+                producer = RemoveSemaphoreOps(other).mutate(producer);
+            }
+        }
+
+        // The other side may not be there to release a semaphore if it
+        // fails, so each side closes the semaphores the other one
+        // waits on when it exits.
+        string sem = op->name + ".semaphore", folding_sem = op->name + ".folding_semaphore";
+        producer = Block::make(close_semaphore_on_exit(sem), mutate(producer));
+        consumer = mutate(consumer);
+        FindSemaphores consumer_sems;
+        consumer.accept(&consumer_sems);
+        if (consumer_sems.result.count(folding_sem)) {
+            consumer = Block::make(close_semaphore_on_exit(folding_sem), consumer);
+        }
+
+        body = Fork::make(producer, consumer);
+        body = LetStmt::make(sem, Call::make(Handle(), Call::make_semaphore, {0}, Call::Intrinsic), body);
+        for (size_t i = lets.size(); i > 0; i--) {
+            body = LetStmt::make(lets[i-1]->name, lets[i-1]->value, body);
+        }
+
+        stmt = Realize::make(op->name, op->types, op->bounds, op->condition, body);
+    }
+
+public:
+    ForkAsyncProducers(const map<string, Function> &e) : env(e) {}
+};
+
+}  // namespace
+
+Stmt fork_async_producers(Stmt s, const map<string, Function> &env) {
+    bool any_async = false;
+    for (const auto &p : env) {
+        any_async |= p.second.schedule().async();
+    }
+    if (!any_async) {
+        return s;
+    }
+    return ForkAsyncProducers(env).mutate(s);
+}
+
+}
+}
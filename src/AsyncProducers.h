@@ -0,0 +1,29 @@
+#ifndef HALIDE_ASYNC_PRODUCERS_H
+#define HALIDE_ASYNC_PRODUCERS_H
+
+/** \file
+ * Defines the lowering pass that runs the producers of Funcs
+ * scheduled async() on threads of their own.
+ */
+
+#include <map>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Split the realization of each Func scheduled async() into two
+ * halves that run at the same time: one that computes the Func, and
+ * one that consumes it. The consumer waits on a semaphore before each
+ * use of a value the producer hasn't finished yet, and if the storage
+ * of the Func is folded, the producer waits on a second semaphore for
+ * the consumer to be done with the slots it is about to
+ * overwrite. Must run after storage folding and skip_stages, and
+ * before storage flattening. */
+Stmt fork_async_producers(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
@@ -0,0 +1,878 @@
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+#include "AutoSchedule.h"
+#include "Bounds.h"
+#include "ExprUsesVar.h"
+#include "FindCalls.h"
+#include "Func.h"
+#include "Inline.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "RealizationOrder.h"
+#include "Simplify.h"
+
+namespace Halide {
+
+MachineParams MachineParams::generic() {
+    return MachineParams(16, 16 * 1024 * 1024, 40);
+}
+
+namespace Internal {
+
+using std::map;
+using std::ostringstream;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The extent assumed for any dimension we can't find an estimate for.
+const int64_t default_extent = 1024;
+
+// Funcs that cost at most this many operations summed over all their
+// call sites are inlined even if they aren't called pointwise.
+const int64_t inline_threshold = 16;
+
+// The cost of starting one tile of one stage, in arithmetic
+// operations. This covers the loop overhead and the partially used
+// cache lines at the edges of the tile, and stops the tiling search
+// from preferring tiny tiles when the redundant work is the same.
+const double tile_overhead = 1000;
+
+// Stages that do less work than this, in arithmetic operations, are
+// not worth the overhead of running in parallel.
+const double min_parallel_work = 100000;
+
+// Count the operations needed to evaluate an expression once. A
+// simple arithmetic operation costs one, divisions and calls to math
+// library functions cost more.
+class CountOps : public IRVisitor {
+public:
+    int64_t arith = 0, loads = 0;
+
+private:
+    using IRVisitor::visit;
+
+    template<typename T>
+    void visit_binary(const T *op) {
+        arith++;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Add *op) {visit_binary(op);}
+    void visit(const Sub *op) {visit_binary(op);}
+    void visit(const Mul *op) {visit_binary(op);}
+    void visit(const Min *op) {visit_binary(op);}
+    void visit(const Max *op) {visit_binary(op);}
+    void visit(const EQ *op) {visit_binary(op);}
+    void visit(const NE *op) {visit_binary(op);}
+    void visit(const LT *op) {visit_binary(op);}
+    void visit(const LE *op) {visit_binary(op);}
+    void visit(const GT *op) {visit_binary(op);}
+    void visit(const GE *op) {visit_binary(op);}
+    void visit(const And *op) {visit_binary(op);}
+    void visit(const Or *op) {visit_binary(op);}
+    void visit(const Not *op) {visit_binary(op);}
+    void visit(const Select *op) {visit_binary(op);}
+    void visit(const Cast *op) {visit_binary(op);}
+
+    void visit(const Div *op) {
+        int bits;
+        arith += is_const_power_of_two_integer(op->b, &bits) ? 1 : 8;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Mod *op) {
+        int bits;
+        arith += is_const_power_of_two_integer(op->b, &bits) ? 1 : 8;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Halide || op->call_type == Call::Image) {
+            loads++;
+        } else if (op->call_type == Call::Intrinsic || op->call_type == Call::PureIntrinsic) {
+            arith++;
+        } else {
+            // Math library functions and other externs.
+            arith += 20;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Load *op) {
+        loads++;
+        IRVisitor::visit(op);
+    }
+};
+
+// Count the calls to each Func in an expression, and check whether
+// they are all pointwise, i.e. each argument is a bare variable.
+class FindCallSites : public IRVisitor {
+public:
+    map<string, int> count;
+    set<string> not_pointwise;
+
+private:
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide) {
+            count[op->name]++;
+            for (const Expr &arg : op->args) {
+                if (!arg.as<Variable>()) {
+                    not_pointwise.insert(op->name);
+                }
+            }
+        }
+    }
+};
+
+// Check that every call to a Func uses the same variable in a given
+// argument position. Used to check that a pure var of an update
+// definition carries no dependence, so it can be vectorized or
+// parallelized.
+class CallsUseVarAt : public IRVisitor {
+public:
+    CallsUseVarAt(const string &f, int i, const string &v) : func(f), idx(i), var(v) {}
+    bool result = true;
+
+private:
+    using IRVisitor::visit;
+    const string &func;
+    int idx;
+    const string &var;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->name == func) {
+            const Variable *v = op->args[idx].as<Variable>();
+            if (!v || v->name != var) {
+                result = false;
+            }
+        }
+    }
+};
+
+// An inclusive range of integer coordinates.
+struct Span {
+    int64_t min, max;
+    int64_t extent() const {
+        return std::max(max - min + 1, (int64_t)0);
+    }
+};
+
+typedef vector<Span> Region;
+
+int64_t region_size(const Region &r) {
+    int64_t size = 1;
+    for (const Span &s : r) {
+        size *= s.extent();
+    }
+    return size;
+}
+
+void merge_regions(Region &a, const Region &b) {
+    if (a.empty()) {
+        a = b;
+        return;
+    }
+    internal_assert(a.size() == b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i].min = std::min(a[i].min, b[i].min);
+        a[i].max = std::max(a[i].max, b[i].max);
+    }
+}
+
+// Replace scalar Params with their current values, which we use as
+// estimates of the values they will take at run time.
+class SubstituteParamValues : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const Variable *op) {
+        if (op->param.defined() && !op->param.is_buffer()) {
+            expr = op->param.get_scalar_expr();
+        } else {
+            expr = op;
+        }
+    }
+};
+
+int64_t const_or(Expr e, int64_t fallback, bool *unknown) {
+    if (e.defined()) {
+        e = simplify(e);
+        const int64_t *i = as_const_int(e);
+        if (!i) {
+            e = simplify(SubstituteParamValues().mutate(e));
+            i = as_const_int(e);
+        }
+        if (i) {
+            return *i;
+        }
+    }
+    *unknown = true;
+    return fallback;
+}
+
+// One definition of a Func, with all inlined Funcs substituted in.
+struct DefInfo {
+    vector<Expr> exprs;
+    vector<ReductionVariable> rvars;
+    // Which pure dimensions of the Func this definition loops over.
+    vector<bool> uses_dim;
+    // The number of points in the reduction domain.
+    int64_t rdom_size;
+    int64_t ops;
+};
+
+struct FuncInfo {
+    Function func;
+    vector<DefInfo> defs;
+    int64_t bytes_per_point;
+    bool inlined = false;
+    // Already scheduled by the user; left alone.
+    bool fixed = false;
+    Region region;
+    set<string> consumers;
+};
+
+// A set of Funcs computed together within the tiles of a leader
+// Func. The leader is computed at root.
+struct Group {
+    string leader;
+    vector<string> members;
+    // Tile sizes for the innermost one or two pure dimensions of the
+    // leader. Empty if the leader is not tiled.
+    vector<int64_t> tile;
+    double cost;
+};
+
+class AutoScheduler {
+    const Target &target;
+    const MachineParams &params;
+    map<string, Function> env;
+    vector<string> order;
+    set<string> outputs;
+    map<string, FuncInfo> funcs;
+    map<string, Group> groups;
+    bool warned_unknown = false;
+
+    void warn_unknown(const string &what) {
+        if (!warned_unknown) {
+            user_warning << "Auto-scheduler could not determine " << what
+                         << "; assuming an extent of " << default_extent << ". "
+                         << "Use Func::estimate on the outputs, and set scalar Params to "
+                         << "typical values, to give better estimates.\n";
+            warned_unknown = true;
+        }
+    }
+
+    Expr inline_all(Expr e) {
+        // Inline consumers before producers, so that calls exposed
+        // by inlining one Func get inlined in turn.
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            const FuncInfo &f = funcs[*it];
+            if (f.inlined) {
+                e = inline_function(e, f.func);
+            }
+        }
+        return e;
+    }
+
+    void analyze_definition(FuncInfo &f, const Definition &def) {
+        DefInfo d;
+        const vector<string> args = f.func.args();
+        if (!def.is_init()) {
+            for (const Expr &e : def.args()) {
+                d.exprs.push_back(inline_all(e));
+            }
+        }
+        for (const Expr &e : def.values()) {
+            d.exprs.push_back(inline_all(e));
+        }
+        if (def.predicate().defined()) {
+            d.exprs.push_back(inline_all(def.predicate()));
+        }
+        d.rvars = def.schedule().rvars();
+        d.rdom_size = 1;
+        for (const ReductionVariable &rv : d.rvars) {
+            bool unknown = false;
+            d.rdom_size *= const_or(rv.extent, default_extent, &unknown);
+            if (unknown) {
+                warn_unknown("the extent of " + rv.var);
+            }
+        }
+        for (const string &arg : args) {
+            bool used = def.is_init();
+            for (const Expr &e : d.exprs) {
+                used = used || expr_uses_var(e, arg);
+            }
+            d.uses_dim.push_back(used);
+        }
+        CountOps counter;
+        for (const Expr &e : d.exprs) {
+            e.accept(&counter);
+        }
+        d.ops = counter.arith + counter.loads;
+        f.defs.push_back(d);
+    }
+
+    // Starting from the regions required of some Funcs, walk back
+    // through the pipeline and work out the regions required of the
+    // Funcs they call. If 'members' is non-null, only propagate into
+    // those Funcs.
+    map<string, Region> propagate(map<string, Region> regions, const set<string> *members) {
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            const FuncInfo &f = funcs[*it];
+            if (f.inlined || !regions.count(*it) || f.func.has_extern_definition()) {
+                continue;
+            }
+            const Region &r = regions[*it];
+            const vector<string> args = f.func.args();
+            for (const DefInfo &d : f.defs) {
+                Scope<Interval> scope;
+                for (size_t i = 0; i < args.size(); i++) {
+                    scope.push(args[i], Interval(make_const(Int(32), r[i].min),
+                                                 make_const(Int(32), r[i].max)));
+                }
+                for (const ReductionVariable &rv : d.rvars) {
+                    scope.push(rv.var, Interval(rv.min, simplify(rv.min + rv.extent - 1)));
+                }
+                for (const Expr &e : d.exprs) {
+                    map<string, Box> boxes = boxes_required(e, scope);
+                    for (const auto &b : boxes) {
+                        auto callee = funcs.find(b.first);
+                        if (callee == funcs.end() || callee->second.inlined ||
+                            b.first == *it ||
+                            (members && !members->count(b.first))) {
+                            continue;
+                        }
+                        Region req;
+                        for (size_t i = 0; i < b.second.size(); i++) {
+                            bool unknown = false;
+                            Span s;
+                            s.min = const_or(b.second[i].has_lower_bound() ? b.second[i].min : Expr(), 0, &unknown);
+                            s.max = const_or(b.second[i].has_upper_bound() ? b.second[i].max : Expr(),
+                                             s.min + default_extent - 1, &unknown);
+                            if (unknown) {
+                                warn_unknown("the region required of " + b.first);
+                            }
+                            req.push_back(s);
+                        }
+                        merge_regions(regions[b.first], req);
+                    }
+                }
+            }
+        }
+        return regions;
+    }
+
+    // Arithmetic work done to compute a region of a Func.
+    double work(const FuncInfo &f, const Region &r) {
+        double total = 0;
+        for (const DefInfo &d : f.defs) {
+            double points = (double)d.rdom_size;
+            for (size_t i = 0; i < r.size(); i++) {
+                if (d.uses_dim[i]) {
+                    points *= r[i].extent();
+                }
+            }
+            total += points * d.ops;
+        }
+        return total;
+    }
+
+    double bytes(const FuncInfo &f, const Region &r) {
+        return (double)region_size(r) * f.bytes_per_point;
+    }
+
+    // The parallel loop of a stage computed at root and not tiled is
+    // the outermost pure dimension with enough iterations to occupy
+    // the machine, or the outermost dimension if there is none.
+    int parallel_dim(const FuncInfo &f) {
+        int d = (int)f.region.size() - 1;
+        for (int i = d; i >= 0; i--) {
+            if (f.region[i].extent() >= params.parallelism) {
+                return i;
+            }
+        }
+        return d;
+    }
+
+    // The modelled run time of a group with the given tile size, in
+    // units of arithmetic operations.
+    double group_cost(const Group &g, const vector<int64_t> &tile) {
+        FuncInfo &leader = funcs[g.leader];
+        double compute = work(leader, leader.region);
+        double memory = 2 * bytes(leader, leader.region);
+        double spill = 0;
+        double par;
+
+        if (g.members.empty()) {
+            if (leader.func.has_extern_definition() || leader.region.empty()) {
+                par = 1;
+            } else {
+                par = (double)leader.region[parallel_dim(leader)].extent();
+            }
+        } else {
+            // The region of the leader computed by one tile. Any
+            // untiled dimensions are outside the tile loops, so the
+            // tile covers a single coordinate of them.
+            Region tile_region;
+            int64_t tiles = 1;
+            for (size_t i = 0; i < leader.region.size(); i++) {
+                const Span &s = leader.region[i];
+                int64_t t = i < tile.size() ? tile[i] : 1;
+                int64_t mid = s.min + (s.extent() - t) / 2;
+                tile_region.push_back({mid, mid + t - 1});
+                tiles *= (s.extent() + t - 1) / t;
+            }
+            map<string, Region> initial;
+            initial[g.leader] = tile_region;
+            set<string> members(g.members.begin(), g.members.end());
+            map<string, Region> regions = propagate(initial, &members);
+
+            compute += tiles * (g.members.size() + 1) * tile_overhead;
+
+            double footprint = bytes(leader, tile_region);
+            for (const string &m : g.members) {
+                const FuncInfo &f = funcs[m];
+                internal_assert(regions.count(m));
+                compute += work(f, regions[m]) * tiles;
+                footprint += bytes(f, regions[m]);
+            }
+            // If the intermediates of a tile don't fit in this core's
+            // share of the cache, they go to memory and back.
+            if (footprint * params.parallelism > params.last_level_cache_size) {
+                spill = 2 * (footprint - bytes(leader, tile_region)) * tiles;
+            }
+            // The parallel loop is over the outer tile index of the
+            // outermost tiled dimension.
+            internal_assert(!tile.empty() && tile.back() > 0);
+            const Span &s = leader.region[tile.size() - 1];
+            par = (double)((s.extent() + tile.back() - 1) / tile.back());
+        }
+
+        par = std::max(1.0, std::min(par, (double)params.parallelism));
+        return (compute + params.balance * spill) / par + params.balance * memory;
+    }
+
+    // Find the best tile size for a group with members, and its cost.
+    // A leader with no dimensions, or with an empty region (e.g. from
+    // estimates of zero), has nothing to tile, so the group is given
+    // an infinite cost and never chosen.
+    void choose_tile(Group &g) {
+        FuncInfo &leader = funcs[g.leader];
+        int vec = target.natural_vector_size(leader.func.output_types()[0]);
+        size_t dims = std::min(leader.region.size(), (size_t)2);
+        if (dims == 0 || region_size(leader.region) == 0) {
+            g.tile.clear();
+            g.cost = std::numeric_limits<double>::infinity();
+            return;
+        }
+
+        vector<int64_t> x_sizes, y_sizes;
+        for (int64_t s : {1, 2, 4, 8, 16, 32}) {
+            x_sizes.push_back(s * std::max(vec, 8));
+        }
+        for (int64_t s : {2, 4, 8, 16, 32, 64, 128}) {
+            y_sizes.push_back(s);
+        }
+
+        g.cost = -1;
+        for (int64_t tx : x_sizes) {
+            tx = std::max(std::min(tx, leader.region[0].extent()), (int64_t)1);
+            for (int64_t ty : y_sizes) {
+                vector<int64_t> tile = {tx};
+                if (dims > 1) {
+                    tile.push_back(std::max(std::min(ty, leader.region[1].extent()), (int64_t)1));
+                }
+                double c = group_cost(g, tile);
+                if (g.cost < 0 || c < g.cost) {
+                    g.cost = c;
+                    g.tile = tile;
+                }
+                if (dims == 1) {
+                    break;
+                }
+            }
+        }
+    }
+
+    // The group that consumes everything a group produces, if there
+    // is exactly one.
+    string single_consumer_group(const Group &g, const map<string, string> &group_of) {
+        string result;
+        const FuncInfo &f = funcs[g.leader];
+        for (const string &c : f.consumers) {
+            const string &cg = group_of.at(c);
+            if (!result.empty() && result != cg) {
+                return "";
+            }
+            result = cg;
+        }
+        return result;
+    }
+
+    bool can_fuse_into(const Group &g, const Group &h) {
+        const FuncInfo &p = funcs[g.leader];
+        const FuncInfo &c = funcs[h.leader];
+        return !outputs.count(g.leader) && !p.fixed && !c.fixed &&
+            !p.func.has_extern_definition() && !c.func.has_extern_definition() &&
+            !c.func.has_update_definition() && !c.region.empty();
+    }
+
+    void make_groups() {
+        map<string, string> group_of;
+        for (const string &name : order) {
+            const FuncInfo &f = funcs[name];
+            if (f.inlined) {
+                continue;
+            }
+            Group g;
+            g.leader = name;
+            g.cost = group_cost(g, vector<int64_t>());
+            groups[name] = g;
+            group_of[name] = name;
+        }
+
+        // Greedily merge the pair of groups that saves the most,
+        // until no merge saves anything.
+        while (true) {
+            double best_benefit = 0;
+            Group best;
+            string best_producer;
+            for (const auto &it : groups) {
+                const Group &g = it.second;
+                string consumer = single_consumer_group(g, group_of);
+                if (consumer.empty() || consumer == g.leader) {
+                    continue;
+                }
+                const Group &h = groups[consumer];
+                if (!can_fuse_into(g, h)) {
+                    continue;
+                }
+                Group merged = h;
+                merged.members.push_back(g.leader);
+                merged.members.insert(merged.members.end(), g.members.begin(), g.members.end());
+                choose_tile(merged);
+                double benefit = g.cost + h.cost - merged.cost;
+                if (benefit > best_benefit) {
+                    best_benefit = benefit;
+                    best = merged;
+                    best_producer = g.leader;
+                }
+            }
+            if (best_producer.empty()) {
+                break;
+            }
+            debug(1) << "Auto-scheduler fusing " << best_producer
+                     << " into " << best.leader << "\n";
+            for (auto &it : group_of) {
+                if (it.second == best_producer) {
+                    it.second = best.leader;
+                }
+            }
+            groups.erase(best_producer);
+            groups[best.leader] = best;
+        }
+    }
+
+    // Vectorize and, if requested, parallelize the update definitions
+    // of a Func along pure dimensions that carry no dependence.
+    void schedule_updates(const FuncInfo &f, const Region &r, int vec, bool parallel, ostringstream &src) {
+        Func func(f.func);
+        const vector<string> args = f.func.args();
+        for (size_t u = 0; u < f.func.updates().size(); u++) {
+            const Definition &def = f.func.update((int)u);
+            vector<bool> pure(args.size(), false);
+            for (size_t i = 0; i < args.size(); i++) {
+                const Variable *v = def.args()[i].as<Variable>();
+                if (!v || v->name != args[i]) {
+                    continue;
+                }
+                CallsUseVarAt check(f.func.name(), (int)i, args[i]);
+                for (const Expr &e : def.values()) {
+                    e.accept(&check);
+                }
+                pure[i] = check.result;
+            }
+            ostringstream stage;
+            if (pure[0] && r[0].extent() >= vec) {
+                func.update((int)u).vectorize(Var(args[0]), vec);
+                stage << ".vectorize(" << args[0] << ", " << vec << ")";
+            }
+            if (parallel) {
+                // Prefer the outermost pure dimension with enough
+                // iterations to occupy the machine, then the widest.
+                int p = -1;
+                for (int i = (int)args.size() - 1; i > 0; i--) {
+                    if (!pure[i] || r[i].extent() <= 1) {
+                        continue;
+                    }
+                    if (p < 0 || (r[p].extent() < params.parallelism && r[i].extent() > r[p].extent())) {
+                        p = i;
+                    }
+                }
+                if (p > 0) {
+                    func.update((int)u).parallel(Var(args[p]));
+                    stage << ".parallel(" << args[p] << ")";
+                }
+            }
+            if (!stage.str().empty()) {
+                src << f.func.name() << ".update(" << u << ")" << stage.str() << ";\n";
+            }
+        }
+    }
+
+    void apply_group(const Group &g, ostringstream &src) {
+        const FuncInfo &leader = funcs[g.leader];
+        Func f(leader.func);
+        const vector<string> args = leader.func.args();
+
+        if (!outputs.count(g.leader)) {
+            f.compute_root();
+        }
+        src << leader.func.name();
+        if (!outputs.count(g.leader)) {
+            src << ".compute_root()";
+        }
+
+        if (leader.func.has_extern_definition() || leader.region.empty()) {
+            src << ";\n";
+            return;
+        }
+
+        int vec = target.natural_vector_size(leader.func.output_types()[0]);
+        string tile_var;
+        if (g.members.empty()) {
+            if (leader.region[0].extent() >= vec) {
+                f.vectorize(Var(args[0]), vec);
+                src << ".vectorize(" << args[0] << ", " << vec << ")";
+            }
+            int p = parallel_dim(leader);
+            if (work(leader, leader.region) >= min_parallel_work &&
+                (p > 0 || leader.region[0].extent() >= (int64_t)vec * params.parallelism)) {
+                f.parallel(Var(args[p]));
+                src << ".parallel(" << args[p] << ")";
+            }
+        } else if (g.tile.size() == 1) {
+            Var x(args[0]), xo(args[0] + "_o"), xi(args[0] + "_i");
+            f.split(x, xo, xi, (int)g.tile[0]).parallel(xo);
+            src << ".split(" << x.name() << ", " << xo.name() << ", " << xi.name() << ", " << g.tile[0] << ")"
+                << ".parallel(" << xo.name() << ")";
+            if (g.tile[0] >= vec) {
+                f.vectorize(xi, vec);
+                src << ".vectorize(" << xi.name() << ", " << vec << ")";
+            }
+            tile_var = xo.name();
+        } else {
+            Var x(args[0]), xo(args[0] + "_o"), xi(args[0] + "_i");
+            Var y(args[1]), yo(args[1] + "_o"), yi(args[1] + "_i");
+            f.tile(x, y, xo, yo, xi, yi, (int)g.tile[0], (int)g.tile[1]).parallel(yo);
+            src << ".tile(" << x.name() << ", " << y.name() << ", "
+                << xo.name() << ", " << yo.name() << ", "
+                << xi.name() << ", " << yi.name() << ", "
+                << g.tile[0] << ", " << g.tile[1] << ")"
+                << ".parallel(" << yo.name() << ")";
+            if (g.tile[0] >= vec) {
+                f.vectorize(xi, vec);
+                src << ".vectorize(" << xi.name() << ", " << vec << ")";
+            }
+            tile_var = xo.name();
+        }
+        src << ";\n";
+        schedule_updates(leader, leader.region, vec, work(leader, leader.region) >= min_parallel_work, src);
+
+        if (g.members.empty()) {
+            return;
+        }
+
+        // Work out the regions of the members computed per tile, so
+        // we know which of them are wide enough to vectorize.
+        map<string, Region> initial;
+        Region tile_region;
+        for (size_t i = 0; i < args.size(); i++) {
+            int64_t t = i < g.tile.size() ? g.tile[i] : 1;
+            tile_region.push_back({0, t - 1});
+        }
+        initial[g.leader] = tile_region;
+        set<string> members(g.members.begin(), g.members.end());
+        map<string, Region> regions = propagate(initial, &members);
+
+        for (const string &m : g.members) {
+            const FuncInfo &mf = funcs[m];
+            Func member(mf.func);
+            const Region &r = regions[m];
+            int mvec = target.natural_vector_size(mf.func.output_types()[0]);
+            member.compute_at(f, Var(tile_var));
+            src << m << ".compute_at(" << g.leader << ", " << tile_var << ")";
+            if (!r.empty() && r[0].extent() >= mvec) {
+                member.vectorize(Var(mf.func.args()[0]), mvec);
+                src << ".vectorize(" << mf.func.args()[0] << ", " << mvec << ")";
+            }
+            src << ";\n";
+            if (!r.empty()) {
+                schedule_updates(mf, r, mvec, false, src);
+            }
+        }
+    }
+
+public:
+    AutoScheduler(const vector<Function> &outs, const Target &t, const MachineParams &p) :
+        target(t), params(p) {
+        vector<Function> output_funcs = outs;
+        for (Function f : outs) {
+            outputs.insert(f.name());
+            env[f.name()] = f;
+            map<string, Function> calls = find_transitive_calls(f);
+            env.insert(calls.begin(), calls.end());
+        }
+        order = realization_order(output_funcs, env);
+    }
+
+    string run() {
+        user_assert(!target.has_gpu_feature())
+            << "The auto-scheduler only generates schedules for the CPU.\n";
+
+        // Decide which Funcs to inline, producers first so that the
+        // cost of a Func includes the cost of anything inlined into it.
+        for (const string &name : order) {
+            FuncInfo &f = funcs[name];
+            f.func = env[name];
+            f.bytes_per_point = 0;
+            for (const Type &t : f.func.output_types()) {
+                f.bytes_per_point += t.bytes();
+            }
+            const Schedule &s = f.func.schedule();
+            if (!outputs.count(name) &&
+                (!s.splits().empty() || !s.compute_level().is_inline() ||
+                 s.memoized())) {
+                user_warning << "Auto-scheduler is leaving the existing schedule of "
+                             << name << " alone.\n";
+                f.fixed = true;
+            }
+        }
+        for (const string &name : order) {
+            FuncInfo &f = funcs[name];
+            if (f.fixed || outputs.count(name) || !f.func.can_be_inlined() ||
+                f.func.has_extern_definition()) {
+                continue;
+            }
+            CountOps counter;
+            vector<Expr> values;
+            for (const Expr &e : f.func.values()) {
+                values.push_back(inline_all(e));
+                values.back().accept(&counter);
+            }
+            int64_t ops = counter.arith + counter.loads;
+
+            // A Func that just loads a single value, perhaps with some
+            // arithmetic on the coordinates (e.g. a boundary
+            // condition), is not worth storing: that would cost a
+            // store and a load to save only the index arithmetic.
+            bool is_load = false;
+            if (values.size() == 1) {
+                Expr v = values[0];
+                while (const Cast *c = v.as<Cast>()) {
+                    v = c->value;
+                }
+                const Call *call = v.as<Call>();
+                is_load = call && (call->call_type == Call::Halide || call->call_type == Call::Image);
+            }
+
+            int call_sites = 0;
+            bool pointwise = true;
+            for (const auto &it : env) {
+                FindCallSites sites;
+                it.second.accept(&sites);
+                call_sites += sites.count[name];
+                pointwise = pointwise && !sites.not_pointwise.count(name);
+            }
+            if (pointwise || is_load || ops * call_sites <= inline_threshold) {
+                debug(1) << "Auto-scheduler inlining " << name << "\n";
+                f.inlined = true;
+            }
+        }
+
+        for (const string &name : order) {
+            FuncInfo &f = funcs[name];
+            if (f.inlined || f.func.has_extern_definition()) {
+                continue;
+            }
+            analyze_definition(f, f.func.definition());
+            for (const Definition &def : f.func.updates()) {
+                analyze_definition(f, def);
+            }
+            for (const DefInfo &d : f.defs) {
+                for (const Expr &e : d.exprs) {
+                    FindCallSites sites;
+                    e.accept(&sites);
+                    for (const auto &c : sites.count) {
+                        if (funcs.count(c.first) && c.first != name) {
+                            funcs[c.first].consumers.insert(name);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Start from the estimated regions of the outputs and work out
+        // how much of everything else gets computed.
+        map<string, Region> initial;
+        for (const string &name : outputs) {
+            const Function &f = env[name];
+            Region r;
+            for (const string &arg : f.args()) {
+                Span s = {0, default_extent - 1};
+                bool found = false;
+                for (const Bound &b : f.schedule().estimates()) {
+                    if (b.var == arg) {
+                        bool unknown = false;
+                        s.min = const_or(b.min, 0, &unknown);
+                        s.max = s.min + const_or(b.extent, default_extent, &unknown) - 1;
+                        found = !unknown;
+                    }
+                }
+                if (!found) {
+                    warn_unknown("the size of output " + name + " in dimension " + arg);
+                }
+                r.push_back(s);
+            }
+            initial[name] = r;
+        }
+        map<string, Region> regions = propagate(initial, nullptr);
+        for (const auto &it : regions) {
+            funcs[it.first].region = it.second;
+        }
+
+        make_groups();
+
+        ostringstream src;
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            if (groups.count(*it) && !funcs[*it].fixed) {
+                apply_group(groups[*it], src);
+            }
+        }
+        return src.str();
+    }
+};
+
+}  // namespace
+
+string generate_schedules(const vector<Function> &outputs,
+                          const Target &target,
+                          const MachineParams &params) {
+    AutoScheduler scheduler(outputs, target, params);
+    string schedule = scheduler.run();
+    debug(1) << "Auto-generated schedule:\n" << schedule << "\n";
+    return schedule;
+}
+
+}
+}
@@ -0,0 +1,36 @@
+#ifndef HALIDE_AUTO_SCHEDULE_H
+#define HALIDE_AUTO_SCHEDULE_H
+
+/** \file
+ *
+ * Defines the analytic auto-scheduler used by Pipeline::auto_schedule.
+ */
+
+#include <string>
+#include <vector>
+
+#include "Pipeline.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+class Function;
+
+/** Choose and apply schedules for every Func in the pipeline that
+ * computes the given outputs, using the estimates on the outputs
+ * (see \ref Func::estimate) and an analytic cost model of the given
+ * machine. Cheap and pointwise Funcs are inlined, producers are fused
+ * into the tiles of their consumers when that saves more memory
+ * traffic than it costs in redundant recompute, and every stage
+ * computed at root is vectorized and parallelized. Returns the
+ * schedule as C++ source, so that it can be pasted into the pipeline
+ * and then hand-tuned. */
+std::string generate_schedules(const std::vector<Function> &outputs,
+                               const Target &target,
+                               const MachineParams &params);
+
+}
+}
+
+#endif
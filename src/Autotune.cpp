@@ -0,0 +1,829 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+
+#include "Autotune.h"
+#include "Func.h"
+#include "Generator.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "Pipeline.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::ostringstream;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char kUsage[] = "autotune [-g GENERATOR_NAME] [-l LOG_FILE] [-o OUTPUT_FILE] [-t TRIALS] [-r SEED] "
+                      "[-s SIZES] [-n SAMPLES] [generator_arg=value [...]]\n\n"
+                      "  -l  The results log. Defaults to GENERATOR_NAME.autotune.log. If it already exists, "
+                      "the search resumes from the results in it.\n"
+                      "  -o  A file to write the best schedule found to, as C++ source. It is always printed to stdout.\n"
+                      "  -t  The number of new candidate schedules to try. Defaults to 100.\n"
+                      "  -r  The random seed. Defaults to 0.\n"
+                      "  -s  A comma separated list of output sizes, e.g. 1920,1080. If omitted, the "
+                      "estimates on the outputs are used (see Func::estimate).\n"
+                      "  -n  The number of timing runs per candidate; the minimum is reported. Defaults to 10.\n";
+
+// Candidate split factors and tile heights. Powers of two, so that
+// any vector width that fits in a split divides it.
+const int split_x_factors[] = {1, 8, 16, 32, 64, 128, 256};
+const int split_y_factors[] = {1, 2, 4, 8, 16, 32, 64, 128};
+
+// The number of loop levels of its consumer a Func may be computed
+// at, counting from the innermost.
+const int max_compute_at_depth = 4;
+
+// Give up on finding an untried candidate after this many attempts.
+const int max_attempts_per_trial = 100;
+
+// Collect the Funcs a Function calls, in order of first appearance,
+// so that the stages of two separately built instances of a
+// Generator can be matched up without relying on their names.
+class OrderedCalls : public IRVisitor {
+public:
+    vector<Function> calls;
+
+    using IRVisitor::visit;
+
+    void include(const Function &f) {
+        for (const Function &g : calls) {
+            if (g.same_as(f)) {
+                return;
+            }
+        }
+        calls.push_back(f);
+    }
+
+private:
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->func.defined()) {
+            include(Function(op->func));
+        }
+    }
+};
+
+// The schedule of a single Func in a candidate.
+struct Choice {
+    // -1 to inline, 0 to compute at root, and k > 0 to compute at the
+    // (k-1)th innermost loop of the Func's single consumer.
+    int compute;
+    int split_x, split_y, vector;
+    bool parallel;
+};
+
+typedef vector<Choice> Candidate;
+
+struct Stage {
+    Function func;
+    bool output, fixed;
+    // The index of the only Func that calls this one, or -1 if there
+    // isn't exactly one.
+    int consumer;
+    int natural_vector;
+};
+
+string candidate_key(const Candidate &c) {
+    ostringstream key;
+    for (size_t i = 0; i < c.size(); i++) {
+        const Choice &ch = c[i];
+        if (i > 0) {
+            key << " ";
+        }
+        if (ch.compute < 0) {
+            key << "i";
+        } else if (ch.compute == 0) {
+            key << "r";
+        } else {
+            key << "a" << ch.compute - 1;
+        }
+        key << "." << ch.split_x << "." << ch.split_y << "." << ch.vector << "." << (ch.parallel ? 1 : 0);
+    }
+    return key.str();
+}
+
+bool parse_candidate(const string &key, size_t num_stages, Candidate *c) {
+    c->clear();
+    for (const string &s : split_string(key, " ")) {
+        vector<string> fields = split_string(s, ".");
+        if (fields.size() != 5 || fields[0].empty()) {
+            return false;
+        }
+        Choice ch;
+        if (fields[0] == "i") {
+            ch.compute = -1;
+        } else if (fields[0] == "r") {
+            ch.compute = 0;
+        } else if (fields[0][0] == 'a') {
+            ch.compute = atoi(fields[0].c_str() + 1) + 1;
+        } else {
+            return false;
+        }
+        ch.split_x = std::max(1, atoi(fields[1].c_str()));
+        ch.split_y = std::max(1, atoi(fields[2].c_str()));
+        ch.vector = std::max(1, atoi(fields[3].c_str()));
+        ch.parallel = fields[4] == "1";
+        c->push_back(ch);
+    }
+    return c->size() == num_stages;
+}
+
+// The loops over the pure dimensions of a Func scheduled with the
+// given choice, innermost first.
+vector<string> loop_vars(const Function &f, const Choice &ch) {
+    const vector<string> &args = f.args();
+    vector<string> loops;
+    if (ch.split_x > 1 && ch.split_y > 1) {
+        loops = {args[0] + "_i", args[1] + "_i", args[0] + "_o", args[1] + "_o"};
+        loops.insert(loops.end(), args.begin() + 2, args.end());
+    } else if (ch.split_x > 1) {
+        loops = {args[0] + "_i", args[0] + "_o"};
+        loops.insert(loops.end(), args.begin() + 1, args.end());
+    } else {
+        loops = args;
+    }
+    return loops;
+}
+
+// Deterministic pseudo-random input data, as a function of the
+// coordinates, so that every candidate sees the same values however
+// much of an input its schedule touches.
+uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void fill_input(const buffer_t *buf, Type t, int index) {
+    int extent[4];
+    for (int i = 0; i < 4; i++) {
+        extent[i] = std::max(buf->extent[i], 1);
+    }
+    for (int w = 0; w < extent[3]; w++) {
+        for (int z = 0; z < extent[2]; z++) {
+            for (int y = 0; y < extent[1]; y++) {
+                for (int x = 0; x < extent[0]; x++) {
+                    uint64_t h = mix((uint64_t)index + 1);
+                    h = mix(h ^ (uint32_t)(x + buf->min[0]));
+                    h = mix(h ^ (uint32_t)(y + buf->min[1]));
+                    h = mix(h ^ (uint32_t)(z + buf->min[2]));
+                    h = mix(h ^ (uint32_t)(w + buf->min[3]));
+                    int64_t offset = ((int64_t)x * buf->stride[0] + (int64_t)y * buf->stride[1] +
+                                      (int64_t)z * buf->stride[2] + (int64_t)w * buf->stride[3]);
+                    uint8_t *dst = buf->host + offset * buf->elem_size;
+                    if (t.is_float() && t.bits() == 32) {
+                        float v = (float)(h >> 40) / (float)(1 << 24);
+                        memcpy(dst, &v, sizeof(v));
+                    } else if (t.is_float() && t.bits() == 64) {
+                        double v = (double)(h >> 11) / (double)(1ULL << 53);
+                        memcpy(dst, &v, sizeof(v));
+                    } else if (t.is_bool()) {
+                        *dst = h & 1;
+                    } else {
+                        memcpy(dst, &h, buf->elem_size);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Compare two densely packed images of the same shape. Floating point
+// values may differ slightly, as different schedules are free to
+// reassociate some arithmetic.
+bool images_match(const Image<> &a, const Image<> &b) {
+    Type t = a.type();
+    size_t n = a.number_of_elements();
+    if (t.is_float() && t.bits() == 32) {
+        const float *pa = (const float *)a.raw_buffer()->host;
+        const float *pb = (const float *)b.raw_buffer()->host;
+        for (size_t i = 0; i < n; i++) {
+            if (!(std::abs(pa[i] - pb[i]) <= 1e-4f * std::max(1.0f, std::abs(pa[i])))) {
+                return false;
+            }
+        }
+        return true;
+    } else if (t.is_float() && t.bits() == 64) {
+        const double *pa = (const double *)a.raw_buffer()->host;
+        const double *pb = (const double *)b.raw_buffer()->host;
+        for (size_t i = 0; i < n; i++) {
+            if (!(std::abs(pa[i] - pb[i]) <= 1e-8 * std::max(1.0, std::abs(pa[i])))) {
+                return false;
+            }
+        }
+        return true;
+    } else {
+        return memcmp(a.raw_buffer()->host, b.raw_buffer()->host, n * t.bytes()) == 0;
+    }
+}
+
+string runtime_error_message;
+
+void record_runtime_error(void *, const char *msg) {
+    runtime_error_message += msg;
+}
+
+class Autotuner {
+    string generator_name;
+    map<string, string> generator_args;
+    vector<int> sizes;
+    int samples;
+    std::ostream &cerr;
+
+    Target target;
+    vector<Stage> stages;
+
+    // The outputs of the reference schedule.
+    vector<Image<>> reference;
+
+    // Every result so far, by candidate key. Negative times are
+    // failures.
+    map<string, double> results;
+    std::ofstream log;
+
+    // Walk back from the outputs of a freshly built pipeline, listing
+    // producers before consumers.
+    vector<Stage> find_stages(const Pipeline &p) {
+        vector<Stage> result;
+        vector<Function> order;
+        map<string, vector<Function>> calls;
+        std::function<void(const Function &)> visit = [&](const Function &f) {
+            if (calls.count(f.name())) {
+                return;
+            }
+            OrderedCalls c;
+            f.accept(&c);
+            if (f.has_extern_definition()) {
+                for (const ExternFuncArgument &arg : f.extern_arguments()) {
+                    if (arg.is_func()) {
+                        c.include(Function(arg.func));
+                    }
+                }
+            }
+            calls[f.name()] = c.calls;
+            for (const Function &g : c.calls) {
+                if (g.name() != f.name()) {
+                    visit(g);
+                }
+            }
+            order.push_back(f);
+        };
+        set<string> outputs;
+        for (const Func &f : p.outputs()) {
+            outputs.insert(f.name());
+            visit(f.function());
+        }
+
+        map<string, int> index;
+        for (const Function &f : order) {
+            index[f.name()] = (int)result.size();
+            Stage s;
+            s.func = f;
+            s.output = outputs.count(f.name()) > 0;
+            const Schedule &sched = f.schedule();
+            s.fixed = (!sched.splits().empty() ||
+                       (!s.output && (!sched.compute_level().is_inline() || sched.memoized())));
+            s.consumer = -1;
+            s.natural_vector = target.natural_vector_size(f.output_types()[0]);
+            result.push_back(s);
+        }
+        map<string, set<string>> consumers;
+        for (const Function &f : order) {
+            for (const Function &g : calls[f.name()]) {
+                if (g.name() != f.name()) {
+                    consumers[g.name()].insert(f.name());
+                }
+            }
+        }
+        for (Stage &s : result) {
+            const set<string> &c = consumers[s.func.name()];
+            if (c.size() == 1 && !s.output) {
+                s.consumer = index[*c.begin()];
+            }
+        }
+        return result;
+    }
+
+    bool is_tunable(const Stage &s) {
+        return !s.fixed && !s.func.has_extern_definition();
+    }
+
+    // Clamp a candidate into something that will compile: outputs are
+    // always computed at root, only Funcs with a single consumer that
+    // is itself computed somewhere (and has no update definitions,
+    // since the split loops only exist in the pure definition) may be
+    // computed within its loops, and so on.
+    void legalize(Candidate &c) {
+        for (int i = (int)c.size() - 1; i >= 0; i--) {
+            const Stage &s = stages[i];
+            Choice &ch = c[i];
+            if (!is_tunable(s)) {
+                ch = {0, 1, 1, 1, false};
+                continue;
+            }
+            if (s.output || (ch.compute < 0 && !s.func.can_be_inlined())) {
+                ch.compute = 0;
+            }
+            if (ch.compute > 0) {
+                int k = s.consumer;
+                if (k < 0 || !is_tunable(stages[k]) || c[k].compute < 0 ||
+                    stages[k].func.has_update_definition() || stages[k].func.args().empty()) {
+                    ch.compute = 0;
+                } else {
+                    int depth = (int)loop_vars(stages[k].func, c[k]).size();
+                    ch.compute = std::min(ch.compute, depth);
+                }
+            }
+            int dims = (int)s.func.args().size();
+            if (ch.compute < 0 || dims == 0) {
+                ch.split_x = ch.split_y = ch.vector = 1;
+                ch.parallel = false;
+                continue;
+            }
+            if (dims < 2 || ch.split_x == 1) {
+                ch.split_y = 1;
+            }
+            if (ch.split_x > 1 && ch.vector > ch.split_x) {
+                ch.vector = ch.split_x;
+            }
+            if (ch.compute > 0) {
+                ch.parallel = false;
+            }
+        }
+    }
+
+    void apply(const Candidate &c, ostringstream &src) {
+        for (int i = (int)c.size() - 1; i >= 0; i--) {
+            const Stage &s = stages[i];
+            const Choice &ch = c[i];
+            if (!is_tunable(s) || ch.compute < 0) {
+                continue;
+            }
+            Func f(s.func);
+            const vector<string> &args = s.func.args();
+            ostringstream stage;
+            if (ch.compute == 0 && !s.output) {
+                f.compute_root();
+                stage << ".compute_root()";
+            } else if (ch.compute > 0) {
+                const Stage &consumer = stages[s.consumer];
+                string v = loop_vars(consumer.func, c[s.consumer])[ch.compute - 1];
+                f.compute_at(Func(consumer.func), Var(v));
+                stage << ".compute_at(" << consumer.func.name() << ", " << v << ")";
+            }
+            if (ch.split_x > 1 && ch.split_y > 1) {
+                Var x(args[0]), xo(args[0] + "_o"), xi(args[0] + "_i");
+                Var y(args[1]), yo(args[1] + "_o"), yi(args[1] + "_i");
+                f.tile(x, y, xo, yo, xi, yi, ch.split_x, ch.split_y);
+                stage << ".tile(" << x.name() << ", " << y.name() << ", "
+                      << xo.name() << ", " << yo.name() << ", "
+                      << xi.name() << ", " << yi.name() << ", "
+                      << ch.split_x << ", " << ch.split_y << ")";
+            } else if (ch.split_x > 1) {
+                Var x(args[0]), xo(args[0] + "_o"), xi(args[0] + "_i");
+                f.split(x, xo, xi, ch.split_x);
+                stage << ".split(" << x.name() << ", " << xo.name() << ", " << xi.name() << ", " << ch.split_x << ")";
+            }
+            vector<string> loops = loop_vars(s.func, ch);
+            if (ch.vector > 1) {
+                f.vectorize(Var(loops[0]), ch.vector);
+                stage << ".vectorize(" << loops[0] << ", " << ch.vector << ")";
+            }
+            if (ch.parallel) {
+                f.parallel(Var(loops.back()));
+                stage << ".parallel(" << loops.back() << ")";
+            }
+            if (!stage.str().empty()) {
+                src << s.func.name() << stage.str() << ";\n";
+            }
+        }
+    }
+
+    // Build a fresh instance of the Generator and schedule it with
+    // the given candidate, or with the analytic auto-scheduler if the
+    // candidate is null.
+    std::unique_ptr<GeneratorBase> build(const Candidate *c, Pipeline *p, vector<Parameter> *inputs,
+                                         string *source) {
+        std::unique_ptr<GeneratorBase> gen = GeneratorRegistry::create(generator_name, generator_args);
+        *p = gen->build_pipeline_and_inputs(inputs);
+        vector<Stage> s = find_stages(*p);
+        user_assert(s.size() == stages.size())
+            << "Generator " << generator_name << " built a different pipeline on a second call to build().\n";
+        stages = s;
+        ostringstream src;
+        if (c) {
+            apply(*c, src);
+        } else {
+            if (!sizes.empty()) {
+                for (Func f : p->outputs()) {
+                    const vector<string> &args = f.function().args();
+                    for (size_t i = 0; i < sizes.size() && i < args.size(); i++) {
+                        f.estimate(Var(args[i]), 0, sizes[i]);
+                    }
+                }
+            }
+            src << p->auto_schedule(target);
+        }
+        *source = src.str();
+        return gen;
+    }
+
+    // Run a scheduled pipeline, and check its output against the
+    // reference (or record it as the reference). Returns the minimum
+    // time over the samples in seconds, or a negative value if the
+    // candidate failed or got the wrong answer.
+    double run(Pipeline &p, const vector<Parameter> &inputs, bool is_reference) {
+        vector<Image<>> outputs;
+        for (Func f : p.outputs()) {
+            vector<int> extents = sizes;
+            if (extents.empty()) {
+                for (const string &arg : f.function().args()) {
+                    int extent = 0;
+                    for (const Bound &b : f.function().schedule().estimates()) {
+                        const int64_t *e = as_const_int(b.extent);
+                        if (b.var == arg && e) {
+                            extent = (int)*e;
+                        }
+                    }
+                    user_assert(extent > 0)
+                        << "Output " << f.name() << " has no estimate for dimension " << arg
+                        << ". Use Func::estimate or pass the output sizes with -s.\n";
+                    extents.push_back(extent);
+                }
+            }
+            for (const Type &t : f.output_types()) {
+                outputs.push_back(Image<>(t, extents));
+            }
+        }
+        Realization dst(outputs);
+
+        runtime_error_message.clear();
+        p.set_error_handler(record_runtime_error);
+        p.compile_jit(target);
+
+        for (Parameter param : inputs) {
+            if (param.is_buffer()) {
+                param.set_buffer(BufferPtr());
+            }
+        }
+        p.infer_input_bounds(dst);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (inputs[i].is_buffer()) {
+                fill_input(inputs[i].get_buffer().raw_buffer(), inputs[i].type(), (int)i);
+            }
+        }
+
+        p.realize(dst, target);
+        if (!runtime_error_message.empty()) {
+            cerr << runtime_error_message;
+            return -1;
+        }
+        if (is_reference) {
+            reference = outputs;
+        } else {
+            for (size_t i = 0; i < outputs.size(); i++) {
+                if (!images_match(reference[i], outputs[i])) {
+                    return -2;
+                }
+            }
+        }
+
+        // Min-of-N timing, as in apps/support/benchmark.h
+        double best = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < samples; i++) {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            p.realize(dst, target);
+            auto t2 = std::chrono::high_resolution_clock::now();
+            double dt = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1e6;
+            best = std::min(best, dt);
+        }
+        return best;
+    }
+
+    void record(const string &status, double t, const string &key) {
+        log << status << "\t";
+        if (t >= 0) {
+            log << t;
+        } else {
+            log << "-";
+        }
+        log << "\t" << key << "\n";
+        log.flush();
+    }
+
+    // Evaluate a candidate (or the auto-scheduler, if null) unless
+    // it's in the log already.
+    double evaluate(const string &key, const Candidate *c, bool is_reference = false) {
+        if (results.count(key) && !is_reference) {
+            return results[key];
+        }
+        bool logged = results.count(key) > 0;
+        if (!logged) {
+            // If this candidate brings down the whole process, a
+            // resumed search will find this line without a result and
+            // skip it.
+            record("run", -1, key);
+        }
+        double t = -1;
+        string status = "fail";
+#ifdef WITH_EXCEPTIONS
+        try {
+#endif
+            Pipeline p;
+            vector<Parameter> inputs;
+            string source;
+            std::unique_ptr<GeneratorBase> gen = build(c, &p, &inputs, &source);
+            t = run(p, inputs, is_reference);
+            status = t >= 0 ? "ok" : t == -2 ? "wrong" : "fail";
+#ifdef WITH_EXCEPTIONS
+        } catch (const Halide::Error &e) {
+            cerr << e.what();
+        }
+#endif
+        if (!logged) {
+            record(status, t, key);
+        }
+        results[key] = t;
+        cerr << status << "\t";
+        if (t >= 0) {
+            cerr << t * 1000 << " ms";
+        } else {
+            cerr << "-";
+        }
+        cerr << "\t" << key << "\n";
+        return t;
+    }
+
+    void read_log(const string &filename, const string &header) {
+        std::ifstream in(filename);
+        string line;
+        map<string, string> status;
+        bool first = true;
+        while (std::getline(in, line)) {
+            if (first) {
+                user_assert(line == header)
+                    << "The autotuning log " << filename << " is for a different Generator, target or set of "
+                    << "arguments:\n" << line << "\n";
+                first = false;
+                continue;
+            }
+            vector<string> fields = split_string(line, "\t");
+            if (fields.size() != 3) {
+                continue;
+            }
+            status[fields[2]] = fields[0];
+            if (fields[0] == "ok") {
+                results[fields[2]] = atof(fields[1].c_str());
+            } else {
+                results[fields[2]] = -1;
+            }
+        }
+        for (const auto &it : status) {
+            if (it.second == "run") {
+                cerr << "Candidate crashed in a previous run: " << it.first << "\n";
+                record("crash", -1, it.first);
+            }
+        }
+    }
+
+    string best_key() {
+        string best;
+        for (const auto &it : results) {
+            if (it.second >= 0 && it.first != "reference" &&
+                (best.empty() || it.second < results[best])) {
+                best = it.first;
+            }
+        }
+        return best;
+    }
+
+public:
+    Autotuner(const string &name, const map<string, string> &args,
+              const vector<int> &sizes, int samples, std::ostream &cerr) :
+        generator_name(name), generator_args(args), sizes(sizes), samples(samples), cerr(cerr) {}
+
+    int tune(const string &log_file, const string &output_file, int trials, int seed) {
+        Pipeline p;
+        vector<Parameter> inputs;
+        std::unique_ptr<GeneratorBase> gen = GeneratorRegistry::create(generator_name, generator_args);
+        target = gen->get_target();
+        user_assert(!target.has_gpu_feature())
+            << "The autotuner only tunes schedules for the CPU.\n";
+        p = gen->build_pipeline_and_inputs(&inputs);
+        stages = find_stages(p);
+
+        ostringstream header;
+        header << "# autotune " << generator_name;
+        for (const auto &it : generator_args) {
+            header << " " << it.first << "=" << it.second;
+        }
+        for (int s : sizes) {
+            header << " " << s;
+        }
+        bool resuming = std::ifstream(log_file).good();
+        if (resuming) {
+            read_log(log_file, header.str());
+        }
+        log.open(log_file, std::ios::app);
+        user_assert(log.good()) << "Could not open " << log_file << " for writing.\n";
+        if (!resuming) {
+            log << header.str() << "\n";
+        }
+
+        // The reference schedule computes everything at root,
+        // serially. It is always rerun, as its output isn't logged.
+        Candidate reference_candidate(stages.size(), Choice{0, 1, 1, 1, false});
+        legalize(reference_candidate);
+        user_assert(evaluate("reference", &reference_candidate, true) >= 0)
+            << "The reference schedule of " << generator_name << " failed.\n";
+
+        evaluate("auto", nullptr);
+
+        // Start the search from the best candidate so far, or from
+        // computing everything at root, vectorized and parallel.
+        Candidate current;
+        string best = best_key();
+        if (best.empty() || !parse_candidate(best, stages.size(), &current)) {
+            current.clear();
+            for (const Stage &s : stages) {
+                current.push_back(Choice{0, 1, 1, s.natural_vector, true});
+            }
+            legalize(current);
+            evaluate(candidate_key(current), &current);
+        }
+
+        std::mt19937 rng(seed);
+        auto pick = [&](int n) { return (int)(rng() % n); };
+        for (int trial = 0; trial < trials; trial++) {
+            Candidate c;
+            string key;
+            int attempts = 0;
+            do {
+                c = current;
+                int mutations = 1 + pick(3);
+                for (int m = 0; m < mutations; m++) {
+                    Choice &ch = c[pick((int)c.size())];
+                    int v = stages[&ch - &c[0]].natural_vector;
+                    switch (pick(5)) {
+                    case 0:
+                        ch.compute = pick(max_compute_at_depth + 2) - 1;
+                        break;
+                    case 1:
+                        ch.split_x = split_x_factors[pick(sizeof(split_x_factors) / sizeof(int))];
+                        break;
+                    case 2:
+                        ch.split_y = split_y_factors[pick(sizeof(split_y_factors) / sizeof(int))];
+                        break;
+                    case 3: {
+                        const int widths[] = {1, v, 2 * v};
+                        ch.vector = widths[pick(3)];
+                        break;
+                    }
+                    default:
+                        ch.parallel = !ch.parallel;
+                    }
+                }
+                legalize(c);
+                key = candidate_key(c);
+            } while (results.count(key) && ++attempts < max_attempts_per_trial);
+            if (attempts == max_attempts_per_trial) {
+                cerr << "Could not find an untried candidate; stopping early.\n";
+                break;
+            }
+            double t = evaluate(key, &c);
+            best = best_key();
+            if (t >= 0 && t <= results[best]) {
+                current = c;
+            }
+        }
+
+        best = best_key();
+        user_assert(!best.empty()) << "No candidate schedule ran successfully.\n";
+        string source;
+        Candidate c;
+        if (best == "auto") {
+            build(nullptr, &p, &inputs, &source);
+        } else {
+            bool parsed = parse_candidate(best, stages.size(), &c);
+            internal_assert(parsed);
+            build(&c, &p, &inputs, &source);
+        }
+
+        // The best result may have come from the log of an earlier
+        // search, checked against that search's reference, so check
+        // it against this one's before reporting it.
+        if (run(p, inputs, false) < 0) {
+            cerr << "The best schedule found, " << best
+                 << ", doesn't compute the same output as the reference schedule.\n";
+            return 1;
+        }
+        cerr << "Best schedule (" << results[best] * 1000 << " ms, "
+             << results["reference"] / results[best] << "x faster than the reference):\n";
+        std::cout << source;
+        if (!output_file.empty()) {
+            std::ofstream out(output_file);
+            out << source;
+            user_assert(out.good()) << "Could not write " << output_file << "\n";
+        }
+        return 0;
+    }
+};
+
+}  // namespace
+
+int autotune_main(int argc, char **argv, std::ostream &cerr) {
+    map<string, string> flags_info = { { "-g", "" },
+                                       { "-l", "" },
+                                       { "-o", "" },
+                                       { "-t", "100" },
+                                       { "-r", "0" },
+                                       { "-s", "" },
+                                       { "-n", "10" } };
+    map<string, string> generator_args;
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-') {
+            vector<string> v = split_string(argv[i], "=");
+            if (v.size() != 2 || v[0].empty() || v[1].empty()) {
+                cerr << kUsage;
+                return 1;
+            }
+            generator_args[v[0]] = v[1];
+            continue;
+        }
+        auto it = flags_info.find(argv[i]);
+        if (it != flags_info.end()) {
+            if (i + 1 >= argc) {
+                cerr << kUsage;
+                return 1;
+            }
+            it->second = argv[i + 1];
+            ++i;
+            continue;
+        }
+        cerr << "Unknown flag: " << argv[i] << "\n";
+        cerr << kUsage;
+        return 1;
+    }
+
+    vector<string> generator_names = GeneratorRegistry::enumerate();
+    string generator_name = flags_info["-g"];
+    if (generator_name.empty()) {
+        // If -g isn't specified, but there's only one generator registered, just use that one.
+        if (generator_names.size() != 1) {
+            cerr << "-g must be specified unless exactly one generator is registered:\n";
+            for (auto name : generator_names) {
+                cerr << "    " << name << "\n";
+            }
+            cerr << kUsage;
+            return 1;
+        }
+        generator_name = generator_names[0];
+    }
+
+    vector<int> sizes;
+    if (!flags_info["-s"].empty()) {
+        for (const string &s : split_string(flags_info["-s"], ",")) {
+            int size = atoi(s.c_str());
+            if (size <= 0) {
+                cerr << "Malformed -s option: " << flags_info["-s"] << "\n";
+                cerr << kUsage;
+                return 1;
+            }
+            sizes.push_back(size);
+        }
+    }
+
+    int trials = atoi(flags_info["-t"].c_str());
+    int seed = atoi(flags_info["-r"].c_str());
+    int samples = std::max(1, atoi(flags_info["-n"].c_str()));
+    string log_file = flags_info["-l"];
+    if (log_file.empty()) {
+        log_file = generator_name + ".autotune.log";
+    }
+
+    Autotuner tuner(generator_name, generator_args, sizes, samples, cerr);
+    return tuner.tune(log_file, flags_info["-o"], trials, seed);
+}
+
+}
+}
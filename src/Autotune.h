@@ -0,0 +1,35 @@
+#ifndef HALIDE_AUTOTUNE_H
+#define HALIDE_AUTOTUNE_H
+
+/** \file
+ *
+ * Defines an empirical autotuner for Generators.
+ */
+
+#include <ostream>
+
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+/** autotune_main() searches for a fast schedule for a registered
+ * Generator by benchmarking it in-process. Each candidate schedule
+ * chooses, for every Func the Generator leaves unscheduled, whether
+ * to inline it, compute it at root, or compute it within the loops of
+ * its single consumer, along with split factors, a vector width and
+ * whether to parallelize. Candidates are JIT-compiled, run on
+ * pseudo-random inputs, checked against a serial reference schedule,
+ * and timed as the minimum over several runs. Every result is
+ * appended to a plain-text log, which is read back on startup so that
+ * an interrupted search resumes where it left off, and the fastest
+ * schedule found is printed as C++ source. It can be trivially
+ * wrapped by a "real" main() (see tools/AutoTune.cpp) and linked
+ * against the Generators to tune, in the same way as
+ * generate_filter_main(). */
+EXPORT int autotune_main(int argc, char **argv, std::ostream &cerr);
+
+}
+}
+
+#endif
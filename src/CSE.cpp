@@ -1,4 +1,6 @@
+#include <cstring>
 #include <map>
+#include <unordered_map>
 
 #include "CSE.h"
 #include "IRMutator.h"
@@ -62,41 +64,100 @@ bool should_extract(Expr e) {
 
 }
 
+uint64_t hash_combine(uint64_t h, uint64_t x) {
+    return (h ^ (x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2))) * 0xff51afd7ed558ccdULL;
+}
+
+// Hash the parts of an Expr that aren't its children. Together with
+// the value numbers of its children, this identifies an Expr up to
+// hash collisions.
+uint64_t hash_node(const Expr &e) {
+    uint64_t h = (uint64_t)e->type_info();
+    h = hash_combine(h, (uint64_t)e.type().code());
+    h = hash_combine(h, (uint64_t)e.type().bits());
+    h = hash_combine(h, (uint64_t)e.type().lanes());
+    if (const IntImm *op = e.as<IntImm>()) {
+        h = hash_combine(h, (uint64_t)op->value);
+    } else if (const UIntImm *op = e.as<UIntImm>()) {
+        h = hash_combine(h, op->value);
+    } else if (const FloatImm *op = e.as<FloatImm>()) {
+        uint64_t bits;
+        memcpy(&bits, &op->value, sizeof(bits));
+        h = hash_combine(h, bits);
+    } else if (const StringImm *op = e.as<StringImm>()) {
+        h = hash_combine(h, std::hash<string>()(op->value));
+    } else if (const Variable *op = e.as<Variable>()) {
+        h = hash_combine(h, std::hash<string>()(op->name));
+    } else if (const Load *op = e.as<Load>()) {
+        h = hash_combine(h, std::hash<string>()(op->name));
+    } else if (const Call *op = e.as<Call>()) {
+        h = hash_combine(h, std::hash<string>()(op->name));
+        h = hash_combine(h, (uint64_t)op->call_type);
+        h = hash_combine(h, (uint64_t)op->value_index);
+    }
+    return h;
+}
+
 // A global-value-numbering of expressions. Returns canonical form of
 // the Expr and writes out a global value numbering as a side-effect.
+//
+// Children are numbered before their parents, so by the time we look
+// up an Expr its children have already been replaced by the canonical
+// Exprs for their numbers. Two Exprs are then equal exactly when they
+// agree at the top node and share the same child pointers, so the
+// hash of an Expr only needs its top node and its child numbers, and
+// confirming a match only has to look one level down.
 class GVN : public IRMutator {
 public:
     struct Entry {
         Expr expr;
         int use_count;
+        vector<int> children;
     };
     vector<Entry> entries;
 
-    typedef map<ExprWithCompareCache, int> CacheType;
-    CacheType numbering;
+    // Entries bucketed by the hash of their top node and child numbers.
+    std::unordered_multimap<uint64_t, int> numbering;
 
-    map<Expr, int, ExprCompare> shallow_numbering;
+    // Entries by the address of any Expr known to be equal to them.
+    struct ExprHash {
+        size_t operator()(const Expr &e) const {
+            return std::hash<const IRNode *>()(e.get());
+        }
+    };
+    struct ExprSame {
+        bool operator()(const Expr &a, const Expr &b) const {
+            return a.same_as(b);
+        }
+    };
+    std::unordered_map<Expr, int, ExprHash, ExprSame> shallow_numbering;
 
     Scope<int> let_substitutions;
     int number;
 
-    IRCompareCache cache;
+    // The numbers of the children of the Expr currently being
+    // rebuilt, in the order they were visited.
+    vector<int> *child_numbers;
 
-    GVN() : number(0), cache(8) {}
+    GVN() : number(0), child_numbers(nullptr) {}
 
     Stmt mutate(Stmt s) {
         internal_error << "Can't call GVN on a Stmt: " << s << "\n";
         return Stmt();
     }
 
-    ExprWithCompareCache with_cache(Expr e) {
-        return ExprWithCompareCache(e, &cache);
+    Expr mutate(Expr e) {
+        e = number_expr(e);
+        if (child_numbers) {
+            child_numbers->push_back(number);
+        }
+        return e;
     }
 
-    Expr mutate(Expr e) {
+    Expr number_expr(Expr e) {
         // Early out if we've already seen this exact Expr.
         {
-            map<Expr, int, ExprCompare>::iterator iter = shallow_numbering.find(e);
+            auto iter = shallow_numbering.find(e);
             if (iter != shallow_numbering.end()) {
                 number = iter->second;
                 internal_assert(entries[number].expr.type() == e.type());
@@ -113,33 +174,48 @@ public:
             }
         }
 
-        // If e already has an entry, return that.
-        CacheType::iterator iter = numbering.find(with_cache(e));
-        if (iter != numbering.end()) {
-            number = iter->second;
-            shallow_numbering[e] = number;
-            internal_assert(entries[number].expr.type() == e.type());
-            return entries[number].expr;
-        }
-
         // Rebuild using things already in the numbering.
         Expr old_e = e;
+        vector<int> children;
+        vector<int> *old_child_numbers = child_numbers;
+        child_numbers = &children;
         e = IRMutator::mutate(e);
+        child_numbers = old_child_numbers;
+
+        // Rebuilding may have produced something already in the
+        // numbering (e.g. the body of a let).
+        {
+            auto iter = shallow_numbering.find(e);
+            if (iter != shallow_numbering.end()) {
+                number = iter->second;
+                shallow_numbering[old_e] = number;
+                internal_assert(entries[number].expr.type() == old_e.type());
+                return entries[number].expr;
+            }
+        }
 
-        // See if it's there in another form after being rebuilt
-        // (e.g. because it was a let variable).
-        iter = numbering.find(with_cache(e));
-        if (iter != numbering.end()) {
-            number = iter->second;
-            shallow_numbering[old_e] = number;
-            internal_assert(entries[number].expr.type() == old_e.type());
-            return entries[number].expr;
+        // See if it's there in another form after being rebuilt.
+        uint64_t h = hash_node(e);
+        for (int c : children) {
+            h = hash_combine(h, (uint64_t)c);
+        }
+        auto range = numbering.equal_range(h);
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            const Entry &candidate = entries[iter->second];
+            // The children match, so equal() won't recurse into them.
+            if (candidate.children == children && equal(candidate.expr, e)) {
+                number = iter->second;
+                shallow_numbering[old_e] = number;
+                internal_assert(candidate.expr.type() == old_e.type());
+                return candidate.expr;
+            }
         }
 
         // Add it to the numbering.
-        Entry entry = {e, 0};
+        Entry entry = {e, 0, children};
         number = (int)entries.size();
-        numbering[with_cache(e)] = number;
+        numbering.insert(std::make_pair(h, number));
+        shallow_numbering[old_e] = number;
         shallow_numbering[e] = number;
         entries.push_back(entry);
         internal_assert(e.type() == old_e.type());
@@ -185,7 +261,7 @@ public:
         }
 
         // Find this thing's number.
-        map<Expr, int, ExprCompare>::iterator iter = gvn.shallow_numbering.find(e);
+        auto iter = gvn.shallow_numbering.find(e);
         if (iter != gvn.shallow_numbering.end()) {
             GVN::Entry &entry = gvn.entries[iter->second];
             entry.use_count++;
@@ -64,7 +64,19 @@ const string globals =
     "int halide_debug_to_file(void *ctx, const char *filename, int, struct buffer_t *buf);\n"
     "int halide_start_clock(void *ctx);\n"
     "int64_t halide_current_time_ns(void *ctx);\n"
+    "int halide_do_par_for(void *ctx, int (*)(void *, int, uint8_t *), int, int, uint8_t *);\n"
+    "int halide_do_async(void *ctx, int (*)(void *, int, uint8_t *), int, int, uint8_t *);\n"
+    "int halide_profiler_do_par_for(void *ctx, int (*)(void *, int, uint8_t *), int, int, uint8_t *, void *);\n"
     "void halide_profiler_pipeline_end(void *, void *);\n"
+    "void halide_profiler_thread_end(void *, void *);\n"
+    "void *halide_scratch_pool_create(void *ctx, int64_t);\n"
+    "void *halide_scratch_pool_acquire(void *ctx, void *pool);\n"
+    "void halide_scratch_pool_release(void *ctx, void *buf);\n"
+    "void halide_scratch_pool_destroy(void *ctx, void *pool);\n"
+    "int halide_semaphore_init(void *sem, int);\n"
+    "int halide_semaphore_release(void *sem, int);\n"
+    "int halide_semaphore_acquire(void *sem, int);\n"
+    "void halide_semaphore_close(void *ctx, void *sem);\n"
     "}\n"
     "\n"
 
@@ -159,9 +171,79 @@ const string globals =
     " b->stride[3] = stride3;\n"
     " return true;\n"
     "}\n";
+
+// Emitted once, ahead of the first function that uses vector
+// types. Vectors are GCC/Clang vector extension types, so arithmetic,
+// bitwise ops and comparisons use the native operators, and the
+// compiler maps them to whatever SIMD the target has. Boolean vectors
+// are represented as masks of int8 lanes that are either 0 or -1.
+const string vector_helpers =
+    "#if !defined(__GNUC__) && !defined(__clang__)\n"
+    "#error \"Vectorized Halide pipelines compiled to C require GCC or Clang vector extensions\"\n"
+    "#endif\n"
+    "#if defined(__has_builtin)\n"
+    "#if __has_builtin(__builtin_convertvector)\n"
+    "#define HALIDE_HAS_BUILTIN_CONVERTVECTOR 1\n"
+    "#endif\n"
+    "#if __has_builtin(__builtin_shufflevector)\n"
+    "#define HALIDE_HAS_BUILTIN_SHUFFLEVECTOR 1\n"
+    "#endif\n"
+    "#endif\n"
+    "template<typename V, typename T> inline V halide_vector_broadcast(T x) {\n"
+    " V r;\n"
+    " for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) r[i] = x;\n"
+    " return r;\n"
+    "}\n"
+    "template<typename V, typename T, typename S> inline V halide_vector_ramp(T base, S stride) {\n"
+    " V r;\n"
+    " for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) r[i] = base + (T)i * stride;\n"
+    " return r;\n"
+    "}\n"
+    "template<typename V, typename T> inline V halide_vector_load(const T *p) {\n"
+    " V r;\n"
+    " memcpy(&r, p, sizeof(r));\n"
+    " return r;\n"
+    "}\n"
+    "template<typename V, typename T, typename I> inline V halide_vector_gather(const T *p, I idx) {\n"
+    " V r;\n"
+    " for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) r[i] = p[idx[i]];\n"
+    " return r;\n"
+    "}\n"
+    "template<typename V, typename T> inline void halide_vector_store(T *p, V v) {\n"
+    " memcpy(p, &v, sizeof(v));\n"
+    "}\n"
+    "template<typename V, typename T, typename I> inline void halide_vector_scatter(T *p, I idx, V v) {\n"
+    " for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++) p[idx[i]] = v[i];\n"
+    "}\n"
+    "template<typename R, int... I, typename V> inline R halide_vector_shuffle(V a, V b) {\n"
+    "#ifdef HALIDE_HAS_BUILTIN_SHUFFLEVECTOR\n"
+    " return __builtin_shufflevector(a, b, I...);\n"
+    "#else\n"
+    " const int n = sizeof(a) / sizeof(a[0]);\n"
+    " const int idx[] = {I...};\n"
+    " R r;\n"
+    " for (size_t i = 0; i < sizeof(r) / sizeof(r[0]); i++) r[i] = idx[i] < n ? a[idx[i]] : b[idx[i] - n];\n"
+    " return r;\n"
+    "#endif\n"
+    "}\n"
+    "template<typename A, typename B> inline A halide_vector_convert(B b) {\n"
+    "#ifdef HALIDE_HAS_BUILTIN_CONVERTVECTOR\n"
+    " return __builtin_convertvector(b, A);\n"
+    "#else\n"
+    " A a;\n"
+    " for (size_t i = 0; i < sizeof(a) / sizeof(a[0]); i++) a[i] = b[i];\n"
+    " return a;\n"
+    "#endif\n"
+    "}\n"
+    // The mask must have lanes of the same width as the values.
+    "template<typename V, typename M> inline V halide_vector_select(M m, V a, V b) {\n"
+    " return reinterpret<V>((m & reinterpret<M>(a)) | (~m & reinterpret<M>(b)));\n"
+    "}\n";
 }
 
-CodeGen_C::CodeGen_C(ostream &s, OutputKind output_kind, const std::string &guard) : IRPrinter(s), id("$$ BAD ID $$"), output_kind(output_kind), extern_c_open(false) {
+CodeGen_C::CodeGen_C(ostream &s, OutputKind output_kind, const std::string &guard) :
+    IRPrinter(s), id("$$ BAD ID $$"), output_kind(output_kind),
+    vector_extensions(true), extern_c_open(false) {
     if (is_header()) {
         // If it's a header, emit an include guard.
         stream << "#ifndef HALIDE_" << print_name(guard) << '\n'
@@ -202,7 +284,24 @@ namespace {
 string type_to_c_type(Type type, bool include_space, bool c_plus_plus = true) {
     bool needs_space = true;
     ostringstream oss;
-    user_assert(type.lanes() == 1) << "Can't use vector types when compiling to C (yet)\n";
+    if (type.is_vector()) {
+        // Vector types are named e.g. int32x8_t, float32x4_t, or
+        // uint1x16_t for a boolean mask. See emit_vector_typedefs.
+        user_assert(!type.is_handle()) << "Can't use vectors of handles when compiling to C\n";
+        user_assert((type.lanes() & (type.lanes() - 1)) == 0)
+            << "Can't use vector type " << type << " when compiling to C: "
+            << "the number of lanes must be a power of two\n";
+        if (type.is_float()) {
+            oss << "float";
+        } else if (type.is_uint()) {
+            oss << "uint";
+        } else {
+            oss << "int";
+        }
+        oss << type.bits() << "x" << type.lanes() << "_t";
+        if (include_space) oss << " ";
+        return oss.str();
+    }
     if (type.is_float()) {
         if (type.bits() == 32) {
             oss << "float";
@@ -358,7 +457,8 @@ class ExternCallPrototypes : public IRGraphVisitor {
     }
 
     void emit_function_decl(ostream &stream, const Call *op, const std::string &name) {
-        stream << type_to_c_type(op->type, true) << " " << name << "(";
+        // Vector calls are scalarized, so declare the scalar version.
+        stream << type_to_c_type(op->type.element_of(), true) << " " << name << "(";
         if (function_takes_user_context(name)) {
             stream << "void *";
             if (op->args.size()) {
@@ -372,7 +472,7 @@ class ExternCallPrototypes : public IRGraphVisitor {
             if (op->args[i].as<StringImm>()) {
                 stream << "const char *";
             } else {
-              stream << type_to_c_type(op->args[i].type(), true);
+              stream << type_to_c_type(op->args[i].type().element_of(), true);
             }
         }
         stream << ");\n";
@@ -436,6 +536,50 @@ public:
         stream << "\n";
     }
 };
+
+/** Find the widths of all of the vector types used in a Stmt. */
+class VectorLanes : public IRGraphVisitor {
+    using IRGraphVisitor::include;
+
+    void include(const Expr &e) {
+        if (e.type().is_vector()) {
+            lanes.insert(e.type().lanes());
+        }
+        IRGraphVisitor::include(e);
+    }
+
+public:
+    std::set<int> lanes;
+};
+}
+
+void CodeGen_C::emit_vector_typedefs(const std::set<int> &lanes) {
+    // The helpers are templates, so they can't have C linkage.
+    switch_to_c_or_c_plus_plus(COrCPlusPlus::CPlusPlus);
+
+    if (vector_typedefs_emitted.empty()) {
+        stream << vector_helpers;
+    }
+
+    const Type element_types[] = {
+        Bool(), Int(8), Int(16), Int(32), Int(64),
+        UInt(8), UInt(16), UInt(32), UInt(64), Float(32), Float(64)
+    };
+    for (int l : lanes) {
+        if (!vector_typedefs_emitted.insert(l).second ||
+            (l & (l - 1)) != 0) {
+            // Already declared, or not representable. The latter is
+            // reported when the type is printed.
+            continue;
+        }
+        for (Type t : element_types) {
+            // Boolean vectors are masks of int8 lanes.
+            Type storage = t.is_bool() ? Int(8) : t;
+            stream << "typedef " << type_to_c_type(storage, true)
+                   << type_to_c_type(t.with_lanes(l), false)
+                   << " __attribute__((vector_size(" << storage.bytes() * l << ")));\n";
+        }
+    }
 }
 
 void CodeGen_C::compile(const Module &input) {
@@ -509,6 +653,14 @@ void CodeGen_C::compile(const LoweredFunc &f) {
             switch_to_c_or_c_plus_plus(COrCPlusPlus::C);
             e.emit_c_declarations(stream);
         }
+
+        if (vector_extensions) {
+            VectorLanes v;
+            f.body.accept(&v);
+            if (!v.lanes.empty()) {
+                emit_vector_typedefs(v.lanes);
+            }
+        }
     }
 
     switch_to_c_or_c_plus_plus(is_c_plus_plus_interface() ? COrCPlusPlus::Default : COrCPlusPlus::C);
@@ -770,13 +922,30 @@ void CodeGen_C::visit(const Variable *op) {
 }
 
 void CodeGen_C::visit(const Cast *op) {
-    print_assignment(op->type, "(" + print_type(op->type) + ")(" + print_expr(op->value) + ")");
+    if (vector_extensions && op->type.is_vector()) {
+        string value = print_expr(op->value);
+        if (op->value.type().is_bool()) {
+            // Masks are 0 or -1, but true converts to 1.
+            value = "-" + value;
+        } else if (op->type.is_bool()) {
+            value = "(" + value + " != 0)";
+        }
+        print_assignment(op->type, "halide_vector_convert<" + print_type(op->type) + ">(" + value + ")");
+    } else {
+        print_assignment(op->type, "(" + print_type(op->type) + ")(" + print_expr(op->value) + ")");
+    }
 }
 
 void CodeGen_C::visit_binop(Type t, Expr a, Expr b, const char * op) {
     string sa = print_expr(a);
     string sb = print_expr(b);
-    print_assignment(t, sa + " " + op + " " + sb);
+    if (vector_extensions && t.is_vector() && t.is_bool() && !a.type().is_bool()) {
+        // A vector comparison produces a mask with lanes as wide as
+        // its operands. Narrow it to a boolean vector.
+        print_assignment(t, "halide_vector_convert<" + print_type(t) + ">(" + sa + " " + op + " " + sb + ")");
+    } else {
+        print_assignment(t, sa + " " + op + " " + sb);
+    }
 }
 
 void CodeGen_C::visit(const Add *op) {
@@ -818,11 +987,19 @@ void CodeGen_C::visit(const Mod *op) {
 }
 
 void CodeGen_C::visit(const Max *op) {
-    print_expr(Call::make(op->type, "max", {op->a, op->b}, Call::Extern));
+    if (vector_extensions && op->type.is_vector()) {
+        print_expr(Select::make(GT::make(op->a, op->b), op->a, op->b));
+    } else {
+        print_expr(Call::make(op->type, "max", {op->a, op->b}, Call::Extern));
+    }
 }
 
 void CodeGen_C::visit(const Min *op) {
-    print_expr(Call::make(op->type, "min", {op->a, op->b}, Call::Extern));
+    if (vector_extensions && op->type.is_vector()) {
+        print_expr(Select::make(LT::make(op->a, op->b), op->a, op->b));
+    } else {
+        print_expr(Call::make(op->type, "min", {op->a, op->b}, Call::Extern));
+    }
 }
 
 void CodeGen_C::visit(const EQ *op) {
@@ -850,15 +1027,27 @@ void CodeGen_C::visit(const GE *op) {
 }
 
 void CodeGen_C::visit(const Or *op) {
-    visit_binop(op->type, op->a, op->b, "||");
+    if (vector_extensions && op->type.is_vector()) {
+        visit_binop(op->type, op->a, op->b, "|");
+    } else {
+        visit_binop(op->type, op->a, op->b, "||");
+    }
 }
 
 void CodeGen_C::visit(const And *op) {
-    visit_binop(op->type, op->a, op->b, "&&");
+    if (vector_extensions && op->type.is_vector()) {
+        visit_binop(op->type, op->a, op->b, "&");
+    } else {
+        visit_binop(op->type, op->a, op->b, "&&");
+    }
 }
 
 void CodeGen_C::visit(const Not *op) {
-    print_assignment(op->type, "!(" + print_expr(op->a) + ")");
+    if (vector_extensions && op->type.is_vector()) {
+        print_assignment(op->type, "~" + print_expr(op->a));
+    } else {
+        print_assignment(op->type, "!(" + print_expr(op->a) + ")");
+    }
 }
 
 void CodeGen_C::visit(const IntImm *op) {
@@ -873,6 +1062,23 @@ void CodeGen_C::visit(const UIntImm *op) {
     print_assignment(op->type, "(" + print_type(op->type) + ")(" + std::to_string(op->value) + ")");
 }
 
+void CodeGen_C::visit(const Ramp *op) {
+    internal_assert(vector_extensions) << "Unhandled Ramp in C backend\n";
+    string base = print_expr(op->base);
+    string stride = print_expr(op->stride);
+    print_assignment(op->type, "halide_vector_ramp<" + print_type(op->type) + ">(" + base + ", " + stride + ")");
+}
+
+void CodeGen_C::visit(const Broadcast *op) {
+    internal_assert(vector_extensions) << "Unhandled Broadcast in C backend\n";
+    string value = print_expr(op->value);
+    string rhs = "halide_vector_broadcast<" + print_type(op->type) + ">(" + value + ")";
+    if (op->type.is_bool()) {
+        rhs = "-" + rhs;
+    }
+    print_assignment(op->type, rhs);
+}
+
 void CodeGen_C::visit(const StringImm *op) {
     ostringstream oss;
     oss << Expr(op);
@@ -925,6 +1131,13 @@ void CodeGen_C::visit(const Call *op) {
                     op->call_type == Call::PureIntrinsic)
         << "Can only codegen extern calls and intrinsics\n";
 
+    if (op->call_type == Call::Extern && op->name == "halide_profiler_set_parallel_func") {
+        // Profiled code makes this call just before each parallel
+        // loop it launches. Remember the slot for the loop.
+        internal_assert(op->args.size() == 2);
+        parallel_profiler_thread = print_expr(op->args[0]);
+    }
+
     ostringstream rhs;
 
     // Handle intrinsics first
@@ -1206,6 +1419,16 @@ void CodeGen_C::visit(const Call *op) {
                << "~" << struct_name << "() {" << call << "}"
                << "} " << instance_name << "(" << arg << ");\n";
         rhs << print_expr(0);
+    } else if (op->is_intrinsic(Call::make_semaphore)) {
+        internal_assert(op->args.size() == 1);
+        string value = print_expr(op->args[0]);
+        // A halide_semaphore_t is two 64-bit words.
+        string sem_name = unique_name('m');
+        do_indent();
+        stream << "uint64_t " << sem_name << "[2];\n";
+        do_indent();
+        stream << "halide_semaphore_init(" << sem_name << ", " << value << ");\n";
+        rhs << "(void *)" << sem_name;
     } else if (op->is_intrinsic(Call::div_round_to_zero)) {
         rhs << print_expr(op->args[0]) << " / " << print_expr(op->args[1]);
     } else if (op->is_intrinsic(Call::mod_round_to_zero)) {
@@ -1216,11 +1439,129 @@ void CodeGen_C::visit(const Call *op) {
             " Halide.\n";
     } else if (op->is_intrinsic(Call::indeterminate_expression)) {
         user_error << "Indeterminate expression occurred during constant-folding.\n";
+    } else if (vector_extensions &&
+               (op->is_intrinsic(Call::shuffle_vector) ||
+                op->is_intrinsic(Call::slice_vector) ||
+                op->is_intrinsic(Call::interleave_vectors) ||
+                op->is_intrinsic(Call::concat_vectors))) {
+        // Work out which lane of which vector each lane of the
+        // result comes from. Indices count across all the vectors.
+        vector<Expr> vecs;
+        vector<int> indices;
+        if (op->is_intrinsic(Call::shuffle_vector) ||
+            op->is_intrinsic(Call::slice_vector)) {
+            const Call *concat = op->args[0].as<Call>();
+            if (concat && concat->is_intrinsic(Call::concat_vectors)) {
+                // Shuffle the pieces directly.
+                vecs = concat->args;
+            } else {
+                vecs = {op->args[0]};
+            }
+            if (op->is_intrinsic(Call::shuffle_vector)) {
+                for (size_t i = 1; i < op->args.size(); i++) {
+                    const int64_t *idx = as_const_int(op->args[i]);
+                    internal_assert(idx);
+                    indices.push_back((int)*idx);
+                }
+            } else {
+                internal_assert(op->args.size() == 4);
+                const int64_t *start = as_const_int(op->args[1]);
+                const int64_t *stride = as_const_int(op->args[2]);
+                internal_assert(start && stride) << "argument to slice_vector must be a constant.\n";
+                for (int i = 0; i < op->type.lanes(); i++) {
+                    indices.push_back((int)(*start + *stride * i));
+                }
+            }
+        } else {
+            vecs = op->args;
+            int arg_lanes = op->args[0].type().lanes();
+            if (op->is_intrinsic(Call::interleave_vectors)) {
+                for (int i = 0; i < arg_lanes; i++) {
+                    for (size_t j = 0; j < vecs.size(); j++) {
+                        indices.push_back((int)j * arg_lanes + i);
+                    }
+                }
+            } else {
+                for (int i = 0; i < op->type.lanes(); i++) {
+                    indices.push_back(i);
+                }
+            }
+        }
+        internal_assert((int)indices.size() == op->type.lanes());
+
+        vector<string> args(vecs.size());
+        for (size_t i = 0; i < vecs.size(); i++) {
+            args[i] = print_expr(vecs[i]);
+        }
+
+        bool one_shuffle = op->type.is_vector() && vecs.size() <= 2;
+        for (Expr v : vecs) {
+            one_shuffle = one_shuffle && v.type().is_vector() && v.type() == vecs[0].type();
+        }
+        if (one_shuffle) {
+            // A single shuffle of at most two vectors of the same
+            // type. Compilers can't always turn the lane-by-lane
+            // version into one.
+            rhs << "halide_vector_shuffle<" << print_type(op->type);
+            for (int idx : indices) {
+                rhs << ", " << idx;
+            }
+            rhs << ">(" << args[0] << ", " << args.back() << ")";
+        } else {
+            // Build the result one lane at a time.
+            vector<string> lanes;
+            for (int idx : indices) {
+                for (size_t j = 0; j < vecs.size(); j++) {
+                    int arg_lanes = vecs[j].type().lanes();
+                    if (idx < arg_lanes) {
+                        lanes.push_back(arg_lanes == 1 ? args[j] : args[j] + "[" + std::to_string(idx) + "]");
+                        break;
+                    }
+                    idx -= arg_lanes;
+                }
+            }
+            internal_assert((int)lanes.size() == op->type.lanes());
+            if (op->type.is_scalar()) {
+                rhs << lanes[0];
+            } else {
+                rhs << print_type(op->type) << "{";
+                for (size_t i = 0; i < lanes.size(); i++) {
+                    if (i > 0) rhs << ", ";
+                    rhs << lanes[i];
+                }
+                rhs << "}";
+            }
+        }
     } else if (op->call_type == Call::Intrinsic ||
                op->call_type == Call::PureIntrinsic) {
         // TODO: other intrinsics
         internal_error << "Unhandled intrinsic in C backend: " << op->name << '\n';
 
+    } else if (vector_extensions && op->type.is_vector()) {
+        // There are no vector versions of extern functions, so call
+        // the scalar version once per lane.
+        vector<string> args(op->args.size());
+        for (size_t i = 0; i < op->args.size(); i++) {
+            args[i] = print_expr(op->args[i]);
+        }
+        string result_id = unique_name('_');
+        do_indent();
+        stream << print_type(op->type, AppendSpace) << result_id << ";\n";
+        do_indent();
+        stream << "for (int i = 0; i < " << op->type.lanes() << "; i++) "
+               << result_id << "[i] = " << op->name << "(";
+        if (function_takes_user_context(op->name)) {
+            stream << (have_user_context ? "__user_context_, " : "nullptr, ");
+        }
+        for (size_t i = 0; i < op->args.size(); i++) {
+            if (i > 0) stream << ", ";
+            stream << args[i];
+            if (op->args[i].type().is_vector()) {
+                stream << "[i]";
+            }
+        }
+        stream << ");\n";
+        rhs << result_id;
     } else {
         // Generic calls
         vector<string> args(op->args.size());
@@ -1246,6 +1587,38 @@ void CodeGen_C::visit(const Call *op) {
 void CodeGen_C::visit(const Load *op) {
 
     Type t = op->type;
+
+    if (vector_extensions && t.is_vector()) {
+        // Loads of boolean vectors read bools, and then turn them into a mask.
+        Type elem = t.is_bool() ? UInt(8) : t.element_of();
+        string name = print_name(op->name);
+        if (!allocations.contains(op->name) ||
+            allocations.get(op->name).type != elem) {
+            name = "((const " + print_type(elem) + " *)" + name + ")";
+        }
+
+        Type loaded = t.is_bool() ? UInt(8, t.lanes()) : t;
+        ostringstream rhs;
+        const Ramp *ramp = op->index.as<Ramp>();
+        const Broadcast *broadcast = op->index.as<Broadcast>();
+        if (ramp && is_one(ramp->stride)) {
+            rhs << "halide_vector_load<" << print_type(loaded) << ">("
+                << name << " + " << print_expr(ramp->base) << ")";
+        } else if (broadcast) {
+            rhs << "halide_vector_broadcast<" << print_type(loaded) << ">("
+                << name << "[" << print_expr(broadcast->value) << "])";
+        } else {
+            string index = print_expr(op->index);
+            rhs << "halide_vector_gather<" << print_type(loaded) << ">("
+                << name << ", " << index << ")";
+        }
+        string value = print_assignment(loaded, rhs.str());
+        if (t.is_bool()) {
+            print_assignment(t, "halide_vector_convert<" + print_type(t) + ">(-" + value + ")");
+        }
+        return;
+    }
+
     bool type_cast_needed =
         !allocations.contains(op->name) ||
         allocations.get(op->name).type != t;
@@ -1271,6 +1644,35 @@ void CodeGen_C::visit(const Store *op) {
 
     Type t = op->value.type();
 
+    if (vector_extensions && t.is_vector()) {
+        Type elem = t.is_bool() ? UInt(8) : t.element_of();
+        string name = print_name(op->name);
+        if (!allocations.contains(op->name) ||
+            allocations.get(op->name).type != elem) {
+            name = "((" + print_type(elem) + " *)" + name + ")";
+        }
+
+        string value = print_expr(op->value);
+        if (t.is_bool()) {
+            // Store the mask as bools.
+            value = print_assignment(UInt(8, t.lanes()),
+                                     "halide_vector_convert<" + print_type(UInt(8, t.lanes())) + ">(-" + value + ")");
+        }
+
+        const Ramp *ramp = op->index.as<Ramp>();
+        if (ramp && is_one(ramp->stride)) {
+            string base = print_expr(ramp->base);
+            do_indent();
+            stream << "halide_vector_store(" << name << " + " << base << ", " << value << ");\n";
+        } else {
+            string index = print_expr(op->index);
+            do_indent();
+            stream << "halide_vector_scatter(" << name << ", " << index << ", " << value << ");\n";
+        }
+        cache.clear();
+        return;
+    }
+
     bool type_cast_needed =
         t.is_handle() ||
         !allocations.contains(op->name) ||
@@ -1310,6 +1712,15 @@ void CodeGen_C::visit(const Select *op) {
     string true_val = print_expr(op->true_value);
     string false_val = print_expr(op->false_value);
     string cond = print_expr(op->condition);
+    if (vector_extensions && op->condition.type().is_vector()) {
+        // Widen the mask to match the lanes of the values, and blend.
+        Type mask_type = Int(std::max(8, op->type.bits()), op->type.lanes());
+        rhs << "halide_vector_select("
+            << "halide_vector_convert<" << print_type(mask_type) << ">(" << cond << "), "
+            << true_val << ", " << false_val << ")";
+        print_assignment(op->type, rhs.str());
+        return;
+    }
     rhs << "(" << print_type(op->type) << ")"
         << "(" << cond
         << " ? " << true_val
@@ -1352,17 +1763,60 @@ void CodeGen_C::visit(const ProducerConsumer *op) {
     print_stmt(op->body);
 }
 
+void CodeGen_C::emit_parallel_tasks(const string &name, Stmt body,
+                                    const string &min, const string &extent,
+                                    const string &runtime_fn,
+                                    const string &profiler_thread) {
+    // Outline the body into a closure that does one iteration,
+    // and hand it to the Halide thread pool, like CodeGen_LLVM
+    // does. The closure captures everything it refers to by
+    // reference, and is reached through a captureless lambda
+    // that matches halide_task_t.
+    string closure = unique_name('p');
+    do_indent();
+    stream << "auto " << closure << " = [&](int " << print_name(name) << ") -> int\n";
+    open_scope();
+    // Parallel loops in the body are launched by other threads.
+    string parent_parallel_profiler_thread = parallel_profiler_thread;
+    parallel_profiler_thread.clear();
+    body.accept(this);
+    parallel_profiler_thread = parent_parallel_profiler_thread;
+    do_indent();
+    stream << "return 0;\n";
+    cache.clear();
+    indent--;
+    do_indent();
+    stream << "}; // closure for " << print_name(name) << "\n";
+
+    string result = unique_name('_');
+    do_indent();
+    stream << "int " << result << " = " << runtime_fn << "("
+           << (have_user_context ? "__user_context_, " : "nullptr, ")
+           << "[](void *, int i, uint8_t *c) -> int { return (*(decltype(" << closure << ") *)c)(i); }, "
+           << min << ", " << extent << ", (uint8_t *)&" << closure
+           << (profiler_thread.empty() ? "" : ", " + profiler_thread) << ");\n";
+    do_indent();
+    stream << "if (" << result << " != 0) return " << result << ";\n";
+}
+
 void CodeGen_C::visit(const For *op) {
+    string id_min = print_expr(op->min);
+    string id_extent = print_expr(op->extent);
+
     if (op->for_type == ForType::Parallel) {
-        do_indent();
-        stream << "#pragma omp parallel for\n";
-    } else {
-        internal_assert(op->for_type == ForType::Serial)
-            << "Can only emit serial or parallel for loops to C\n";
+        if (!parallel_profiler_thread.empty()) {
+            string profiler_thread = parallel_profiler_thread;
+            parallel_profiler_thread.clear();
+            emit_parallel_tasks(op->name, op->body, id_min, id_extent,
+                                "halide_profiler_do_par_for", profiler_thread);
+        } else {
+            emit_parallel_tasks(op->name, op->body, id_min, id_extent, "halide_do_par_for");
+        }
+        return;
     }
 
-    string id_min = print_expr(op->min);
-    string id_extent = print_expr(op->extent);
+    internal_assert(op->for_type == ForType::Serial)
+        << "Can only emit serial or parallel for loops to C\n";
 
     do_indent();
     stream << "for (int "
@@ -1382,6 +1836,15 @@ void CodeGen_C::visit(const For *op) {
 
 }
 
+void CodeGen_C::visit(const Fork *op) {
+    // Both sides of the fork run at once, on threads handed out by
+    // halide_do_async.
+    string task = unique_name("fork");
+    Expr task_var = Variable::make(Int(32), task);
+    Stmt body = IfThenElse::make(task_var == 0, op->first, op->rest);
+    emit_parallel_tasks(task, body, "0", "2", "halide_do_async");
+}
+
 void CodeGen_C::visit(const Provide *op) {
     internal_error << "Cannot emit Provide statements as C\n";
 }
@@ -1399,7 +1862,9 @@ void CodeGen_C::visit(const Allocate *op) {
         alloc.free_function = op->free_function;
         allocations.push(op->name, alloc);
         heap_allocations.push(op->name, 0);
-        stream << print_type(op->type) << "*" << print_name(op->name) << " = (" << print_expr(op->new_expr) << ");\n";
+        string new_expr = print_expr(op->new_expr);
+        do_indent();
+        stream << print_type(op->type) << " *" << print_name(op->name) << " = (" << print_type(op->type) << " *)(" << new_expr << ");\n";
     } else {
         constant_size = op->constant_allocation_size();
         if (constant_size > 0) {
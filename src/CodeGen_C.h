@@ -86,6 +86,16 @@ protected:
     /** Emit a version of a string that is a valid identifier in C (. is replaced with _) */
     virtual std::string print_name(const std::string &);
 
+    /** Emit a closure for body and a call to runtime_fn
+     * (halide_do_par_for, halide_profiler_do_par_for or
+     * halide_do_async) that runs it for each index in [min, min +
+     * extent). If profiler_thread is non-empty, it is passed to
+     * runtime_fn after the closure. */
+    void emit_parallel_tasks(const std::string &name, Stmt body,
+                             const std::string &min, const std::string &extent,
+                             const std::string &runtime_fn,
+                             const std::string &profiler_thread = "");
+
     /** Emit an SSA-style assignment, and set id to the freshly generated name. Return id. */
     std::string print_assignment(Type t, const std::string &rhs);
 
@@ -127,6 +137,26 @@ protected:
     /** True if there is a void * __user_context parameter in the arguments. */
     bool have_user_context;
 
+    /** The profiler slot of the thread in profiled code, from the
+     * call to halide_profiler_set_parallel_func that precedes each
+     * parallel loop it launches, or empty. As in CodeGen_LLVM, the
+     * loop is launched with halide_profiler_do_par_for. */
+    std::string parallel_profiler_thread;
+
+    /** True if vectors should be emitted using GCC/Clang vector
+     * extension types. Code generators for GPU languages that derive
+     * from this class have vector types of their own, and turn this
+     * off. */
+    bool vector_extensions;
+
+    /** The vector widths for which typedefs have already been emitted. */
+    std::set<int> vector_typedefs_emitted;
+
+    /** Emit the vector helper functions (if they haven't been
+     * emitted yet), and typedefs for vectors of every element type
+     * with the given numbers of lanes. */
+    void emit_vector_typedefs(const std::set<int> &lanes);
+
     /** An enum to make calling convention changes clearer. */
     enum class COrCPlusPlus {
         Default,   ///< Whatever compiler is being used
@@ -146,6 +176,8 @@ protected:
     void visit(const UIntImm *);
     void visit(const StringImm *);
     void visit(const FloatImm *);
+    void visit(const Ramp *);
+    void visit(const Broadcast *);
     void visit(const Cast *);
     void visit(const Add *);
     void visit(const Sub *);
@@ -172,6 +204,7 @@ protected:
     void visit(const AssertStmt *);
     void visit(const ProducerConsumer *);
     void visit(const For *);
+    void visit(const Fork *);
     void visit(const Provide *);
     void visit(const Allocate *);
     void visit(const Free *);
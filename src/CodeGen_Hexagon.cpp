@@ -1,5 +1,6 @@
 #include <iostream>
 #include <sstream>
+#include <mutex>
 
 #include "LLVM_Headers.h"
 #include "CodeGen_Hexagon.h"
@@ -50,6 +51,7 @@ CodeGen_Hexagon::CodeGen_Hexagon(Target t) : CodeGen_Posix(t) {
 
 std::unique_ptr<llvm::Module> CodeGen_Hexagon::compile(const Module &module) {
     auto llvm_module = CodeGen_Posix::compile(module);
+    static std::mutex options_mutex;
     static bool options_processed = false;
 
     // TODO: This should be set on the module itself, or some other
@@ -58,7 +60,9 @@ std::unique_ptr<llvm::Module> CodeGen_Hexagon::compile(const Module &module) {
     // implementation of compile) because it is the last
     // Hexagon-specific code to run prior to invoking the target
     // specific lowering in LLVM, minimizing the chances of the wrong
-    // flag being set for the wrong module.
+    // flag being set for the wrong module. Modules may be compiled
+    // on several threads at once, and LLVM's options are global.
+    std::lock_guard<std::mutex> lock(options_mutex);
     if (!options_processed) {
         cl::ParseEnvironmentOptions("halide-hvx-be", "HALIDE_LLVM_ARGS",
                                     "Halide HVX internal compiler\n");
@@ -126,6 +126,7 @@ bool function_takes_user_context(const std::string &name) {
         "halide_device_malloc",
         "halide_device_and_host_malloc",
         "halide_device_sync",
+        "halide_do_async",
         "halide_do_par_for",
         "halide_do_task",
         "halide_error",
@@ -144,6 +145,10 @@ bool function_takes_user_context(const std::string &name) {
         "halide_memoization_cache_lookup",
         "halide_memoization_cache_store",
         "halide_memoization_cache_release",
+        "halide_scratch_pool_create",
+        "halide_scratch_pool_acquire",
+        "halide_scratch_pool_release",
+        "halide_scratch_pool_destroy",
         "halide_cuda_run",
         "halide_opencl_run",
         "halide_opengl_run",
@@ -360,5 +365,15 @@ void set_function_attributes_for_target(llvm::Function *fn, Target t) {
     #endif
 }
 
+int64_t llvm_instruction_count(const llvm::Module &module) {
+    int64_t count = 0;
+    for (const llvm::Function &f : module) {
+        for (const llvm::BasicBlock &b : f) {
+            count += b.size();
+        }
+    }
+    return count;
+}
+
 }
 }
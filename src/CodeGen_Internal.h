@@ -70,6 +70,10 @@ std::unique_ptr<llvm::TargetMachine> make_target_machine(const llvm::Module &mod
 /** Set the appropriate llvm Function attributes given a Target. */
 void set_function_attributes_for_target(llvm::Function *, Target);
 
+/** Count the instructions in an llvm::Module, as a measure of its
+ * size (see CompileTimeProfiler). */
+int64_t llvm_instruction_count(const llvm::Module &module);
+
 }}
 
 #endif
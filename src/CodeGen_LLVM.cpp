@@ -18,6 +18,7 @@
 #include "MatlabWrapper.h"
 #include "IntegerDivisionTable.h"
 #include "CSE.h"
+#include "CompileTimeProfiler.h"
 
 #include "CodeGen_X86.h"
 #include "CodeGen_GPU_Host.h"
@@ -259,7 +260,8 @@ CodeGen_LLVM::CodeGen_LLVM(Target t) :
 
     min_f64(Float(64).min()),
     max_f64(Float(64).max()),
-    destructor_block(nullptr) {
+    destructor_block(nullptr),
+    parallel_profiler_thread(nullptr) {
     initialize_llvm();
 }
 
@@ -489,6 +491,8 @@ MangledNames get_mangled_names(const LoweredFunc &f, const Target &target) {
 }  // namespace
 
 std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
+    CompileTimeProfiler profiler(input.name());
+
     init_module();
 
     debug(1) << "Target triple of initial module: " << module->getTargetTriple() << "\n";
@@ -544,6 +548,10 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
     verifyModule(*module);
     debug(2) << "Done generating llvm bitcode\n";
 
+    if (CompileTimeProfiler::enabled()) {
+        profiler.pass_done("llvm_codegen", llvm_instruction_count(*module));
+    }
+
     // Optimize
     CodeGen_LLVM::optimize_module();
 
@@ -938,6 +946,8 @@ llvm::Type *CodeGen_LLVM::llvm_type_of(Type t) {
 void CodeGen_LLVM::optimize_module() {
     debug(3) << "Optimizing module\n";
 
+    CompileTimeProfiler profiler(module->getModuleIdentifier());
+
     // The optimization passes inject intrinsics that aren't legal for
     // PNaCl. (e.g. vectorized floor).
     if (target.arch == Target::PNaCl) return;
@@ -998,6 +1008,10 @@ void CodeGen_LLVM::optimize_module() {
     function_pass_manager.doFinalization();
     module_pass_manager.run(*module);
 
+    if (CompileTimeProfiler::enabled()) {
+        profiler.pass_done("llvm_optimize", llvm_instruction_count(*module));
+    }
+
     debug(3) << "After LLVM optimizations:\n";
     if (debug::debug_level >= 2) {
         module->dump();
@@ -2052,6 +2066,13 @@ void CodeGen_LLVM::visit(const Call *op) {
                     op->call_type == Call::PureIntrinsic)
         << "Can only codegen extern calls and intrinsics\n";
 
+    if (op->call_type == Call::Extern && op->name == "halide_profiler_set_parallel_func") {
+        // Profiled code makes this call just before each parallel
+        // loop it launches. Remember the slot for the loop.
+        internal_assert(op->args.size() == 2);
+        parallel_profiler_thread = codegen(op->args[0]);
+    }
+
     // Some call nodes are actually injected at various stages as a
     // cue for llvm to generate particular ops. In general these are
     // handled in the standard library, but ones with e.g. varying
@@ -2685,6 +2706,16 @@ void CodeGen_LLVM::visit(const Call *op) {
             f->setCallingConv(CallingConv::C);
         }
         register_destructor(f, codegen(arg), Always);
+    } else if (op->is_intrinsic(Call::make_semaphore)) {
+        internal_assert(op->args.size() == 1);
+        // A halide_semaphore_t is two 64-bit words.
+        Value *sem = create_alloca_at_entry(ArrayType::get(i64_t, 2), 1);
+        llvm::Function *init = module->getFunction("halide_semaphore_init");
+        internal_assert(init) << "Could not find halide_semaphore_init in initial module\n";
+        Value *args[] = {builder->CreatePointerCast(sem, init->getFunctionType()->getParamType(0)),
+                         codegen(op->args[0])};
+        builder->CreateCall(init, args);
+        value = builder->CreatePointerCast(sem, i8_t->getPointerTo());
     } else if (op->is_intrinsic(Call::call_cached_indirect_function)) {
         // Arguments to call_cached_indirect_function are of the form
         //
@@ -3126,6 +3157,109 @@ void CodeGen_LLVM::visit(const ProducerConsumer *op) {
     codegen(op->body);
 }
 
+void CodeGen_LLVM::codegen_parallel_tasks(const std::string &name, Stmt body,
+                                          Value *min, Value *extent,
+                                          const std::string &runtime_fn,
+                                          Value *profiler_thread) {
+    debug(3) << "Entering parallel for loop over " << name << "\n";
+
+    // Find every symbol that the body of this loop refers to
+    // and dump it into a closure
+    Closure closure(body, name);
+
+    // Allocate a closure
+    StructType *closure_t = build_closure_type(closure, buffer_t_type, context);
+    Value *ptr = create_alloca_at_entry(closure_t, 1);
+
+    // Fill in the closure
+    pack_closure(closure_t, ptr, closure, symbol_table, buffer_t_type, builder);
+
+    // Make a new function that does one iteration of the body of the loop
+    llvm::Type *voidPointerType = (llvm::Type *)(i8_t->getPointerTo());
+    llvm::Type *args_t[] = {voidPointerType, i32_t, voidPointerType};
+    FunctionType *func_t = FunctionType::get(i32_t, args_t, false);
+    llvm::Function *containing_function = function;
+    function = llvm::Function::Create(func_t, llvm::Function::InternalLinkage,
+                                      "par_for_" + function->getName() + "_" + name, module.get());
+    function->setDoesNotAlias(3);
+    set_function_attributes_for_target(function, target);
+
+    // Make the initial basic block and jump the builder into the new function
+    IRBuilderBase::InsertPoint call_site = builder->saveIP();
+    BasicBlock *block = BasicBlock::Create(*context, "entry", function);
+    builder->SetInsertPoint(block);
+
+    // Get the user context value before swapping out the symbol table.
+    Value *user_context = get_user_context();
+
+    // Save the destructor block
+    BasicBlock *parent_destructor_block = destructor_block;
+    destructor_block = nullptr;
+
+    // Parallel loops in the body are launched by other threads.
+    Value *parent_parallel_profiler_thread = parallel_profiler_thread;
+    parallel_profiler_thread = nullptr;
+
+    // Make a new scope to use
+    Scope<Value *> saved_symbol_table;
+    symbol_table.swap(saved_symbol_table);
+
+    // Get the function arguments
+
+    // The user context is first argument of the function; it's
+    // important that we override the name to be "__user_context",
+    // since the LLVM function has a random auto-generated name for
+    // this argument.
+    llvm::Function::arg_iterator iter = function->arg_begin();
+    sym_push("__user_context", iterator_to_pointer(iter));
+
+    // Next is the loop variable.
+    ++iter;
+    sym_push(name, iterator_to_pointer(iter));
+
+    // The closure pointer is the third and last argument.
+    ++iter;
+    iter->setName("closure");
+    Value *closure_handle = builder->CreatePointerCast(iterator_to_pointer(iter),
+                                                       closure_t->getPointerTo());
+    // Load everything from the closure into the new scope
+    unpack_closure(closure, symbol_table, closure_t, closure_handle, builder);
+
+    // Generate the new function body
+    codegen(body);
+
+    // Return success
+    return_with_error_code(ConstantInt::get(i32_t, 0));
+
+    // Move the builder back to the main function and call the runtime
+    builder->restoreIP(call_site);
+    llvm::Function *do_tasks = module->getFunction(runtime_fn);
+    internal_assert(do_tasks) << "Could not find " << runtime_fn << " in initial module\n";
+    do_tasks->setDoesNotAlias(5);
+    //do_tasks->setDoesNotCapture(5);
+    ptr = builder->CreatePointerCast(ptr, i8_t->getPointerTo());
+    std::vector<Value *> args = {user_context, function, min, extent, ptr};
+    if (profiler_thread) {
+        args.push_back(profiler_thread);
+    }
+    debug(4) << "Creating call to " << runtime_fn << "\n";
+    Value *result = builder->CreateCall(do_tasks, args);
+
+    debug(3) << "Leaving parallel for loop over " << name << "\n";
+
+    // Now restore the scope
+    symbol_table.swap(saved_symbol_table);
+    function = containing_function;
+
+    // Restore the destructor block
+    destructor_block = parent_destructor_block;
+    parallel_profiler_thread = parent_parallel_profiler_thread;
+
+    // Check for success
+    Value *did_succeed = builder->CreateICmpEQ(result, ConstantInt::get(i32_t, 0));
+    create_assertion(did_succeed, Expr(), result);
+}
+
 void CodeGen_LLVM::visit(const For *op) {
     Value *min = codegen(op->min);
     Value *extent = codegen(op->extent);
@@ -3170,102 +3304,29 @@ void CodeGen_LLVM::visit(const For *op) {
         // Pop the loop variable from the scope
         sym_pop(op->name);
     } else if (op->for_type == ForType::Parallel) {
-
-        debug(3) << "Entering parallel for loop over " << op->name << "\n";
-
-        // Find every symbol that the body of this loop refers to
-        // and dump it into a closure
-        Closure closure(op->body, op->name);
-
-        // Allocate a closure
-        StructType *closure_t = build_closure_type(closure, buffer_t_type, context);
-        Value *ptr = create_alloca_at_entry(closure_t, 1);
-
-        // Fill in the closure
-        pack_closure(closure_t, ptr, closure, symbol_table, buffer_t_type, builder);
-
-        // Make a new function that does one iteration of the body of the loop
-        llvm::Type *voidPointerType = (llvm::Type *)(i8_t->getPointerTo());
-        llvm::Type *args_t[] = {voidPointerType, i32_t, voidPointerType};
-        FunctionType *func_t = FunctionType::get(i32_t, args_t, false);
-        llvm::Function *containing_function = function;
-        function = llvm::Function::Create(func_t, llvm::Function::InternalLinkage,
-                                          "par_for_" + function->getName() + "_" + op->name, module.get());
-        function->setDoesNotAlias(3);
-        set_function_attributes_for_target(function, target);
-
-        // Make the initial basic block and jump the builder into the new function
-        IRBuilderBase::InsertPoint call_site = builder->saveIP();
-        BasicBlock *block = BasicBlock::Create(*context, "entry", function);
-        builder->SetInsertPoint(block);
-
-        // Get the user context value before swapping out the symbol table.
-        Value *user_context = get_user_context();
-
-        // Save the destructor block
-        BasicBlock *parent_destructor_block = destructor_block;
-        destructor_block = nullptr;
-
-        // Make a new scope to use
-        Scope<Value *> saved_symbol_table;
-        symbol_table.swap(saved_symbol_table);
-
-        // Get the function arguments
-
-        // The user context is first argument of the function; it's
-        // important that we override the name to be "__user_context",
-        // since the LLVM function has a random auto-generated name for
-        // this argument.
-        llvm::Function::arg_iterator iter = function->arg_begin();
-        sym_push("__user_context", iterator_to_pointer(iter));
-
-        // Next is the loop variable.
-        ++iter;
-        sym_push(op->name, iterator_to_pointer(iter));
-
-        // The closure pointer is the third and last argument.
-        ++iter;
-        iter->setName("closure");
-        Value *closure_handle = builder->CreatePointerCast(iterator_to_pointer(iter),
-                                                           closure_t->getPointerTo());
-        // Load everything from the closure into the new scope
-        unpack_closure(closure, symbol_table, closure_t, closure_handle, builder);
-
-        // Generate the new function body
-        codegen(op->body);
-
-        // Return success
-        return_with_error_code(ConstantInt::get(i32_t, 0));
-
-        // Move the builder back to the main function and call do_par_for
-        builder->restoreIP(call_site);
-        llvm::Function *do_par_for = module->getFunction("halide_do_par_for");
-        internal_assert(do_par_for) << "Could not find halide_do_par_for in initial module\n";
-        do_par_for->setDoesNotAlias(5);
-        //do_par_for->setDoesNotCapture(5);
-        ptr = builder->CreatePointerCast(ptr, i8_t->getPointerTo());
-        Value *args[] = {user_context, function, min, extent, ptr};
-        debug(4) << "Creating call to do_par_for\n";
-        Value *result = builder->CreateCall(do_par_for, args);
-
-        debug(3) << "Leaving parallel for loop over " << op->name << "\n";
-
-        // Now restore the scope
-        symbol_table.swap(saved_symbol_table);
-        function = containing_function;
-
-        // Restore the destructor block
-        destructor_block = parent_destructor_block;
-
-        // Check for success
-        Value *did_succeed = builder->CreateICmpEQ(result, ConstantInt::get(i32_t, 0));
-        create_assertion(did_succeed, Expr(), result);
+        if (parallel_profiler_thread) {
+            Value *profiler_thread = parallel_profiler_thread;
+            parallel_profiler_thread = nullptr;
+            codegen_parallel_tasks(op->name, op->body, min, extent,
+                                   "halide_profiler_do_par_for", profiler_thread);
+        } else {
+            codegen_parallel_tasks(op->name, op->body, min, extent, "halide_do_par_for");
+        }
 
     } else {
         internal_error << "Unknown type of For node. Only Serial and Parallel For nodes should survive down to codegen.\n";
     }
 }
 
+void CodeGen_LLVM::visit(const Fork *op) {
+    // A fork is a two-task parallel loop, where the tasks are handed
+    // to halide_do_async, which gives each of them a thread.
+    std::string task = unique_name("fork");
+    Expr task_var = Variable::make(Int(32), task);
+    Stmt body = IfThenElse::make(task_var == 0, op->first, op->rest);
+    codegen_parallel_tasks(task, body, ConstantInt::get(i32_t, 0), ConstantInt::get(i32_t, 2), "halide_do_async");
+}
+
 void CodeGen_LLVM::visit(const Store *op) {
     // Even on 32-bit systems, Handles are treated as 64-bit in
     // memory, so convert stores of handles to stores of uint64_ts.
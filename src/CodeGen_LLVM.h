@@ -265,6 +265,16 @@ protected:
      * the destructor block. */
     void return_with_error_code(llvm::Value *error_code);
 
+    /** Compile body into a function of the task index and a closure,
+     * and emit a call to runtime_fn (halide_do_par_for,
+     * halide_profiler_do_par_for or halide_do_async) to run it for
+     * each index in [min, min + extent). If profiler_thread is
+     * non-null, it is passed to runtime_fn after the closure. */
+    void codegen_parallel_tasks(const std::string &name, Stmt body,
+                                llvm::Value *min, llvm::Value *extent,
+                                const std::string &runtime_fn,
+                                llvm::Value *profiler_thread = nullptr);
+
     /** Put a string constant in the module as a global variable and return a pointer to it. */
     llvm::Constant *create_string_constant(const std::string &str);
 
@@ -365,6 +375,7 @@ protected:
     virtual void visit(const For *);
     virtual void visit(const Store *);
     virtual void visit(const Block *);
+    virtual void visit(const Fork *);
     virtual void visit(const IfThenElse *);
     virtual void visit(const Evaluate *);
     // @}
@@ -480,6 +491,13 @@ private:
      * to this block. */
     llvm::BasicBlock *destructor_block;
 
+    /** The profiler slot of the thread in profiled code, from the
+     * call to halide_profiler_set_parallel_func that precedes each
+     * parallel loop it launches, or nullptr. The loop is launched
+     * with halide_profiler_do_par_for, so that the runtime can bill
+     * it to the slot's Func without searching for the slot. */
+    llvm::Value *parallel_profiler_thread;
+
     /** Embed an instance of halide_filter_metadata_t in the code, using
      * the given name (by convention, this should be ${FUNCTIONNAME}_metadata)
      * as extern "C" linkage. Note that the return value is a function-returning-
@@ -44,7 +44,9 @@ protected:
 
     class CodeGen_Metal_C : public CodeGen_C {
     public:
-        CodeGen_Metal_C(std::ostream &s) : CodeGen_C(s) {}
+        CodeGen_Metal_C(std::ostream &s) : CodeGen_C(s) {
+            vector_extensions = false;
+        }
         void add_kernel(Stmt stmt,
                         const std::string &name,
                         const std::vector<DeviceArgument> &args);
@@ -254,6 +254,16 @@ void CodeGen_X86::visit(const Cast *op) {
          u8(((wild_u16x_ + wild_u16x_) + 1) / 2)},
         {Target::FeatureEnd, true, UInt(16, 8), 0, "llvm.x86.sse2.pavg.w",
          u16(((wild_u32x_ + wild_u32x_) + 1) / 2)},
+        // The avx512 saturating narrowing moves (see x86_avx512.ll)
+        {Target::AVX512_BW, false, Int(16, 16), 9, "packssdwx16",
+         i16_sat(wild_i32x_)},
+        {Target::AVX512_BW, false, Int(8, 32), 17, "packsswbx32",
+         i8_sat(wild_i16x_)},
+        {Target::AVX512_BW, false, UInt(8, 32), 17, "packuswbx32",
+         u8_sat(wild_i16x_)},
+        {Target::AVX512_BW, false, UInt(16, 16), 9, "packusdwx16",
+         u16_sat(wild_i32x_)},
+
         {Target::FeatureEnd, false, Int(16, 8), 0, "packssdwx8",
          i16_sat(wild_i32x_)},
         {Target::FeatureEnd, false, Int(8, 16), 0, "packsswbx16",
@@ -412,6 +422,17 @@ void CodeGen_X86::visit(const Call *op) {
 }
 
 string CodeGen_X86::mcpu() const {
+    if (target.has_feature(Target::AVX512_BW)) {
+        #if LLVM_VERSION >= 80
+        if (target.has_feature(Target::AVX512_VNNI)) return "cascadelake";
+        #endif
+        #if LLVM_VERSION >= 39
+        return "skylake-avx512";
+        #else
+        return "skx";
+        #endif
+    }
+    if (target.has_feature(Target::AVX512)) return "knl";
     if (target.has_feature(Target::AVX2)) return "haswell";
     if (target.has_feature(Target::AVX)) return "corei7-avx";
     // We want SSE4.1 but not SSE4.2, hence "penryn" rather than "corei7"
@@ -438,6 +459,29 @@ string CodeGen_X86::mattrs() const {
         separator = ",";
     }
     #endif
+    if (target.has_feature(Target::AVX512)) {
+        features += separator + "+avx512f";
+        separator = ",";
+    }
+    if (target.has_feature(Target::AVX512_BW)) {
+        features += separator + "+avx512bw";
+        separator = ",";
+    }
+    if (target.has_feature(Target::AVX512_DQ)) {
+        features += separator + "+avx512dq";
+        separator = ",";
+    }
+    if (target.has_feature(Target::AVX512_VL)) {
+        features += separator + "+avx512vl";
+        separator = ",";
+    }
+    #if LLVM_VERSION >= 60
+    // This attr only exists in llvm 6.0+
+    if (target.has_feature(Target::AVX512_VNNI)) {
+        features += separator + "+avx512vnni";
+        separator = ",";
+    }
+    #endif
     return features;
 }
 
@@ -446,7 +490,9 @@ bool CodeGen_X86::use_soft_float_abi() const {
 }
 
 int CodeGen_X86::native_vector_bits() const {
-    if (target.has_feature(Target::AVX)) {
+    if (target.has_feature(Target::AVX512)) {
+        return 512;
+    } else if (target.has_feature(Target::AVX)) {
         return 256;
     } else {
         return 128;
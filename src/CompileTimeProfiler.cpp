@@ -0,0 +1,130 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "CompileTimeProfiler.h"
+#include "Debug.h"
+#include "IRVisitor.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Counts the distinct nodes in a Stmt.
+class CountNodes : public IRGraphVisitor {
+public:
+    size_t count(const Stmt &s) {
+        include(s);
+        return visited.size();
+    }
+};
+
+string json_escape(const string &s) {
+    string result;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+// The passes recorded so far by every profiler in the process. They
+// are written out when the process exits.
+class Report {
+    struct Pass {
+        string pipeline, name;
+        double seconds;
+        int64_t ir_size;
+    };
+    std::mutex mutex;
+    vector<Pass> passes;
+
+public:
+    string filename;
+
+    Report() {
+        size_t read = 0;
+        filename = get_env_variable("HL_COMPILE_PROFILE", read);
+    }
+
+    void add(const string &pipeline, const string &name, double seconds, int64_t ir_size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        passes.push_back({pipeline, name, seconds, ir_size});
+    }
+
+    ~Report() {
+        if (filename.empty()) return;
+        std::ofstream f(filename.c_str());
+        if (!f.is_open()) {
+            debug(0) << "Could not open " << filename << " to write the compile-time profile\n";
+            return;
+        }
+        f << "{\"passes\": [";
+        for (size_t i = 0; i < passes.size(); i++) {
+            const Pass &p = passes[i];
+            f << (i > 0 ? ",\n" : "\n")
+              << " {\"pipeline\": \"" << json_escape(p.pipeline) << "\", "
+              << "\"pass\": \"" << json_escape(p.name) << "\", "
+              << "\"seconds\": " << p.seconds << ", "
+              << "\"ir_size\": " << p.ir_size << "}";
+        }
+        f << "\n]}\n";
+    }
+};
+
+Report &report() {
+    static Report r;
+    return r;
+}
+
+}
+
+CompileTimeProfiler::CompileTimeProfiler(const string &pipeline_name) :
+    pipeline_name(pipeline_name), start_ns(now_ns()) {
+}
+
+void CompileTimeProfiler::pass_done(const string &pass, const Stmt &s) {
+    if (!enabled()) return;
+    int64_t end_ns = now_ns();
+    report().add(pipeline_name, pass, (end_ns - start_ns) / 1e9, s.defined() ? CountNodes().count(s) : 0);
+    // Don't charge the next pass for counting nodes.
+    reset();
+}
+
+void CompileTimeProfiler::pass_done(const string &pass, int64_t ir_size) {
+    if (!enabled()) return;
+    int64_t end_ns = now_ns();
+    report().add(pipeline_name, pass, (end_ns - start_ns) / 1e9, ir_size);
+    reset();
+}
+
+void CompileTimeProfiler::reset() {
+    start_ns = now_ns();
+}
+
+bool CompileTimeProfiler::enabled() {
+    return !report().filename.empty();
+}
+
+}
+}
@@ -0,0 +1,64 @@
+#ifndef HALIDE_COMPILE_TIME_PROFILER_H
+#define HALIDE_COMPILE_TIME_PROFILER_H
+
+/** \file
+ *
+ * Defines a helper for measuring how long each pass of compilation
+ * takes.
+ */
+
+#include <string>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Records how long each pass of compiling a pipeline takes, and how
+ * large the IR is once the pass is done. This does nothing unless the
+ * environment variable HL_COMPILE_PROFILE is set to a filename. The
+ * passes of every pipeline compiled by the process are then written
+ * to that file as JSON when the process exits, in the order in which
+ * they ran:
+ *
+ \code
+ {"passes": [
+  {"pipeline": "blur", "pass": "bounds_inference", "seconds": 0.00042, "ir_size": 318},
+  ...
+ ]}
+ \endcode
+ *
+ * For passes over Halide IR, ir_size is the number of distinct IR
+ * nodes. For passes over LLVM IR, it is the number of LLVM
+ * instructions. */
+class CompileTimeProfiler {
+public:
+    EXPORT CompileTimeProfiler(const std::string &pipeline_name);
+
+    /** Record the time since construction, or since the last call to
+     * pass_done or reset, as spent in the named pass. The size of the
+     * IR is measured on the given Stmt. */
+    EXPORT void pass_done(const std::string &pass, const Stmt &s);
+
+    /** Record a pass over IR that isn't a Halide Stmt, with the size
+     * of that IR computed by the caller. */
+    EXPORT void pass_done(const std::string &pass, int64_t ir_size);
+
+    /** Restart the clock without recording anything, e.g. to skip
+     * time spent printing debug output. */
+    EXPORT void reset();
+
+    /** Returns true if HL_COMPILE_PROFILE is set. Callers can use
+     * this to skip measuring the size of IR that won't be
+     * recorded. */
+    EXPORT static bool enabled();
+
+private:
+    std::string pipeline_name;
+    int64_t start_ns;
+};
+
+}
+}
+
+#endif
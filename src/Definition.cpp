@@ -196,6 +196,7 @@ const Specialization &Definition::add_specialization(Expr condition) {
     s.definition.contents->schedule.storage_dims()     = contents->schedule.storage_dims();
     s.definition.contents->schedule.bounds()           = contents->schedule.bounds();
     s.definition.contents->schedule.memoized()         = contents->schedule.memoized();
+    s.definition.contents->schedule.async()            = contents->schedule.async();
     s.definition.contents->schedule.touched()          = contents->schedule.touched();
     s.definition.contents->schedule.allow_race_conditions() = contents->schedule.allow_race_conditions();
 
@@ -80,6 +80,15 @@ private:
         in_loop = old_in_loop;
     }
 
+    void visit(const Fork *op) {
+        // Both sides run at once, so a free can't go in either of
+        // them. Treat it like a loop.
+        bool old_in_loop = in_loop;
+        in_loop = true;
+        IRVisitor::visit(op);
+        in_loop = old_in_loop;
+    }
+
     void visit(const Block *block) {
         if (in_loop) {
             IRVisitor::visit(block);
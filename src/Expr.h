@@ -60,6 +60,7 @@ enum class IRNodeType {
     Free,
     Realize,
     Block,
+    Fork,
     IfThenElse,
     Evaluate
 };
@@ -1584,6 +1584,12 @@ Func &Func::memoize() {
     return *this;
 }
 
+Func &Func::async() {
+    invalidate_cache();
+    func.schedule().async() = true;
+    return *this;
+}
+
 Stage Func::specialize(Expr c) {
     invalidate_cache();
     return Stage(func.definition(), name(), args(), func.schedule().storage_dims()).specialize(c);
@@ -1659,6 +1665,41 @@ Func &Func::bound(Var var, Expr min, Expr extent) {
     return *this;
 }
 
+Func &Func::estimate(Var var, Expr min, Expr extent) {
+    user_assert(min.defined() && extent.defined())
+        << "Estimates for " << var.name() << " of " << name() << " must be defined\n";
+    user_assert(Int(32).can_represent(min.type())) << "Can't represent min estimate in int32\n";
+    user_assert(Int(32).can_represent(extent.type())) << "Can't represent extent estimate in int32\n";
+
+    min = cast<int32_t>(min);
+    extent = cast<int32_t>(extent);
+
+    bool found = false;
+    for (size_t i = 0; i < func.args().size(); i++) {
+        if (var.name() == func.args()[i]) {
+            found = true;
+        }
+    }
+    user_assert(found)
+        << "Can't provide an estimate for variable " << var.name()
+        << " of function " << name()
+        << " because " << var.name()
+        << " is not one of the pure variables of " << name() << ".\n";
+
+    // Replace any existing estimate for this var.
+    std::vector<Bound> &estimates = func.schedule().estimates();
+    for (Bound &b : estimates) {
+        if (b.var == var.name()) {
+            b.min = min;
+            b.extent = extent;
+            return *this;
+        }
+    }
+    Bound b = {var.name(), min, extent, Expr(), Expr()};
+    estimates.push_back(b);
+    return *this;
+}
+
 Func &Func::bound_extent(Var var, Expr extent) {
     return bound(var, Expr(), extent);
 }
@@ -1975,6 +2016,12 @@ Func &Func::trace_realizations() {
     return *this;
 }
 
+Func &Func::trace_regions() {
+    invalidate_cache();
+    func.trace_regions();
+    return *this;
+}
+
 void Func::debug_to_file(const string &filename) {
     invalidate_cache();
     func.debug_file() = filename;
@@ -1116,6 +1116,13 @@ public:
      * runtime error will occur when you try to run your pipeline. */
     EXPORT Func &bound(Var var, Expr min, Expr extent);
 
+    /** Tell the auto-scheduler roughly what region of this function
+     * will be computed. Unlike \ref Func::bound, this has no effect on
+     * the generated code and no assertions are injected; it is only
+     * used to estimate costs in \ref Pipeline::auto_schedule. Estimates
+     * are usually only needed on the outputs of a pipeline. */
+    EXPORT Func &estimate(Var var, Expr min, Expr extent);
+
     /** Expand the region computed so that the min coordinates is
      * congruent to 'remainder' modulo 'modulus', and the extent is a
      * multiple of 'modulus'. For example, f.align_bounds(x, 2) forces
@@ -1647,10 +1654,45 @@ public:
 
     /** Use the halide_memoization_cache_... interface to store a
      *  computed version of this function across invocations of the
-     *  Func.
+     *  Func. Results are keyed on the names of the pipeline and this
+     *  Func, the definitions of this Func and everything it calls,
+     *  and the values of the Params it uses. The contents of Images
+     *  it uses are not part of the key.
      */
     EXPORT Func &memoize();
 
+    /** Produce this Func on a thread of its own, concurrently with
+     * the code that consumes it. The consumer waits only for the
+     * part of the Func it is about to use. This is useful for
+     * overlapping a slow or I/O-bound producer (e.g. an extern stage)
+     * with its consumer, or for pipelining the stages of a long
+     * pipeline. For example:
+     *
+     \code
+     Func f, g;
+     Var x, y;
+     f(x, y) = ...;
+     g(x, y) = f(x, y-1) + f(x, y) + f(x, y+1);
+     f.store_root().compute_at(g, y).fold_storage(y, 8).async();
+     \endcode
+     *
+     * Here f runs ahead of g, one scanline at a time, while g
+     * consumes the scanlines already computed. Folding the storage
+     * bounds how far ahead f may run: it waits for g to finish with a
+     * scanline before overwriting it. Without folding, f may run
+     * ahead by its entire allocation.
+     *
+     * An async Func can't be the output of a pipeline, or be
+     * scheduled inline. Any Funcs it uses that are computed at the
+     * same loop level are computed on its thread too, so they can't
+     * also be used directly by its consumer. Each realization of an
+     * async Func starts a thread, so scheduling it at a fine
+     * granularity (e.g. inside an innermost loop) is wasteful. On
+     * targets whose runtime has no threads (QuRT and NoOS), async()
+     * is ignored and the Func is computed before its consumer as
+     * usual. */
+    EXPORT Func &async();
+
 
     /** Allocate storage for this function within f's loop over
      * var. Scheduling storage is optional, and can be used to
@@ -1806,6 +1848,19 @@ public:
      * halide_trace. */
     EXPORT Func &trace_realizations();
 
+    /** Trace the regions of this Func that are stored to and loaded
+     * from, as boxes with a min and extent per dimension, rather than
+     * tracing each load and store. Each vectorized loop reports the
+     * box it touches once per vector. All other accesses are reported
+     * once per production of the Func (for stores, and loads by its
+     * own update definitions) and once per consumption of it (for
+     * loads). This is much cheaper than trace_loads and trace_stores,
+     * so it suits coarse tracing of access patterns in production
+     * pipelines. Accesses with no bounds that can be computed, such
+     * as data-dependent loads, aren't reported. If the Func is
+     * inlined, this has no effect. */
+    EXPORT Func &trace_regions();
+
     /** Get a handle on the internal halide function that this Func
      * represents. Useful if you want to do introspection on Halide
      * functions */
@@ -47,13 +47,13 @@ struct FunctionContents {
     std::string extern_function_name;
     bool extern_is_c_plus_plus;
 
-    bool trace_loads, trace_stores, trace_realizations;
+    bool trace_loads, trace_stores, trace_realizations, trace_regions;
 
     bool frozen;
 
     FunctionContents() : extern_is_c_plus_plus(false), trace_loads(false),
                          trace_stores(false), trace_realizations(false),
-                         frozen(false) {}
+                         trace_regions(false), frozen(false) {}
 
     void accept(IRVisitor *visitor) const {
         init_def.accept(visitor);
@@ -308,6 +308,7 @@ void deep_copy_function_contents_helper(const IntrusivePtr<FunctionContents> &sr
     dst->trace_loads = src->trace_loads;
     dst->trace_stores = src->trace_stores;
     dst->trace_realizations = src->trace_realizations;
+    dst->trace_regions = src->trace_regions;
     dst->frozen = src->frozen;
     dst->output_buffers = src->output_buffers;
 
@@ -827,6 +828,9 @@ void Function::trace_stores() {
 void Function::trace_realizations() {
     contents->trace_realizations = true;
 }
+void Function::trace_regions() {
+    contents->trace_regions = true;
+}
 bool Function::is_tracing_loads() const {
     return contents->trace_loads;
 }
@@ -836,6 +840,9 @@ bool Function::is_tracing_stores() const {
 bool Function::is_tracing_realizations() const {
     return contents->trace_realizations;
 }
+bool Function::is_tracing_regions() const {
+    return contents->trace_regions;
+}
 
 void Function::freeze() {
     contents->frozen = true;
@@ -231,9 +231,11 @@ public:
     EXPORT void trace_loads();
     EXPORT void trace_stores();
     EXPORT void trace_realizations();
+    EXPORT void trace_regions();
     EXPORT bool is_tracing_loads() const;
     EXPORT bool is_tracing_stores() const;
     EXPORT bool is_tracing_realizations() const;
+    EXPORT bool is_tracing_regions() const;
     // @}
 
     /** Mark function as frozen, which means it cannot accept new
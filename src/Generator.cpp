@@ -418,6 +418,19 @@ Module GeneratorBase::build_module(const std::string &function_name,
     return pipeline.compile_to_module(filter_arguments, function_name, target, linkage_type);
 }
 
+Pipeline GeneratorBase::build_pipeline_and_inputs(std::vector<Parameter> *inputs) {
+    build_params();
+    Pipeline pipeline = build_pipeline();
+    build_params(true);
+    std::vector<void *> vf = ObjectInstanceRegistry::instances_in_range(
+        this, size, ObjectInstanceRegistry::FilterParam);
+    inputs->clear();
+    for (void *p : vf) {
+        inputs->push_back(*static_cast<Parameter *>(p));
+    }
+    return pipeline;
+}
+
 void generator_test() {
     GeneratorParam<int> gp("gp", 1);
 
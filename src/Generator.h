@@ -577,6 +577,12 @@ public:
     EXPORT Module build_module(const std::string &function_name = "",
                                const LoweredFunc::LinkageType linkage_type = LoweredFunc::External);
 
+    // Call build() and return the resulting Pipeline without compiling
+    // it, along with the Parameters of the Params and ImageParams it
+    // takes as input. This is for tools that reschedule and run a
+    // Generator in-process, such as the autotuner.
+    EXPORT Pipeline build_pipeline_and_inputs(std::vector<Parameter> *inputs);
+
 protected:
     EXPORT GeneratorBase(size_t size, const void *introspection_helper);
 
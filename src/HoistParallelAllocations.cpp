@@ -0,0 +1,257 @@
+#include "HoistParallelAllocations.h"
+#include "Bounds.h"
+#include "CodeGen_Internal.h"
+#include "ExprUsesVar.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "RemoveDeadAllocations.h"
+#include "Scope.h"
+#include "Simplify.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+bool runs_on_host(const For *op) {
+    return op->device_api == DeviceAPI::None || op->device_api == DeviceAPI::Host;
+}
+
+// Find the heap allocations in the body of one parallel loop that can
+// use a scratch pool, and rewrite them to do so.
+class UseScratchPools : public IRMutator {
+public:
+    struct Pool {
+        string name;
+        Expr buffer_bytes;
+    };
+    vector<Pool> pools;
+
+    UseScratchPools(const For *loop) {
+        push_var(loop->name, Interval(loop->min, simplify(loop->min + loop->extent - 1)));
+    }
+
+private:
+    using IRMutator::visit;
+
+    // Bounds of the variables defined inside the loop, in terms of
+    // variables defined outside it.
+    Scope<Interval> bounds;
+    Scope<int> inner_vars;
+
+    void push_var(const string &name, Interval interval) {
+        bounds.push(name, interval);
+        inner_vars.push(name, 0);
+    }
+
+    void pop_var(const string &name) {
+        bounds.pop(name);
+        inner_vars.pop(name);
+    }
+
+    // Get an upper bound for e that doesn't depend on the loop, or an
+    // undefined Expr if there isn't one.
+    Expr loop_invariant_upper_bound(Expr e) {
+        Interval i = bounds_of_expr_in_scope(e, bounds);
+        if (!i.has_upper_bound()) {
+            return Expr();
+        }
+        Expr upper = simplify(i.max);
+        if (expr_uses_vars(upper, inner_vars)) {
+            return Expr();
+        }
+        return upper;
+    }
+
+    void visit(const For *op) {
+        if (!runs_on_host(op)) {
+            stmt = op;
+            return;
+        }
+        Interval min_bounds = bounds_of_expr_in_scope(op->min, bounds);
+        Interval max_bounds = bounds_of_expr_in_scope(op->min + op->extent - 1, bounds);
+        push_var(op->name, Interval(min_bounds.min, max_bounds.max));
+        IRMutator::visit(op);
+        pop_var(op->name);
+    }
+
+    void visit(const LetStmt *op) {
+        push_var(op->name, bounds_of_expr_in_scope(op->value, bounds));
+        IRMutator::visit(op);
+        pop_var(op->name);
+    }
+
+    void visit(const Allocate *op) {
+        // Allocations the code generator puts on the stack, or that
+        // already have a custom allocator, are left alone.
+        // So are allocations with a condition, e.g. host buffers that
+        // are never used: the code generator skips halide_malloc when
+        // the condition is false, but would still acquire a buffer
+        // from a pool.
+        int32_t constant_size = op->constant_allocation_size();
+        bool on_heap = (constant_size == 0 ||
+                        !can_allocation_fit_on_stack(constant_size * op->type.bytes()));
+        if (op->new_expr.defined() || op->extents.empty() || !on_heap || !is_one(op->condition)) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        // Every buffer in the pool is as big as the largest the
+        // allocation can be on any iteration. When the extents depend
+        // on the loop (e.g. a shrinking triangular region) or on
+        // loaded data, the bound may be well above what most
+        // iterations need, so each of the pool's buffers (about one
+        // per thread) can be larger than halide_malloc would have
+        // allocated. The code generator pads heap allocations by up
+        // to a vector, so leave room for that too.
+        Expr bytes = make_const(Int(64), op->type.bytes());
+        for (Expr e : op->extents) {
+            bytes *= cast<int64_t>(e);
+        }
+        bytes += op->type.bytes() + 128;
+        Expr max_bytes = loop_invariant_upper_bound(bytes);
+        if (!max_bytes.defined()) {
+            debug(3) << "Can't bound the size of " << op->name << " in a parallel loop\n";
+            IRMutator::visit(op);
+            return;
+        }
+
+        Pool pool = {op->name + ".scratch_pool", max(max_bytes, 0)};
+        pools.push_back(pool);
+        debug(3) << "Using scratch pool " << pool.name << " of " << pool.buffer_bytes
+                 << " bytes per buffer for " << op->name << "\n";
+
+        Expr pool_ptr = Call::make(Handle(), Call::address_of,
+                                   {Load::make(UInt(8), pool.name, 0, BufferPtr(), Parameter())},
+                                   Call::Intrinsic);
+        Expr new_expr = Call::make(Handle(), "halide_scratch_pool_acquire", {pool_ptr}, Call::Extern);
+        stmt = Allocate::make(op->name, op->type, op->extents, op->condition, mutate(op->body),
+                              new_expr, "halide_scratch_pool_release");
+    }
+};
+
+class HoistParallelAllocations : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        if (!runs_on_host(op)) {
+            // Don't touch anything offloaded to a device.
+            stmt = op;
+            return;
+        }
+
+        IRMutator::visit(op);
+        op = stmt.as<For>();
+        internal_assert(op);
+        if (op->for_type != ForType::Parallel) {
+            return;
+        }
+
+        UseScratchPools pools(op);
+        Stmt body = pools.mutate(op->body);
+        if (pools.pools.empty()) {
+            return;
+        }
+
+        // Each pool is itself an allocation, made with a custom
+        // allocator, that wraps the loop. Early frees have already
+        // been injected, so free it explicitly after the loop.
+        stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+        for (const UseScratchPools::Pool &pool : pools.pools) {
+            Expr new_expr = Call::make(Handle(), "halide_scratch_pool_create", {pool.buffer_bytes}, Call::Extern);
+            stmt = Allocate::make(pool.name, UInt(8), {1}, const_true(),
+                                  Block::make(stmt, Free::make(pool.name)),
+                                  new_expr, "halide_scratch_pool_destroy");
+        }
+    }
+};
+
+}  // namespace
+
+Stmt hoist_parallel_allocations(Stmt s) {
+    return HoistParallelAllocations().mutate(s);
+}
+
+namespace {
+
+// Count the allocations that take their buffer from a scratch pool,
+// and the pools.
+class CountPools : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Allocate *op) {
+        if (op->free_function == "halide_scratch_pool_release") {
+            pooled++;
+        } else if (op->free_function == "halide_scratch_pool_destroy") {
+            pools++;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    int pooled = 0, pools = 0;
+};
+
+void check_pools(Stmt s, int pooled, int pools) {
+    // Lowering removes dead allocations after hoisting, which must
+    // see that the pools are used by the allocations taken from them.
+    CountPools counter;
+    remove_dead_allocations(hoist_parallel_allocations(s)).accept(&counter);
+    if (counter.pooled != pooled || counter.pools != pools) {
+        internal_error << "Expected " << pooled << " allocations from "
+                       << pools << " scratch pools, got " << counter.pooled
+                       << " from " << counter.pools << " for:\n" << s << "\n";
+    }
+}
+
+Stmt parallel_loop(const string &name, Expr extent, Stmt body) {
+    return For::make(name, 0, extent, ForType::Parallel, DeviceAPI::None, body);
+}
+
+}  // namespace
+
+void hoist_parallel_allocations_test() {
+    Expr x = Variable::make(Int(32), "x");
+    Expr y = Variable::make(Int(32), "y");
+    Expr n = Variable::make(Int(32), "n");
+    Expr c = Variable::make(Bool(), "c");
+    Stmt store = Store::make("buf", cast<float>(x), x, Parameter());
+    Stmt use = For::make("x", 0, n, ForType::Serial, DeviceAPI::None, store);
+
+    // A heap allocation in a parallel loop uses a pool.
+    Stmt alloc = Allocate::make("buf", Float(32), {n}, const_true(), use);
+    check_pools(parallel_loop("y", 16, alloc), 1, 1);
+
+    // One whose extent depends on the loop uses a pool of buffers
+    // sized for the last iteration.
+    Stmt triangle = Allocate::make("buf", Float(32), {y * 1024 + 1}, const_true(), use);
+    check_pools(parallel_loop("y", 16, triangle), 1, 1);
+
+    // One whose extent can't be bounded is left alone.
+    Expr loaded = Load::make(Int(32), "sizes", y, BufferPtr(), Parameter());
+    Stmt unbounded = Allocate::make("buf", Float(32), {loaded}, const_true(), use);
+    check_pools(parallel_loop("y", 16, unbounded), 0, 0);
+
+    // So is one with a condition.
+    Stmt conditional = Allocate::make("buf", Float(32), {n}, c, use);
+    check_pools(parallel_loop("y", 16, conditional), 0, 0);
+
+    // So is one in a serial loop.
+    check_pools(For::make("y", 0, 16, ForType::Serial, DeviceAPI::None, alloc), 0, 0);
+
+    // In nested parallel loops, the pool is created around the
+    // innermost one.
+    Stmt nested = parallel_loop("z", 4, parallel_loop("y", 16, alloc));
+    check_pools(nested, 1, 1);
+    internal_assert(hoist_parallel_allocations(nested).as<For>())
+        << "Scratch pool wasn't placed inside the outer parallel loop\n";
+
+    std::cout << "hoist_parallel_allocations test passed" << std::endl;
+}
+
+}
+}
@@ -0,0 +1,27 @@
+#ifndef HALIDE_HOIST_PARALLEL_ALLOCATIONS_H
+#define HALIDE_HOIST_PARALLEL_ALLOCATIONS_H
+
+/** \file
+ * Defines the lowering pass that moves heap allocations made inside
+ * parallel loops into per-loop pools of scratch buffers.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find heap allocations inside the body of parallel loops whose size
+ * can be bounded above by an expression that doesn't depend on the
+ * loop, and rewrite them to take a buffer from a pool created before
+ * the loop and give it back afterwards, instead of calling
+ * halide_malloc and halide_free on every iteration. Must be called
+ * after storage flattening and early free injection. */
+Stmt hoist_parallel_allocations(Stmt s);
+
+EXPORT void hoist_parallel_allocations_test();
+
+}
+}
+
+#endif
@@ -471,6 +471,16 @@ Stmt Block::make(const std::vector<Stmt> &stmts) {
     return result;
 }
 
+Stmt Fork::make(Stmt first, Stmt rest) {
+    internal_assert(first.defined()) << "Fork of undefined\n";
+    internal_assert(rest.defined()) << "Fork of undefined\n";
+
+    Fork *node = new Fork;
+    node->first = first;
+    node->rest = rest;
+    return node;
+}
+
 Stmt IfThenElse::make(Expr condition, Stmt then_case, Stmt else_case) {
     internal_assert(condition.defined() && then_case.defined()) << "IfThenElse of undefined\n";
     // else_case may be null.
@@ -571,6 +581,7 @@ template<> void StmtNode<Allocate>::accept(IRVisitor *v) const { v->visit((const
 template<> void StmtNode<Free>::accept(IRVisitor *v) const { v->visit((const Free *)this); }
 template<> void StmtNode<Realize>::accept(IRVisitor *v) const { v->visit((const Realize *)this); }
 template<> void StmtNode<Block>::accept(IRVisitor *v) const { v->visit((const Block *)this); }
+template<> void StmtNode<Fork>::accept(IRVisitor *v) const { v->visit((const Fork *)this); }
 template<> void StmtNode<IfThenElse>::accept(IRVisitor *v) const { v->visit((const IfThenElse *)this); }
 template<> void StmtNode<Evaluate>::accept(IRVisitor *v) const { v->visit((const Evaluate *)this); }
 
@@ -619,6 +630,7 @@ Call::ConstString Call::copy_memory = "copy_memory";
 Call::ConstString Call::likely = "likely";
 Call::ConstString Call::likely_if_innermost = "likely_if_innermost";
 Call::ConstString Call::register_destructor = "register_destructor";
+Call::ConstString Call::make_semaphore = "make_semaphore";
 Call::ConstString Call::div_round_to_zero = "div_round_to_zero";
 Call::ConstString Call::mod_round_to_zero = "mod_round_to_zero";
 Call::ConstString Call::slice_vector = "slice_vector";
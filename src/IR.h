@@ -409,6 +409,20 @@ struct Block : public StmtNode<Block> {
     static const IRNodeType _type_info = IRNodeType::Block;
 };
 
+/** Run two statements at the same time, and wait for both to
+ * finish. 'first' runs on a thread of its own, and 'rest' runs on
+ * the current thread. Used to run the producers of Funcs scheduled
+ * async() alongside their consumers. The two sides may block waiting
+ * on each other through semaphores, so they must never be run one
+ * after the other. */
+struct Fork : public StmtNode<Fork> {
+    Stmt first, rest;
+
+    EXPORT static Stmt make(Stmt first, Stmt rest);
+
+    static const IRNodeType _type_info = IRNodeType::Fork;
+};
+
 /** An if-then-else block. 'else' may be undefined. */
 struct IfThenElse : public StmtNode<IfThenElse> {
     Expr condition;
@@ -499,6 +513,7 @@ struct Call : public ExprNode<Call> {
         likely,
         likely_if_innermost,
         register_destructor,
+        make_semaphore,
         div_round_to_zero,
         mod_round_to_zero,
         slice_vector,
@@ -211,6 +211,11 @@ void IRVisitor::visit(const Block *op) {
     }
 }
 
+void IRVisitor::visit(const Fork *op) {
+    op->first.accept(this);
+    op->rest.accept(this);
+}
+
 void IRVisitor::visit(const IfThenElse *op) {
     op->condition.accept(this);
     op->then_case.accept(this);
@@ -433,6 +438,11 @@ void IRGraphVisitor::visit(const Block *op) {
     if (op->rest.defined()) include(op->rest);
 }
 
+void IRGraphVisitor::visit(const Fork *op) {
+    include(op->first);
+    include(op->rest);
+}
+
 void IRGraphVisitor::visit(const IfThenElse *op) {
     include(op->condition);
     include(op->then_case);
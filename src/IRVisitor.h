@@ -60,6 +60,7 @@ public:
     EXPORT virtual void visit(const Free *);
     EXPORT virtual void visit(const Realize *);
     EXPORT virtual void visit(const Block *);
+    EXPORT virtual void visit(const Fork *);
     EXPORT virtual void visit(const IfThenElse *);
     EXPORT virtual void visit(const Evaluate *);
 };
@@ -124,6 +125,7 @@ public:
     EXPORT virtual void visit(const Free *);
     EXPORT virtual void visit(const Realize *);
     EXPORT virtual void visit(const Block *);
+    EXPORT virtual void visit(const Fork *);
     EXPORT virtual void visit(const IfThenElse *);
     EXPORT virtual void visit(const Evaluate *);
     // @}
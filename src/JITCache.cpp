@@ -0,0 +1,587 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "JITCache.h"
+#include "Debug.h"
+#include "IRPrinter.h"
+#include "Module.h"
+#include "IRVisitor.h"
+#include "Util.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#include <sys/utime.h>
+#define getpid _getpid
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const char *const cache_magic = "halide_jit_cache 2";
+const char *const cache_suffix = ".halide_jit";
+
+// Two unrelated 64-bit string hashes. The first names the cache file,
+// and the second is stored in it to catch collisions.
+uint64_t fnv1a_hash(const string &s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : s) {
+        h ^= (uint8_t)c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t djb2_hash(const string &s) {
+    uint64_t h = 5381;
+    for (char c : s) {
+        h = h * 33 + (uint8_t)c;
+    }
+    return h;
+}
+
+string hex(uint64_t x) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)x);
+    return buf;
+}
+
+string cache_dir() {
+    size_t read = 0;
+    return get_env_variable("HL_JIT_CACHE_DIR", read);
+}
+
+uint64_t cache_size_limit() {
+    size_t read = 0;
+    string s = get_env_variable("HL_JIT_CACHE_SIZE", read);
+    if (s.empty()) {
+        return 256 * 1024 * 1024;
+    }
+    return std::strtoull(s.c_str(), nullptr, 10);
+}
+
+// Names made by unique_name() depend on what else the process has
+// compiled, so the same pipeline gets different names in different
+// processes. Rename every part of a name that looks like one, in order
+// of first appearance, so that those names don't change the key.
+class UniqueNameCanonicalizer {
+    std::map<string, int> renamed;
+
+public:
+    string operator()(const string &name) {
+        string result;
+        size_t i = 0;
+        while (i < name.size()) {
+            size_t j = i;
+            while (j < name.size() && (isalnum(name[j]) || name[j] == '_' || name[j] == '$')) {
+                j++;
+            }
+            if (j == i) {
+                result += name[i++];
+                continue;
+            }
+            string token = name.substr(i, j - i);
+            i = j;
+
+            // Look for "c123" or "anything$123".
+            size_t digits = token.find_last_not_of("0123456789") + 1;
+            bool is_unique_name =
+                !isdigit(token[0]) && digits < token.size() &&
+                (digits == 1 || token[digits - 1] == '$');
+            if (!is_unique_name) {
+                result += token;
+                continue;
+            }
+            auto it = renamed.find(token);
+            if (it == renamed.end()) {
+                it = renamed.emplace(token, (int)renamed.size()).first;
+            }
+            result += "$" + std::to_string(it->second);
+        }
+        return result;
+    }
+};
+
+// Serialize lowered IR into a cache key. Unlike printing it with
+// IRPrinter, this keeps every bit of each float constant, and the
+// contents of string constants and the names of extern functions
+// (which are symbols, and can't be renamed) are written verbatim.
+// Only the names of variables, buffers and loops are canonicalized.
+class KeyPrinter : public IRVisitor {
+    std::ostream &s;
+    UniqueNameCanonicalizer canonical;
+
+    using IRVisitor::visit;
+
+    void verbatim(const string &str) {
+        s << str.size() << "'" << str << " ";
+    }
+
+    void print(const Expr &e) {
+        if (e.defined()) {
+            e.accept(this);
+        } else {
+            s << "_ ";
+        }
+    }
+
+    void print(const Stmt &st) {
+        if (st.defined()) {
+            st.accept(this);
+        } else {
+            s << "_ ";
+        }
+    }
+
+    void print(const vector<Expr> &exprs) {
+        s << "[" << exprs.size() << " ";
+        for (const Expr &e : exprs) {
+            print(e);
+        }
+        s << "] ";
+    }
+
+    template<typename T>
+    void binary(const char *tag, const T *op) {
+        s << "(" << tag << " " << op->type << " ";
+        print(op->a);
+        print(op->b);
+        s << ") ";
+    }
+
+    void visit(const IntImm *op) {
+        s << op->type << " " << op->value << " ";
+    }
+
+    void visit(const UIntImm *op) {
+        s << op->type << " " << op->value << "u ";
+    }
+
+    void visit(const FloatImm *op) {
+        uint64_t bits;
+        static_assert(sizeof(bits) == sizeof(op->value), "FloatImm value isn't 64 bits");
+        memcpy(&bits, &op->value, sizeof(bits));
+        s << op->type << " f" << bits << " ";
+    }
+
+    void visit(const StringImm *op) {
+        s << "str ";
+        verbatim(op->value);
+    }
+
+    void visit(const Cast *op) {
+        s << "(cast " << op->type << " ";
+        print(op->value);
+        s << ") ";
+    }
+
+    void visit(const Variable *op) {
+        s << "var " << op->type << " ";
+        name(op->name);
+    }
+
+    void visit(const Add *op) { binary("+", op); }
+    void visit(const Sub *op) { binary("-", op); }
+    void visit(const Mul *op) { binary("*", op); }
+    void visit(const Div *op) { binary("/", op); }
+    void visit(const Mod *op) { binary("%", op); }
+    void visit(const Min *op) { binary("min", op); }
+    void visit(const Max *op) { binary("max", op); }
+    void visit(const EQ *op) { binary("==", op); }
+    void visit(const NE *op) { binary("!=", op); }
+    void visit(const LT *op) { binary("<", op); }
+    void visit(const LE *op) { binary("<=", op); }
+    void visit(const GT *op) { binary(">", op); }
+    void visit(const GE *op) { binary(">=", op); }
+    void visit(const And *op) { binary("&&", op); }
+    void visit(const Or *op) { binary("||", op); }
+
+    void visit(const Not *op) {
+        s << "(! ";
+        print(op->a);
+        s << ") ";
+    }
+
+    void visit(const Select *op) {
+        s << "(select ";
+        print(op->condition);
+        print(op->true_value);
+        print(op->false_value);
+        s << ") ";
+    }
+
+    void visit(const Load *op) {
+        s << "(load " << op->type << " ";
+        name(op->name);
+        print(op->index);
+        s << ") ";
+    }
+
+    void visit(const Ramp *op) {
+        s << "(ramp " << op->lanes << " ";
+        print(op->base);
+        print(op->stride);
+        s << ") ";
+    }
+
+    void visit(const Broadcast *op) {
+        s << "(broadcast " << op->lanes << " ";
+        print(op->value);
+        s << ") ";
+    }
+
+    void visit(const Call *op) {
+        s << "(call " << op->type << " " << (int)op->call_type << " " << op->value_index << " ";
+        if (op->call_type == Call::Extern ||
+            op->call_type == Call::ExternCPlusPlus ||
+            op->call_type == Call::PureExtern ||
+            op->call_type == Call::Intrinsic ||
+            op->call_type == Call::PureIntrinsic) {
+            verbatim(op->name);
+        } else {
+            name(op->name);
+        }
+        print(op->args);
+        s << ") ";
+    }
+
+    void visit(const Let *op) {
+        s << "(let ";
+        name(op->name);
+        print(op->value);
+        print(op->body);
+        s << ") ";
+    }
+
+    void visit(const LetStmt *op) {
+        s << "{let ";
+        name(op->name);
+        print(op->value);
+        print(op->body);
+        s << "} ";
+    }
+
+    void visit(const AssertStmt *op) {
+        s << "{assert ";
+        print(op->condition);
+        print(op->message);
+        s << "} ";
+    }
+
+    void visit(const ProducerConsumer *op) {
+        s << "{" << (op->is_producer ? "produce " : "consume ");
+        name(op->name);
+        print(op->body);
+        s << "} ";
+    }
+
+    void visit(const For *op) {
+        s << "{for " << op->for_type << " " << op->device_api << " ";
+        name(op->name);
+        print(op->min);
+        print(op->extent);
+        print(op->body);
+        s << "} ";
+    }
+
+    void visit(const Store *op) {
+        s << "{store ";
+        name(op->name);
+        print(op->value);
+        print(op->index);
+        s << "} ";
+    }
+
+    void visit(const Provide *op) {
+        s << "{provide ";
+        name(op->name);
+        print(op->values);
+        print(op->args);
+        s << "} ";
+    }
+
+    void visit(const Allocate *op) {
+        s << "{allocate " << op->type << " ";
+        name(op->name);
+        print(op->extents);
+        print(op->condition);
+        print(op->new_expr);
+        verbatim(op->free_function);
+        print(op->body);
+        s << "} ";
+    }
+
+    void visit(const Free *op) {
+        s << "{free ";
+        name(op->name);
+        s << "} ";
+    }
+
+    void visit(const Realize *op) {
+        s << "{realize ";
+        name(op->name);
+        for (const Type &t : op->types) {
+            s << t << " ";
+        }
+        for (const Range &r : op->bounds) {
+            print(r.min);
+            print(r.extent);
+        }
+        print(op->condition);
+        print(op->body);
+        s << "} ";
+    }
+
+    void visit(const Block *op) {
+        s << "{block ";
+        print(op->first);
+        print(op->rest);
+        s << "} ";
+    }
+
+    void visit(const Fork *op) {
+        s << "{fork ";
+        print(op->first);
+        print(op->rest);
+        s << "} ";
+    }
+
+    void visit(const IfThenElse *op) {
+        s << "{if ";
+        print(op->condition);
+        print(op->then_case);
+        print(op->else_case);
+        s << "} ";
+    }
+
+    void visit(const Evaluate *op) {
+        s << "{evaluate ";
+        print(op->value);
+        s << "} ";
+    }
+
+public:
+    KeyPrinter(std::ostream &s) : s(s) {}
+
+    void name(const string &n) {
+        string c = canonical(n);
+        s << c.size() << ":" << c << " ";
+    }
+
+    void print(const LoweredFunc &f) {
+        s << "Function ";
+        verbatim(f.name);
+        s << (int)f.linkage << "\n";
+        for (const LoweredArgument &arg : f.args) {
+            s << "Argument " << (int)arg.kind << " " << (int)arg.dimensions << " " << arg.type << " ";
+            name(arg.name);
+            print(arg.def);
+            print(arg.min);
+            print(arg.max);
+            s << arg.alignment.modulus << " " << arg.alignment.remainder << "\n";
+        }
+        print(f.body);
+        s << "\n";
+    }
+};
+
+// Mark an entry as recently used.
+void touch(const string &filename) {
+    #ifdef _WIN32
+    _utime(filename.c_str(), nullptr);
+    #else
+    utime(filename.c_str(), nullptr);
+    #endif
+}
+
+struct CacheFile {
+    string name;
+    uint64_t size;
+    int64_t mod_time;
+};
+
+// List the entries in the cache directory. Other processes may be
+// adding and deleting entries concurrently, so files that vanish
+// while we look at them are silently skipped.
+vector<CacheFile> list_cache_files(const string &dir) {
+    vector<CacheFile> result;
+    #ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA((dir + "\\*" + cache_suffix).c_str(), &data);
+    if (h == INVALID_HANDLE_VALUE) return result;
+    do {
+        ULARGE_INTEGER size, time;
+        size.LowPart = data.nFileSizeLow;
+        size.HighPart = data.nFileSizeHigh;
+        time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+        time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+        result.push_back({dir + "\\" + data.cFileName, size.QuadPart, (int64_t)time.QuadPart});
+    } while (FindNextFileA(h, &data));
+    FindClose(h);
+    #else
+    DIR *d = opendir(dir.c_str());
+    if (!d) return result;
+    while (struct dirent *e = readdir(d)) {
+        string name = e->d_name;
+        if (!ends_with(name, cache_suffix)) continue;
+        name = dir + "/" + name;
+        struct stat s;
+        if (::stat(name.c_str(), &s) != 0) continue;
+        result.push_back({name, (uint64_t)s.st_size, (int64_t)s.st_mtime});
+    }
+    closedir(d);
+    #endif
+    return result;
+}
+
+// Delete the least recently used entries, other than the one just
+// written, until the cache fits within its size limit.
+void evict(const string &dir, const string &keep) {
+    uint64_t limit = cache_size_limit();
+    vector<CacheFile> files = list_cache_files(dir);
+    uint64_t total = 0;
+    for (const CacheFile &f : files) {
+        total += f.size;
+    }
+    if (total <= limit) return;
+
+    std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b) {
+        return a.mod_time < b.mod_time;
+    });
+    for (const CacheFile &f : files) {
+        if (total <= limit) break;
+        if (f.name == keep) continue;
+        debug(2) << "Evicting " << f.name << " from the JIT cache\n";
+        // Another process may have beaten us to it.
+        std::remove(f.name.c_str());
+        total -= f.size;
+    }
+}
+
+}
+
+JITCache::JITCache(const Module &m) {
+    if (!enabled()) return;
+
+    std::ostringstream s;
+    s << cache_magic << "\n"
+      << "LLVM_VERSION = " << LLVM_VERSION << "\n"
+      << "Target = " << m.target().to_string() << "\n";
+    KeyPrinter printer(s);
+    for (const LoweredFunc &f : m.functions()) {
+        printer.print(f);
+    }
+    // The contents of the Module's buffers get embedded in the object
+    // code.
+    for (const BufferPtr &buf : m.buffers()) {
+        const buffer_t *b = buf.raw_buffer();
+        size_t num_elems = 1;
+        s << "Buffer ";
+        printer.name(buf.name());
+        s << b->elem_size;
+        for (int d = 0; d < 4 && b->extent[d]; d++) {
+            s << " [" << b->min[d] << ", " << b->extent[d] << ", " << b->stride[d] << "]";
+            num_elems += b->stride[d] * (b->extent[d] - 1);
+        }
+        s << "\n";
+        s.write((const char *)b->host, num_elems * b->elem_size);
+    }
+    key = s.str();
+
+    filename = cache_dir() + "/" + hex(fnv1a_hash(key)) + cache_suffix;
+}
+
+bool JITCache::enabled() {
+    return !cache_dir().empty();
+}
+
+bool JITCache::load(JITCacheEntry &entry) const {
+    if (filename.empty()) return false;
+
+    std::ifstream f(filename.c_str(), std::ios::binary);
+    if (!f.is_open()) {
+        debug(2) << "JIT cache miss: " << filename << "\n";
+        return false;
+    }
+
+    string magic, check, soft_float, object_size;
+    std::getline(f, magic);
+    std::getline(f, check);
+    std::getline(f, entry.triple);
+    std::getline(f, entry.data_layout);
+    std::getline(f, entry.mcpu);
+    std::getline(f, entry.mattrs);
+    std::getline(f, soft_float);
+    std::getline(f, object_size);
+    if (!f.good() ||
+        magic != cache_magic ||
+        check != hex(djb2_hash(key)) + " " + std::to_string(key.size())) {
+        debug(1) << "Ignoring stale or colliding JIT cache entry " << filename << "\n";
+        return false;
+    }
+    entry.use_soft_float_abi = (soft_float == "1");
+    entry.object.resize(std::strtoull(object_size.c_str(), nullptr, 10));
+    f.read(entry.object.data(), entry.object.size());
+    if ((size_t)f.gcount() != entry.object.size()) {
+        debug(1) << "Ignoring truncated JIT cache entry " << filename << "\n";
+        return false;
+    }
+
+    debug(2) << "JIT cache hit: " << filename << "\n";
+    touch(filename);
+    return true;
+}
+
+void JITCache::store(const JITCacheEntry &entry) const {
+    if (filename.empty()) return;
+
+    // Write to a temporary file and then rename it into place, so
+    // that other processes never see a partially-written entry.
+    string temp = filename + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream f(temp.c_str(), std::ios::binary);
+        if (!f.is_open()) {
+            debug(1) << "Could not write JIT cache entry " << temp << "\n";
+            return;
+        }
+        f << cache_magic << "\n"
+          << hex(djb2_hash(key)) << " " << key.size() << "\n"
+          << entry.triple << "\n"
+          << entry.data_layout << "\n"
+          << entry.mcpu << "\n"
+          << entry.mattrs << "\n"
+          << (entry.use_soft_float_abi ? 1 : 0) << "\n"
+          << entry.object.size() << "\n";
+        f.write(entry.object.data(), entry.object.size());
+    }
+    #ifdef _WIN32
+    // rename() won't replace an existing file on Windows.
+    std::remove(filename.c_str());
+    #endif
+    if (std::rename(temp.c_str(), filename.c_str()) != 0) {
+        debug(1) << "Could not write JIT cache entry " << filename << "\n";
+        std::remove(temp.c_str());
+        return;
+    }
+    debug(2) << "Added " << filename << " to the JIT cache\n";
+
+    evict(cache_dir(), filename);
+}
+
+}
+}
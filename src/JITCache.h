@@ -0,0 +1,61 @@
+#ifndef HALIDE_JIT_CACHE_H
+#define HALIDE_JIT_CACHE_H
+
+/** \file
+ *
+ * Defines a cache of JIT-compiled object code that persists across
+ * processes.
+ */
+
+#include <string>
+#include <vector>
+
+#include "Module.h"
+
+namespace Halide {
+namespace Internal {
+
+/** The object code for a JIT-compiled Module, along with what is
+ * needed to load it back into an execution engine. */
+struct JITCacheEntry {
+    std::string triple, data_layout, mcpu, mattrs;
+    bool use_soft_float_abi;
+    std::vector<char> object;
+
+    JITCacheEntry() : use_soft_float_abi(false) {}
+};
+
+/** A directory of object code for previously JIT-compiled Modules,
+ * so that a process that compiles the same pipeline as an earlier
+ * process can skip LLVM entirely. This does nothing unless the
+ * environment variable HL_JIT_CACHE_DIR is set to a directory. Entries
+ * are keyed by a hash of the printed lowered Module (including the
+ * contents of any embedded buffers), its Target, and the LLVM
+ * version. Once the directory holds more than HL_JIT_CACHE_SIZE bytes
+ * (256MB by default), the least recently used entries are deleted.
+ *
+ * The key does not capture the version of Halide itself, so the
+ * directory should be cleared when upgrading Halide. */
+class JITCache {
+public:
+    EXPORT JITCache(const Module &m);
+
+    /** Returns true if HL_JIT_CACHE_DIR is set. */
+    EXPORT static bool enabled();
+
+    /** Look up the Module in the cache. Returns false on a miss. */
+    EXPORT bool load(JITCacheEntry &entry) const;
+
+    /** Add the object code for the Module to the cache, evicting old
+     * entries if the cache has grown too large. */
+    EXPORT void store(const JITCacheEntry &entry) const;
+
+private:
+    std::string key;
+    std::string filename;
+};
+
+}
+}
+
+#endif
@@ -4,6 +4,8 @@
 #include <set>
 
 #include "CodeGen_Internal.h"
+#include "CompileTimeProfiler.h"
+#include "JITCache.h"
 #include "JITModule.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Runtime_Linker.h"
@@ -160,7 +162,8 @@ JITModule::Symbol compile_and_get_function(ExecutionEngine &ee, const string &na
         internal_error << "Compiling " << name << " returned nullptr\n";
     }
 
-    JITModule::Symbol symbol(f, fn->getFunctionType());
+    // Functions loaded from the JIT cache have no LLVM declaration.
+    JITModule::Symbol symbol(f, fn ? fn->getFunctionType() : nullptr);
 
     debug(2) << "Function " << name << " is at " << f << "\n";
 
@@ -200,6 +203,47 @@ public:
     }
 };
 
+// Saves the object code MCJIT produces to the on-disk JIT cache, and
+// hands MCJIT object code previously loaded from it.
+class HalideJITObjectCache : public llvm::ObjectCache {
+    const JITCache &cache;
+    const JITCacheEntry *cached;
+
+public:
+    HalideJITObjectCache(const JITCache &cache, const JITCacheEntry *cached) : cache(cache), cached(cached) {}
+
+    virtual void notifyObjectCompiled(const llvm::Module *m, llvm::MemoryBufferRef object) {
+        JITCacheEntry entry;
+        llvm::TargetOptions options;
+        get_target_options(*m, options, entry.mcpu, entry.mattrs);
+        entry.use_soft_float_abi = (options.FloatABIType == llvm::FloatABI::Soft);
+        entry.triple = m->getTargetTriple();
+        entry.data_layout = m->getDataLayoutStr();
+        entry.object.assign(object.getBufferStart(), object.getBufferEnd());
+        cache.store(entry);
+    }
+
+    virtual std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *) {
+        if (!cached) {
+            return nullptr;
+        }
+        return llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(cached->object.data(), cached->object.size()));
+    }
+};
+
+// Make an empty module with the target options of a cached one, for
+// MCJIT to load the cached object code in place of.
+std::unique_ptr<llvm::Module> make_module_for_cache_entry(const JITCacheEntry &entry, const string &name,
+                                                          llvm::LLVMContext &context) {
+    std::unique_ptr<llvm::Module> m(new llvm::Module(name, context));
+    m->setTargetTriple(entry.triple);
+    m->setDataLayout(entry.data_layout);
+    m->addModuleFlag(llvm::Module::Warning, "halide_use_soft_float_abi", entry.use_soft_float_abi ? 1 : 0);
+    m->addModuleFlag(llvm::Module::Warning, "halide_mcpu", llvm::MDString::get(context, entry.mcpu));
+    m->addModuleFlag(llvm::Module::Warning, "halide_mattrs", llvm::MDString::get(context, entry.mattrs));
+    return m;
+}
+
 }
 
 JITModule::JITModule() {
@@ -209,16 +253,34 @@ JITModule::JITModule() {
 JITModule::JITModule(const Module &m, const LoweredFunc &fn,
                      const std::vector<JITModule> &dependencies) {
     jit_module = new JITModuleContents();
-    std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(m, jit_module->context));
+
+    // If a previous process left the object code for this Module in
+    // the on-disk cache, skip codegen entirely.
+    JITCache cache(m);
+    JITCacheEntry cached;
+    bool cache_hit = cache.load(cached);
+    std::unique_ptr<llvm::Module> llvm_module;
+    if (cache_hit) {
+        llvm_module = make_module_for_cache_entry(cached, m.name(), jit_module->context);
+    } else {
+        llvm_module = compile_module_to_llvm_module(m, jit_module->context);
+    }
     std::vector<JITModule> deps_with_runtime = dependencies;
     std::vector<JITModule> shared_runtime = JITSharedRuntime::get(llvm_module.get(), m.target());
     deps_with_runtime.insert(deps_with_runtime.end(), shared_runtime.begin(), shared_runtime.end());
-    compile_module(std::move(llvm_module), fn.name, m.target(), deps_with_runtime);
+    if (JITCache::enabled()) {
+        HalideJITObjectCache object_cache(cache, cache_hit ? &cached : nullptr);
+        compile_module(std::move(llvm_module), fn.name, m.target(), deps_with_runtime,
+                       std::vector<std::string>(), &object_cache);
+    } else {
+        compile_module(std::move(llvm_module), fn.name, m.target(), deps_with_runtime);
+    }
 }
 
 void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &function_name, const Target &target,
                                const std::vector<JITModule> &dependencies,
-                               const std::vector<std::string> &requested_exports) {
+                               const std::vector<std::string> &requested_exports,
+                               llvm::ObjectCache *object_cache) {
 
     // Make the execution engine
     debug(2) << "Creating new execution engine\n";
@@ -233,6 +295,9 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     DataLayout initial_module_data_layout = m->getDataLayout();
     string module_name = m->getModuleIdentifier();
 
+    CompileTimeProfiler profiler(module_name);
+    int64_t instruction_count = CompileTimeProfiler::enabled() ? llvm_instruction_count(*m) : 0;
+
     llvm::EngineBuilder engine_builder((std::move(m)));
     engine_builder.setTargetOptions(options);
     engine_builder.setErrorStr(&error_string);
@@ -278,6 +343,16 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
         ee->RegisterJITEventListener(listeners[i]);
     }
 
+    if (object_cache) {
+        // The object code may come from the cache rather than from
+        // the module, in which case the module doesn't define the
+        // symbols we're about to look up, so MCJIT won't load it
+        // lazily. Load it now.
+        ee->setObjectCache(object_cache);
+        ee->finalizeObject();
+        ee->setObjectCache(nullptr);
+    }
+
     // Retrieve function pointers from the compiled module (which also
     // triggers compilation)
     debug(1) << "JIT compiling " << module_name << "\n";
@@ -300,6 +375,8 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     debug(2) << "Finalizing object\n";
     ee->finalizeObject();
 
+    profiler.pass_done("llvm_jit", instruction_count);
+
     // Do any target-specific post-compilation module meddling
     for (size_t i = 0; i < listeners.size(); i++) {
         ee->UnregisterJITEventListener(listeners[i]);
@@ -123,6 +123,29 @@ vector<Stmt> block_to_vector(Stmt s) {
     return result;
 }
 
+/** Find the names of all buffers stored to in a Stmt. */
+class FindStores : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Store *op) {
+        result.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+public:
+    set<string> result;
+};
+
+Expr slice_vector(Expr vec, int start, int lanes) {
+    return Call::make(vec.type().with_lanes(lanes), Call::slice_vector,
+                      {vec, start, 1, lanes}, Call::PureIntrinsic);
+}
+
+Expr concat_vectors(Expr a, Expr b) {
+    return Call::make(a.type().with_lanes(a.type().lanes() + b.type().lanes()),
+                      Call::concat_vectors, {a, b}, Call::PureIntrinsic);
+}
+
 Expr scratch_index(int i, Type t) {
     if (t.is_scalar()) {
         return i;
@@ -191,8 +214,15 @@ class LoopCarryOverLoop : public IRMutator {
     // to lift out.
     const Scope<int> &in_consume;
 
+    // Buffers stored to somewhere in the loop. A value loaded from
+    // one of these on the previous iteration may be stale.
+    const set<string> &stored;
+
     int max_carried_values;
 
+    // Whether to only carry sliding windows of vector loads.
+    bool only_vector_windows;
+
     using IRMutator::visit;
 
     void visit(const LetStmt *op) {
@@ -243,6 +273,137 @@ class LoopCarryOverLoop : public IRMutator {
         stmt = Block::make(result);
     }
 
+    bool safe_to_lift(const Load *load) {
+        return ((load->image.defined() ||
+                 load->param.defined() ||
+                 in_consume.contains(load->name)) &&
+                !stored.count(load->name));
+    }
+
+    // Wrap the initial stores to a scratch buffer in the lets they
+    // use, and queue up the allocation of the scratch buffer.
+    void add_scratch_allocation(const string &scratch, Type t, int size,
+                                Stmt initial_stores,
+                                const vector<pair<string, Expr>> &initial_lets) {
+        for (size_t i = initial_lets.size(); i > 0; i--) {
+            auto l = initial_lets[i-1];
+            initial_stores = LetStmt::make(l.first, l.second, initial_stores);
+        }
+        // We may be lifting the initial stores out of let stmts,
+        // so rewrap them in the necessary ones.
+        for (size_t i = containing_lets.size(); i > 0; i--) {
+            auto l = containing_lets[i-1];
+            if (stmt_uses_var(initial_stores, l.first)) {
+                initial_stores = LetStmt::make(l.first, l.second, initial_stores);
+            }
+        }
+        allocs.push_back({scratch, t, size, initial_stores});
+    }
+
+    // Dense vector loads from the same buffer at small constant
+    // offsets from each other, that move forwards by exactly one
+    // vector per loop iteration, form a sliding window. E.g. a
+    // vectorized 3-tap blur loads f[x-1:x+7], f[x:x+8], and
+    // f[x+1:x+9], and then on the next iteration f[x+7:x+15],
+    // f[x+8:x+16], and f[x+9:x+17]. All of these are slices of the
+    // concatenation of the leading-edge load and the leading-edge
+    // load from the previous iteration, so we keep those two vectors
+    // in a scratch buffer and only load one new vector per
+    // iteration. Returns the number of vectors carried.
+    int rotate_vector_windows(Stmt &core, int budget,
+                              vector<Stmt> &leading_edge_stores,
+                              vector<Stmt> &scratch_shuffles) {
+        FindLoads find_loads;
+        core.accept(&find_loads);
+
+        struct Window {
+            Expr base;
+            vector<pair<const Load *, int64_t>> loads;
+        };
+        vector<Window> windows;
+
+        for (const Load *load : find_loads.result) {
+            const Ramp *r = load->index.as<Ramp>();
+            if (!r || !is_one(r->stride) || !safe_to_lift(load)) continue;
+
+            Expr base = substitute_in_all_lets(simplify(common_subexpression_elimination(r->base)));
+            Expr next_base = step_forwards(r->base, linear);
+            if (!next_base.defined()) continue;
+            const int64_t *step = as_const_int(simplify(next_base - base));
+            if (!step || *step != r->lanes) continue;
+
+            bool represented = false;
+            for (Window &w : windows) {
+                const Load *other = w.loads[0].first;
+                if (other->name != load->name || other->type != load->type) continue;
+                const int64_t *offset = as_const_int(simplify(base - w.base));
+                if (offset) {
+                    w.loads.push_back({load, *offset});
+                    represented = true;
+                    break;
+                }
+            }
+            if (!represented) {
+                windows.push_back({base, {{load, 0}}});
+            }
+        }
+
+        int carried = 0;
+        for (Window &w : windows) {
+            if (carried + 2 > budget) break;
+
+            std::sort(w.loads.begin(), w.loads.end(),
+                      [](const pair<const Load *, int64_t> &a, const pair<const Load *, int64_t> &b) {
+                          return a.second < b.second;
+                      });
+            const Load *first = w.loads.front().first, *last = w.loads.back().first;
+            int64_t min_offset = w.loads.front().second, max_offset = w.loads.back().second;
+            Type t = first->type;
+            int lanes = t.lanes();
+            // The two vectors must cover the window, and there must
+            // be more than one distinct load in it to be worth it.
+            if (min_offset == max_offset || max_offset - min_offset >= lanes) continue;
+
+            debug(3) << "Found sliding window of " << w.loads.size() << " loads from " << first->name << "\n";
+
+            // The scratch buffer holds the leading edge from the
+            // previous iteration followed by the current one.
+            string scratch = unique_name('c');
+            Expr prev = Load::make(t, scratch, scratch_index(0, t), BufferPtr(), Parameter());
+            Expr current = Load::make(t, scratch, scratch_index(1, t), BufferPtr(), Parameter());
+            for (const auto &l : w.loads) {
+                Expr replacement;
+                if (l.second == max_offset) {
+                    replacement = current;
+                } else {
+                    replacement = slice_vector(concat_vectors(prev, current),
+                                               (int)(l.second - max_offset + lanes), lanes);
+                }
+                core = graph_substitute(l.first, replacement, core);
+            }
+
+            leading_edge_stores.push_back(Store::make(scratch, last, scratch_index(1, t), Parameter()));
+            scratch_shuffles.push_back(Store::make(scratch, current, scratch_index(0, t), Parameter()));
+
+            // On the first iteration there's no previous leading
+            // edge. The lanes of it that get used all lie within the
+            // trailing edge, so shift those into place instead of
+            // loading anything outside the window.
+            Expr initial = slice_vector(concat_vectors(first, first), (int)(max_offset - min_offset), lanes);
+            vector<pair<string, Expr>> initial_lets;
+            initial = simplify(common_subexpression_elimination(initial));
+            while (const Let *l = initial.as<Let>()) {
+                initial_lets.push_back(make_pair(l->name, l->value));
+                initial = l->body;
+            }
+            add_scratch_allocation(scratch, t.element_of(), 2 * lanes,
+                                   Store::make(scratch, initial, scratch_index(0, t), Parameter()),
+                                   initial_lets);
+            carried += 2;
+        }
+        return carried;
+    }
+
     Stmt lift_carried_values_out_of_stmt(Stmt orig_stmt) {
         debug(4) << "About to lift carried values out of stmt: " << orig_stmt << "\n";
 
@@ -251,9 +412,22 @@ class LoopCarryOverLoop : public IRMutator {
         // exponential runtime.
         Stmt graph_stmt = substitute_in_all_lets(orig_stmt);
 
+        vector<Stmt> not_first_iteration_scratch_stores;
+        vector<Stmt> scratch_shuffles;
+        Stmt core = graph_stmt;
+
+        // Sliding windows of vector loads get the first claim on the
+        // registers.
+        int budget = max_carried_values;
+        budget -= rotate_vector_windows(core, budget,
+                                        not_first_iteration_scratch_stores,
+                                        scratch_shuffles);
+
         // Find all the loads in these stmts.
         FindLoads find_loads;
-        graph_stmt.accept(&find_loads);
+        if (!only_vector_windows) {
+            core.accept(&find_loads);
+        }
 
         debug(4) << "Found " << find_loads.result.size() << " loads\n";
 
@@ -261,10 +435,7 @@ class LoopCarryOverLoop : public IRMutator {
         vector<vector<const Load *>> loads;
         for (const Load *load : find_loads.result) {
             // Check if it's safe to lift out.
-            bool safe = (load->image.defined() ||
-                         load->param.defined() ||
-                         in_consume.contains(load->name));
-            if (!safe) continue;
+            if (!safe_to_lift(load)) continue;
 
             bool represented = false;
             for (vector<const Load *> &v : loads) {
@@ -303,7 +474,7 @@ class LoopCarryOverLoop : public IRMutator {
             }
         }
 
-        if (chains.empty()) {
+        if (chains.empty() && not_first_iteration_scratch_stores.empty()) {
             return orig_stmt;
         }
 
@@ -349,10 +520,10 @@ class LoopCarryOverLoop : public IRMutator {
         vector<vector<int>> trimmed;
         size_t sz = 0;
         for (const vector<int> &c : chains) {
-            if (sz + c.size() > (size_t)max_carried_values) {
-                if (sz < (size_t)max_carried_values - 1) {
+            if (sz + c.size() > (size_t)budget) {
+                if (sz + 1 < (size_t)budget) {
                     // Take a partial chain
-                    trimmed.emplace_back(c.begin(), c.begin() + max_carried_values - sz);
+                    trimmed.emplace_back(c.begin(), c.begin() + budget - sz);
                 }
                 break;
             }
@@ -374,10 +545,6 @@ class LoopCarryOverLoop : public IRMutator {
         // the next loop iteration. If it's the first loop iteration,
         // we need to populate the entire scratch buffer.
 
-        vector<Stmt> not_first_iteration_scratch_stores;
-        vector<Stmt> scratch_shuffles;
-        Stmt core = graph_stmt;
-
         for (const vector<int> &c : chains) {
             string scratch = unique_name('c');
             vector<Expr> initial_scratch_values;
@@ -429,26 +596,11 @@ class LoopCarryOverLoop : public IRMutator {
                 initial_scratch_stores.push_back(store_to_scratch);
             }
 
-            Stmt initial_stores = Block::make(initial_scratch_stores);
-
-            // Wrap them in the appropriate lets
-            for (size_t i = initial_lets.size(); i > 0; i--) {
-                auto l = initial_lets[i-1];
-                initial_stores = LetStmt::make(l.first, l.second, initial_stores);
-            }
-            // We may be lifting the initial stores out of let stmts,
-            // so rewrap them in the necessary ones.
-            for (size_t i = containing_lets.size(); i > 0; i--) {
-                auto l = containing_lets[i-1];
-                if (stmt_uses_var(initial_stores, l.first)) {
-                    initial_stores = LetStmt::make(l.first, l.second, initial_stores);
-                }
-            }
-
-            allocs.push_back({scratch,
-                        loads[c.front()][0]->type.element_of(),
-                        (int)c.size() * loads[c.front()][0]->type.lanes(),
-                        initial_stores});
+            add_scratch_allocation(scratch,
+                                   loads[c.front()][0]->type.element_of(),
+                                   (int)c.size() * loads[c.front()][0]->type.lanes(),
+                                   Block::make(initial_scratch_stores),
+                                   initial_lets);
         }
 
         Stmt s = Block::make(not_first_iteration_scratch_stores);
@@ -470,9 +622,16 @@ class LoopCarryOverLoop : public IRMutator {
         stmt = op;
     }
 
+    void visit(const Fork *op) {
+        // Don't lift loads out of code that runs on another thread.
+        stmt = op;
+    }
+
 public:
-    LoopCarryOverLoop(const string &var, const Scope<int> &s, int max_carried_values)
-        : in_consume(s), max_carried_values(max_carried_values) {
+    LoopCarryOverLoop(const string &var, const Scope<int> &s, const set<string> &stored,
+                      int max_carried_values, bool only_vector_windows)
+        : in_consume(s), stored(stored), max_carried_values(max_carried_values),
+          only_vector_windows(only_vector_windows) {
         linear.push(var, 1);
     }
 
@@ -490,6 +649,7 @@ class LoopCarry : public IRMutator {
     using IRMutator::visit;
 
     int max_carried_values;
+    bool only_vector_windows;
     Scope<int> in_consume;
 
     void visit(const ProducerConsumer *op) {
@@ -504,9 +664,16 @@ class LoopCarry : public IRMutator {
     }
 
     void visit(const For *op) {
-        if (op->for_type == ForType::Serial && !is_one(op->extent)) {
+        if (op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            // Leave loops offloaded to some other device alone.
+            stmt = op;
+        } else if (op->for_type == ForType::Serial && !is_one(op->extent)) {
             Stmt body = mutate(op->body);
-            LoopCarryOverLoop carry(op->name, in_consume, max_carried_values);
+            FindStores find_stores;
+            body.accept(&find_stores);
+            LoopCarryOverLoop carry(op->name, in_consume, find_stores.result,
+                                    max_carried_values, only_vector_windows);
             body = carry.mutate(body);
             if (body.same_as(op->body)) {
                 stmt = op;
@@ -529,14 +696,20 @@ class LoopCarry : public IRMutator {
     }
 
 public:
-    LoopCarry(int max_carried_values) : max_carried_values(max_carried_values) {}
+    LoopCarry(int max_carried_values, bool only_vector_windows)
+        : max_carried_values(max_carried_values), only_vector_windows(only_vector_windows) {}
 };
 
 }
 
 
 Stmt loop_carry(Stmt s, int max_carried_values) {
-    s = LoopCarry(max_carried_values).mutate(s);
+    s = LoopCarry(max_carried_values, false).mutate(s);
+    return s;
+}
+
+Stmt carry_vector_windows(Stmt s, int max_carried_values) {
+    s = LoopCarry(max_carried_values, true).mutate(s);
     return s;
 }
 
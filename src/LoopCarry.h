@@ -7,12 +7,23 @@ namespace Halide {
 namespace Internal {
 
 /** Reuse loads done on previous loop iterations by stashing them in
- * induction variables instead of redoing the load. Can be an
- * optimization or pessimization depending on how good the L1 cache is
- * on the architecture and how many memory issue slots there
- * are. Currently only intended for Hexagon. */
+ * induction variables instead of redoing the load. Dense vector loads
+ * that slide along with the loop by one vector per iteration (as in a
+ * vectorized stencil) are rebuilt from the leading-edge vector and
+ * the one from the previous iteration, so only one vector is loaded
+ * per iteration. Can be an optimization or pessimization depending on
+ * how good the L1 cache is on the architecture and how many memory
+ * issue slots there are. Loops that run on a device other than the
+ * host are left alone. */
 Stmt loop_carry(Stmt, int max_carried_values = 8);
 
+/** Only rotate sliding windows of dense vector loads through
+ * registers, as described above, and leave scalar loads alone. This
+ * is what CPU targets use, as carrying scalar values would get in the
+ * way of LLVM's loop vectorizer. Lowering only runs it when the
+ * environment variable HL_CARRY_VECTOR_WINDOWS is set to 1. */
+Stmt carry_vector_windows(Stmt, int max_carried_values = 8);
+
 }
 }
 
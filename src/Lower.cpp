@@ -2,15 +2,18 @@
 #include <set>
 #include <sstream>
 #include <algorithm>
+#include <memory>
 
 #include "Lower.h"
 
 #include "AddImageChecks.h"
 #include "AddParameterChecks.h"
 #include "AllocationBoundsInference.h"
+#include "AsyncProducers.h"
 #include "Bounds.h"
 #include "BoundsInference.h"
 #include "CSE.h"
+#include "CompileTimeProfiler.h"
 #include "Debug.h"
 #include "DebugToFile.h"
 #include "DeepCopy.h"
@@ -20,6 +23,7 @@
 #include "Function.h"
 #include "FuseGPUThreadLoops.h"
 #include "FuzzFloatStores.h"
+#include "HoistParallelAllocations.h"
 #include "HexagonOffload.h"
 #include "InjectHostDevBufferCopies.h"
 #include "InjectImageIntrinsics.h"
@@ -52,6 +56,7 @@
 #include "UnifyDuplicateLets.h"
 #include "UniquifyVariableNames.h"
 #include "UnrollLoops.h"
+#include "Util.h"
 #include "VaryingAttributes.h"
 #include "VectorizeLoops.h"
 #include "WrapCalls.h"
@@ -67,6 +72,16 @@ using std::map;
 
 Stmt lower(vector<Function> outputs, const string &pipeline_name, const Target &t, const vector<IRMutator *> &custom_passes) {
 
+    CompileTimeProfiler profiler(pipeline_name);
+
+    // Lowering simplifies the whole Stmt many times over, and most of
+    // it is unchanged from one time to the next.
+    std::unique_ptr<SimplifyMemo> simplify_memo;
+    size_t read = 0;
+    if (get_env_variable("HL_SIMPLIFY_MEMO", read) == "1") {
+        simplify_memo.reset(new SimplifyMemo);
+    }
+
     // Compute an environment
     map<string, Function> env;
     for (Function f : outputs) {
@@ -76,110 +91,168 @@ Stmt lower(vector<Function> outputs, const string &pipeline_name, const Target &
 
     // Create a deep-copy of the entire graph of Funcs.
     std::tie(outputs, env) = deep_copy(outputs, env);
+    profiler.pass_done("deep_copy", Stmt());
 
     // Substitute in wrapper Funcs
     env = wrap_func_calls(env);
+    profiler.pass_done("wrap_func_calls", Stmt());
+
+    // The runtimes for these targets have no threads, so an async
+    // producer would have to finish before its consumer started, and
+    // would deadlock on the semaphore guarding folded storage. Compute
+    // async Funcs like any other Func instead. The env holds copies,
+    // so this doesn't touch the caller's schedule.
+    if (t.os == Target::QuRT || t.os == Target::NoOS) {
+        for (auto &p : env) {
+            p.second.schedule().async() = false;
+        }
+    }
 
     // Compute a realization order
     vector<string> order = realization_order(outputs, env);
+    profiler.pass_done("realization_order", Stmt());
 
     // Try to simplify the RHS/LHS of a function definition by propagating its
     // specializations' conditions
     simplify_specializations(env);
+    profiler.pass_done("simplify_specializations", Stmt());
 
     bool any_memoized = false;
 
     debug(1) << "Creating initial loop nests...\n";
     Stmt s = schedule_functions(outputs, order, env, t, any_memoized);
+    profiler.pass_done("schedule_functions", s);
     debug(2) << "Lowering after creating initial loop nests:\n" << s << '\n';
+    profiler.reset();
 
     if (any_memoized) {
         debug(1) << "Injecting memoization...\n";
         s = inject_memoization(s, env, pipeline_name, outputs);
+        profiler.pass_done("inject_memoization", s);
         debug(2) << "Lowering after injecting memoization:\n" << s << '\n';
+        profiler.reset();
     } else {
         debug(1) << "Skipping injecting memoization...\n";
     }
 
     debug(1) << "Injecting prefetches...\n";
     s = inject_prefetch(s, env);
+    profiler.pass_done("inject_prefetch", s);
     debug(2) << "Lowering after injecting prefetches:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Injecting tracing...\n";
     s = inject_tracing(s, pipeline_name, env, outputs);
+    profiler.pass_done("inject_tracing", s);
     debug(2) << "Lowering after injecting tracing:\n" << s << '\n';
+    profiler.reset();
 
     debug(1) << "Adding checks for parameters\n";
     s = add_parameter_checks(s, t);
+    profiler.pass_done("add_parameter_checks", s);
     debug(2) << "Lowering after injecting parameter checks:\n" << s << '\n';
+    profiler.reset();
 
     // Compute the maximum and minimum possible value of each
     // function. Used in later bounds inference passes.
     debug(1) << "Computing bounds of each function's value\n";
     FuncValueBounds func_bounds = compute_function_value_bounds(order, env);
+    profiler.pass_done("compute_function_value_bounds", s);
 
     // The checks will be in terms of the symbols defined by bounds
     // inference.
     debug(1) << "Adding checks for images\n";
     s = add_image_checks(s, outputs, t, order, env, func_bounds);
+    profiler.pass_done("add_image_checks", s);
     debug(2) << "Lowering after injecting image checks:\n" << s << '\n';
+    profiler.reset();
 
     // This pass injects nested definitions of variable names, so we
     // can't simplify statements from here until we fix them up. (We
     // can still simplify Exprs).
     debug(1) << "Performing computation bounds inference...\n";
     s = bounds_inference(s, outputs, order, env, func_bounds, t);
+    profiler.pass_done("bounds_inference", s);
     debug(2) << "Lowering after computation bounds inference:\n" << s << '\n';
+    profiler.reset();
 
     debug(1) << "Performing sliding window optimization...\n";
     s = sliding_window(s, env);
+    profiler.pass_done("sliding_window", s);
     debug(2) << "Lowering after sliding window:\n" << s << '\n';
+    profiler.reset();
 
     debug(1) << "Performing allocation bounds inference...\n";
     s = allocation_bounds_inference(s, env, func_bounds);
+    profiler.pass_done("allocation_bounds_inference", s);
     debug(2) << "Lowering after allocation bounds inference:\n" << s << '\n';
+    profiler.reset();
 
     debug(1) << "Removing code that depends on undef values...\n";
     s = remove_undef(s);
+    profiler.pass_done("remove_undef", s);
     debug(2) << "Lowering after removing code that depends on undef values:\n" << s << "\n\n";
+    profiler.reset();
 
     // This uniquifies the variable names, so we're good to simplify
     // after this point. This lets later passes assume syntactic
     // equivalence means semantic equivalence.
     debug(1) << "Uniquifying variable names...\n";
     s = uniquify_variable_names(s);
+    profiler.pass_done("uniquify_variable_names", s);
     debug(2) << "Lowering after uniquifying variable names:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Performing storage folding optimization...\n";
     s = storage_folding(s, env);
+    profiler.pass_done("storage_folding", s);
     debug(2) << "Lowering after storage folding:\n" << s << '\n';
+    profiler.reset();
 
     debug(1) << "Injecting debug_to_file calls...\n";
     s = debug_to_file(s, outputs, env);
+    profiler.pass_done("debug_to_file", s);
     debug(2) << "Lowering after injecting debug_to_file calls:\n" << s << '\n';
+    profiler.reset();
 
     debug(1) << "Simplifying...\n"; // without removing dead lets, because storage flattening needs the strides
     s = simplify(s, false);
+    profiler.pass_done("simplify", s);
     debug(2) << "Lowering after first simplification:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Dynamically skipping stages...\n";
     s = skip_stages(s, order);
+    profiler.pass_done("skip_stages", s);
     debug(2) << "Lowering after dynamically skipping stages:\n" << s << "\n\n";
+    profiler.reset();
+
+    debug(1) << "Forking async producers...\n";
+    s = fork_async_producers(s, env);
+    profiler.pass_done("fork_async_producers", s);
+    debug(2) << "Lowering after forking async producers:\n" << s << "\n\n";
+    profiler.reset();
 
     if (t.has_feature(Target::OpenGL) || t.has_feature(Target::Renderscript)) {
         debug(1) << "Injecting image intrinsics...\n";
         s = inject_image_intrinsics(s, env);
+        profiler.pass_done("inject_image_intrinsics", s);
         debug(2) << "Lowering after image intrinsics:\n" << s << "\n\n";
+        profiler.reset();
     }
 
     debug(1) << "Performing storage flattening...\n";
     s = storage_flattening(s, outputs, env, t);
+    profiler.pass_done("storage_flattening", s);
     debug(2) << "Lowering after storage flattening:\n" << s << "\n\n";
+    profiler.reset();
 
     if (any_memoized) {
         debug(1) << "Rewriting memoized allocations...\n";
         s = rewrite_memoized_allocations(s, env);
+        profiler.pass_done("rewrite_memoized_allocations", s);
         debug(2) << "Lowering after rewriting memoized allocations:\n" << s << "\n\n";
+        profiler.reset();
     } else {
         debug(1) << "Skipping rewriting memoized allocations...\n";
     }
@@ -191,17 +264,23 @@ Stmt lower(vector<Function> outputs, const string &pipeline_name, const Target &
         (t.arch != Target::Hexagon && (t.features_any_of({Target::HVX_64, Target::HVX_128})))) {
         debug(1) << "Selecting a GPU API for GPU loops...\n";
         s = select_gpu_api(s, t);
+        profiler.pass_done("select_gpu_api", s);
         debug(2) << "Lowering after selecting a GPU API:\n" << s << "\n\n";
+        profiler.reset();
 
         debug(1) << "Injecting host <-> dev buffer copies...\n";
         s = inject_host_dev_buffer_copies(s, t);
+        profiler.pass_done("inject_host_dev_buffer_copies", s);
         debug(2) << "Lowering after injecting host <-> dev buffer copies:\n" << s << "\n\n";
+        profiler.reset();
     }
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Injecting OpenGL texture intrinsics...\n";
         s = inject_opengl_intrinsics(s);
+        profiler.pass_done("inject_opengl_intrinsics", s);
         debug(2) << "Lowering after OpenGL intrinsics:\n" << s << "\n\n";
+        profiler.reset();
     }
 
     if (t.has_gpu_feature() ||
@@ -209,82 +288,142 @@ Stmt lower(vector<Function> outputs, const string &pipeline_name, const Target &
         t.has_feature(Target::Renderscript)) {
         debug(1) << "Injecting per-block gpu synchronization...\n";
         s = fuse_gpu_thread_loops(s);
+        profiler.pass_done("fuse_gpu_thread_loops", s);
         debug(2) << "Lowering after injecting per-block gpu synchronization:\n" << s << "\n\n";
+        profiler.reset();
     }
 
     debug(1) << "Simplifying...\n";
     s = simplify(s);
+    profiler.pass_done("simplify", s);
     s = unify_duplicate_lets(s);
+    profiler.pass_done("unify_duplicate_lets", s);
     s = remove_trivial_for_loops(s);
+    profiler.pass_done("remove_trivial_for_loops", s);
     debug(2) << "Lowering after second simplifcation:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Unrolling...\n";
     s = unroll_loops(s);
+    profiler.pass_done("unroll_loops", s);
     s = simplify(s);
+    profiler.pass_done("simplify", s);
     debug(2) << "Lowering after unrolling:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Vectorizing...\n";
     s = vectorize_loops(s);
+    profiler.pass_done("vectorize_loops", s);
     s = simplify(s);
+    profiler.pass_done("simplify", s);
     debug(2) << "Lowering after vectorizing:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Detecting vector interleavings...\n";
     s = rewrite_interleavings(s);
+    profiler.pass_done("rewrite_interleavings", s);
     s = simplify(s);
+    profiler.pass_done("simplify", s);
     debug(2) << "Lowering after rewriting vector interleavings:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Partitioning loops to simplify boundary conditions...\n";
     s = partition_loops(s);
+    profiler.pass_done("partition_loops", s);
     s = simplify(s);
+    profiler.pass_done("simplify", s);
     debug(2) << "Lowering after partitioning loops:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Trimming loops to the region over which they do something...\n";
     s = trim_no_ops(s);
+    profiler.pass_done("trim_no_ops", s);
     debug(2) << "Lowering after loop trimming:\n" << s << "\n\n";
+    profiler.reset();
+
+    // Hexagon does a more aggressive version of this during codegen,
+    // after aligning loads. Elsewhere it's opt-in: LLVM keeps the
+    // window in registers, but C compilers may spill it, and lowering
+    // doesn't know which backend the Stmt is for.
+    if (t.arch != Target::Hexagon &&
+        get_env_variable("HL_CARRY_VECTOR_WINDOWS", read) == "1") {
+        debug(1) << "Carrying sliding windows of vector loads across loop iterations...\n";
+        s = carry_vector_windows(s);
+        profiler.pass_done("carry_vector_windows", s);
+        s = simplify(s);
+        profiler.pass_done("simplify", s);
+        debug(2) << "Lowering after carrying sliding windows of vector loads:\n" << s << "\n\n";
+        profiler.reset();
+    }
 
     debug(1) << "Injecting early frees...\n";
     s = inject_early_frees(s);
+    profiler.pass_done("inject_early_frees", s);
     debug(2) << "Lowering after injecting early frees:\n" << s << "\n\n";
+    profiler.reset();
 
     if (t.has_feature(Target::Profile)) {
         debug(1) << "Injecting profiling...\n";
         s = inject_profiling(s, pipeline_name);
+        profiler.pass_done("inject_profiling", s);
         debug(2) << "Lowering after injecting profiling:\n" << s << "\n\n";
+        profiler.reset();
     }
 
     if (t.has_feature(Target::FuzzFloatStores)) {
         debug(1) << "Fuzzing floating point stores...\n";
         s = fuzz_float_stores(s);
+        profiler.pass_done("fuzz_float_stores", s);
         debug(2) << "Lowering after fuzzing floating point stores:\n" << s << "\n\n";
+        profiler.reset();
     }
 
+    debug(1) << "Hoisting allocations out of parallel loops...\n";
+    s = hoist_parallel_allocations(s);
+    profiler.pass_done("hoist_parallel_allocations", s);
+    debug(2) << "Lowering after hoisting allocations out of parallel loops:\n" << s << "\n\n";
+    profiler.reset();
+
     debug(1) << "Simplifying...\n";
     s = common_subexpression_elimination(s);
+    profiler.pass_done("common_subexpression_elimination", s);
 
     if (t.has_feature(Target::OpenGL)) {
         debug(1) << "Detecting varying attributes...\n";
         s = find_linear_expressions(s);
+        profiler.pass_done("find_linear_expressions", s);
         debug(2) << "Lowering after detecting varying attributes:\n" << s << "\n\n";
+        profiler.reset();
 
         debug(1) << "Moving varying attribute expressions out of the shader...\n";
         s = setup_gpu_vertex_buffer(s);
+        profiler.pass_done("setup_gpu_vertex_buffer", s);
         debug(2) << "Lowering after removing varying attributes:\n" << s << "\n\n";
+        profiler.reset();
     }
 
     s = remove_dead_allocations(s);
+    profiler.pass_done("remove_dead_allocations", s);
     s = remove_trivial_for_loops(s);
+    profiler.pass_done("remove_trivial_for_loops", s);
     s = simplify(s);
+    profiler.pass_done("simplify", s);
     debug(1) << "Lowering after final simplification:\n" << s << "\n\n";
+    profiler.reset();
 
     debug(1) << "Splitting off Hexagon offload...\n";
     s = inject_hexagon_rpc(s, t);
+    profiler.pass_done("inject_hexagon_rpc", s);
     debug(2) << "Lowering after splitting off Hexagon offload:\n" << s << '\n';
+    profiler.reset();
 
     if (!custom_passes.empty()) {
         for (size_t i = 0; i < custom_passes.size(); i++) {
             debug(1) << "Running custom lowering pass " << i << "...\n";
             s = custom_passes[i]->mutate(s);
+            profiler.pass_done("custom_pass_" + std::to_string(i), s);
             debug(1) << "Lowering after custom pass " << i << ":\n" << s << "\n\n";
+            profiler.reset();
         }
     }
 
@@ -1,13 +1,17 @@
 #include "Memoization.h"
 #include "Error.h"
+#include "FindCalls.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "IRPrinter.h"
 #include "Param.h"
 #include "Scope.h"
 #include "Util.h"
 #include "Var.h"
 
 #include <map>
+#include <sstream>
+#include <string.h>
 
 namespace Halide {
 namespace Internal {
@@ -109,7 +113,15 @@ public:
         info.type = expr.type();
         info.size_expr = info.type.bytes();
         info.value_expr = expr;
-        dependency_info[DependencyKey(info.type.bytes(), unique_name("memoize_tag"))] = info;
+        // Number the tags in the order they are found, rather than
+        // with unique_name, so that they come in the same order in
+        // the key however many other names were made before.
+        std::ostringstream name;
+        name << "memoize_tag";
+        name.width(8);
+        name.fill('0');
+        name << tag_count++;
+        dependency_info[DependencyKey(info.type.bytes(), name.str())] = info;
     }
 
     // Used to make sure larger parameters come before smaller ones
@@ -139,8 +151,124 @@ public:
     };
 
     std::map<DependencyKey, DependencyInfo> dependency_info;
+    int tag_count = 0;
 };
 
+// Prints the definitions of Funcs for hash_definition. Float
+// constants are printed exactly, and the pure and reduction variables
+// of each definition are printed by position, so that the names given
+// to unnamed Vars and RDoms don't change the result.
+class DefinitionPrinter : public IRPrinter {
+    std::map<std::string, std::string> var_names;
+
+    using IRPrinter::visit;
+
+    void visit(const FloatImm *op) {
+        uint64_t bits;
+        memcpy(&bits, &op->value, sizeof(bits));
+        stream << op->type << "(" << bits << ")";
+    }
+
+    void visit(const Variable *op) {
+        auto it = var_names.find(op->name);
+        if (it != var_names.end() && !op->param.defined()) {
+            stream << it->second;
+        } else {
+            IRPrinter::visit(op);
+        }
+    }
+
+    void print_definition(const std::vector<std::string> &args, const Definition &def) {
+        var_names.clear();
+        for (size_t i = 0; i < args.size(); i++) {
+            var_names[args[i]] = "$" + std::to_string(i);
+        }
+        const std::vector<ReductionVariable> &rvars = def.schedule().rvars();
+        for (size_t i = 0; i < rvars.size(); i++) {
+            stream << "rvar ";
+            print(rvars[i].min);
+            stream << " ";
+            print(rvars[i].extent);
+            stream << "\n";
+            var_names[rvars[i].var] = "$r" + std::to_string(i);
+        }
+        for (Expr e : def.args()) {
+            print(e);
+            stream << " ";
+        }
+        if (def.predicate().defined()) {
+            stream << "where ";
+            print(def.predicate());
+        }
+        stream << " =";
+        for (Expr e : def.values()) {
+            stream << " ";
+            print(e);
+        }
+        stream << "\n";
+    }
+
+public:
+    DefinitionPrinter(std::ostream &s) : IRPrinter(s) {}
+
+    void print_function(const Function &f) {
+        stream << "func " << f.name() << " " << f.dimensions();
+        for (Type t : f.output_types()) {
+            stream << " " << t;
+        }
+        stream << "\n";
+        if (f.has_extern_definition()) {
+            // The pure args of extern definitions are made up names.
+            stream << "extern " << f.extern_function_name()
+                   << " " << f.extern_definition_is_c_plus_plus();
+            var_names.clear();
+            for (const ExternFuncArgument &arg : f.extern_arguments()) {
+                if (arg.is_func()) {
+                    stream << " func " << Function(arg.func).name();
+                } else if (arg.is_expr()) {
+                    stream << " ";
+                    print(arg.expr);
+                } else if (arg.is_buffer()) {
+                    stream << " buffer " << arg.buffer.name();
+                } else if (arg.is_image_param()) {
+                    stream << " param " << arg.image_param.name();
+                }
+            }
+            stream << "\n";
+        } else {
+            const std::vector<std::string> args = f.args();
+            print_definition(args, f.definition());
+            for (const Definition &update : f.updates()) {
+                print_definition(args, update);
+            }
+        }
+    }
+};
+
+// A hash of the definitions of a memoized Func and everything it
+// calls. It goes in the cache key, so that results stored by one
+// build of a program are only found by another if they compute the
+// same thing. Buffer contents aren't part of it, as they aren't part
+// of the key either.
+uint64_t hash_definition(const Function &function) {
+    std::ostringstream text;
+    DefinitionPrinter printer(text);
+    printer.print_function(function);
+    // find_transitive_calls returns a map sorted by name.
+    for (const std::pair<std::string, Function> &i : find_transitive_calls(function)) {
+        if (i.first != function.name()) {
+            printer.print_function(i.second);
+        }
+    }
+
+    // 64-bit FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : text.str()) {
+        h = (h ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    return h;
+}
+
 typedef std::pair<FindParameterDependencies::DependencyKey, FindParameterDependencies::DependencyInfo> DependencyKeyInfoPair;
 
 class KeyInfo {
@@ -148,6 +276,7 @@ class KeyInfo {
     Expr key_size_expr;
     const std::string &top_level_name;
     const std::string &function_name;
+    uint64_t definition_hash;
 
     size_t parameters_alignment() {
         int32_t max_alignment = 0;
@@ -166,20 +295,6 @@ class KeyInfo {
         return (size_t)(1 << i);
     }
 
-// Using the full names in the key results in a (hopefully incredibly
-// slight) performance difference based on how one names filters and
-// functions. It is arguably a little easier to debug if something
-// goes wrong as one doesn't need to destructure the cache key by hand
-// in the debugger. Also, if a pointer is used, a counter must also be
-// put in the cache key to avoid aliasing on reuse of the address in
-// JIT situations where code is regenerated into the same region of
-// memory.
-//
-// There is a plan to change the hash function used in the cache and
-// after that happens, we'll measure performance again and maybe decide
-// to choose one path or the other here and remove the #ifdef.
-#define USE_FULL_NAMES_IN_KEY 0
-#if USE_FULL_NAMES_IN_KEY
     Stmt call_copy_memory(const std::string &key_name, const std::string &value, Expr index) {
         Expr dest = Call::make(Handle(), Call::address_of,
                                {Load::make(UInt(8), key_name, index, BufferPtr(), Parameter())},
@@ -190,21 +305,31 @@ class KeyInfo {
         return Evaluate::make(Call::make(UInt(8), Call::copy_memory,
                                          {dest, src, copy_size}, Call::Intrinsic));
     }
-#endif
+
+    // Pad the key with zero bytes up to a multiple of the given
+    // alignment.
+    void pad_key(std::vector<Stmt> &writes, const std::string &key_name,
+                 Expr &index, size_t &alignment, size_t needed_alignment) {
+        while (alignment % needed_alignment) {
+            writes.push_back(Store::make(key_name, Cast::make(UInt(8), 0), index, Parameter()));
+            index = index + 1;
+            alignment++;
+        }
+    }
 
 public:
   KeyInfo(const Function &function, const std::string &name)
-        : top_level_name(name), function_name(function.name())
+        : top_level_name(name), function_name(function.name()),
+          definition_hash(hash_definition(function))
     {
         dependencies.visit_function(function);
         size_t size_so_far = 0;
 
-#if USE_FULL_NAMES_IN_KEY
-        size_so_far = 4 + (int32_t)((top_level_name.size() + 3) & ~3);
-        size_so_far += 4 + function_name.size();
-#else
-        size_so_far += Handle().bytes() + 4;
-#endif
+        // The names, each padded to four bytes, and the hash of the
+        // definition.
+        size_so_far += 4 + ((top_level_name.size() + 3) & ~3);
+        size_so_far += 4 + ((function_name.size() + 3) & ~3);
+        size_so_far += 8;
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
@@ -228,64 +353,38 @@ public:
         std::vector<Stmt> writes;
         Expr index = Expr(0);
 
-#if USE_FULL_NAMES_IN_KEY
-        // In code below, casts to vec type is done because stores to
-        // the buffer can be unaligned.
-
-        Expr top_level_name_size = (int32_t)top_level_name.size();
-        writes.push_back(Store::make(key_name,
-                                     Cast::make(Int(32), top_level_name_size),
-                                     (index / Int(32).bytes()), Parameter()));
-        index += 4;
-        writes.push_back(call_copy_memory(key_name, top_level_name, index));
-        // Align to four byte boundary again.
-        index += top_level_name_size;
-        size_t alignment = 4 + top_level_name.size();
-        while (alignment % 4) {
-            writes.push_back(Store::make(key_name, Cast::make(UInt(8), 0), index, Parameter()));
-            index = index + 1;
-            alignment++;
+        // The key starts with the names of the pipeline and the Func,
+        // and a hash of the definitions of the Func and everything it
+        // calls. Unlike pointers to the names, these are the same
+        // each time the pipeline is compiled, so keys stay valid
+        // across processes for the disk tier of the cache. In code
+        // below, casts to vec type is done because stores to the
+        // buffer can be unaligned.
+        size_t alignment = 0;
+        for (const std::string &n : {top_level_name, function_name}) {
+            Expr size = (int32_t)n.size();
+            writes.push_back(Store::make(key_name,
+                                         Cast::make(Int(32), size),
+                                         (index / Int(32).bytes()), Parameter()));
+            index += 4;
+            writes.push_back(call_copy_memory(key_name, n, index));
+            index += size;
+            alignment += 4 + n.size();
+            // Align to four byte boundary again.
+            pad_key(writes, key_name, index, alignment, 4);
         }
 
-        Expr name_size = (int32_t)function_name.size();
-        writes.push_back(Store::make(key_name,
-                                     Cast::make(Int(32), name_size),
-                                     (index / Int(32).bytes())));
-        index += 4;
-        writes.push_back(call_copy_memory(key_name, function_name, index));
-        index += name_size;
-        alignment += 4 + function_name.size();
-#else
-        // Store a pointer to a string identifying the filter and
-        // function. Assume this will be unique due to CSE. This can
-        // break with loading and unloading of code, though the name
-        // mechanism can also break in those conditions. For JIT, a
-        // counter is needed as the address may be reused. This isn't
-        // a problem when using full names as the function names
-        // already are uniquefied by a counter.
-        writes.push_back(Store::make(key_name,
-                                     StringImm::make(std::to_string(top_level_name.size()) + ":" + top_level_name +
-                                                     std::to_string(function_name.size()) + ":" + function_name),
-                                     (index / Handle().bytes()), Parameter()));
-        size_t alignment = Handle().bytes();
-        index += Handle().bytes();
-
-        // Halide compilation is not threadsafe anyway...
-        static std::atomic<int> memoize_instance {0};
-        writes.push_back(Store::make(key_name,
-                                     memoize_instance++,
-                                     (index / Int(32).bytes()), Parameter()));
-        alignment += 4;
-        index += 4;
-#endif
+        for (int i = 0; i < 2; i++) {
+            int32_t word = (int32_t)(uint32_t)(definition_hash >> (32 * i));
+            writes.push_back(Store::make(key_name, word,
+                                         (index / Int(32).bytes()), Parameter()));
+            index += 4;
+            alignment += 4;
+        }
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
-            while (alignment % needed_alignment) {
-                writes.push_back(Store::make(key_name, Cast::make(UInt(8), 0), index, Parameter()));
-                index = index + 1;
-                alignment++;
-            }
+            pad_key(writes, key_name, index, alignment, needed_alignment);
         }
 
         for (const DependencyKeyInfoPair &i : dependencies.dependency_info) {
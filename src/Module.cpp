@@ -1,7 +1,13 @@
 #include "Module.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #include "CodeGen_C.h"
 #include "CodeGen_Internal.h"
@@ -76,6 +82,86 @@ Outputs add_suffixes(const Outputs &in, const std::string &suffix) {
     return out;
 }
 
+// The maximum number of threads to compile independent LLVM modules
+// on. Defaults to one per core.
+int num_compile_threads() {
+    size_t read = 0;
+    std::string n = get_env_variable("HL_NUM_COMPILE_THREADS", read);
+    int threads = n.empty() ? (int)std::thread::hardware_concurrency() : std::atoi(n.c_str());
+    return std::max(threads, 1);
+}
+
+// Set on threads running compile jobs, so that jobs that themselves
+// run compile jobs don't oversubscribe the machine.
+thread_local bool in_compile_job = false;
+
+// Run some independent jobs on up to num_compile_threads() threads,
+// including the calling thread. If any job fails, the first error is
+// rethrown on the calling thread once all the jobs are done.
+void run_compile_jobs(const std::vector<std::function<void()>> &jobs) {
+    int num_threads = in_compile_job ? 1 : std::min((int)jobs.size(), num_compile_threads());
+    if (num_threads <= 1) {
+        for (const auto &job : jobs) {
+            job();
+        }
+        return;
+    }
+
+    debug(1) << "Running " << jobs.size() << " compile jobs on " << num_threads << " threads\n";
+
+    std::atomic<size_t> next_job(0);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto worker = [&]() {
+        in_compile_job = true;
+        for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+#ifdef WITH_EXCEPTIONS
+            try {
+#endif
+                jobs[i]();
+#ifdef WITH_EXCEPTIONS
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+#endif
+        }
+        in_compile_job = false;
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// An LLVMContext, and everything in it, may only be used by one
+// thread at a time. Make a copy of a module in another context by
+// round-tripping it through bitcode.
+std::unique_ptr<llvm::Module> copy_module_to_context(llvm::Module &module, llvm::LLVMContext &context) {
+    std::string bitcode;
+    {
+        llvm::raw_string_ostream out(bitcode);
+        WriteBitcodeToFile(&module, out);
+    }
+    auto copy = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bitcode, module.getModuleIdentifier()), context);
+    if (!copy) {
+        internal_error << "Could not copy module " << module.getModuleIdentifier() << "\n";
+    }
+    std::unique_ptr<llvm::Module> result(std::move(*copy));
+    result->setModuleIdentifier(module.getModuleIdentifier());
+    return result;
+}
+
 }  // namespace
 
 struct ModuleContents {
@@ -172,6 +258,7 @@ void Module::compile(const Outputs &output_files) const {
         !output_files.static_library_name.empty()) {
         llvm::LLVMContext context;
         std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(*this, context));
+        bool assembly_emitted = false;
 
         if (!output_files.object_name.empty() || !output_files.static_library_name.empty()) {
             // We must always generate the object files here, either because they are
@@ -186,7 +273,13 @@ void Module::compile(const Outputs &output_files) const {
                 object_name = temp_dir->add_temp_object_file(output_files.static_library_name, "", target());
             }
 
-            {
+            // Emitting object code and assembly each run the LLVM
+            // backend, so if both are requested, emit the assembly
+            // in parallel from a copy of the module.
+            llvm::LLVMContext assembly_context;
+            std::unique_ptr<llvm::Module> assembly_module;
+            std::vector<std::function<void()>> jobs;
+            jobs.push_back([&]() {
                 debug(1) << "Module.compile(): object_name " << object_name << "\n";
                 auto out = make_raw_fd_ostream(object_name);
                 if (target().arch == Target::PNaCl) {
@@ -195,7 +288,19 @@ void Module::compile(const Outputs &output_files) const {
                     compile_llvm_module_to_object(*llvm_module, *out);
                 }
                 out->flush();
+            });
+            if (!output_files.assembly_name.empty() &&
+                target().arch != Target::PNaCl &&
+                !in_compile_job && num_compile_threads() > 1) {
+                assembly_module = copy_module_to_context(*llvm_module, assembly_context);
+                jobs.push_back([&]() {
+                    debug(1) << "Module.compile(): assembly_name " << output_files.assembly_name << "\n";
+                    auto out = make_raw_fd_ostream(output_files.assembly_name);
+                    compile_llvm_module_to_assembly(*assembly_module, *out);
+                });
+                assembly_emitted = true;
             }
+            run_compile_jobs(jobs);
 
             if (!output_files.static_library_name.empty()) {
                 debug(1) << "Module.compile(): static_library_name " << output_files.static_library_name << "\n";
@@ -203,7 +308,7 @@ void Module::compile(const Outputs &output_files) const {
                 create_static_library({object_name}, base_target, output_files.static_library_name);
             }
         }
-        if (!output_files.assembly_name.empty()) {
+        if (!output_files.assembly_name.empty() && !assembly_emitted) {
             debug(1) << "Module.compile(): assembly_name " << output_files.assembly_name << "\n";
             auto out = make_raw_fd_ostream(output_files.assembly_name);
             if (target().arch == Target::PNaCl) {
@@ -299,6 +404,11 @@ void compile_multitarget(const std::string &fn_name,
     TemporaryObjectFileDir temp_dir;
     std::vector<Expr> wrapper_args;
     std::vector<LoweredArgument> base_target_args;
+    // Producing each Module runs user code (e.g. a Generator), which
+    // need not be thread-safe, so that is done serially. The LLVM
+    // codegen for each Module is independent, so the Modules are
+    // compiled in parallel once they have all been produced.
+    std::vector<std::function<void()>> compile_jobs;
     for (const Target &target : targets) {
         // arch-bits-os must be identical across all targets.
         if (target.os != base_target.os ||
@@ -343,7 +453,9 @@ void compile_multitarget(const std::string &fn_name,
         if (sub_out.object_name.empty()) {
             sub_out.object_name = temp_dir.add_temp_object_file(output_files.static_library_name, suffix, target);
         }
-        module.compile(sub_out);
+        compile_jobs.push_back([module, sub_out]() {
+            module.compile(sub_out);
+        });
 
         static_assert(sizeof(uint64_t)*8 >= Target::FeatureEnd, "Features will not fit in uint64_t");
         uint64_t feature_bits = 0;
@@ -368,8 +480,10 @@ void compile_multitarget(const std::string &fn_name,
     // and add that to the result.
     if (!base_target.has_feature(Target::NoRuntime)) {
         const Target runtime_target = base_target.without_feature(Target::NoRuntime);
-        compile_standalone_runtime(Outputs().object(temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target)),
-            runtime_target);
+        const Outputs runtime_out = Outputs().object(temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target));
+        compile_jobs.push_back([runtime_out, runtime_target]() {
+            compile_standalone_runtime(runtime_out, runtime_target);
+        });
     }
 
     Expr indirect_result = Call::make(Int(32), Call::call_cached_indirect_function, wrapper_args, Call::Intrinsic);
@@ -400,7 +514,12 @@ void compile_multitarget(const std::string &fn_name,
 
     Module wrapper_module(fn_name, wrapper_target);
     wrapper_module.append(LoweredFunc(fn_name, base_target_args, wrapper_body, LoweredFunc::External));
-    wrapper_module.compile(Outputs().object(temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true)));
+    const Outputs wrapper_out = Outputs().object(temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true));
+    compile_jobs.push_back([wrapper_module, wrapper_out]() {
+        wrapper_module.compile(wrapper_out);
+    });
+
+    run_compile_jobs(compile_jobs);
 
     if (!output_files.c_header_name.empty()) {
         debug(1) << "compile_multitarget: c_header_name " << output_files.c_header_name << "\n";
@@ -2,6 +2,7 @@
 
 #include "Pipeline.h"
 #include "Argument.h"
+#include "AutoSchedule.h"
 #include "Func.h"
 #include "IRVisitor.h"
 #include "LLVM_Headers.h"
@@ -169,6 +170,16 @@ vector<Func> Pipeline::outputs() const {
     return funcs;
 }
 
+string Pipeline::auto_schedule(const Target &target, const MachineParams &params) {
+    user_assert(defined()) << "Can't auto-schedule an undefined Pipeline.\n";
+    for (Function f : contents->outputs) {
+        user_assert(f.has_pure_definition() || f.has_extern_definition())
+            << "Can't auto-schedule undefined Func.\n";
+    }
+    invalidate_cache();
+    return generate_schedules(contents->outputs, target, params);
+}
+
 void Pipeline::compile_to(const Outputs &output_files,
                           const vector<Argument> &args,
                           const string &fn_name,
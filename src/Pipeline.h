@@ -52,6 +52,28 @@ struct CustomLoweringPass {
 
 struct JITExtern;
 
+/** A description of the machine that Pipeline::auto_schedule should
+ * generate schedules for. */
+struct MachineParams {
+    /** The number of cores, or more generally the amount of
+     * parallelism that is worth exposing. */
+    int parallelism;
+
+    /** The size of the last-level cache in bytes. */
+    int64_t last_level_cache_size;
+
+    /** How much more expensive it is to load a byte from memory than
+     * to do one arithmetic operation. */
+    float balance;
+
+    MachineParams(int parallelism, int64_t llc, float balance) :
+        parallelism(parallelism), last_level_cache_size(llc), balance(balance) {}
+
+    /** Parameters that are reasonable for a typical multi-core x86 or
+     * ARM machine. */
+    EXPORT static MachineParams generic();
+};
+
 /** A class representing a Halide pipeline. Constructed from the Func
  * or Funcs that it outputs. */
 class Pipeline {
@@ -79,6 +101,15 @@ public:
     /** Get the Funcs this pipeline outputs. */
     EXPORT std::vector<Func> outputs() const;
 
+    /** Schedule every Func in the pipeline automatically, using the
+     * estimates set with Func::estimate on the outputs and a simple
+     * model of the costs of computation and memory traffic on the
+     * given machine. Scalar Params are assumed to take their current
+     * values (see Param::set). The Funcs must not already have been
+     * scheduled. Returns the chosen schedule as C++ source. */
+    EXPORT std::string auto_schedule(const Target &target,
+                                     const MachineParams &params = MachineParams::generic());
+
     /** Compile and generate multiple target files with single call.
      * Deduces target files based on filenames specified in
      * output_files struct.
@@ -6,6 +6,7 @@
 #include "Profiling.h"
 #include "CodeGen_Internal.h"
 #include "IRMutator.h"
+#include "IRVisitor.h"
 #include "IROperator.h"
 #include "Scope.h"
 #include "Simplify.h"
@@ -19,11 +20,41 @@ using std::map;
 using std::string;
 using std::vector;
 
+// Count the lanes stored to a Func on each pass through a Stmt,
+// excluding stores nested inside loops or conditionals.
+class CountStores : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &func;
+
+    void visit(const Store *op) {
+        IRVisitor::visit(op);
+        if (op->name == func || starts_with(op->name, func + ".")) {
+            lanes += op->value.type().lanes();
+        }
+    }
+
+    void visit(const For *op) {
+        has_loops = true;
+    }
+
+    void visit(const IfThenElse *op) {
+        op->condition.accept(this);
+    }
+
+public:
+    int lanes = 0;
+    bool has_loops = false;
+
+    CountStores(const string &f) : func(f) {}
+};
+
 class InjectProfiling : public IRMutator {
 public:
     map<string, int> indices;   // maps from func name -> index in buffer.
 
     vector<int> stack; // What produce nodes are we currently inside of.
+    vector<string> producing; // The names of those produce nodes.
 
     string pipeline_name;
 
@@ -35,6 +66,83 @@ public:
     map<int, uint64_t> func_stack_current; // map from func id -> current stack allocation
     map<int, uint64_t> func_stack_peak; // map from func id -> peak stack allocation
 
+    // Whether the code being mutated runs on a host thread with a
+    // profiler slot of its own, as opposed to on an offload target
+    // that reports a single current Func for the whole device.
+    bool profiling_threads = true;
+
+    // The variable holding the profiler slot of the current thread.
+    string thread_name = unique_name("profiler_thread");
+
+    // Report that the current thread is computing the Func with the
+    // given index.
+    Stmt set_current_func(int idx) {
+        Expr profiler_token = Variable::make(Int(32), "profiler_token");
+        Expr call;
+        if (profiling_threads) {
+            Expr profiler_thread = Variable::make(Handle(), thread_name);
+            // This call gets inlined and becomes a single store instruction.
+            call = Call::make(Int(32), "halide_profiler_set_thread_func",
+                              {profiler_thread, profiler_token + idx}, Call::Extern);
+        } else {
+            Expr profiler_state = Variable::make(Handle(), "profiler_state");
+            call = Call::make(Int(32), "halide_profiler_set_current_func",
+                              {profiler_state, profiler_token, idx}, Call::Extern);
+        }
+        return Evaluate::make(call);
+    }
+
+    // Report that the current thread is waiting for work done on
+    // other threads, which bill their own time.
+    Stmt set_thread_idle() {
+        Expr profiler_thread = Variable::make(Handle(), thread_name);
+        // -1 is halide_profiler_outside_of_halide
+        Expr call = Call::make(Int(32), "halide_profiler_set_thread_func",
+                               {profiler_thread, -1}, Call::Extern);
+        return Evaluate::make(call);
+    }
+
+    // Whether the stores being mutated are already counted outside
+    // of the loop they're in.
+    bool stores_counted = false;
+
+    // Add to the number of elements of the current Func the current
+    // thread has computed.
+    Stmt count_elements(Expr n) {
+        Expr profiler_thread = Variable::make(Handle(), thread_name);
+        // This call gets inlined and becomes a single add to memory.
+        Expr call = Call::make(Int(32), "halide_profiler_count_elements",
+                               {profiler_thread, cast<uint64_t>(n)}, Call::Extern);
+        return Evaluate::make(call);
+    }
+
+    // Wrap s, which runs on a thread of its own, so that it claims a
+    // profiler slot on entry and releases it on exit. It starts out
+    // billing the Func it is nested inside.
+    Stmt claim_thread_slot(Stmt s) {
+        s = Block::make(set_current_func(stack.back()), s);
+        Expr profiler_thread = Variable::make(Handle(), thread_name);
+        Expr end_thread = Call::make(Int(32), Call::register_destructor,
+                                     {Expr("halide_profiler_thread_end"), profiler_thread}, Call::Intrinsic);
+        s = Block::make(Evaluate::make(end_thread), s);
+        Expr profiler_pipeline_state = Variable::make(Handle(), "profiler_pipeline_state");
+        Expr start_thread = Call::make(Handle(), "halide_profiler_thread_start",
+                                       {profiler_pipeline_state}, Call::Extern);
+        return LetStmt::make(thread_name, start_thread, s);
+    }
+
+    // Mutate s, which runs on a thread of its own.
+    Stmt mutate_on_own_thread(Stmt s) {
+        string old_thread_name = thread_name;
+        bool old_stores_counted = stores_counted;
+        thread_name = unique_name("profiler_thread");
+        stores_counted = false;
+        s = claim_thread_slot(mutate(s));
+        thread_name = old_thread_name;
+        stores_counted = old_stores_counted;
+        return s;
+    }
+
 private:
     using IRMutator::visit;
 
@@ -187,7 +295,9 @@ private:
         if (op->is_producer) {
             idx = get_func_id(op->name);
             stack.push_back(idx);
+            producing.push_back(op->name);
             body = mutate(op->body);
+            producing.pop_back();
             stack.pop_back();
         } else {
             body = mutate(op->body);
@@ -196,27 +306,58 @@ private:
             idx = stack.back();
         }
 
-        Expr profiler_token = Variable::make(Int(32), "profiler_token");
-        Expr profiler_state = Variable::make(Handle(), "profiler_state");
+        body = Block::make(set_current_func(idx), body);
 
-        // This call gets inlined and becomes a single store instruction.
-        Expr set_task = Call::make(Int(32), "halide_profiler_set_current_func",
-                                   {profiler_state, profiler_token, idx}, Call::Extern);
+        stmt = ProducerConsumer::make(op->name, op->is_producer, body);
+    }
 
-        body = Block::make(Evaluate::make(set_task), body);
+    void visit(const Store *op) {
+        IRMutator::visit(op);
+        if (profiling_threads && !stores_counted && !producing.empty()) {
+            const string &func = producing.back();
+            if (op->name == func || starts_with(op->name, func + ".")) {
+                stmt = Block::make(stmt, count_elements(op->value.type().lanes()));
+            }
+        }
+    }
 
-        stmt = ProducerConsumer::make(op->name, op->is_producer, body);
+    void visit(const IfThenElse *op) {
+        // Stores under a condition are counted where they happen.
+        bool old_stores_counted = stores_counted;
+        stores_counted = false;
+        IRMutator::visit(op);
+        stores_counted = old_stores_counted;
+    }
+
+    void visit(const Fork *op) {
+        if (!profiling_threads) {
+            IRMutator::visit(op);
+            return;
+        }
+        // Each half runs on a thread of its own, so the thread that
+        // forks them bills nothing until they're done.
+        Stmt first = mutate_on_own_thread(op->first);
+        Stmt rest = mutate_on_own_thread(op->rest);
+        stmt = Block::make({set_thread_idle(),
+                            Fork::make(first, rest),
+                            set_current_func(stack.back())});
     }
 
     void visit(const For *op) {
         Stmt body = op->body;
+        Stmt count;
 
-        // The for loop indicates a device transition or a
-        // parallel job launch. Decrement the number of active
-        // threads outside the loop, and increment it inside the
-        // body.
-        bool update_active_threads = (op->device_api == DeviceAPI::Hexagon ||
-                                      op->for_type == ForType::Parallel);
+        // A loop offloaded to the DSP reports its Funcs and active
+        // threads through the profiler state on the DSP. Decrement
+        // the number of active threads outside the loop, and
+        // increment it inside the body.
+        bool update_active_threads = (op->device_api == DeviceAPI::Hexagon);
+
+        // The iterations of a parallel loop on the host run on
+        // threads of their own, which each report their Func.
+        bool parallel_on_host = (op->for_type == ForType::Parallel &&
+                                 (op->device_api == DeviceAPI::None ||
+                                  op->device_api == DeviceAPI::Host));
 
         Expr state = Variable::make(Handle(), "profiler_state");
         Stmt incr_active_threads =
@@ -237,9 +378,12 @@ private:
             // hexagon. We don't support per-func stats remotely,
             // which means we can't do memory accounting.
             bool old_profiling_memory = profiling_memory;
+            bool old_profiling_threads = profiling_threads;
             profiling_memory = false;
+            profiling_threads = false;
             body = mutate(body);
             profiling_memory = old_profiling_memory;
+            profiling_threads = old_profiling_threads;
 
             // Get the profiler state pointer from scratch inside the
             // kernel. There will be a separate copy of the state on
@@ -247,18 +391,50 @@ private:
             Expr get_state = Call::make(Handle(), "halide_profiler_get_state", {}, Call::Extern);
             body = substitute("profiler_state", Variable::make(Handle(), "hvx_profiler_state"), body);
             body = LetStmt::make("hvx_profiler_state", get_state, body);
+        } else if (parallel_on_host && profiling_threads) {
+            body = mutate_on_own_thread(body);
         } else if (op->device_api == DeviceAPI::None ||
                    op->device_api == DeviceAPI::Host) {
-            body = mutate(body);
+            // Rather than counting the elements stored by an innermost
+            // loop one store at a time, count them all before the loop.
+            CountStores counter(producing.empty() ? "" : producing.back());
+            if (profiling_threads && !stores_counted && !producing.empty()) {
+                body.accept(&counter);
+            }
+            if (counter.lanes > 0 && !counter.has_loops) {
+                count = count_elements(cast<uint64_t>(op->extent) * counter.lanes);
+                stores_counted = true;
+                body = mutate(body);
+                stores_counted = false;
+            } else {
+                body = mutate(body);
+            }
         } else {
             body = op->body;
         }
 
         stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
 
+        if (count.defined()) {
+            stmt = Block::make(count, stmt);
+        }
+
         if (update_active_threads) {
             stmt = Block::make({decr_active_threads, stmt, incr_active_threads});
         }
+
+        if (parallel_on_host && profiling_threads) {
+            // Codegen launches the loop that follows this call with
+            // halide_profiler_do_par_for, passing it this thread's
+            // slot, which bills the chunks the thread pool claims the
+            // loop in to the slot's parallel_func.
+            Expr profiler_token = Variable::make(Int(32), "profiler_token");
+            Expr profiler_thread = Variable::make(Handle(), thread_name);
+            Stmt set_parallel_func =
+                Evaluate::make(Call::make(Int(32), "halide_profiler_set_parallel_func",
+                                          {profiler_thread, profiler_token + stack.back()}, Call::Extern));
+            stmt = Block::make({set_parallel_func, set_thread_idle(), stmt, set_current_func(stack.back())});
+        }
     }
 };
 
@@ -294,14 +470,9 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
         s = Block::make(update_stack, s);
     }
 
-    Expr profiler_state = Variable::make(Handle(), "profiler_state");
-    Stmt incr_active_threads =
-        Evaluate::make(Call::make(Int(32), "halide_profiler_incr_active_threads",
-                                  {profiler_state}, Call::Extern));
-    Stmt decr_active_threads =
-        Evaluate::make(Call::make(Int(32), "halide_profiler_decr_active_threads",
-                                  {profiler_state}, Call::Extern));
-    s = Block::make({incr_active_threads, s, decr_active_threads});
+    // The calling thread reports its Funcs through a profiler slot of
+    // its own, like the threads running parallel loop iterations.
+    s = profiling.claim_thread_slot(s);
 
     s = LetStmt::make("profiler_pipeline_state", get_pipeline_state, s);
     s = LetStmt::make("profiler_state", get_state, s);
@@ -45,16 +45,34 @@ class RemoveDeadAllocations : public IRMutator {
     }
 
     void visit(const Allocate *op) {
+        // The size, condition and custom allocator of an allocation
+        // may use other allocations, e.g. a buffer taken from a
+        // scratch pool refers to the pool.
+        std::vector<Expr> extents;
+        bool all_extents_unmodified = true;
+        for (size_t i = 0; i < op->extents.size(); i++) {
+            extents.push_back(mutate(op->extents[i]));
+            all_extents_unmodified &= extents[i].same_as(op->extents[i]);
+        }
+        Expr condition = mutate(op->condition);
+        Expr new_expr;
+        if (op->new_expr.defined()) {
+            new_expr = mutate(op->new_expr);
+        }
+
         allocs.push(op->name, 1);
         Stmt body = mutate(op->body);
 
         if (allocs.contains(op->name)) {
             stmt = body;
             allocs.pop(op->name);
-        } else if (body.same_as(op->body)) {
+        } else if (all_extents_unmodified &&
+                   body.same_as(op->body) &&
+                   condition.same_as(op->condition) &&
+                   new_expr.same_as(op->new_expr)) {
             stmt = op;
         } else {
-            stmt = Allocate::make(op->name, op->type, op->extents, op->condition, body, op->new_expr, op->free_function);
+            stmt = Allocate::make(op->name, op->type, extents, condition, body, new_expr, op->free_function);
         }
     }
 
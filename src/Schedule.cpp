@@ -88,13 +88,15 @@ struct ScheduleContents {
     std::vector<Dim> dims;
     std::vector<StorageDim> storage_dims;
     std::vector<Bound> bounds;
+    std::vector<Bound> estimates;
     std::vector<Prefetch> prefetches;
     std::map<std::string, IntrusivePtr<Internal::FunctionContents>> wrappers;
     bool memoized;
+    bool async;
     bool touched;
     bool allow_race_conditions;
 
-    ScheduleContents() : memoized(false), touched(false), allow_race_conditions(false) {};
+    ScheduleContents() : memoized(false), async(false), touched(false), allow_race_conditions(false) {};
 
     // Pass an IRMutator through to all Exprs referenced in the ScheduleContents
     void mutate(IRMutator *mutator) {
@@ -125,6 +127,14 @@ struct ScheduleContents {
                 b.remainder = mutator->mutate(b.remainder);
             }
         }
+        for (Bound &b : estimates) {
+            if (b.min.defined()) {
+                b.min = mutator->mutate(b.min);
+            }
+            if (b.extent.defined()) {
+                b.extent = mutator->mutate(b.extent);
+            }
+        }
         for (Prefetch &p : prefetches) {
             if (p.offset.defined()) {
                 p.offset = mutator->mutate(p.offset);
@@ -158,8 +168,10 @@ Schedule Schedule::deep_copy(
     copy.contents->dims = contents->dims;
     copy.contents->storage_dims = contents->storage_dims;
     copy.contents->bounds = contents->bounds;
+    copy.contents->estimates = contents->estimates;
     copy.contents->prefetches = contents->prefetches;
     copy.contents->memoized = contents->memoized;
+    copy.contents->async = contents->async;
     copy.contents->touched = contents->touched;
     copy.contents->allow_race_conditions = contents->allow_race_conditions;
 
@@ -187,6 +199,14 @@ bool Schedule::memoized() const {
     return contents->memoized;
 }
 
+bool &Schedule::async() {
+    return contents->async;
+}
+
+bool Schedule::async() const {
+    return contents->async;
+}
+
 bool &Schedule::touched() {
     return contents->touched;
 }
@@ -227,6 +247,14 @@ const std::vector<Bound> &Schedule::bounds() const {
     return contents->bounds;
 }
 
+std::vector<Bound> &Schedule::estimates() {
+    return contents->estimates;
+}
+
+const std::vector<Bound> &Schedule::estimates() const {
+    return contents->estimates;
+}
+
 std::vector<Prefetch> &Schedule::prefetches() {
     return contents->prefetches;
 }
@@ -316,6 +344,14 @@ void Schedule::accept(IRVisitor *visitor) const {
             b.remainder.accept(visitor);
         }
     }
+    for (const Bound &b : estimates()) {
+        if (b.min.defined()) {
+            b.min.accept(visitor);
+        }
+        if (b.extent.defined()) {
+            b.extent.accept(visitor);
+        }
+    }
     for (const Prefetch &p : prefetches()) {
         if (p.offset.defined()) {
             p.offset.accept(visitor);
@@ -225,6 +225,14 @@ public:
     bool memoized() const;
     // @}
 
+    /** This flag is set to true if the function's producer should run
+     * on a thread of its own, concurrently with its consumers. See
+     * Func::async */
+    // @{
+    bool &async();
+    bool async() const;
+    // @}
+
     /** This flag is set to true if the dims list has been manipulated
      * by the user (or if a ScheduleHandle was created that could have
      * been used to manipulate it). It controls the warning that
@@ -277,6 +285,14 @@ public:
     std::vector<Bound> &bounds();
     // @}
 
+    /** Estimates of the region of this function that will be
+     * computed. These have no effect on the generated code; they are
+     * only consumed by the auto-scheduler. See \ref Func::estimate */
+    // @{
+    const std::vector<Bound> &estimates() const;
+    std::vector<Bound> &estimates();
+    // @}
+
     /** You may perform prefetching in some of the dimensions of a
      * function. See \ref Func::prefetch */
     // @{
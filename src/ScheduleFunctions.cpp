@@ -1122,6 +1122,16 @@ void validate_schedule(Function f, Stmt s, const Target &target, bool is_output,
     LoopLevel store_at = f.schedule().store_level();
     LoopLevel compute_at = f.schedule().compute_level();
 
+    if (f.schedule().async()) {
+        user_assert(!is_output)
+            << "Func " << f.name() << " is the output, so can't be scheduled async().\n";
+        user_assert(!compute_at.is_inline())
+            << "Func " << f.name() << " is scheduled async(), so it must be"
+            << " scheduled with compute_at or compute_root.\n";
+        user_assert(!f.schedule().memoized())
+            << "Func " << f.name() << " is scheduled async(), so it can't also be memoized.\n";
+    }
+
     // Outputs must be compute_root and store_root. They're really
     // store_in_user_code, but store_root is close enough.
     if (is_output) {
@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <set>
 #include <stdio.h>
 
 #include "Simplify.h"
@@ -133,12 +134,95 @@ bool propagate_indeterminate_expression(Expr e0, Expr e1, Expr e2, Type t, Expr
            propagate_indeterminate_expression(e2, t, expr);
 }
 
+// Finds the names of everything the simplifier might look up in its
+// scopes while simplifying an Expr.
+class FindSimplifierInputs : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+
+    void visit(const Variable *op) {
+        names.insert(op->name);
+    }
+
+    void visit(const Call *op) {
+        IRGraphVisitor::visit(op);
+        // See Simplify::visit(const Call *).
+        if (op->call_type == Call::Image || op->call_type == Call::Halide) {
+            for (size_t i = 0; i < op->args.size(); i++) {
+                names.insert(op->name + ".stride." + std::to_string(i));
+                names.insert(op->name + ".min." + std::to_string(i));
+            }
+        }
+    }
+
+public:
+    std::set<string> names;
+};
+
+}
+
+struct SimplifyMemo::Contents {
+    struct Key {
+        Expr expr;
+        bool simplify_lets;
+        // For each of the names found by FindSimplifierInputs, in
+        // order: whether it's a let variable and whether it has a
+        // replacement, then its constant bounds and its alignment, if
+        // known.
+        vector<int64_t> facts;
+        // The replacements of those let variables that have one.
+        vector<Expr> replacements;
+        // See ExprWithCompareCache.
+        mutable IRCompareCache *cache;
+
+        bool operator<(const Key &other) const {
+            if (simplify_lets != other.simplify_lets) {
+                return simplify_lets < other.simplify_lets;
+            }
+            if (facts != other.facts) {
+                return facts < other.facts;
+            }
+            for (size_t i = 0; i < replacements.size(); i++) {
+                ExprWithCompareCache a(replacements[i], cache), b(other.replacements[i], cache);
+                if (a < b) return true;
+                if (b < a) return false;
+            }
+            return ExprWithCompareCache(expr, cache) < ExprWithCompareCache(other.expr, cache);
+        }
+    };
+
+    struct Value {
+        Expr result;
+        // How much simplifying the Expr incremented the old_uses and
+        // new_uses of each let variable, which a memoized result must
+        // replay.
+        vector<pair<int, int>> uses;
+    };
+
+    IRCompareCache cache;
+    map<Key, Value> results;
+    int hits, misses;
+
+    Contents() : cache(8), hits(0), misses(0) {}
+};
+
+namespace {
+thread_local SimplifyMemo::Contents *current_simplify_memo = nullptr;
+}
+
+SimplifyMemo::SimplifyMemo() : contents(new Contents), enclosing(current_simplify_memo) {
+    current_simplify_memo = contents.get();
+}
+
+SimplifyMemo::~SimplifyMemo() {
+    debug(1) << "Simplifier memo: " << contents->hits << " hits, "
+             << contents->misses << " misses\n";
+    current_simplify_memo = enclosing;
 }
 
 class Simplify : public IRMutator {
 public:
     Simplify(bool r, const Scope<Interval> *bi, const Scope<ModulusRemainder> *ai) :
-        simplify_lets(r) {
+        simplify_lets(r), expr_depth(0) {
         alignment_info.set_containing_scope(ai);
 
         // Only respect the constant bounds from the containing scope.
@@ -152,7 +236,103 @@ public:
 
     }
 
-    // Uncomment to debug all Expr mutations.
+    Expr mutate(Expr e) {
+        SimplifyMemo::Contents *memo = current_simplify_memo;
+        if (!memo || expr_depth > 0 || !e.defined() ||
+            e.as<Variable>() || is_const(e) || e.as<StringImm>()) {
+            expr_depth++;
+            Expr result = IRMutator::mutate(e);
+            expr_depth--;
+            return result;
+        }
+
+        // Record everything the simplifier knows that could affect
+        // the result. Let variables may be replaced by their values,
+        // which the simplifier then looks at too, so follow
+        // replacements until no new names turn up.
+        FindSimplifierInputs inputs;
+        e.accept(&inputs);
+        vector<string> pending(inputs.names.begin(), inputs.names.end());
+        while (!pending.empty()) {
+            string name = pending.back();
+            pending.pop_back();
+            if (var_info.contains(name) && var_info.ref(name).replacement.defined()) {
+                FindSimplifierInputs more;
+                var_info.ref(name).replacement.accept(&more);
+                for (const string &n : more.names) {
+                    if (inputs.names.insert(n).second) {
+                        pending.push_back(n);
+                    }
+                }
+            }
+        }
+        SimplifyMemo::Contents::Key key;
+        key.expr = e;
+        key.simplify_lets = simplify_lets;
+        key.cache = &memo->cache;
+        vector<VarInfo *> lets;
+        for (const string &name : inputs.names) {
+            VarInfo *info = var_info.contains(name) ? &var_info.ref(name) : nullptr;
+            lets.push_back(info);
+            if (!info) {
+                key.facts.push_back(0);
+            } else if (!info->replacement.defined()) {
+                key.facts.push_back(1);
+            } else {
+                key.facts.push_back(2);
+                key.replacements.push_back(info->replacement);
+            }
+            if (bounds_info.contains(name)) {
+                pair<int64_t, int64_t> b = bounds_info.get(name);
+                key.facts.push_back(1);
+                key.facts.push_back(b.first);
+                key.facts.push_back(b.second);
+            } else {
+                key.facts.push_back(0);
+            }
+            if (alignment_info.contains(name)) {
+                ModulusRemainder mod_rem = alignment_info.get(name);
+                key.facts.push_back(1);
+                key.facts.push_back(mod_rem.modulus);
+                key.facts.push_back(mod_rem.remainder);
+            } else {
+                key.facts.push_back(0);
+            }
+        }
+
+        auto it = memo->results.find(key);
+        if (it != memo->results.end()) {
+            memo->hits++;
+            for (size_t i = 0; i < lets.size(); i++) {
+                if (lets[i]) {
+                    lets[i]->old_uses += it->second.uses[i].first;
+                    lets[i]->new_uses += it->second.uses[i].second;
+                }
+            }
+            return it->second.result;
+        }
+        memo->misses++;
+
+        SimplifyMemo::Contents::Value value;
+        for (VarInfo *info : lets) {
+            value.uses.push_back(info ? make_pair(info->old_uses, info->new_uses) : make_pair(0, 0));
+        }
+        expr_depth++;
+        value.result = IRMutator::mutate(e);
+        expr_depth--;
+        for (size_t i = 0; i < lets.size(); i++) {
+            if (lets[i]) {
+                value.uses[i].first = lets[i]->old_uses - value.uses[i].first;
+                value.uses[i].second = lets[i]->new_uses - value.uses[i].second;
+            }
+        }
+        memo->results.emplace(key, value);
+        return value.result;
+    }
+    using IRMutator::mutate;
+
+    // Uncomment (in place of the mutate above) to debug all Expr
+    // mutations.
     /*
     Expr mutate(Expr e) {
         static int indent = 0;
@@ -176,6 +356,9 @@ public:
 private:
     bool simplify_lets;
 
+    // How many Exprs deep we are. Only the outermost Exprs are memoized.
+    int expr_depth;
+
     struct VarInfo {
         Expr replacement;
         int old_uses, new_uses;
@@ -6,6 +6,7 @@
  */
 
 #include <cmath>
+#include <memory>
 
 #include "IR.h"
 #include "Bounds.h"
@@ -29,6 +30,31 @@ EXPORT Expr simplify(Expr, bool simplify_lets = true,
                      const Scope<ModulusRemainder> &alignment = Scope<ModulusRemainder>::empty_scope());
 // @}
 
+/** While an instance of this class is alive, calls to simplify on the
+ * same thread remember the result of simplifying each top-level Expr
+ * they meet (e.g. each LetStmt value or Store index), along with what
+ * the simplifier knew about the variables it refers to at the
+ * time. When a later call meets an Expr that is equal to one of those
+ * according to IRDeepCompare, in the same context, it reuses the old
+ * result instead of simplifying the Expr again. This pays off when the
+ * same Stmt is simplified repeatedly with little change in between,
+ * as happens across the passes of lowering. lower() uses one if the
+ * environment variable HL_SIMPLIFY_MEMO is set. */
+class SimplifyMemo {
+public:
+    EXPORT SimplifyMemo();
+    EXPORT ~SimplifyMemo();
+
+    struct Contents;
+
+private:
+    std::unique_ptr<Contents> contents;
+    Contents *enclosing;
+
+    SimplifyMemo(const SimplifyMemo &) = delete;
+    void operator=(const SimplifyMemo &) = delete;
+};
+
 /** A common use of the simplifier is to prove boolean expressions are
  * true at compile time. Equivalent to is_one(simplify(e)) */
 EXPORT bool can_prove(Expr e);
@@ -511,6 +511,27 @@ private:
         visit_block_stmt(op->rest);
         stream << close_div();
     }
+    void visit(const Fork *op) {
+        stream << open_div("Fork");
+        int id = unique_id();
+        stream << open_expand_button(id);
+        stream << keyword("fork") << " ";
+        stream << close_expand_button();
+        stream << matched("{");
+        stream << open_div("ForkFirst Indent", id);
+        print(op->first);
+        stream << close_div();
+        stream << matched("}") << " ";
+        id = unique_id();
+        stream << open_expand_button(id);
+        stream << close_expand_button();
+        stream << matched("{");
+        stream << open_div("ForkRest Indent", id);
+        print(op->rest);
+        stream << close_div();
+        stream << matched("}");
+        stream << close_div();
+    }
     void visit(const IfThenElse *op) {
         stream << open_div("IfThenElse");
         int id = unique_id();
@@ -208,7 +208,11 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
                     }
                 }
 
-                if (factor.defined()) {
+                if (factor.defined() && func.schedule().async() && !dims_folded.empty()) {
+                    // The folding semaphore of an async Func counts
+                    // free slots along a single dimension.
+                    debug(3) << "Not folding " << func.name() << " again, because it is async\n";
+                } else if (factor.defined()) {
                     debug(3) << "Proceeding with factor " << factor << "\n";
 
                     Fold fold = {(int)i - 1, factor};
@@ -217,6 +221,46 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
 
                     Expr next_var = Variable::make(Int(32), op->name) + 1;
                     Expr next_min = substitute(op->name, next_var, min);
+
+                    if (func.schedule().async()) {
+                        // The producer runs on another thread, so it
+                        // has to wait for the consumer to be done with
+                        // the slots it is about to overwrite. Before
+                        // each iteration, take the slots for the
+                        // values newly touched from the folding
+                        // semaphore, and after each iteration hand
+                        // back the slots for the values that are no
+                        // longer needed. The producer keeps the
+                        // acquires, and the consumer keeps the
+                        // releases.
+                        Expr loop_var = Variable::make(Int(32), op->name);
+                        Expr first = (loop_var == op->min);
+                        Expr to_acquire, to_release;
+                        if (min_monotonic_increasing) {
+                            Expr prev_max = substitute(op->name, loop_var - 1, max);
+                            to_acquire = select(first, extent, Halide::max(max - prev_max, 0));
+                            to_release = Halide::max(next_min - min, 0);
+                        } else {
+                            Expr prev_min = substitute(op->name, loop_var - 1, min);
+                            Expr next_max = substitute(op->name, next_var, max);
+                            to_acquire = select(first, extent, Halide::max(prev_min - min, 0));
+                            to_release = Halide::max(max - next_max, 0);
+                        }
+                        Expr sem = Variable::make(Handle(), func.name() + ".folding_semaphore");
+                        Expr acquire = Call::make(Int(32), "halide_semaphore_acquire",
+                                                  {sem, simplify(to_acquire)}, Call::Extern);
+                        Expr release = Call::make(Int(32), "halide_semaphore_release",
+                                                  {sem, simplify(to_release)}, Call::Extern);
+                        body = Block::make({AssertStmt::make(acquire == 0, -1),
+                                            body,
+                                            Evaluate::make(release)});
+
+                        // Stop here. Folding inner dimensions as well
+                        // would need a semaphore per dimension.
+                        stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+                        return;
+                    }
+
                     if (can_prove(max < next_min)) {
                         // There's no overlapping usage between loop
                         // iterations, so we can continue to search
@@ -337,6 +381,13 @@ class StorageFolding : public IRMutator {
                     bounds[d] = Range(0, f);
                 }
 
+                if (func.schedule().async()) {
+                    // All the slots of the folded storage start out free.
+                    Expr sem = Call::make(Handle(), Call::make_semaphore,
+                                          {folder.dims_folded[0].factor}, Call::Intrinsic);
+                    body = LetStmt::make(op->name + ".folding_semaphore", sem, body);
+                }
+
                 stmt = Realize::make(op->name, op->types, bounds, op->condition, body);
             }
         }
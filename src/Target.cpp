@@ -127,6 +127,18 @@ Target calculate_host_target() {
         if (have_avx2) {
             initial_features.push_back(Target::AVX2);
         }
+        bool have_avx512f = info2[1] & (1 << 16);
+        if (have_avx2 && have_avx512f) {
+            initial_features.push_back(Target::AVX512);
+            bool have_avx512dq = info2[1] & (1 << 17);
+            bool have_avx512bw = info2[1] & (1 << 30);
+            bool have_avx512vl = info2[1] & (1U << 31);
+            bool have_avx512vnni = info2[2] & (1 << 11);
+            if (have_avx512bw) initial_features.push_back(Target::AVX512_BW);
+            if (have_avx512dq) initial_features.push_back(Target::AVX512_DQ);
+            if (have_avx512vl) initial_features.push_back(Target::AVX512_VL);
+            if (have_avx512vnni) initial_features.push_back(Target::AVX512_VNNI);
+        }
     }
 #ifdef _WIN32
 #ifndef _MSC_VER
@@ -251,6 +263,11 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"fuzz_float_stores", Target::FuzzFloatStores},
     {"soft_float_abi", Target::SoftFloatABI},
     {"msan", Target::MSAN},
+    {"avx512", Target::AVX512},
+    {"avx512_bw", Target::AVX512_BW},
+    {"avx512_dq", Target::AVX512_DQ},
+    {"avx512_vl", Target::AVX512_VL},
+    {"avx512_vnni", Target::AVX512_VNNI},
 };
 
 bool lookup_feature(const std::string &tok, Target::Feature &result) {
@@ -76,6 +76,11 @@ struct Target {
         FuzzFloatStores = halide_target_feature_fuzz_float_stores,
         SoftFloatABI = halide_target_feature_soft_float_abi,
         MSAN = halide_target_feature_msan,
+        AVX512 = halide_target_feature_avx512,
+        AVX512_BW = halide_target_feature_avx512_bw,
+        AVX512_DQ = halide_target_feature_avx512_dq,
+        AVX512_VL = halide_target_feature_avx512_vl,
+        AVX512_VNNI = halide_target_feature_avx512_vnni,
         FeatureEnd = halide_target_feature_end
     };
     Target() : os(OSUnknown), arch(ArchUnknown), bits(0) {}
@@ -220,11 +225,19 @@ struct Target {
         user_assert(os != OSUnknown && arch != ArchUnknown && bits != 0)
             << "natural_vector_size cannot be used on a Target with Unknown values.\n";
 
-        const bool is_avx2 = has_feature(Halide::Target::AVX2);
+        const bool is_avx512 = has_feature(Halide::Target::AVX512);
+        const bool is_avx2 = has_feature(Halide::Target::AVX2) || is_avx512;
         const bool is_avx = has_feature(Halide::Target::AVX) && !is_avx2;
         const bool is_integer = t.is_int() || t.is_uint();
         const int data_size = t.bytes();
 
+        // AVX-512 has 512-bit SIMD registers, but operations on 8 and
+        // 16-bit integers at that width need the BW extension.
+        if (is_avx512 && (!is_integer || data_size >= 4 ||
+                          has_feature(Halide::Target::AVX512_BW))) {
+            return 64 / data_size;
+        }
+
         if (arch == Target::Hexagon) {
             if (is_integer) {
                 // HVX is either 64 or 128 byte vector size.
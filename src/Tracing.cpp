@@ -1,6 +1,8 @@
 #include "Tracing.h"
+#include "Bounds.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "Simplify.h"
 #include "runtime/HalideRuntime.h"
 
 namespace Halide {
@@ -15,18 +17,89 @@ using std::vector;
 using std::map;
 using std::string;
 
+// Replace vectorized loops with no-ops, so that the boxes touched by
+// the rest of a Stmt can be found.
+class StripVectorizedLoops : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        if (op->for_type == ForType::Vectorized) {
+            stmt = Evaluate::make(0);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+};
+
 class InjectTracing : public IRMutator {
 public:
     const map<string, Function> &env;
     int global_level;
+    bool tracing_regions = false;
 
     InjectTracing(const map<string, Function> &e)
         : env(e),
-          global_level(tracing_level()) {}
+          global_level(tracing_level()) {
+        for (const auto &i : env) {
+            tracing_regions = tracing_regions || i.second.is_tracing_regions();
+        }
+    }
 
 private:
     using IRMutator::visit;
 
+    // Make a trace event of the given type for the box of each Func
+    // traced by region (or just the named one) in boxes.
+    Stmt trace_boxes(const map<string, Box> &boxes, halide_trace_event_code event,
+                     const string &only = "") {
+        Stmt result;
+        for (const auto &i : boxes) {
+            if (!only.empty() && i.first != only) continue;
+            map<string, Function>::const_iterator iter = env.find(i.first);
+            if (iter == env.end() || !iter->second.is_tracing_regions()) continue;
+
+            const Box &box = i.second;
+            vector<Expr> args;
+            args.push_back(i.first);
+            args.push_back(event);
+            args.push_back(Variable::make(Int(32), i.first + ".trace_id"));
+            args.push_back(0); // value index
+            args.push_back(0); // value
+            bool bounded = true;
+            for (size_t d = 0; d < box.size(); d++) {
+                if (!box[d].is_bounded()) {
+                    bounded = false;
+                    break;
+                }
+                args.push_back(simplify(box[d].min));
+                args.push_back(simplify(box[d].max - box[d].min + 1));
+            }
+            if (!bounded) continue;
+
+            Stmt call = Evaluate::make(Call::make(Int(32), Call::trace, args, Call::Intrinsic));
+            if (box.maybe_unused()) {
+                call = IfThenElse::make(box.used, call);
+            }
+            result = result.defined() ? Block::make(result, call) : call;
+        }
+        return result;
+    }
+
+    void visit(const For *op) {
+        IRMutator::visit(op);
+        if (tracing_regions && op->for_type == ForType::Vectorized) {
+            // Report the boxes touched by the whole vector up front.
+            Stmt stores = trace_boxes(boxes_provided(stmt), halide_trace_store_region);
+            Stmt loads = trace_boxes(boxes_required(stmt), halide_trace_load_region);
+            if (loads.defined()) {
+                stmt = Block::make(loads, stmt);
+            }
+            if (stores.defined()) {
+                stmt = Block::make(stores, stmt);
+            }
+        }
+    }
+
     void visit(const Call *op) {
 
         // Calls inside of an address_of don't count, but we want to
@@ -166,7 +239,7 @@ private:
             new_body = Block::make(new_body, Evaluate::make(call_after));
             new_body = LetStmt::make(op->name + ".trace_id", call_before, new_body);
             stmt = Realize::make(op->name, op->types, op->bounds, op->condition, new_body);
-        } else if (f.is_tracing_stores() || f.is_tracing_loads()) {
+        } else if (f.is_tracing_stores() || f.is_tracing_loads() || f.is_tracing_regions()) {
             // We need a trace id defined to pass to the loads and stores
             Stmt new_body = op->body;
             new_body = LetStmt::make(op->name + ".trace_id", 0, new_body);
@@ -183,6 +256,24 @@ private:
         map<string, Function>::const_iterator iter = env.find(op->name);
         if (iter == env.end()) return;
         Function f = iter->second;
+        if (f.is_tracing_regions()) {
+            // Report the boxes of the Func touched outside of
+            // vectorized loops, which report their own. A production
+            // can load from the Func in its update definitions.
+            Stmt rest = StripVectorizedLoops().mutate(op->body);
+            Stmt events;
+            if (op->is_producer) {
+                events = trace_boxes(boxes_provided(rest), halide_trace_store_region, op->name);
+            }
+            Stmt loads = trace_boxes(boxes_required(rest), halide_trace_load_region, op->name);
+            if (loads.defined()) {
+                events = events.defined() ? Block::make(events, loads) : loads;
+            }
+            if (events.defined()) {
+                stmt = ProducerConsumer::make(op->name, op->is_producer, Block::make(events, op->body));
+                op = stmt.as<ProducerConsumer>();
+            }
+        }
         if (f.is_tracing_realizations() || global_level > 0) {
             // Throw a tracing call around each pipeline event
             vector<Expr> args;
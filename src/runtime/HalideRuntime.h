@@ -143,6 +143,44 @@ extern struct halide_thread *halide_spawn_thread(void (*f)(void *), void *closur
 /** Join a thread. */
 extern void halide_join_thread(struct halide_thread *);
 
+/** Run size tasks at the same time, each on a thread of its own. The
+ * last task runs on the calling thread. Unlike halide_do_par_for, no
+ * task ever waits for a free thread, so the tasks may block waiting
+ * on each other. Used to run the producers of Funcs scheduled
+ * async() alongside their consumers. Should return zero if all the
+ * tasks return zero, or the return value of one of the failing tasks
+ * otherwise. The default implementation spawns a new thread with
+ * halide_spawn_thread for every task but the last each time it is
+ * called, and joins them before returning; threads are not reused
+ * across calls. On platforms without threads the tasks run one after
+ * the other, in order, and Halide ignores async() when lowering for
+ * them. */
+extern int halide_do_async(void *user_context, halide_task_t task,
+                           int min, int size, uint8_t *closure);
+
+/** A counting semaphore, used by the producers of Funcs scheduled
+ * async() to tell their consumers that data is ready, and by the
+ * consumers to tell the producers that space in a folded buffer is
+ * free. It holds no resources, so it needs no cleanup. */
+struct halide_semaphore_t {
+    uint64_t _private[2];
+};
+
+/** Semaphore operations. halide_semaphore_acquire blocks until the
+ * count is at least n, then takes n from it. Once a semaphore is
+ * closed, an acquire that can't be satisfied fails instead of
+ * blocking, and returns a non-zero value. Each side of an async
+ * pipeline closes the semaphores the other side waits on when it
+ * exits, so that if one side fails the other doesn't wait for it
+ * forever. halide_semaphore_close has the signature of a destructor
+ * for that reason. */
+// @{
+extern int halide_semaphore_init(struct halide_semaphore_t *, int n);
+extern int halide_semaphore_release(struct halide_semaphore_t *, int n);
+extern int halide_semaphore_acquire(struct halide_semaphore_t *, int n);
+extern void halide_semaphore_close(void *user_context, void *semaphore);
+// @}
+
 /** Set the number of threads used by Halide's thread pool. Returns
  * the old number.
  *
@@ -161,6 +199,58 @@ extern void halide_join_thread(struct halide_thread *);
  */
 extern int halide_set_num_threads(int n);
 
+/** Policies the default thread pool can use to hand out the
+ * iterations of a parallel loop to threads. Iterations are claimed in
+ * chunks; claiming more than one at a time amortizes the per-task
+ * overhead of loops with many cheap iterations. */
+enum halide_par_for_schedule_t {
+    /** Each thread claims grain iterations at a time. Idle threads
+     * steal work from busy ones. This is the default, with a grain
+     * of one. */
+    halide_par_for_schedule_dynamic = 0,
+
+    /** The loop is split into equal contiguous blocks, one per
+     * thread, up front. Threads claim grain iterations at a time from
+     * their own block, and only steal once it is exhausted, so a
+     * thread that is busy elsewhere doesn't hold up the loop. Unlike
+     * an OpenMP static schedule, which iterations a thread runs is
+     * therefore not fixed. */
+    halide_par_for_schedule_blocked = 1,
+
+    /** Each thread claims a chunk proportional to the number of
+     * iterations remaining divided by the number of threads, but no
+     * fewer than grain iterations. */
+    halide_par_for_schedule_guided = 2
+};
+
+/** Set the policy used by the default implementation of
+ * halide_do_par_for to hand out parallel loop iterations, and the
+ * minimum number of iterations claimed at once. A grain <= 0 means
+ * one. If this is never called, the policy is taken from the
+ * environment variable HL_PAR_FOR_SCHEDULE, which may be one of
+ * "dynamic", "blocked", or "guided", optionally followed by a colon
+ * and a grain size (e.g. "guided:4"). This is a global setting; to
+ * use a different policy for a particular pipeline, set it before
+ * running that pipeline. Custom implementations of halide_do_par_for
+ * may ignore it. */
+extern void halide_set_par_for_schedule(enum halide_par_for_schedule_t schedule, int grain);
+
+/** Pin the worker threads of the default thread pool to CPUs. Worker
+ * thread i is pinned to cpus[i % num_cpus]. If nodes is not NULL, it
+ * gives the NUMA node (e.g. the socket) of each CPU, and turns on
+ * NUMA mode when there is more than one: each node is handed a
+ * contiguous block of the iterations of every parallel loop, and
+ * idle threads steal work from threads on their own node before
+ * looking elsewhere. Together with the operating system's first-touch
+ * page placement, this keeps the memory a worker produces on its own
+ * node. Passing num_cpus = 0 unpins the workers. If this is never
+ * called, the CPUs are taken from the environment variable
+ * HL_THREAD_AFFINITY, a list of CPUs and ranges where semicolons
+ * separate NUMA nodes, e.g. "0-15,32-47;16-31,48-63". Ignored on
+ * platforms that can't pin threads, and by custom implementations of
+ * halide_do_par_for. */
+extern void halide_set_thread_affinity(int num_cpus, const int *cpus, const int *nodes);
+
 /** Halide calls these functions to allocate and free memory. To
  * replace in AOT code, use the halide_set_custom_malloc and
  * halide_set_custom_free, or (on platforms that support weak
@@ -183,6 +273,23 @@ extern halide_malloc_t halide_set_custom_malloc(halide_malloc_t user_malloc);
 extern halide_free_t halide_set_custom_free(halide_free_t user_free);
 //@}
 
+/** The default halide_malloc on posix platforms can keep freed
+ * allocations of up to 16MB in a pool, sorted into size classes four
+ * to each power of two, and hand them back out to later requests of a
+ * similar size instead of going to the system allocator. Rounding up
+ * to a size class makes each pooled allocation up to 25% larger than
+ * requested. This helps pipelines that
+ * allocate and free the same scratch buffers over and over, e.g. in
+ * Funcs computed inside a tiled or parallel loop. Freed memory is
+ * kept in several separately locked caches picked per thread, so
+ * threads rarely contend. Set the most memory the pool may hold on to
+ * with halide_set_malloc_pool_size; zero (the default) disables it,
+ * and shrinking it returns the pooled memory to the system. If this
+ * is never called, the size is taken from the environment variable
+ * HL_MALLOC_POOL_SIZE. The pool isn't used by custom allocators set
+ * with halide_set_custom_malloc. */
+extern void halide_set_malloc_pool_size(int64_t max_bytes);
+
 /** Halide calls these functions to interact with the underlying
  * system runtime functions. To replace in AOT code on platforms that
  * support weak linking, define these functions yourself.
@@ -284,7 +391,9 @@ enum halide_trace_event_code {halide_trace_load = 0,
                               halide_trace_consume = 5,
                               halide_trace_end_consume = 6,
                               halide_trace_begin_pipeline = 7,
-                              halide_trace_end_pipeline = 8};
+                              halide_trace_end_pipeline = 8,
+                              halide_trace_load_region = 9,
+                              halide_trace_store_region = 10};
 
 #pragma pack(push, 1)
 struct halide_trace_event {
@@ -302,11 +411,10 @@ struct halide_trace_event {
 /** Called when Funcs are marked as trace_load, trace_store, or
  * trace_realization. See Func::set_custom_trace. The default
  * implementation either prints events via halide_printf, or if
- * HL_TRACE_FILE is defined, dumps the trace to that file in a
- * yet-to-be-documented binary format (see src/runtime/tracing.cpp to
- * reverse engineer the format). If the trace is going to be large,
- * you may want to make the file a named pipe, and then read from that
- * pipe into gzip.
+ * HL_TRACE_FILE is defined, dumps the trace to that file in the
+ * binary format described by halide_trace_packet_t. If the trace is
+ * going to be large, you may want to make the file a named pipe, and
+ * then read from that pipe into gzip.
  *
  * halide_trace returns a unique ID which will be passed to future
  * events that "belong" to the earlier event as the parent id. The
@@ -322,6 +430,12 @@ struct halide_trace_event {
  *      end_consume
  *    end_realization
  *
+ * Funcs traced by region (see Func::trace_regions) report the box of
+ * each Func loaded from or stored to by a vectorized loop, production
+ * or consumption with a load_region or store_region event. Its
+ * coordinates are a min and extent for each dimension, like those of
+ * a realization.
+ *
  * Threading means that ownership cannot be inferred from the ordering
  * of events. There can be many active realizations of a given
  * function, or many active productions for a single
@@ -343,6 +457,57 @@ extern halide_trace_t halide_set_custom_trace(halide_trace_t trace);
  * format. */
 extern void halide_set_trace_file(int fd);
 
+/** The header of each packet of a binary trace file. A trace file is
+ * a sequence of packets, each made of this header, followed by the
+ * value of the event (lanes values of the smallest power-of-two
+ * number of bytes that holds type_bits), followed by the event's
+ * coordinates as dimensions int32_ts. All values are in the byte order
+ * of the machine that wrote the trace.
+ *
+ * Halide starts each file it opens or is given with a header packet:
+ * one whose event is halide_trace_file_header, id is
+ * halide_trace_file_magic, and parent_id is the version of the format,
+ * with no value or coordinates. A file named by HL_TRACE_FILE is
+ * truncated when a process first opens it, so it holds the trace of
+ * the last process to write to it, after a single header. Header
+ * packets may still appear later in a file passed to
+ * halide_set_trace_file that already holds a trace. Files with no header
+ * are version 1, which is the version described here. See
+ * util/HalideTraceDump.cpp for a reader. */
+#pragma pack(push, 1)
+struct halide_trace_packet_t {
+    /** The id returned by halide_trace for this event. */
+    int32_t id;
+
+    /** The id of the event this one belongs to. */
+    int32_t parent_id;
+
+    /** The halide_trace_event_code of the event. */
+    uint8_t event;
+
+    /** The halide_type_code_t and bits of the value's type. */
+    uint8_t type_code, type_bits;
+
+    /** The number of lanes of the value, and the number of
+     * coordinates, both clamped to 255. */
+    uint8_t lanes;
+    uint8_t value_index;
+    uint8_t dimensions;
+
+    /** The name of the Func, truncated and zero-terminated. */
+    char func[34];
+};
+#pragma pack(pop)
+
+enum {
+    /** The event code of a trace file header packet. */
+    halide_trace_file_header = 255,
+    /** The id of a trace file header packet: "HTRC". */
+    halide_trace_file_magic = 0x43525448,
+    /** The version of the trace file format Halide writes. */
+    halide_trace_file_version = 1
+};
+
 /** Halide calls this to retrieve the file descriptor to write binary
  * trace events to. The default implementation returns the value set
  * by halide_set_trace_file. Implement it yourself if you wish to use
@@ -351,8 +516,15 @@ extern void halide_set_trace_file(int fd);
  * information to stdout. */
 extern int halide_get_trace_file(void *user_context);
 
+/** Binary trace packets are gathered in memory and written to the
+ * trace file in large chunks: whenever the buffer fills up, at the end
+ * of each pipeline, and when tracing is shut down. This call writes
+ * out any packets still in memory. Returns zero on success. */
+extern int halide_flush_trace(void *user_context);
+
 /** If tracing is writing to a file. This call closes that file
- * (flushing the trace). Returns zero on success. */
+ * (flushing the trace), and frees the buffer that packets are gathered
+ * in. Returns zero on success. */
 extern int halide_shutdown_trace();
 
 /** All Halide GPU or device backend implementations much provide an interface
@@ -469,6 +641,91 @@ extern void halide_memoization_cache_release(void *user_context, void *host);
  */
 extern void halide_memoization_cache_cleanup();
 
+/** Policies the default memoization cache can use to choose which
+ * entries to evict when it is full. */
+enum halide_memoization_cache_eviction_policy_t {
+    /** Evict the least recently used entry. This is the default. */
+    halide_memoization_cache_evict_lru = 0,
+
+    /** Evict by GreedyDual-Size: each entry's priority is the time it
+     * took to compute divided by its size in bytes, plus an inflation
+     * value that rises as entries are evicted, so that entries that
+     * are cheap to recompute per byte go first, and entries that
+     * haven't been used in a while eventually go too. The entry
+     * evicted is the lowest priority one among the few least recently
+     * used entries. */
+    halide_memoization_cache_evict_cost_aware = 1
+};
+
+/** Set the eviction policy of the default memoization cache. */
+extern void halide_memoization_cache_set_eviction_policy(enum halide_memoization_cache_eviction_policy_t policy);
+
+/** Statistics for the whole default memoization cache, accumulated
+ * since the last call to halide_memoization_cache_cleanup. */
+struct halide_memoization_cache_stats_t {
+    /** The number of lookups that found a result, and that didn't. */
+    uint64_t hits, misses;
+
+    /** The number of entries evicted to make room for others. */
+    uint64_t evictions;
+
+    /** The number of bytes of results currently in the cache, and the
+     * size set by halide_memoization_cache_set_size. */
+    int64_t current_bytes, max_bytes;
+
+    /** The number of entries currently in the cache. */
+    uint64_t num_entries;
+
+    /** The number of lookups that missed in memory but were satisfied
+     * by the disk tier, and the number of entries written to it as
+     * they were stored. Both are zero if the disk tier isn't enabled. */
+    uint64_t disk_hits, disk_writes;
+};
+
+/** Statistics for one memoized Func in the default memoization
+ * cache. */
+struct halide_memoization_cache_func_stats_t {
+    /** The name of the Func. Owned by the cache, and valid until
+     * halide_memoization_cache_cleanup is called. */
+    const char *name;
+
+    uint64_t hits, misses, evictions;
+
+    /** The total time spent computing the results of this Func that
+     * were stored in the cache, in nanoseconds. */
+    uint64_t compute_time;
+
+    /** The number of bytes of results of this Func currently in the
+     * cache. */
+    int64_t current_bytes;
+};
+
+/** Enable a second tier for the default memoization cache, backed by
+ * files in the given directory, which must already exist. Entries
+ * are written there as they are stored in memory, and lookups that
+ * miss in memory check it before reporting a miss, so results survive
+ * restarting the process. Cache keys are made from the names of the
+ * pipeline and the Func, a hash of the definitions of the Func and
+ * everything it calls, and the values of the parameters it depends
+ * on, so entries are found by later runs, or new builds, that define
+ * the Func the same way. Each file is checked against the full cache
+ * key and a checksum before it is used. The files take at most max_bytes of
+ * disk space; entries larger than 1/256th of that aren't written. A
+ * max_bytes of zero selects the default of 1GB. Passing NULL for
+ * directory disables the disk tier. If this is never called, the
+ * environment variables HL_MEMOIZATION_CACHE_DIR and
+ * HL_MEMOIZATION_CACHE_DISK_SIZE are used instead. The disk tier is
+ * off by default. */
+extern void halide_memoization_cache_set_disk_tier(const char *directory, int64_t max_bytes);
+
+/** Get statistics for the default memoization cache, and for up to
+ * max_funcs of the Funcs that have used it. Returns the number of
+ * entries written to func_stats. func_stats may be NULL if max_funcs
+ * is zero. */
+extern int halide_memoization_cache_get_stats(struct halide_memoization_cache_stats_t *stats,
+                                              struct halide_memoization_cache_func_stats_t *func_stats,
+                                              int max_funcs);
+
 /** Create a unique file with a name of the form prefixXXXXXsuffix in an arbitrary
  * (but writable) directory; this is typically $TMP or /tmp, but the specific
  * location is not guaranteed. (Note that the exact form of the file name
@@ -728,7 +985,12 @@ typedef enum halide_target_feature_t {
     halide_target_feature_fuzz_float_stores = 35, ///< On every floating point store, set the last bit of the mantissa to zero. Pipelines for which the output is very different with this feature enabled may also produce very different output on different processors.
     halide_target_feature_soft_float_abi = 36, ///< Enable soft float ABI. This only enables the soft float ABI calling convention, which does not necessarily use soft floats.
     halide_target_feature_msan = 37, ///< Enable hooks for MSAN support.
-    halide_target_feature_end = 38 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
+    halide_target_feature_avx512 = 38, ///< Use AVX-512 foundation instructions. Only relevant on x86.
+    halide_target_feature_avx512_bw = 39, ///< Use AVX-512 byte and word instructions. Only relevant on x86.
+    halide_target_feature_avx512_dq = 40, ///< Use AVX-512 doubleword and quadword instructions. Only relevant on x86.
+    halide_target_feature_avx512_vl = 41, ///< Use AVX-512 instructions on 128 and 256-bit vectors. Only relevant on x86.
+    halide_target_feature_avx512_vnni = 42, ///< Use AVX-512 vector neural network instructions. Only relevant on x86.
+    halide_target_feature_end = 43 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
 } halide_target_feature_t;
 
 /** This function is called internally by Halide in some situations to determine
@@ -931,6 +1193,24 @@ struct halide_profiler_func_stats {
     /** The average number of thread pool worker threads active while computing this Func. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
+    /** The number of parallel loop iterations run for this Func by
+     * the default thread pool, and the number of chunks they were
+     * claimed in. Their ratio is the average chunk size chosen by the
+     * parallel loop schedule (see halide_set_par_for_schedule). */
+    uint64_t parallel_tasks, parallel_chunks;
+
+    /** Hardware performance counters read while computing this Func:
+     * cycles, instructions retired, last-level cache misses and
+     * branch mispredictions. Only gathered when the profiler state's
+     * read_counters is set (e.g. by HL_PROFILER_COUNTERS=1), on
+     * platforms that support it. */
+    uint64_t cycles, instructions, cache_misses, branch_misses;
+
+    /** The number of values of this Func computed while the counters
+     * above were being read, counting each update definition
+     * separately. */
+    uint64_t elements;
+
     /** The name of this Func. A global constant string. */
     const char *name;
 
@@ -983,6 +1263,91 @@ struct halide_profiler_pipeline_stats {
     int num_allocs;
 };
 
+/** The most threads the sampling profiler can follow at once. Time
+ * spent on threads beyond this goes unsampled. */
+enum { halide_profiler_max_threads = 256 };
+
+/** The number of hardware performance counters the profiler reads
+ * for each thread: cycles, instructions, last-level cache misses and
+ * branch misses. */
+enum { halide_profiler_num_counters = 4 };
+
+/** The kinds of event the profiler records for its timeline. */
+enum halide_profiler_event_kind {
+    /** A thread claimed a profiler slot for the pipeline whose first
+     * Func has the event's func id. The value is the thread's OS id,
+     * or zero where it isn't known. */
+    halide_profiler_event_thread_start,
+    /** A thread released its slot. */
+    halide_profiler_event_thread_end,
+    /** A thread started computing the Func with the event's id. An
+     * id of halide_profiler_outside_of_halide means it went idle. */
+    halide_profiler_event_func,
+    /** The Func with the event's id allocated or freed heap memory,
+     * leaving the value as its current allocation. */
+    halide_profiler_event_memory
+};
+
+/** An event recorded by the profiler for its timeline. */
+struct halide_profiler_event {
+    /** When the event happened, from halide_current_time_ns. */
+    uint64_t time;
+
+    /** A value whose meaning depends on the kind of event. */
+    uint64_t value;
+
+    /** The id of the Func the event concerns. */
+    int func;
+
+    /** A halide_profiler_event_kind. */
+    int kind;
+};
+
+/** The number of events each thread slot, and the heap, records
+ * before they start overwriting their oldest events. */
+enum { halide_profiler_max_events = 1 << 16 };
+
+/** The state of one thread running profiled Halide code. */
+struct halide_profiler_thread_state {
+    /** The id of the Func this thread is currently computing. Set by
+     * the thread, read periodically by the profiler thread. */
+    int current_func;
+
+    /** The id of the Func whose parallel loop the thread most recently
+     * launched. halide_profiler_do_par_for bills the chunks the
+     * thread pool claims the loop's iterations in to it. */
+    int parallel_func;
+
+    /** Nonzero while a thread is using this slot. */
+    int in_use;
+
+    /** The stats of the pipeline the thread is running. */
+    struct halide_profiler_pipeline_stats *pipeline;
+
+    /** The number of values the thread has computed since its
+     * hardware counters were last read. */
+    uint64_t elements;
+
+    /** The values of the thread's hardware counters when last read. */
+    uint64_t counters[halide_profiler_num_counters];
+
+    /** The OS handles of the hardware counters of the thread with id
+     * counters_thread, valid if counters_open is nonzero. They stay
+     * open when the slot is released, for the next time the same
+     * thread claims it. */
+    int counter_fds[halide_profiler_num_counters];
+    int counters_thread;
+    int counters_open;
+
+    /** A ring buffer of the last halide_profiler_max_events events
+     * recorded by threads using this slot, or NULL if the timeline
+     * isn't being recorded. */
+    struct halide_profiler_event *events;
+
+    /** The number of events ever recorded into the ring buffer. */
+    uint64_t num_events;
+};
+
 /** The global state of the profiler. */
 struct halide_profiler_state {
     /** Guards access to the fields below. If not locked, the sampling
@@ -997,11 +1362,12 @@ struct halide_profiler_state {
     /** An internal id used for bookkeeping. */
     int first_free_id;
 
-    /** The id of the current running Func. Set by the pipeline, read
-     * periodically by the profiler thread. */
+    /** The id of the current running Func, for code that doesn't
+     * report Funcs per-thread (e.g. on a DSP). */
     int current_func;
 
-    /** The number of threads currently doing work. */
+    /** The number of threads currently doing work, for code that
+     * doesn't report Funcs per-thread. */
     int active_threads;
 
     /** A linked list of stats gathered for each pipeline. */
@@ -1014,6 +1380,30 @@ struct halide_profiler_state {
 
     /** Is the profiler thread running. */
     bool started;
+
+    /** Whether threads read hardware performance counters each time
+     * they start or stop computing a Func. Initialized from the
+     * environment variable HL_PROFILER_COUNTERS when the profiler
+     * thread starts. */
+    bool read_counters;
+
+    /** The file to which to write a timeline of the events recorded
+     * on each thread, in the Chrome trace event format, at process
+     * exit. NULL if no timeline is being recorded. Initialized from
+     * the environment variable HL_PROFILER_TIMELINE when the profiler
+     * thread starts. */
+    const char *timeline_file;
+
+    /** A ring buffer of the heap allocation events of all threads,
+     * and the number of events ever recorded into it. */
+    struct halide_profiler_event *memory_events;
+    uint64_t num_memory_events;
+
+    /** A slot for each thread currently running profiled Halide
+     * code. Each pipeline, parallel loop iteration and async producer
+     * claims one on entry, and the profiler thread bills every sample
+     * to the Funcs of all claimed slots. */
+    struct halide_profiler_thread_state threads[halide_profiler_max_threads];
 };
 
 /** Profiler func ids with special meanings. */
@@ -1045,6 +1435,13 @@ extern void halide_profiler_reset();
  * reset. Also happens at process exit. */
 extern void halide_profiler_report(void *user_context);
 
+/** Write the events recorded since the last reset to the given file,
+ * as a timeline in the Chrome trace event format, which can be
+ * viewed in chrome://tracing or Perfetto. Events are only recorded
+ * if HL_PROFILER_TIMELINE names a file, to which the timeline is
+ * also written at process exit. Returns zero on success. */
+extern int halide_profiler_write_timeline(void *user_context, const char *filename);
+
 /// \name "Float16" functions
 /// These functions operate of bits (``uint16_t``) representing a half
 /// precision floating point number (IEEE-754 2008 binary16).
@@ -9,4 +9,20 @@ WEAK int halide_host_cpu_count() {
     return sysconf(97);
 }
 
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
+
+WEAK int halide_set_current_thread_cpu(int cpu) {
+    // A pid of zero means the calling thread.
+    uint64_t mask[16];
+    if (cpu < 0) {
+        memset(mask, 0xff, sizeof(mask));
+    } else if (cpu < (int)(sizeof(mask) * 8)) {
+        memset(mask, 0, sizeof(mask));
+        mask[cpu / 64] = (uint64_t)1 << (cpu % 64);
+    } else {
+        return -1;
+    }
+    return sched_setaffinity(0, sizeof(mask), mask);
+}
+
 }
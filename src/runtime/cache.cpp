@@ -3,12 +3,16 @@
 #include "printer.h"
 #include "scoped_mutex_lock.h"
 
-// This is temporary code. In particular, the hash table is stupid and
-// currently thread safety is accomplished via large granularity spin
-// locks. It is mainly intended to prove the programming model and
-// runtime interface for memoization. We'll improve the implementation
-// later. In the meantime, on some platforms it can be replaced by a
-// platform specific LRU cache such as libcache from Apple.
+extern "C" void *fopen(const char *, const char *);
+extern "C" int fclose(void *);
+extern "C" size_t fwrite(const void *, size_t, size_t, void *);
+extern "C" size_t fread(void *, size_t, size_t, void *);
+extern "C" int rename(const char *, const char *);
+
+// The default memoization cache. Entries are spread over a fixed
+// number of independently locked shards, each with a growable hash
+// table and its own LRU list. On some platforms it can be replaced by
+// a platform specific LRU cache such as libcache from Apple.
 
 namespace Halide { namespace Runtime { namespace Internal {
 
@@ -76,12 +80,23 @@ WEAK bool bounds_equal(const buffer_t &buf1, const buffer_t &buf2) {
 }
 
 // Each host block has extra space to store a header just before the contents.
-// 16 is chosen to keep that alignment.
-// The header holds the cache key hash and pointer to the hash entry.
+// 32 is chosen to fit the header while keeping 16 byte alignment.
+// The header holds the cache key hash, pointer to the hash entry, and
+// the time of the cache miss that allocated the block.
 //
 // This is an optimization the number of cycles it takes for the cache
 // to operate.
-const size_t extra_bytes_host_bytes = 16;
+const size_t extra_bytes_host_bytes = 32;
+
+// Statistics for one memoized Func, identified by the Func name
+// embedded in its cache keys.
+struct CacheFuncStats {
+    CacheFuncStats *next;
+    char *name;
+    uint64_t hits, misses, evictions;
+    uint64_t compute_time;
+    int64_t current_size;
+};
 
 struct CacheEntry {
     CacheEntry *next;
@@ -92,6 +107,15 @@ struct CacheEntry {
     uint32_t hash;
     uint32_t in_use_count; // 0 if none returned from halide_cache_lookup
     uint32_t tuple_count;
+    // The total size of the buffers, and how long they took to
+    // compute, in nanoseconds, as measured from the cache miss to the
+    // store.
+    int64_t size;
+    uint64_t compute_time;
+    // The GreedyDual-Size priority of the entry. Entries with the
+    // lowest priority are evicted first under the cost-aware policy.
+    double priority;
+    CacheFuncStats *stats;
     buffer_t computed_bounds;
     buffer_t buf[1];
     // ADDITIONAL buffer_t STRUCTS HERE
@@ -107,6 +131,7 @@ struct CacheEntry {
 struct CacheBlockHeader {
     CacheEntry *entry;
     uint32_t hash;
+    int64_t miss_time;
 };
 
 WEAK CacheBlockHeader *get_pointer_to_header(uint8_t * host) {
@@ -123,6 +148,10 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
     hash = key_hash;
     in_use_count = 0;
     tuple_count = tuples;
+    size = 0;
+    compute_time = 0;
+    priority = 0;
+    stats = NULL;
 
     key = (uint8_t *)halide_malloc(NULL, key_size);
     if (key == NULL) {
@@ -153,64 +182,269 @@ WEAK buffer_t &CacheEntry::buffer(int32_t i) {
     return buf_ptr[i];
 }
 
-WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size)  {
-    uint32_t h = 5381;
+WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size, uint32_t h = 5381)  {
     for (size_t i = 0; i < key_size; i++) {
       h = (h << 5) + h + key[i];
     }
     return h;
 }
 
-WEAK halide_mutex memoization_lock;
-
-const size_t kHashTableSize = 256;
+// The hash of an entry covers its computed bounds as well as its key,
+// as all the tiles of a Func computed at some loop level share a key,
+// and differ only in their bounds. The result is mixed, as the shard
+// and bucket come from its low bits, and bounds often differ only in
+// their higher bits.
+WEAK uint32_t entry_hash(const uint8_t *key, size_t key_size, const buffer_t &computed_bounds) {
+    uint32_t h = djb_hash(key, key_size);
+    h = djb_hash((const uint8_t *)&computed_bounds.elem_size, sizeof(computed_bounds.elem_size), h);
+    h = djb_hash((const uint8_t *)computed_bounds.min, sizeof(computed_bounds.min), h);
+    h = djb_hash((const uint8_t *)computed_bounds.extent, sizeof(computed_bounds.extent), h);
+    h = djb_hash((const uint8_t *)computed_bounds.stride, sizeof(computed_bounds.stride), h);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
 
-WEAK CacheEntry *cache_entries[kHashTableSize];
+// The cache is split into shards, each with its own lock, hash table
+// and LRU list, so that threads looking up unrelated keys don't
+// serialize on a single lock. The low bits of an entry's hash select the
+// shard, and the remaining bits select the bucket within it.
+const uint32_t kNumShards = 16;
+const size_t kInitialBuckets = 16;
+
+struct CacheShard {
+    // Guards all the fields below.
+    halide_mutex lock;
+
+    // A power-of-two sized hash table of singly linked chains. Grown
+    // when the average chain length exceeds two.
+    CacheEntry **buckets;
+    size_t num_buckets;
+    size_t num_entries;
+
+    // Doubly linked list of all entries in the shard, in order of use.
+    CacheEntry *most_recently_used;
+    CacheEntry *least_recently_used;
+
+    // The number of bytes of buffers held by entries in this shard.
+    int64_t current_size;
+
+    // Statistics for the shard, and for each Func with keys that
+    // hash to it.
+    uint64_t hits, misses, evictions;
+    CacheFuncStats *func_stats;
+
+    // The GreedyDual-Size inflation value: the priority of the most
+    // recently evicted entry. New and reused entries have their
+    // priority set relative to it, so that entries that haven't been
+    // used in a while age out even if they were expensive.
+    double inflation;
+
+    // Keep shards on separate cache lines.
+    uint8_t padding[64];
+};
 
-WEAK CacheEntry *most_recently_used = NULL;
-WEAK CacheEntry *least_recently_used = NULL;
+WEAK CacheShard cache_shards[kNumShards];
 
 const uint64_t kDefaultCacheSize = 1 << 20;
 WEAK int64_t max_cache_size = kDefaultCacheSize;
+
+// The sum of the current_size of all the shards. Updated atomically
+// so that it can be read without taking every shard's lock.
 WEAK int64_t current_cache_size = 0;
 
+WEAK halide_memoization_cache_eviction_policy_t eviction_policy = halide_memoization_cache_evict_lru;
+
+// The number of least recently used entries the cost-aware policy
+// considers when choosing an entry to evict.
+const int kEvictionSamples = 8;
+
+WEAK CacheShard *shard_for_hash(uint32_t h) {
+    return &cache_shards[h % kNumShards];
+}
+
+WEAK CacheEntry **bucket_for_hash(CacheShard *shard, uint32_t h) {
+    return &shard->buckets[(h / kNumShards) & (shard->num_buckets - 1)];
+}
+
+// Double the size of a shard's hash table. If the allocation fails,
+// the shard just keeps its longer chains.
+WEAK void grow_shard(CacheShard *shard) {
+    size_t new_num_buckets = shard->num_buckets ? shard->num_buckets * 2 : kInitialBuckets;
+    CacheEntry **new_buckets = (CacheEntry **)halide_malloc(NULL, new_num_buckets * sizeof(CacheEntry *));
+    if (new_buckets == NULL) {
+        return;
+    }
+    memset(new_buckets, 0, new_num_buckets * sizeof(CacheEntry *));
+
+    CacheEntry **old_buckets = shard->buckets;
+    size_t old_num_buckets = shard->num_buckets;
+    shard->buckets = new_buckets;
+    shard->num_buckets = new_num_buckets;
+    for (size_t i = 0; i < old_num_buckets; i++) {
+        CacheEntry *entry = old_buckets[i];
+        while (entry != NULL) {
+            CacheEntry *next = entry->next;
+            CacheEntry **bucket = bucket_for_hash(shard, entry->hash);
+            entry->next = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+    halide_free(NULL, old_buckets);
+}
+
+WEAK void unlink_from_lru(CacheShard *shard, CacheEntry *entry) {
+    if (entry->less_recent != NULL) {
+        entry->less_recent->more_recent = entry->more_recent;
+    } else {
+        halide_assert(NULL, shard->least_recently_used == entry);
+        shard->least_recently_used = entry->more_recent;
+    }
+    if (entry->more_recent != NULL) {
+        entry->more_recent->less_recent = entry->less_recent;
+    } else {
+        halide_assert(NULL, shard->most_recently_used == entry);
+        shard->most_recently_used = entry->less_recent;
+    }
+    entry->more_recent = NULL;
+    entry->less_recent = NULL;
+}
+
+WEAK void link_as_most_recent(CacheShard *shard, CacheEntry *entry) {
+    entry->more_recent = NULL;
+    entry->less_recent = shard->most_recently_used;
+    if (shard->most_recently_used != NULL) {
+        shard->most_recently_used->more_recent = entry;
+    }
+    shard->most_recently_used = entry;
+    if (shard->least_recently_used == NULL) {
+        shard->least_recently_used = entry;
+    }
+}
+
+WEAK void adjust_cache_size(CacheShard *shard, int64_t delta) {
+    shard->current_size += delta;
+    __sync_add_and_fetch(&current_cache_size, delta);
+}
+
+// Keys made by Halide (see KeyInfo in Memoization.cpp) start with the
+// length-prefixed name of the top level pipeline, padded to four
+// bytes, followed by the length-prefixed name of the memoized Func,
+// then a hash of its definition and the values it depends on. Returns
+// false if the key doesn't look like that.
+WEAK bool key_func_name(const uint8_t *key, int32_t key_size, const char **name, int32_t *name_size) {
+    int32_t len;
+    if (key_size < 4) return false;
+    memcpy(&len, key, 4);
+    if (len < 0 || len > key_size) return false;
+    int32_t offset = 4 + ((len + 3) & ~3);
+    if (offset + 4 > key_size) return false;
+    memcpy(&len, key + offset, 4);
+    offset += 4;
+    if (len < 0 || offset + len > key_size) return false;
+    *name = (const char *)(key + offset);
+    *name_size = len;
+    return true;
+}
+
+// Find the statistics for the Func that made a cache key, creating
+// them if need be. The shard must be locked. Returns NULL if we're
+// out of memory.
+WEAK CacheFuncStats *find_or_create_func_stats(CacheShard *shard, const uint8_t *key, int32_t key_size) {
+    const char *name = "<unknown>";
+    int32_t name_size = 9;
+    key_func_name(key, key_size, &name, &name_size);
+
+    for (CacheFuncStats *f = shard->func_stats; f; f = f->next) {
+        if (strncmp(f->name, name, name_size) == 0 && f->name[name_size] == 0) {
+            return f;
+        }
+    }
+
+    CacheFuncStats *f = (CacheFuncStats *)halide_malloc(NULL, sizeof(CacheFuncStats) + name_size + 1);
+    if (f == NULL) {
+        return NULL;
+    }
+    memset(f, 0, sizeof(CacheFuncStats));
+    f->name = (char *)(f + 1);
+    memcpy(f->name, name, name_size);
+    f->name[name_size] = 0;
+    f->next = shard->func_stats;
+    shard->func_stats = f;
+    return f;
+}
+
+WEAK void update_priority(CacheShard *shard, CacheEntry *entry) {
+    entry->priority = shard->inflation + (double)entry->compute_time / (double)max(entry->size, (int64_t)1);
+}
+
+// Pick the entry to evict from a shard next, or NULL if every entry
+// is in use. The LRU policy takes the least recently used entry. The
+// cost-aware policy takes the lowest priority entry among the few
+// least recently used ones.
+WEAK CacheEntry *choose_eviction_candidate(CacheShard *shard) {
+    CacheEntry *best = NULL;
+    int samples = 0;
+    for (CacheEntry *e = shard->least_recently_used; e != NULL; e = e->more_recent) {
+        if (e->in_use_count != 0) {
+            continue;
+        }
+        if (eviction_policy == halide_memoization_cache_evict_lru) {
+            return e;
+        }
+        if (best == NULL || e->priority < best->priority) {
+            best = e;
+        }
+        if (++samples == kEvictionSamples) {
+            break;
+        }
+    }
+    return best;
+}
+
 #if CACHE_DEBUGGING
-WEAK void validate_cache() {
-    print(NULL) << "validating cache, "
-                << "current size " << current_cache_size
-                << " of maximum " << max_cache_size << "\n";
-    int entries_in_hash_table = 0;
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
+WEAK void validate_shard(CacheShard *shard) {
+    print(NULL) << "validating cache shard, "
+                << "current size " << shard->current_size
+                << " of cache total " << current_cache_size
+                << " and maximum " << max_cache_size << "\n";
+    size_t entries_in_hash_table = 0;
+    for (size_t i = 0; i < shard->num_buckets; i++) {
+        CacheEntry *entry = shard->buckets[i];
         while (entry != NULL) {
             entries_in_hash_table++;
-            if (entry->more_recent == NULL && entry != most_recently_used) {
+            if (entry->more_recent == NULL && entry != shard->most_recently_used) {
                 halide_print(NULL, "cache invalid case 1\n");
                 __builtin_trap();
             }
-            if (entry->less_recent == NULL && entry != least_recently_used) {
+            if (entry->less_recent == NULL && entry != shard->least_recently_used) {
                 halide_print(NULL, "cache invalid case 2\n");
                 __builtin_trap();
             }
             entry = entry->next;
         }
     }
-    int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
+    size_t entries_from_mru = 0;
+    CacheEntry *mru_chain = shard->most_recently_used;
     while (mru_chain != NULL) {
         entries_from_mru++;
         mru_chain = mru_chain->less_recent;
     }
-    int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
+    size_t entries_from_lru = 0;
+    CacheEntry *lru_chain = shard->least_recently_used;
     while (lru_chain != NULL) {
         entries_from_lru++;
         lru_chain = lru_chain->more_recent;
     }
-    print(NULL) << "hash entries " << entries_in_hash_table
-                << ", mru entries " << entries_from_mru
-                << ", lru entries " << entries_from_lru << "\n";
-    if (entries_in_hash_table != entries_from_mru) {
+    print(NULL) << "hash entries " << (uint64_t)entries_in_hash_table
+                << ", mru entries " << (uint64_t)entries_from_mru
+                << ", lru entries " << (uint64_t)entries_from_lru << "\n";
+    if (entries_in_hash_table != entries_from_mru ||
+        entries_in_hash_table != shard->num_entries) {
         halide_print(NULL, "cache invalid case 3\n");
         __builtin_trap();
     }
@@ -221,88 +455,380 @@ WEAK void validate_cache() {
 }
 #endif
 
-WEAK void prune_cache() {
+// Evict least recently used entries that aren't in use from a shard
+// until its size is at most budget. The shard must be locked. The
+// evicted entries are unlinked from the shard and prepended to the
+// evicted list, to be released with release_evicted once the lock is
+// dropped.
+WEAK void prune_shard(CacheShard *shard, int64_t budget, CacheEntry **evicted) {
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_shard(shard);
 #endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != NULL) {
-        CacheEntry *more_recent = prune_candidate->more_recent;
-
-        if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
-                }
-                halide_assert(NULL, prev_hash_entry != NULL);
-                prev_hash_entry->next = prune_candidate->next;
-            }
+    while (shard->current_size > budget) {
+        CacheEntry *prune_candidate = choose_eviction_candidate(shard);
+        if (prune_candidate == NULL) {
+            break;
+        }
 
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
-            }
-            if (more_recent != NULL) {
-                more_recent->less_recent = prune_candidate->less_recent;
-            }
+        // Remove from hash table
+        CacheEntry **prev_hash_entry = bucket_for_hash(shard, prune_candidate->hash);
+        while (*prev_hash_entry != prune_candidate) {
+            halide_assert(NULL, *prev_hash_entry != NULL);
+            prev_hash_entry = &(*prev_hash_entry)->next;
+        }
+        *prev_hash_entry = prune_candidate->next;
+        shard->num_entries--;
 
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
-            }
-            if (prune_candidate->less_recent != NULL) {
-                prune_candidate->less_recent = more_recent;
-            }
+        unlink_from_lru(shard, prune_candidate);
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= buf_size(&prune_candidate->buffer(i));
-            }
+        // Decrease cache used amount.
+        adjust_cache_size(shard, -prune_candidate->size);
 
-            // Deallocate the entry.
-            prune_candidate->destroy();
-            halide_free(NULL, prune_candidate);
+        shard->evictions++;
+        if (prune_candidate->stats) {
+            prune_candidate->stats->evictions++;
+            prune_candidate->stats->current_size -= prune_candidate->size;
         }
+        shard->inflation = max(shard->inflation, prune_candidate->priority);
 
-        prune_candidate = more_recent;
+        prune_candidate->next = *evicted;
+        *evicted = prune_candidate;
     }
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_shard(shard);
 #endif
 }
 
-}}} // namespace Halide::Runtime::Internal
+// The optional disk tier. Entries are written to files in a single
+// directory. The file for an entry is picked by hashing its key and
+// computed bounds into one of a fixed number of slots, so the
+// directory never holds more than kDiskSlots files no matter how many
+// keys there are, and a colliding key simply replaces the old file.
+// Files are written under a temporary name and renamed into place, so
+// readers, including other processes, never see a partial file.
+//
+// A file holds a DiskEntryHeader, the key bytes, and then for each
+// tuple element its bounds and contents. The checksum covers
+// everything after the header. The tier uses stdio rather than mmap
+// so that it works on every platform this module is linked into.
+const uint32_t kDiskMagic = 0x434d4c48; // "HLMC"
+const uint32_t kDiskVersion = 1;
+const uint32_t kDiskSlots = 256;
+const int64_t kDefaultDiskSize = (int64_t)1 << 30;
+
+// elem_size, then min, extent and stride of each dimension.
+const int kPackedBoundsSize = 13;
+
+struct DiskEntryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t key_size;
+    uint32_t tuple_count;
+    uint64_t compute_time;
+    uint64_t payload_size;
+    uint64_t checksum;
+    int32_t computed_bounds[kPackedBoundsSize];
+    int32_t padding;
+};
 
-extern "C" {
+// Guards initialization and changes of the disk tier settings.
+WEAK halide_mutex disk_tier_lock;
+WEAK bool disk_tier_initialized = false;
+WEAK bool disk_tier_enabled = false;
+WEAK char disk_tier_dir[1024];
+WEAK int64_t disk_tier_max_size = kDefaultDiskSize;
+WEAK uint64_t disk_hits = 0;
+WEAK uint64_t disk_writes = 0;
+
+WEAK void set_disk_tier_already_locked(const char *directory, int64_t max_bytes) {
+    if (directory == NULL || directory[0] == 0 ||
+        strlen(directory) + 32 > sizeof(disk_tier_dir)) {
+        disk_tier_enabled = false;
+    } else {
+        strncpy(disk_tier_dir, directory, sizeof(disk_tier_dir));
+        disk_tier_max_size = max_bytes > 0 ? max_bytes : kDefaultDiskSize;
+        disk_tier_enabled = true;
+    }
+    __sync_synchronize();
+    disk_tier_initialized = true;
+}
 
-WEAK void halide_memoization_cache_set_size(int64_t size) {
-    if (size == 0) {
-        size = kDefaultCacheSize;
+// Parse a decimal size, which may not fit in an int. Returns zero,
+// which selects the default size, if there is no number.
+WEAK int64_t parse_size(const char *str) {
+    int64_t result = 0;
+    while (*str >= '0' && *str <= '9' && result < ((int64_t)1 << 59)) {
+        result = result * 10 + (*str++ - '0');
+    }
+    return result;
+}
+
+// A quick check of whether the disk tier is on. The settings
+// themselves must be read with get_disk_tier.
+WEAK bool disk_tier_active() {
+    if (!disk_tier_initialized) {
+        ScopedMutexLock lock(&disk_tier_lock);
+        if (!disk_tier_initialized) {
+            const char *size = getenv("HL_MEMOIZATION_CACHE_DISK_SIZE");
+            set_disk_tier_already_locked(getenv("HL_MEMOIZATION_CACHE_DIR"), size ? parse_size(size) : 0);
+        }
     }
+    return disk_tier_enabled;
+}
 
-    ScopedMutexLock lock(&memoization_lock);
+// Copy the disk tier settings, which
+// halide_memoization_cache_set_disk_tier may change at any time, into
+// dir, which must be as large as disk_tier_dir, and max_size. Returns
+// false if the disk tier is off.
+WEAK bool get_disk_tier(char *dir, int64_t *max_size) {
+    ScopedMutexLock lock(&disk_tier_lock);
+    if (!disk_tier_enabled) {
+        return false;
+    }
+    strncpy(dir, disk_tier_dir, sizeof(disk_tier_dir));
+    *max_size = disk_tier_max_size;
+    return true;
+}
 
-    max_cache_size = size;
-    prune_cache();
+// 64-bit FNV-1a, for file names and checksums.
+const uint64_t kFNVOffsetBasis = 0xcbf29ce484222325ULL;
+
+WEAK uint64_t fnv_hash(uint64_t h, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return h;
 }
 
-WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
-                                         buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers) {
-    uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
+WEAK void pack_bounds(const buffer_t &buf, int32_t *packed) {
+    packed[0] = buf.elem_size;
+    for (int i = 0; i < 4; i++) {
+        packed[1 + i * 3] = buf.min[i];
+        packed[2 + i * 3] = buf.extent[i];
+        packed[3 + i * 3] = buf.stride[i];
+    }
+}
+
+// Write the path of the file for a key in the directory dir into
+// path, which must have room for the directory name plus 32
+// characters.
+WEAK void disk_entry_path(char *path, char *end, const char *dir, const uint8_t *key, size_t key_size,
+                          const int32_t *computed_bounds) {
+    uint64_t h = fnv_hash(kFNVOffsetBasis, key, key_size);
+    h = fnv_hash(h, computed_bounds, kPackedBoundsSize * sizeof(int32_t));
+    char *dst = halide_string_to_string(path, end, dir);
+    dst = halide_string_to_string(dst, end, "/halide_memo_");
+    dst = halide_uint64_to_string(dst, end, h % kDiskSlots, 1);
+    halide_string_to_string(dst, end, ".bin");
+}
+
+// Write an entry to the disk tier, if it fits. Must be called without
+// holding any shard lock.
+WEAK void write_to_disk(CacheEntry *entry) {
+    char dir[sizeof(disk_tier_dir)];
+    int64_t max_size;
+    if (!get_disk_tier(dir, &max_size)) {
+        return;
+    }
+
+    uint64_t payload_size = entry->key_size;
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        payload_size += kPackedBoundsSize * sizeof(int32_t) + buf_size(&entry->buffer(i));
+    }
+    if ((int64_t)(sizeof(DiskEntryHeader) + payload_size) > max_size / kDiskSlots) {
+        return;
+    }
+
+    DiskEntryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kDiskMagic;
+    header.version = kDiskVersion;
+    header.key_size = entry->key_size;
+    header.tuple_count = entry->tuple_count;
+    header.compute_time = entry->compute_time;
+    header.payload_size = payload_size;
+    pack_bounds(entry->computed_bounds, header.computed_bounds);
+
+    uint64_t checksum = fnv_hash(kFNVOffsetBasis, entry->key, entry->key_size);
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        int32_t bounds[kPackedBoundsSize];
+        pack_bounds(entry->buffer(i), bounds);
+        checksum = fnv_hash(checksum, bounds, sizeof(bounds));
+        checksum = fnv_hash(checksum, entry->buffer(i).host, buf_size(&entry->buffer(i)));
+    }
+    header.checksum = checksum;
+
+    char path[sizeof(disk_tier_dir)];
+    disk_entry_path(path, path + sizeof(path), dir, entry->key, entry->key_size, header.computed_bounds);
+
+    // The temporary name must be unique across threads and processes
+    // writing to the same slot.
+    char temp_path[sizeof(disk_tier_dir) + 32];
+    char *end = temp_path + sizeof(temp_path);
+    char *dst = halide_string_to_string(temp_path, end, path);
+    dst = halide_string_to_string(dst, end, ".");
+    dst = halide_uint64_to_string(dst, end, (uint64_t)(uintptr_t)entry ^ halide_current_time_ns(NULL), 1);
+    halide_string_to_string(dst, end, ".tmp");
+
+    void *f = fopen(temp_path, "wb");
+    if (f == NULL) {
+        return;
+    }
+    bool ok = (fwrite(&header, sizeof(header), 1, f) == 1 &&
+               fwrite(entry->key, entry->key_size, 1, f) == 1);
+    for (uint32_t i = 0; ok && i < entry->tuple_count; i++) {
+        int32_t bounds[kPackedBoundsSize];
+        pack_bounds(entry->buffer(i), bounds);
+        ok = (fwrite(bounds, sizeof(bounds), 1, f) == 1 &&
+              fwrite(entry->buffer(i).host, buf_size(&entry->buffer(i)), 1, f) == 1);
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    // rename doesn't replace an existing file on all platforms.
+    if (ok && rename(temp_path, path) != 0) {
+        remove(path);
+        ok = (rename(temp_path, path) == 0);
+    }
+    if (ok) {
+        __sync_add_and_fetch(&disk_writes, 1);
+    } else {
+        remove(temp_path);
+    }
+}
+
+// Try to fill in the buffers for a key from the disk tier. Returns
+// true, and the time it originally took to compute the entry, if a
+// matching intact file was found. The contents of the buffers are
+// undefined if it returns false.
+WEAK bool read_from_disk(void *user_context, const uint8_t *cache_key, int32_t size,
+                         buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers,
+                         uint64_t *compute_time) {
+    char dir[sizeof(disk_tier_dir)];
+    int64_t max_size;
+    if (!get_disk_tier(dir, &max_size)) {
+        return false;
+    }
+
+    int32_t packed_computed_bounds[kPackedBoundsSize];
+    pack_bounds(*computed_bounds, packed_computed_bounds);
 
-    ScopedMutexLock lock(&memoization_lock);
+    char path[sizeof(disk_tier_dir)];
+    disk_entry_path(path, path + sizeof(path), dir, cache_key, size, packed_computed_bounds);
+
+    void *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+
+    // A file for another key that landed in the same slot isn't an
+    // error, but one that fails the checksum is, and is removed.
+    bool corrupt = false;
+    bool ok = false;
+    uint8_t *key = NULL;
+    DiskEntryHeader header;
+    if (fread(&header, sizeof(header), 1, f) == 1 &&
+        header.magic == kDiskMagic &&
+        header.version == kDiskVersion &&
+        header.key_size == (uint32_t)size &&
+        header.tuple_count == (uint32_t)tuple_count &&
+        memcmp(header.computed_bounds, packed_computed_bounds, sizeof(packed_computed_bounds)) == 0) {
+        key = (uint8_t *)halide_malloc(user_context, size);
+    }
+    if (key != NULL && fread(key, size, 1, f) == 1 && keys_equal(key, cache_key, size)) {
+        uint64_t checksum = fnv_hash(kFNVOffsetBasis, key, size);
+        uint64_t payload_size = size;
+        ok = true;
+        for (int32_t i = 0; ok && i < tuple_count; i++) {
+            int32_t bounds[kPackedBoundsSize], expected[kPackedBoundsSize];
+            pack_bounds(*tuple_buffers[i], expected);
+            size_t bytes = buf_size(tuple_buffers[i]);
+            ok = (fread(bounds, sizeof(bounds), 1, f) == 1 &&
+                  memcmp(bounds, expected, sizeof(bounds)) == 0 &&
+                  fread(tuple_buffers[i]->host, bytes, 1, f) == 1);
+            if (ok) {
+                checksum = fnv_hash(checksum, bounds, sizeof(bounds));
+                checksum = fnv_hash(checksum, tuple_buffers[i]->host, bytes);
+                payload_size += sizeof(bounds) + bytes;
+            }
+        }
+        if (ok && (checksum != header.checksum || payload_size != header.payload_size)) {
+            ok = false;
+            corrupt = true;
+        }
+    }
+    halide_free(user_context, key);
+    fclose(f);
+
+    if (corrupt) {
+        remove(path);
+    }
+    if (ok) {
+        *compute_time = header.compute_time;
+    }
+    return ok;
+}
+
+// Free a list of entries evicted by prune_shard. Must be called
+// without holding any shard lock.
+WEAK void release_evicted(CacheEntry *evicted) {
+    while (evicted != NULL) {
+        CacheEntry *next = evicted->next;
+        evicted->destroy();
+        halide_free(NULL, evicted);
+        evicted = next;
+    }
+}
+
+// Each shard's share of the cache. A shard may grow past its budget
+// while the cache as a whole is within max_cache_size.
+WEAK int64_t shard_budget() {
+    return max_cache_size / kNumShards;
+}
+
+// Bring the whole cache back within max_cache_size, pruning every
+// shard other than the one given down to its budget. Must be called
+// without holding any shard lock.
+WEAK void prune_other_shards(CacheShard *skip) {
+    for (uint32_t i = 0; i < kNumShards && current_cache_size > max_cache_size; i++) {
+        CacheShard *shard = &cache_shards[i];
+        if (shard != skip) {
+            CacheEntry *evicted = NULL;
+            {
+                ScopedMutexLock lock(&shard->lock);
+                prune_shard(shard, shard_budget(), &evicted);
+            }
+            release_evicted(evicted);
+        }
+    }
+}
+
+WEAK bool entry_matches(CacheEntry *entry, uint32_t h, const uint8_t *cache_key, int32_t size,
+                        buffer_t *computed_bounds, int32_t tuple_count) {
+    return (entry->hash == h && entry->key_size == (size_t)size &&
+            keys_equal(entry->key, cache_key, size) &&
+            bounds_equal(entry->computed_bounds, *computed_bounds) &&
+            entry->tuple_count == (uint32_t)tuple_count);
+}
+
+// Add a computed entry to the cache. Entries are written through to
+// the disk tier as they are stored, rather than when they are evicted
+// or the cache is cleaned up, so that nothing is lost if the process
+// exits without running the cache's destructor, and so that each entry
+// is written once. Entries that were just read back from the disk
+// tier are not written again.
+WEAK int store_entry(void *user_context, const uint8_t *cache_key, int32_t size,
+                     buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers,
+                     bool write_through) {
+    debug(user_context) << "halide_memoization_cache_store\n";
+
+    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
+    CacheShard *shard = shard_for_hash(h);
+
+    int64_t compute_time = halide_current_time_ns(user_context) - get_pointer_to_header(tuple_buffers[0]->host)->miss_time;
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
+    debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
 
     debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
@@ -314,92 +840,217 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            bounds_equal(entry->computed_bounds, *computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            bool all_bounds_equal = true;
-
-            {
-                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                    buffer_t *buf = tuple_buffers[i];
-                    all_bounds_equal = bounds_equal(entry->buffer(i), *buf);
-                }
-            }
+    CacheEntry *evicted = NULL;
+    CacheEntry *to_write = NULL;
+    {
+        ScopedMutexLock lock(&shard->lock);
 
-            if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    if (entry->less_recent != NULL) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
+        CacheEntry *entry = shard->num_buckets ? *bucket_for_hash(shard, h) : NULL;
+        while (entry != NULL) {
+            if (entry_matches(entry, h, cache_key, size, computed_bounds, tuple_count)) {
+
+                bool all_bounds_equal = true;
+                bool no_host_pointers_equal = true;
+                {
+                    for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                        buffer_t *buf = tuple_buffers[i];
+                        all_bounds_equal = bounds_equal(entry->buffer(i), *buf);
+                        if (entry->buffer(i).host == buf->host) {
+                            no_host_pointers_equal = false;
+                        }
                     }
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    entry->more_recent->less_recent = entry->less_recent;
+                }
+                if (all_bounds_equal) {
+                    halide_assert(user_context, no_host_pointers_equal);
+                    // This entry is still in use by the caller. Mark it as having no cache entry
+                    // so halide_memoization_cache_release can free the buffer.
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
 
-                    entry->more_recent = NULL;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != NULL) {
-                        most_recently_used->more_recent = entry;
                     }
-                    most_recently_used = entry;
+                    return 0;
                 }
+            }
+            entry = entry->next;
+        }
 
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    buffer_t *buf = tuple_buffers[i];
-                    *buf = entry->buffer(i);
-                }
+        uint64_t added_size = 0;
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                buffer_t *buf = tuple_buffers[i];
+                added_size += buf_size(buf);
+            }
+        }
+        adjust_cache_size(shard, added_size);
+
+        if (shard->num_entries >= shard->num_buckets * 2) {
+            grow_shard(shard);
+        }
 
-                entry->in_use_count += tuple_count;
+        void *entry_storage = NULL;
+        if (shard->num_buckets) {
+            entry_storage = halide_malloc(NULL, sizeof(CacheEntry) + sizeof(buffer_t) * (tuple_count - 1));
+        }
+        if (entry_storage == NULL) {
+            adjust_cache_size(shard, -(int64_t)added_size);
 
-                return 0;
+            // This entry is still in use by the caller. Mark it as having no cache entry
+            // so halide_memoization_cache_release can free the buffer.
+            for (int32_t i = 0; i < tuple_count; i++) {
+                get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
             }
+            return 0;
         }
-        entry = entry->next;
-    }
 
-    for (int32_t i = 0; i < tuple_count; i++) {
-        buffer_t *buf = tuple_buffers[i];
+        CacheEntry *new_entry = (CacheEntry *)entry_storage;
+        bool inited = new_entry->init(cache_key, size, h, *computed_bounds, tuple_count, tuple_buffers);
+        if (!inited) {
+            adjust_cache_size(shard, -(int64_t)added_size);
 
-        // See documentation on extra_bytes_host_bytes
-        buf->host = ((uint8_t *)halide_malloc(user_context, buf_size(buf) + extra_bytes_host_bytes));
-        if (buf->host == NULL) {
-            for (int32_t j = i; j > 0; j--) {
-                halide_free(user_context, get_pointer_to_header(tuple_buffers[j - 1]->host));
-                tuple_buffers[j - 1]->host = NULL;
+            // This entry is still in use by the caller. Mark it as having no cache entry
+            // so halide_memoization_cache_release can free the buffer.
+            for (int32_t i = 0; i < tuple_count; i++) {
+                get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
             }
-            return -1;
+
+            halide_free(user_context, new_entry);
+            return 0;
+        }
+
+        new_entry->size = added_size;
+        new_entry->compute_time = max(compute_time, (int64_t)0);
+        new_entry->stats = find_or_create_func_stats(shard, cache_key, size);
+        if (new_entry->stats) {
+            new_entry->stats->compute_time += new_entry->compute_time;
+            new_entry->stats->current_size += new_entry->size;
+        }
+        update_priority(shard, new_entry);
+
+        CacheEntry **bucket = bucket_for_hash(shard, h);
+        new_entry->next = *bucket;
+        *bucket = new_entry;
+        shard->num_entries++;
+        link_as_most_recent(shard, new_entry);
+
+        new_entry->in_use_count = tuple_count;
+
+        for (int32_t i = 0; i < tuple_count; i++) {
+            get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
+        }
+
+        if (write_through) {
+            to_write = new_entry;
+        }
+
+        // The new entry is in use, so this won't evict it.
+        if (current_cache_size > max_cache_size) {
+            prune_shard(shard, shard_budget(), &evicted);
         }
-        buf->host += extra_bytes_host_bytes;
-        CacheBlockHeader *header = get_pointer_to_header(buf->host);
-        header->hash = h;
-        header->entry = NULL;
-    }
 
 #if CACHE_DEBUGGING
-    validate_cache();
+        validate_shard(shard);
 #endif
+    }
 
-    return 1;
+    release_evicted(evicted);
+
+    // The new entry stays in use until the caller releases it, so it
+    // can't be evicted while it's written without the lock held.
+    if (to_write != NULL && disk_tier_active()) {
+        write_to_disk(to_write);
+    }
+
+    // If this shard couldn't make enough room by itself, take it from
+    // the others.
+    if (current_cache_size > max_cache_size) {
+        prune_other_shards(shard);
+    }
+
+    debug(user_context) << "Exiting halide_memoization_cache_store\n";
+
+    return 0;
 }
 
-WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache_key, int32_t size,
-                                        buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers) {
-    debug(user_context) << "halide_memoization_cache_store\n";
+}}} // namespace Halide::Runtime::Internal
 
-    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
+extern "C" {
+
+WEAK void halide_memoization_cache_set_size(int64_t size) {
+    if (size == 0) {
+        size = kDefaultCacheSize;
+    }
 
-    uint32_t index = h % kHashTableSize;
+    max_cache_size = size;
+    for (uint32_t i = 0; i < kNumShards; i++) {
+        CacheShard *shard = &cache_shards[i];
+        CacheEntry *evicted = NULL;
+        {
+            ScopedMutexLock lock(&shard->lock);
+            prune_shard(shard, shard_budget(), &evicted);
+        }
+        release_evicted(evicted);
+    }
+}
 
-    ScopedMutexLock lock(&memoization_lock);
+WEAK void halide_memoization_cache_set_disk_tier(const char *directory, int64_t max_bytes) {
+    ScopedMutexLock lock(&disk_tier_lock);
+    set_disk_tier_already_locked(directory, max_bytes);
+}
+
+WEAK void halide_memoization_cache_set_eviction_policy(halide_memoization_cache_eviction_policy_t policy) {
+    eviction_policy = policy;
+}
+
+WEAK int halide_memoization_cache_get_stats(halide_memoization_cache_stats_t *stats,
+                                            halide_memoization_cache_func_stats_t *func_stats,
+                                            int max_funcs) {
+    memset(stats, 0, sizeof(halide_memoization_cache_stats_t));
+    stats->max_bytes = max_cache_size;
+    stats->disk_hits = disk_hits;
+    stats->disk_writes = disk_writes;
+    int num_funcs = 0;
+    for (uint32_t s = 0; s < kNumShards; s++) {
+        CacheShard *shard = &cache_shards[s];
+        ScopedMutexLock lock(&shard->lock);
+
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->current_bytes += shard->current_size;
+        stats->num_entries += shard->num_entries;
+
+        // The same Func may have keys in many shards, so merge them
+        // by name.
+        for (CacheFuncStats *f = shard->func_stats; f; f = f->next) {
+            int i = 0;
+            while (i < num_funcs && strcmp(func_stats[i].name, f->name) != 0) {
+                i++;
+            }
+            if (i == num_funcs) {
+                if (num_funcs == max_funcs) {
+                    continue;
+                }
+                memset(&func_stats[i], 0, sizeof(halide_memoization_cache_func_stats_t));
+                func_stats[i].name = f->name;
+                num_funcs++;
+            }
+            func_stats[i].hits += f->hits;
+            func_stats[i].misses += f->misses;
+            func_stats[i].evictions += f->evictions;
+            func_stats[i].compute_time += f->compute_time;
+            func_stats[i].current_bytes += f->current_size;
+        }
+    }
+    return num_funcs;
+}
+
+WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
+                                         buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers) {
+    uint32_t h = entry_hash(cache_key, size, *computed_bounds);
+    CacheShard *shard = shard_for_hash(h);
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
+    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
 
     debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
@@ -411,98 +1062,98 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != NULL) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            bounds_equal(entry->computed_bounds, *computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
+    {
+        ScopedMutexLock lock(&shard->lock);
 
-            bool all_bounds_equal = true;
-            bool no_host_pointers_equal = true;
-            {
-                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                    buffer_t *buf = tuple_buffers[i];
-                    all_bounds_equal = bounds_equal(entry->buffer(i), *buf);
-                    if (entry->buffer(i).host == buf->host) {
-                        no_host_pointers_equal = false;
+        CacheEntry *entry = shard->num_buckets ? *bucket_for_hash(shard, h) : NULL;
+        while (entry != NULL) {
+            if (entry_matches(entry, h, cache_key, size, computed_bounds, tuple_count)) {
+
+                bool all_bounds_equal = true;
+
+                {
+                    for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                        buffer_t *buf = tuple_buffers[i];
+                        all_bounds_equal = bounds_equal(entry->buffer(i), *buf);
                     }
                 }
-            }
-            if (all_bounds_equal) {
-                halide_assert(user_context, no_host_pointers_equal);
-                // This entry is still in use by the caller. Mark it as having no cache entry
-                // so halide_memoization_cache_release can free the buffer.
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
 
+                if (all_bounds_equal) {
+                    if (entry != shard->most_recently_used) {
+                        unlink_from_lru(shard, entry);
+                        link_as_most_recent(shard, entry);
+                    }
+                    update_priority(shard, entry);
+
+                    shard->hits++;
+                    if (entry->stats) {
+                        entry->stats->hits++;
+                    }
+
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        buffer_t *buf = tuple_buffers[i];
+                        *buf = entry->buffer(i);
+                    }
+
+                    entry->in_use_count += tuple_count;
+
+                    return 0;
                 }
-                return 0;
             }
+            entry = entry->next;
         }
-        entry = entry->next;
-    }
 
-    uint64_t added_size = 0;
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            buffer_t *buf = tuple_buffers[i];
-            added_size += buf_size(buf);
+        shard->misses++;
+        CacheFuncStats *stats = find_or_create_func_stats(shard, cache_key, size);
+        if (stats) {
+            stats->misses++;
         }
     }
-    current_cache_size += added_size;
-    prune_cache();
 
-    void *entry_storage = halide_malloc(NULL, sizeof(CacheEntry) + sizeof(buffer_t) * (tuple_count - 1));
-    if (entry_storage == NULL) {
-        current_cache_size -= added_size;
+    // It's a miss. Allocating the buffers doesn't touch the cache, so
+    // do it without holding the lock.
+    int64_t miss_time = halide_current_time_ns(user_context);
+    for (int32_t i = 0; i < tuple_count; i++) {
+        buffer_t *buf = tuple_buffers[i];
 
-        // This entry is still in use by the caller. Mark it as having no cache entry
-        // so halide_memoization_cache_release can free the buffer.
-        for (int32_t i = 0; i < tuple_count; i++) {
-            get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+        // See documentation on extra_bytes_host_bytes
+        buf->host = ((uint8_t *)halide_malloc(user_context, buf_size(buf) + extra_bytes_host_bytes));
+        if (buf->host == NULL) {
+            for (int32_t j = i; j > 0; j--) {
+                halide_free(user_context, get_pointer_to_header(tuple_buffers[j - 1]->host));
+                tuple_buffers[j - 1]->host = NULL;
+            }
+            return -1;
         }
-        return 0;
+        buf->host += extra_bytes_host_bytes;
+        CacheBlockHeader *header = get_pointer_to_header(buf->host);
+        header->hash = h;
+        header->entry = NULL;
+        header->miss_time = miss_time;
     }
 
-    CacheEntry *new_entry = (CacheEntry *)entry_storage;
-    bool inited = new_entry->init(cache_key, size, h, *computed_bounds, tuple_count, tuple_buffers);
-    if (!inited) {
-        current_cache_size -= added_size;
-
-        // This entry is still in use by the caller. Mark it as having no cache entry
-        // so halide_memoization_cache_release can free the buffer.
+    // Before reporting a miss, see if the disk tier has it. If so,
+    // store it back into memory as if it had just been computed, with
+    // the time it originally took to compute.
+    uint64_t compute_time = 0;
+    if (disk_tier_active() &&
+        read_from_disk(user_context, cache_key, size, computed_bounds,
+                       tuple_count, tuple_buffers, &compute_time)) {
         for (int32_t i = 0; i < tuple_count; i++) {
-            get_pointer_to_header(tuple_buffers[i]->host)->entry = NULL;
+            get_pointer_to_header(tuple_buffers[i]->host)->miss_time = miss_time - compute_time;
         }
-
-        halide_free(user_context, new_entry);
+        __sync_add_and_fetch(&disk_hits, 1);
+        store_entry(user_context, cache_key, size, computed_bounds,
+                    tuple_count, tuple_buffers, false);
         return 0;
     }
 
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != NULL) {
-        most_recently_used->more_recent = new_entry;
-    }
-    most_recently_used = new_entry;
-    if (least_recently_used == NULL) {
-        least_recently_used = new_entry;
-    }
-    cache_entries[index] = new_entry;
-
-    new_entry->in_use_count = tuple_count;
-
-    for (int32_t i = 0; i < tuple_count; i++) {
-        get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
-    }
-
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
-    debug(user_context) << "Exiting halide_memoization_cache_store\n";
+    return 1;
+}
 
-    return 0;
+WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache_key, int32_t size,
+                                        buffer_t *computed_bounds, int32_t tuple_count, buffer_t **tuple_buffers) {
+    return store_entry(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers, true);
 }
 
 WEAK void halide_memoization_cache_release(void *user_context, void *host) {
@@ -513,12 +1164,13 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == NULL) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
+        CacheShard *shard = shard_for_hash(header->hash);
+        ScopedMutexLock lock(&shard->lock);
 
         halide_assert(user_context, entry->in_use_count > 0);
         entry->in_use_count--;
 #if CACHE_DEBUGGING
-        validate_cache();
+        validate_shard(shard);
 #endif
     }
 
@@ -527,18 +1179,35 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
 
 WEAK void halide_memoization_cache_cleanup() {
     debug(NULL) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = NULL;
-        while (entry != NULL) {
-            CacheEntry *next = entry->next;
-            entry->destroy();
-            halide_free(NULL, entry);
-            entry = next;
+    for (uint32_t s = 0; s < kNumShards; s++) {
+        CacheShard *shard = &cache_shards[s];
+        for (size_t i = 0; i < shard->num_buckets; i++) {
+            CacheEntry *entry = shard->buckets[i];
+            while (entry != NULL) {
+                CacheEntry *next = entry->next;
+                entry->destroy();
+                halide_free(NULL, entry);
+                entry = next;
+            }
+        }
+        halide_free(NULL, shard->buckets);
+        while (shard->func_stats) {
+            CacheFuncStats *next = shard->func_stats->next;
+            halide_free(NULL, shard->func_stats);
+            shard->func_stats = next;
         }
+        shard->hits = shard->misses = shard->evictions = 0;
+        shard->inflation = 0;
+        shard->buckets = NULL;
+        shard->num_buckets = 0;
+        shard->num_entries = 0;
+        shard->most_recently_used = NULL;
+        shard->least_recently_used = NULL;
+        shard->current_size = 0;
+        halide_mutex_destroy(&shard->lock);
     }
     current_cache_size = 0;
-    halide_mutex_destroy(&memoization_lock);
+    disk_hits = disk_writes = 0;
 }
 
 namespace {
@@ -0,0 +1,22 @@
+#include "HalideRuntime.h"
+
+// Hardware performance counters aren't available on this platform.
+
+extern "C" {
+
+WEAK int halide_perf_counters_open(int *fds) {
+    return -1;
+}
+
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *values) {
+    return -1;
+}
+
+WEAK void halide_perf_counters_close(const int *fds) {
+}
+
+WEAK int halide_perf_counters_thread_id() {
+    return 0;
+}
+
+}
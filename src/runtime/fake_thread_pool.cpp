@@ -55,6 +55,14 @@ WEAK int halide_set_num_threads(int n) {
     return 1;
 }
 
+WEAK void halide_set_par_for_schedule(halide_par_for_schedule_t schedule, int grain) {
+    // Parallel loops run serially, so there's nothing to chunk.
+}
+
+WEAK void halide_set_thread_affinity(int num_cpus, const int *cpus, const int *nodes) {
+    // There are no worker threads to pin.
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
@@ -77,4 +85,41 @@ WEAK int halide_do_par_for(void *user_context, halide_task_t f,
   return (*custom_do_par_for)(user_context, f, min, size, closure);
 }
 
+// Without threads, the tasks of an async fork run one after the
+// other, so a semaphore that isn't ready can never become ready, and
+// acquiring it fails instead of blocking. Lowering ignores async()
+// for the targets that use this runtime, so this is only reached by
+// code that calls it directly.
+WEAK int halide_do_async(void *user_context, halide_task_t f,
+                         int min, int size, uint8_t *closure) {
+    for (int x = min; x < min + size; x++) {
+        int result = halide_do_task(user_context, f, x, closure);
+        if (result) {
+            return result;
+        }
+    }
+    return 0;
+}
+
+WEAK int halide_semaphore_init(halide_semaphore_t *sem, int n) {
+    sem->_private[0] = n;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *sem, int n) {
+    sem->_private[0] += n;
+    return 0;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *sem, int n) {
+    if ((int64_t)sem->_private[0] < n) {
+        return -1;
+    }
+    sem->_private[0] -= n;
+    return 0;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *sem) {
+}
+
 }  // extern "C"
@@ -23,6 +23,8 @@ extern dispatch_semaphore_t dispatch_semaphore_create(long value);
 extern long dispatch_semaphore_wait(dispatch_semaphore_t dsema, dispatch_time_t timeout);
 extern long dispatch_semaphore_signal(dispatch_semaphore_t dsema);
 extern void dispatch_release(void *object);
+#define DISPATCH_TIME_NOW (0ull)
+extern dispatch_time_t dispatch_time(dispatch_time_t when, int64_t delta);
 
 
 WEAK int halide_do_task(void *user_context, halide_task_t f, int idx,
@@ -123,6 +125,46 @@ WEAK int default_do_par_for(void *user_context, halide_task_t f,
     return job.exit_status;
 }
 
+struct async_task {
+    void *user_context;
+    halide_task_t f;
+    int idx;
+    uint8_t *closure;
+    int result;
+};
+
+WEAK void async_task_helper(void *arg) {
+    async_task *t = (async_task *)arg;
+    t->result = halide_do_task(t->user_context, t->f, t->idx, t->closure);
+}
+
+// As in thread_pool_common.h, all semaphores share one lock. There
+// are no condition variables here, so waiters sleep on a dispatch
+// semaphore that is signalled once per waiter when any semaphore
+// changes. A waiter can have its wakeup stolen by a later one, so
+// waits time out and re-check every millisecond.
+struct semaphore_state {
+    int64_t value;
+    int64_t closed;
+};
+
+WEAK halide_mutex semaphore_mutex;
+WEAK dispatch_once_t semaphore_wakeup_once;
+WEAK dispatch_semaphore_t semaphore_wakeup;
+WEAK int semaphore_waiters;
+
+WEAK void init_semaphore_wakeup(void *) {
+    semaphore_wakeup = dispatch_semaphore_create(0);
+}
+
+// Must be called with semaphore_mutex held.
+WEAK void wake_semaphore_waiters() {
+    for (int i = 0; i < semaphore_waiters; i++) {
+        dispatch_semaphore_signal(semaphore_wakeup);
+    }
+    semaphore_waiters = 0;
+}
+
 WEAK halide_do_task_t custom_do_task = default_do_task;
 WEAK halide_do_par_for_t custom_do_par_for = default_do_par_for;
 
@@ -161,6 +203,14 @@ WEAK int halide_set_num_threads(int n) {
     return old_custom_num_threads;
 }
 
+WEAK void halide_set_par_for_schedule(halide_par_for_schedule_t schedule, int grain) {
+    // Grand Central Dispatch decides how to hand out iterations.
+}
+
+WEAK void halide_set_thread_affinity(int num_cpus, const int *cpus, const int *nodes) {
+    // Grand Central Dispatch owns the threads, so we can't pin them.
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
@@ -183,4 +233,59 @@ WEAK int halide_do_par_for(void *user_context, halide_task_t f,
   return (*custom_do_par_for)(user_context, f, min, size, closure);
 }
 
+WEAK int halide_do_async(void *user_context, halide_task_t f,
+                         int min, int size, uint8_t *closure) {
+    if (size <= 1) {
+        return size == 1 ? halide_do_task(user_context, f, min, closure) : 0;
+    }
+    async_task t = {user_context, f, min, closure, 0};
+    halide_thread *thread = halide_spawn_thread(async_task_helper, &t);
+    int result = halide_do_async(user_context, f, min + 1, size - 1, closure);
+    halide_join_thread(thread);
+    return t.result ? t.result : result;
+}
+
+WEAK int halide_semaphore_init(halide_semaphore_t *sem, int n) {
+    semaphore_state *s = (semaphore_state *)sem;
+    s->value = n;
+    s->closed = 0;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *sem, int n) {
+    semaphore_state *s = (semaphore_state *)sem;
+    halide_mutex_lock(&semaphore_mutex);
+    s->value += n;
+    wake_semaphore_waiters();
+    halide_mutex_unlock(&semaphore_mutex);
+    return 0;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *sem, int n) {
+    semaphore_state *s = (semaphore_state *)sem;
+    dispatch_once_f(&semaphore_wakeup_once, NULL, init_semaphore_wakeup);
+    halide_mutex_lock(&semaphore_mutex);
+    while (s->value < n && !s->closed) {
+        semaphore_waiters++;
+        halide_mutex_unlock(&semaphore_mutex);
+        dispatch_semaphore_wait(semaphore_wakeup, dispatch_time(DISPATCH_TIME_NOW, 1000000));
+        halide_mutex_lock(&semaphore_mutex);
+    }
+    int result = -1;
+    if (s->value >= n) {
+        s->value -= n;
+        result = 0;
+    }
+    halide_mutex_unlock(&semaphore_mutex);
+    return result;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *sem) {
+    semaphore_state *s = (semaphore_state *)sem;
+    halide_mutex_lock(&semaphore_mutex);
+    s->closed = 1;
+    wake_semaphore_waiters();
+    halide_mutex_unlock(&semaphore_mutex);
+}
+
 }
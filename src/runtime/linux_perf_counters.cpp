@@ -0,0 +1,112 @@
+#include "HalideRuntime.h"
+
+// Reads hardware performance counters through perf_event_open. The
+// syscall numbers vary across platforms, so like linux_clock.cpp this
+// is only used on x86.
+
+#ifndef SYS_PERF_EVENT_OPEN
+
+#ifdef BITS_64
+#define SYS_PERF_EVENT_OPEN 298
+#define SYS_GETTID 186
+#endif
+
+#ifdef BITS_32
+#define SYS_PERF_EVENT_OPEN 336
+#define SYS_GETTID 224
+#endif
+
+#endif
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The first version of struct perf_event_attr, which every kernel
+// with perf events accepts.
+struct perf_event_attr {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+
+#define PERF_TYPE_HARDWARE 0
+#define PERF_COUNT_HW_CPU_CYCLES 0
+#define PERF_COUNT_HW_INSTRUCTIONS 1
+#define PERF_COUNT_HW_CACHE_MISSES 3
+#define PERF_COUNT_HW_BRANCH_MISSES 5
+#define PERF_FORMAT_GROUP 8
+#define PERF_ATTR_FLAG_EXCLUDE_KERNEL 32
+#define PERF_ATTR_FLAG_EXCLUDE_HV 64
+
+// In the order listed for halide_profiler_num_counters.
+WEAK uint64_t perf_counter_configs[halide_profiler_num_counters] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+}}}
+
+extern "C" {
+
+extern int syscall(int num, ...);
+extern ssize_t read(int fd, void *buf, size_t count);
+
+WEAK int halide_perf_counters_open(int *fds) {
+    // The counters are opened as one group, led by the first, so
+    // that they are scheduled onto the hardware together and can be
+    // read with a single syscall. Counting only user-space events
+    // keeps this working at the default perf_event_paranoid level.
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = perf_counter_configs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.flags = PERF_ATTR_FLAG_EXCLUDE_KERNEL | PERF_ATTR_FLAG_EXCLUDE_HV;
+        // A pid of zero and a cpu of -1 means the calling thread, on
+        // whichever cpu it runs.
+        fds[i] = syscall(SYS_PERF_EVENT_OPEN, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+        if (fds[i] < 0) {
+            for (int j = 0; j < i; j++) {
+                close(fds[j]);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *values) {
+    // A group read returns the number of counters, followed by their
+    // values.
+    uint64_t buf[halide_profiler_num_counters + 1];
+    if (read(fds[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf) ||
+        buf[0] != halide_profiler_num_counters) {
+        return -1;
+    }
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        values[i] = buf[i + 1];
+    }
+    return 0;
+}
+
+WEAK void halide_perf_counters_close(const int *fds) {
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        close(fds[i]);
+    }
+}
+
+WEAK int halide_perf_counters_thread_id() {
+    return syscall(SYS_GETTID);
+}
+
+}
@@ -8,4 +8,9 @@ WEAK int halide_host_cpu_count() {
     return sysconf(1);
 }
 
+WEAK int halide_set_current_thread_cpu(int cpu) {
+    // Native Client doesn't let us pin threads.
+    return -1;
+}
+
 }
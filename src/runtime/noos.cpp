@@ -80,6 +80,41 @@ WEAK int halide_do_par_for(void *user_context, halide_task_t f,
   return (*custom_do_par_for)(user_context, f, min, size, closure);
 }
 
+// Lowering ignores async() for NoOS targets, so these are only
+// reached by code that calls them directly. The tasks run one after
+// the other, and semaphores never block. See fake_thread_pool.cpp.
+WEAK int halide_do_async(void *user_context, halide_task_t f,
+                         int min, int size, uint8_t *closure) {
+    for (int x = min; x < min + size; x++) {
+        int result = halide_do_task(user_context, f, x, closure);
+        if (result) {
+            return result;
+        }
+    }
+    return 0;
+}
+
+WEAK int halide_semaphore_init(halide_semaphore_t *sem, int n) {
+    sem->_private[0] = n;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *sem, int n) {
+    sem->_private[0] += n;
+    return 0;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *sem, int n) {
+    if ((int64_t)sem->_private[0] < n) {
+        return -1;
+    }
+    sem->_private[0] -= n;
+    return 0;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *sem) {
+}
+
 
 WEAK void halide_print(void *user_context, const char *msg) {
     (*custom_print)(user_context, msg);
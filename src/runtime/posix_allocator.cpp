@@ -9,22 +9,199 @@ extern void free(void *);
 
 namespace Halide { namespace Runtime { namespace Internal {
 
+// Allocations are aligned to this, and the space before the pointer
+// returned holds the original pointer and the size class.
+const size_t alignment = 128;
+
+// Freed allocations of up to 16MB can be kept in a pool, in size
+// classes starting at 64 bytes. Each power of two is split into four
+// classes, so rounding an allocation up to its class adds at most
+// a quarter to it; with plain power-of-two classes, a buffer
+// just over a power of two would take nearly twice its size. Anything
+// larger, and anything allocated while the pool is disabled, is
+// marked with kNoSizeClass and goes straight back to the system.
+const int kMinSizeClassShift = 6;
+const int kSizeClassesPerShift = 4;
+const int kNumSizeClasses = (24 - kMinSizeClassShift) * kSizeClassesPerShift + 1;
+const size_t kNoSizeClass = ~(size_t)0;
+
+// The pool is spread over several caches, each with its own lock,
+// free lists and share of the pool size. A thread uses the cache
+// picked by the address of its stack, so threads usually get a cache
+// to themselves without needing thread-local storage. The locks are
+// only ever tried: if another thread holds one, the allocation just
+// goes to the system allocator instead of waiting.
+const int kNumPoolCaches = 16;
+
+struct PoolCache {
+    volatile int lock;
+    // Free blocks of each size class, linked through their first word.
+    void *free_list[kNumSizeClasses];
+    // The number of bytes in the free lists.
+    int64_t current_size;
+    // Keep caches on separate cache lines.
+    uint8_t padding[64];
+};
+
+WEAK PoolCache pool_caches[kNumPoolCaches];
+
+// The most memory the pool may hold on to. Zero disables the pool.
+WEAK int64_t pool_max_size = 0;
+// Whether pool_max_size has been set, from HL_MALLOC_POOL_SIZE or by
+// halide_set_malloc_pool_size. One thread at a time moves it from
+// unset to setting, and on to set once pool_max_size is written.
+WEAK volatile int pool_size_state = 0;
+const int kPoolSizeUnset = 0;
+const int kPoolSizeSetting = 1;
+const int kPoolSizeSet = 2;
+
+WEAK size_t size_class_bytes(size_t size_class) {
+    size_t shift = size_class / kSizeClassesPerShift + kMinSizeClassShift;
+    size_t step = size_class % kSizeClassesPerShift;
+    return ((size_t)1 << shift) + step * ((size_t)1 << (shift - 2));
+}
+
+// The smallest size class that holds x bytes.
+WEAK size_t size_class_for(size_t x) {
+    if (x <= size_class_bytes(0)) {
+        return 0;
+    }
+    // x - 1 lies in [2^shift, 2^(shift + 1)), which is covered by the
+    // four classes above 2^shift.
+    size_t shift = 63 - __builtin_clzll((uint64_t)(x - 1));
+    size_t step = (x - 1 - ((size_t)1 << shift)) / ((size_t)1 << (shift - 2)) + 1;
+    size_t size_class = (shift - kMinSizeClassShift) * kSizeClassesPerShift + step;
+    return size_class < kNumSizeClasses ? size_class : kNoSizeClass;
+}
+
+WEAK PoolCache *pool_cache_for_this_thread() {
+    int on_stack;
+    uint32_t page = (uint32_t)((uintptr_t)&on_stack >> 16);
+    return &pool_caches[(page * 2654435761U) >> 28];
+}
+
+WEAK bool try_lock(PoolCache *cache) {
+    return __sync_lock_test_and_set(&cache->lock, 1) == 0;
+}
+
+WEAK void unlock(PoolCache *cache) {
+    __sync_lock_release(&cache->lock);
+}
+
+WEAK void *&block_orig(void *ptr) {
+    return ((void **)ptr)[-1];
+}
+
+WEAK size_t &block_size_class(void *ptr) {
+    return ((size_t *)ptr)[-2];
+}
+
+// Return everything in the pool to the system.
+WEAK void pool_release_all() {
+    for (int i = 0; i < kNumPoolCaches; i++) {
+        PoolCache *cache = &pool_caches[i];
+        while (!try_lock(cache)) { }
+        for (int c = 0; c < kNumSizeClasses; c++) {
+            void *ptr = cache->free_list[c];
+            while (ptr != NULL) {
+                void *next = *(void **)ptr;
+                free(block_orig(ptr));
+                ptr = next;
+            }
+            cache->free_list[c] = NULL;
+        }
+        cache->current_size = 0;
+        unlock(cache);
+    }
+}
+
+// Wait until no other thread is setting the size of the pool, and
+// claim the right to set it. Returns the state it was in before.
+WEAK int begin_setting_pool_size() {
+    while (true) {
+        int state = pool_size_state;
+        if (state != kPoolSizeSetting &&
+            __sync_bool_compare_and_swap(&pool_size_state, state, kPoolSizeSetting)) {
+            return state;
+        }
+    }
+}
+
+WEAK void end_setting_pool_size() {
+    __sync_synchronize();
+    pool_size_state = kPoolSizeSet;
+}
+
+WEAK bool pool_enabled() {
+    if (pool_size_state != kPoolSizeSet) {
+        // The first thread here reads the environment. Any others
+        // wait for it.
+        if (begin_setting_pool_size() == kPoolSizeUnset) {
+            const char *size = getenv("HL_MALLOC_POOL_SIZE");
+            if (size) {
+                pool_max_size = atoi(size);
+            }
+        }
+        end_setting_pool_size();
+    }
+    __sync_synchronize();
+    return pool_max_size > 0;
+}
+
 WEAK void *default_malloc(void *user_context, size_t x) {
+    size_t size_class = pool_enabled() ? size_class_for(x) : kNoSizeClass;
+    if (size_class != kNoSizeClass) {
+        PoolCache *cache = pool_cache_for_this_thread();
+        if (try_lock(cache)) {
+            void *ptr = cache->free_list[size_class];
+            if (ptr != NULL) {
+                cache->free_list[size_class] = *(void **)ptr;
+                cache->current_size -= size_class_bytes(size_class);
+            }
+            unlock(cache);
+            if (ptr != NULL) {
+                return ptr;
+            }
+        }
+        // Round up, so that the block can be reused for anything in
+        // its size class.
+        x = size_class_bytes(size_class);
+    }
+
     // Allocate enough space for aligning the pointer we return.
-    const size_t alignment = 128;
     void *orig = malloc(x + alignment);
     if (orig == NULL) {
         // Will result in a failed assertion and a call to halide_error
         return NULL;
     }
-    // We want to store the original pointer prior to the pointer we return.
-    void *ptr = (void *)(((size_t)orig + alignment + sizeof(void*) - 1) & ~(alignment - 1));
-    ((void **)ptr)[-1] = orig;
+    // We want to store the original pointer and the size class prior
+    // to the pointer we return. malloc's own alignment of at least two
+    // pointers keeps this within the space we asked for.
+    void *ptr = (void *)(((size_t)orig + alignment + 2 * sizeof(void*) - 1) & ~(alignment - 1));
+    block_orig(ptr) = orig;
+    block_size_class(ptr) = size_class;
     return ptr;
 }
 
 WEAK void default_free(void *user_context, void *ptr) {
-    free(((void**)ptr)[-1]);
+    size_t size_class = block_size_class(ptr);
+    if (size_class != kNoSizeClass && pool_max_size > 0) {
+        PoolCache *cache = pool_cache_for_this_thread();
+        if (try_lock(cache)) {
+            int64_t bytes = size_class_bytes(size_class);
+            bool keep = cache->current_size + bytes <= pool_max_size / kNumPoolCaches;
+            if (keep) {
+                *(void **)ptr = cache->free_list[size_class];
+                cache->free_list[size_class] = ptr;
+                cache->current_size += bytes;
+            }
+            unlock(cache);
+            if (keep) {
+                return;
+            }
+        }
+    }
+    free(block_orig(ptr));
 }
 
 WEAK halide_malloc_t custom_malloc = default_malloc;
@@ -54,4 +231,14 @@ WEAK void halide_free(void *user_context, void *ptr) {
     custom_free(user_context, ptr);
 }
 
+WEAK void halide_set_malloc_pool_size(int64_t max_bytes) {
+    begin_setting_pool_size();
+    int64_t old_max_size = pool_max_size;
+    pool_max_size = max_bytes;
+    end_setting_pool_size();
+    if (max_bytes < old_max_size) {
+        pool_release_all();
+    }
+}
+
 }
@@ -60,13 +60,20 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         p->funcs[i].stack_peak = 0;
         p->funcs[i].active_threads_numerator = 0;
         p->funcs[i].active_threads_denominator = 0;
+        p->funcs[i].parallel_tasks = 0;
+        p->funcs[i].parallel_chunks = 0;
+        p->funcs[i].cycles = 0;
+        p->funcs[i].instructions = 0;
+        p->funcs[i].cache_misses = 0;
+        p->funcs[i].branch_misses = 0;
+        p->funcs[i].elements = 0;
     }
     s->first_free_id += num_funcs;
     s->pipelines = p;
     return p;
 }
 
-WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
+WEAK halide_profiler_pipeline_stats *bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
     halide_profiler_pipeline_stats *p_prev = NULL;
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
@@ -81,15 +88,234 @@ WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int ac
             f->time += time;
             f->active_threads_numerator += active_threads;
             f->active_threads_denominator += 1;
-            p->time += time;
-            p->samples++;
-            p->active_threads_numerator += active_threads;
-            p->active_threads_denominator += 1;
-            return;
+            return p;
         }
         p_prev = p;
     }
     // Someone must have called reset_state while a kernel was running. Do nothing.
+    return NULL;
+}
+
+WEAK void bill_pipeline(halide_profiler_pipeline_stats *p, uint64_t time, int active_threads) {
+    p->time += time;
+    p->samples++;
+    p->active_threads_numerator += active_threads;
+    p->active_threads_denominator += 1;
+}
+
+// Bill the time since the last sample to the Func each claimed thread
+// slot is computing. Threads computing the same Func are billed
+// together, so the Func is charged for each of their time, and its
+// thread count is how many were computing it at once. Each pipeline
+// with any thread in it is charged the elapsed time once.
+WEAK void bill_threads(halide_profiler_state *s, uint64_t time) {
+    int funcs[halide_profiler_max_threads];
+    int n = 0;
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        const volatile halide_profiler_thread_state *t = s->threads + i;
+        int func = t->current_func;
+        if (t->in_use && func >= 0) {
+            funcs[n++] = func;
+        }
+    }
+
+    halide_profiler_pipeline_stats *pipelines[halide_profiler_max_threads];
+    int pipeline_threads[halide_profiler_max_threads];
+    int num_pipelines = 0;
+    for (int i = 0; i < n; i++) {
+        if (funcs[i] < 0) continue;
+        // Count, and mark as billed, the other threads computing this Func.
+        int threads = 1;
+        for (int j = i + 1; j < n; j++) {
+            if (funcs[j] == funcs[i]) {
+                threads++;
+                funcs[j] = halide_profiler_outside_of_halide;
+            }
+        }
+        halide_profiler_pipeline_stats *p = bill_func(s, funcs[i], time * threads, threads);
+        if (!p) continue;
+        int k = 0;
+        while (k < num_pipelines && pipelines[k] != p) k++;
+        if (k == num_pipelines) {
+            pipelines[num_pipelines] = p;
+            pipeline_threads[num_pipelines] = 0;
+            num_pipelines++;
+        }
+        pipeline_threads[k] += threads;
+    }
+
+    for (int k = 0; k < num_pipelines; k++) {
+        bill_pipeline(pipelines[k], time, pipeline_threads[k]);
+    }
+}
+
+// The slot the next call to halide_profiler_thread_start starts
+// searching from.
+WEAK unsigned next_thread_slot = 0;
+
+// A parallel loop launched through halide_profiler_do_par_for, which
+// the thread pool reports the chunks of. It lives on the stack of the
+// launching thread for the duration of the loop. The closure of an
+// in-flight loop is live memory, so no two loops share one.
+struct par_for_launch {
+    uint8_t *closure;
+    uint64_t chunks;
+    par_for_launch *next;
+};
+
+// Guards par_for_launches.
+WEAK halide_mutex par_for_launches_lock;
+WEAK par_for_launch *par_for_launches = NULL;
+
+WEAK bool claim_thread_slot(halide_profiler_thread_state *t) {
+    return !t->in_use && __sync_bool_compare_and_swap(&t->in_use, 0, 1);
+}
+
+// Append an event to a ring buffer of halide_profiler_max_events.
+WEAK void record_event(halide_profiler_event *events, uint64_t n, int kind, int func, uint64_t value) {
+    halide_profiler_event *e = events + n % halide_profiler_max_events;
+    e->time = halide_current_time_ns(NULL);
+    e->value = value;
+    e->func = func;
+    e->kind = kind;
+}
+
+// Find the pipeline containing the Func with the given id.
+WEAK halide_profiler_pipeline_stats *find_pipeline(halide_profiler_state *s, int func_id) {
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (func_id >= p->first_func_id && func_id < p->first_func_id + p->num_funcs) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Writes the timeline through a large buffer, so that it takes few
+// syscalls.
+class TimelineWriter {
+    char buf[64 * 1024];
+    size_t size;
+    int fd;
+    bool first;
+
+public:
+    bool ok;
+
+    TimelineWriter(int fd) : size(0), fd(fd), first(true), ok(true) {}
+
+    void flush() {
+        if (size > 0 && write(fd, buf, size) != (ssize_t)size) {
+            ok = false;
+        }
+        size = 0;
+    }
+
+    void append(const char *str) {
+        size_t len = strlen(str);
+        if (size + len > sizeof(buf)) {
+            flush();
+        }
+        if (len <= sizeof(buf)) {
+            memcpy(buf + size, str, len);
+            size += len;
+        }
+    }
+
+    // Append a trace event. Times are in nanoseconds, and get
+    // written in microseconds to three decimal places.
+    void event(const char *name, const char *cat, char phase, uint64_t time,
+               uint64_t duration, uint64_t tid, const char *args = NULL) {
+        char line_buf[1024];
+        Printer<StringStreamPrinter, sizeof(line_buf)> sstr(NULL, line_buf);
+        sstr << (first ? "\n" : ",\n")
+             << "{\"name\": \"" << name << "\", \"cat\": \"" << cat
+             << "\", \"ph\": \"" << (phase == 'X' ? "X" : "C")
+             << "\", \"pid\": 0, \"tid\": " << tid << ", \"ts\": ";
+        microseconds(sstr, time);
+        if (phase == 'X') {
+            sstr << ", \"dur\": ";
+            microseconds(sstr, duration);
+        }
+        if (args) {
+            sstr << ", \"args\": " << args;
+        }
+        sstr << "}";
+        append(sstr.str());
+        first = false;
+    }
+
+    template<typename P>
+    void microseconds(P &sstr, uint64_t ns) {
+        sstr << ns / 1000 << ".";
+        sstr.dst = halide_uint64_to_string(sstr.dst, sstr.end, ns % 1000, 3);
+    }
+};
+
+// Write the events of one thread slot's ring buffer. Slots record
+// the time they're claimed and released, which shows up as a span
+// named after the pipeline, and each switch between Funcs, between
+// which are spans named after the Func. The oldest events may have
+// been overwritten, so spans whose start is missing are dropped.
+WEAK void write_thread_events(TimelineWriter &w, halide_profiler_state *s,
+                              const halide_profiler_thread_state *t, int slot) {
+    uint64_t tid = slot;
+    uint64_t start = 0, func_start = 0;
+    halide_profiler_pipeline_stats *pipeline = NULL;
+    int func = halide_profiler_please_stop;
+    uint64_t n = t->num_events;
+    uint64_t first = n > halide_profiler_max_events ? n - halide_profiler_max_events : 0;
+    for (uint64_t i = first; i < n; i++) {
+        const halide_profiler_event *e = t->events + i % halide_profiler_max_events;
+        if (func != halide_profiler_please_stop &&
+            (e->kind == halide_profiler_event_func ||
+             e->kind == halide_profiler_event_thread_end)) {
+            halide_profiler_pipeline_stats *p = find_pipeline(s, func);
+            if (func == halide_profiler_outside_of_halide) {
+                w.event("idle", "idle", 'X', func_start, e->time - func_start, tid);
+            } else if (p) {
+                w.event(p->funcs[func - p->first_func_id].name, p->name, 'X',
+                        func_start, e->time - func_start, tid);
+            }
+        }
+        if (e->kind == halide_profiler_event_thread_start) {
+            // Label the span with the OS id of the thread where it's
+            // known, so that nested slots on one thread share a track.
+            if (e->value) {
+                tid = e->value;
+            }
+            start = e->time;
+            pipeline = find_pipeline(s, e->func);
+            func = halide_profiler_please_stop;
+        } else if (e->kind == halide_profiler_event_func) {
+            func = e->func;
+            func_start = e->time;
+        } else if (e->kind == halide_profiler_event_thread_end) {
+            if (pipeline) {
+                w.event(pipeline->name, "thread", 'X', start, e->time - start, tid);
+            }
+            pipeline = NULL;
+            func = halide_profiler_please_stop;
+            tid = slot;
+        }
+    }
+}
+
+// Write the heap allocation events as a counter for each Func.
+WEAK void write_memory_events(TimelineWriter &w, halide_profiler_state *s) {
+    uint64_t n = s->num_memory_events;
+    uint64_t first = n > halide_profiler_max_events ? n - halide_profiler_max_events : 0;
+    for (uint64_t i = first; i < n; i++) {
+        const halide_profiler_event *e = s->memory_events + i % halide_profiler_max_events;
+        halide_profiler_pipeline_stats *p = find_pipeline(s, e->func);
+        if (!p) continue;
+        char name_buf[512], args_buf[64];
+        Printer<StringStreamPrinter, sizeof(name_buf)> name(NULL, name_buf);
+        Printer<StringStreamPrinter, sizeof(args_buf)> args(NULL, args_buf);
+        name << p->name << " " << p->funcs[e->func - p->first_func_id].name << " heap";
+        args << "{\"bytes\": " << e->value << "}";
+        w.event(name.str(), p->name, 'C', e->time, 0, 0, args.str());
+    }
 }
 
 WEAK void sampling_profiler_thread(void *) {
@@ -103,22 +329,28 @@ WEAK void sampling_profiler_thread(void *) {
         uint64_t t1 = halide_current_time_ns(NULL);
         uint64_t t = t1;
         while (1) {
-            int func, active_threads;
-            if (s->get_remote_profiler_state) {
+            uint64_t t_now = halide_current_time_ns(NULL);
+            if (s->current_func == halide_profiler_please_stop) {
+                break;
+            } else if (s->get_remote_profiler_state) {
                 // Execution has disappeared into remote code running
                 // on an accelerator (e.g. Hexagon DSP)
+                int func, active_threads;
                 s->get_remote_profiler_state(&func, &active_threads);
+                if (func == halide_profiler_please_stop) {
+                    break;
+                } else if (func >= 0) {
+                    // Assume all time since I was last awake is due to
+                    // the currently running func.
+                    halide_profiler_pipeline_stats *p = bill_func(s, func, t_now - t, active_threads);
+                    if (p) {
+                        bill_pipeline(p, t_now - t, active_threads);
+                    }
+                }
             } else {
-                func = s->current_func;
-                active_threads = s->active_threads;
-            }
-            uint64_t t_now = halide_current_time_ns(NULL);
-            if (func == halide_profiler_please_stop) {
-                break;
-            } else if (func >= 0) {
                 // Assume all time since I was last awake is due to
-                // the currently running func.
-                bill_func(s, func, t_now - t, active_threads);
+                // the funcs each thread is currently running.
+                bill_threads(s, t_now - t);
             }
             t = t_now;
 
@@ -151,9 +383,136 @@ void sync_compare_max_and_swap(T *ptr, T val) {
     }
 }
 
+void record_memory_event(halide_profiler_pipeline_stats *p, int func_id, uint64_t current) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    if (s->memory_events) {
+        uint64_t n = __sync_fetch_and_add(&s->num_memory_events, 1);
+        record_event(s->memory_events, n, halide_profiler_event_memory,
+                     p->first_func_id + func_id, current);
+    }
+}
+
 }
 
 extern "C" {
+// Claims a slot through which the calling thread reports the Func it is
+// computing, or returns NULL if every slot is taken.
+WEAK void *halide_profiler_thread_start(void *pipeline_state) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    halide_profiler_thread_state *t = NULL;
+
+    int tid = 0;
+    if (s->read_counters) {
+        // Opening counters is expensive, so prefer a slot that already
+        // has them open for this thread.
+        tid = halide_perf_counters_thread_id();
+        for (int i = 0; i < halide_profiler_max_threads && !t; i++) {
+            halide_profiler_thread_state *u = s->threads + i;
+            if (u->counters_open && u->counters_thread == tid && claim_thread_slot(u)) {
+                t = u;
+            }
+        }
+    }
+
+    if (!t) {
+        // Threads claiming slots at the same time start their searches
+        // in different places, so they don't all contend for the same
+        // one. When recording a timeline, which allocates a buffer for
+        // each slot used, keep the number of slots used down instead.
+        unsigned first = s->timeline_file ? 0 : __sync_fetch_and_add(&next_thread_slot, 1);
+        for (int i = 0; i < halide_profiler_max_threads && !t; i++) {
+            halide_profiler_thread_state *u = s->threads + (first + i) % halide_profiler_max_threads;
+            if (claim_thread_slot(u)) {
+                t = u;
+            }
+        }
+        if (!t) return NULL;
+    }
+
+    t->current_func = halide_profiler_outside_of_halide;
+    t->parallel_func = halide_profiler_outside_of_halide;
+    t->pipeline = (halide_profiler_pipeline_stats *)pipeline_state;
+    t->elements = 0;
+
+    if (t->counters_open && (!s->read_counters || t->counters_thread != tid)) {
+        halide_perf_counters_close(t->counter_fds);
+        t->counters_open = 0;
+    }
+    if (s->read_counters && !t->counters_open &&
+        halide_perf_counters_open(t->counter_fds) == 0) {
+        t->counters_thread = tid;
+        t->counters_open = 1;
+    }
+    if (t->counters_open &&
+        halide_perf_counters_read(t->counter_fds, t->counters) != 0) {
+        halide_perf_counters_close(t->counter_fds);
+        t->counters_open = 0;
+    }
+
+    if (s->timeline_file && !t->events) {
+        t->events = (halide_profiler_event *)malloc(halide_profiler_max_events * sizeof(halide_profiler_event));
+    }
+    if (t->events && t->pipeline) {
+        record_event(t->events, t->num_events++, halide_profiler_event_thread_start,
+                     t->pipeline->first_func_id, halide_perf_counters_thread_id());
+    }
+
+    return t;
+}
+
+// Releases a slot claimed by halide_profiler_thread_start. Registered
+// as a destructor, so it also runs if the thread exits with an error.
+WEAK void halide_profiler_thread_end(void *user_context, void *thread) {
+    halide_profiler_thread_state *t = (halide_profiler_thread_state *)thread;
+    if (!t) return;
+    if (t->counters_open) {
+        halide_profiler_read_counters(t);
+    }
+    if (t->events) {
+        record_event(t->events, t->num_events++, halide_profiler_event_thread_end, 0, 0);
+    }
+    t->current_func = halide_profiler_outside_of_halide;
+    __sync_synchronize();
+    t->in_use = 0;
+}
+
+WEAK void halide_profiler_thread_switch(void *thread, int func) {
+    halide_profiler_thread_state *t = (halide_profiler_thread_state *)thread;
+    if (t->counters_open) {
+        halide_profiler_read_counters(t);
+    }
+    if (t->events) {
+        record_event(t->events, t->num_events++, halide_profiler_event_func, func, 0);
+    }
+}
+
+WEAK void halide_profiler_read_counters(void *thread) {
+    halide_profiler_thread_state *t = (halide_profiler_thread_state *)thread;
+    uint64_t values[halide_profiler_num_counters];
+    if (halide_perf_counters_read(t->counter_fds, values) != 0) {
+        return;
+    }
+
+    // Several threads may be computing the same Func, so update its
+    // stats atomically. Time spent outside of any Func (e.g. waiting
+    // for a parallel loop) isn't billed.
+    halide_profiler_pipeline_stats *p = t->pipeline;
+    int func_id = t->current_func;
+    if (p && func_id >= p->first_func_id && func_id < p->first_func_id + p->num_funcs) {
+        halide_profiler_func_stats *f = p->funcs + func_id - p->first_func_id;
+        __sync_add_and_fetch(&f->cycles, values[0] - t->counters[0]);
+        __sync_add_and_fetch(&f->instructions, values[1] - t->counters[1]);
+        __sync_add_and_fetch(&f->cache_misses, values[2] - t->counters[2]);
+        __sync_add_and_fetch(&f->branch_misses, values[3] - t->counters[3]);
+        __sync_add_and_fetch(&f->elements, t->elements);
+    }
+
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        t->counters[i] = values[i];
+    }
+    t->elements = 0;
+}
+
 // Returns the address of the pipeline state associated with pipeline_name.
 WEAK halide_profiler_pipeline_stats *halide_profiler_get_pipeline_state(const char *pipeline_name) {
     halide_profiler_state *s = halide_profiler_get_state();
@@ -181,6 +540,17 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
     ScopedMutexLock lock(&s->lock);
 
     if (!s->started) {
+        const char *read_counters = getenv("HL_PROFILER_COUNTERS");
+        if (read_counters) {
+            s->read_counters = atoi(read_counters) != 0;
+        }
+        const char *timeline_file = getenv("HL_PROFILER_TIMELINE");
+        if (timeline_file && *timeline_file && !s->memory_events) {
+            s->memory_events = (halide_profiler_event *)malloc(halide_profiler_max_events * sizeof(halide_profiler_event));
+            if (s->memory_events) {
+                s->timeline_file = timeline_file;
+            }
+        }
         halide_start_clock(user_context);
         halide_spawn_thread(sampling_profiler_thread, NULL);
         s->started = true;
@@ -251,6 +621,8 @@ WEAK void halide_profiler_memory_allocate(void *user_context,
     __sync_add_and_fetch(&f_stats->memory_total, incr);
     uint64_t f_mem_current = __sync_add_and_fetch(&f_stats->memory_current, incr);
     sync_compare_max_and_swap(&f_stats->memory_peak, f_mem_current);
+
+    record_memory_event(p_stats, func_id, f_mem_current);
 }
 
 WEAK void halide_profiler_memory_free(void *user_context,
@@ -280,7 +652,66 @@ WEAK void halide_profiler_memory_free(void *user_context,
     __sync_sub_and_fetch(&p_stats->memory_current, decr);
 
     // Update per-func memory stats
-    __sync_sub_and_fetch(&f_stats->memory_current, decr);
+    uint64_t f_mem_current = __sync_sub_and_fetch(&f_stats->memory_current, decr);
+
+    record_memory_event(p_stats, func_id, f_mem_current);
+}
+
+WEAK void halide_profiler_record_par_for(uint8_t *closure, uint64_t chunks) {
+    ScopedMutexLock lock(&par_for_launches_lock);
+    for (par_for_launch *l = par_for_launches; l; l = l->next) {
+        if (l->closure == closure) {
+            l->chunks += chunks;
+            return;
+        }
+    }
+}
+
+WEAK int halide_profiler_do_par_for(void *user_context, halide_task_t f,
+                                    int min, int size, uint8_t *closure, void *thread) {
+    // Threads that couldn't claim a slot go unbilled.
+    halide_profiler_thread_state *t = (halide_profiler_thread_state *)thread;
+    int func_id = t ? t->parallel_func : halide_profiler_outside_of_halide;
+    if (func_id < 0) {
+        return halide_do_par_for(user_context, f, min, size, closure);
+    }
+
+    par_for_launch launch = {closure, 0, NULL};
+    {
+        ScopedMutexLock lock(&par_for_launches_lock);
+        launch.next = par_for_launches;
+        par_for_launches = &launch;
+    }
+
+    int result = halide_do_par_for(user_context, f, min, size, closure);
+
+    {
+        ScopedMutexLock lock(&par_for_launches_lock);
+        par_for_launch **prev = &par_for_launches;
+        while (*prev != &launch) {
+            prev = &(*prev)->next;
+        }
+        *prev = launch.next;
+    }
+
+    // A custom do_par_for doesn't report its chunks, so there's
+    // nothing to bill.
+    if (launch.chunks == 0) {
+        return result;
+    }
+
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (func_id >= p->first_func_id && func_id < p->first_func_id + p->num_funcs) {
+            halide_profiler_func_stats *fs = p->funcs + func_id - p->first_func_id;
+            fs->parallel_tasks += size;
+            fs->parallel_chunks += launch.chunks;
+            break;
+        }
+    }
+    return result;
 }
 
 WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_state *s) {
@@ -323,6 +754,14 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
         }
 
         if (print_f_states) {
+            // Funcs are billed for the time of each thread computing
+            // them, so on multiple threads their times can add up to
+            // more than the pipeline's.
+            uint64_t func_time = 0;
+            for (int i = 0; i < p->num_funcs; i++) {
+                func_time += p->funcs[i].time;
+            }
+
             for (int i = 0; i < p->num_funcs; i++) {
                 size_t cursor = 0;
                 sstr.clear();
@@ -345,8 +784,8 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 while (sstr.size() < cursor) sstr << " ";
 
                 int percent = 0;
-                if (p->time != 0) {
-                    percent = (100*fs->time) / p->time;
+                if (func_time != 0) {
+                    percent = (100*fs->time) / func_time;
                 }
                 sstr << "(" << percent << "%)";
                 cursor += 8;
@@ -377,6 +816,24 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 if (fs->stack_peak > 0) {
                     sstr << " stack: " << fs->stack_peak;
                 }
+                if (fs->parallel_chunks > 0) {
+                    float chunk = (float)fs->parallel_tasks / fs->parallel_chunks;
+                    sstr << " chunk: " << chunk;
+                    sstr.erase(3);
+                }
+                if (fs->cycles > 0) {
+                    float ipc = (float)fs->instructions / fs->cycles;
+                    sstr << " ipc: " << ipc;
+                    sstr.erase(3);
+                }
+                if (fs->elements > 0) {
+                    float cache_misses = (float)fs->cache_misses / fs->elements;
+                    float branch_misses = (float)fs->branch_misses / fs->elements;
+                    sstr << " llc misses/elem: " << cache_misses;
+                    sstr.erase(3);
+                    sstr << " branch misses/elem: " << branch_misses;
+                    sstr.erase(3);
+                }
                 sstr << "\n";
 
                 halide_print(user_context, sstr.str());
@@ -385,6 +842,39 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
     }
 }
 
+#define O_CREAT 64
+#define O_WRONLY 1
+#define O_TRUNC 512
+
+WEAK int halide_profiler_write_timeline_unlocked(void *user_context, halide_profiler_state *s, const char *filename) {
+    int fd = open(filename, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        error(user_context) << "Failed to open profiler timeline file " << filename << "\n";
+        return -1;
+    }
+
+    TimelineWriter w(fd);
+    w.append("{\"traceEvents\": [");
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        const halide_profiler_thread_state *t = s->threads + i;
+        if (t->events) {
+            write_thread_events(w, s, t, i);
+        }
+    }
+    if (s->memory_events) {
+        write_memory_events(w, s);
+    }
+    w.append("\n],\n\"displayTimeUnit\": \"ns\"}\n");
+    w.flush();
+    close(fd);
+
+    if (!w.ok) {
+        error(user_context) << "Failed to write profiler timeline file " << filename << "\n";
+        return -1;
+    }
+    return 0;
+}
+
 WEAK void halide_profiler_report(void *user_context) {
     halide_profiler_state *s = halide_profiler_get_state();
     ScopedMutexLock lock(&s->lock);
@@ -392,6 +882,12 @@ WEAK void halide_profiler_report(void *user_context) {
 }
 
 
+WEAK int halide_profiler_write_timeline(void *user_context, const char *filename) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    return halide_profiler_write_timeline_unlocked(user_context, s, filename);
+}
+
 WEAK void halide_profiler_reset() {
     // WARNING: Do not call this method while any other halide
     // pipeline is running; halide_profiler_memory_allocate/free and
@@ -408,6 +904,13 @@ WEAK void halide_profiler_reset() {
         free(p);
     }
     s->first_free_id = 0;
+
+    // The events recorded so far refer to the ids of Funcs in the
+    // pipelines just freed.
+    s->num_memory_events = 0;
+    for (int i = 0; i < halide_profiler_max_threads; i++) {
+        s->threads[i].num_events = 0;
+    }
 }
 
 namespace {
@@ -427,6 +930,10 @@ WEAK void halide_profiler_shutdown() {
     // down the thread.
     halide_profiler_report_unlocked(NULL, s);
 
+    if (s->timeline_file) {
+        halide_profiler_write_timeline_unlocked(NULL, s, s->timeline_file);
+    }
+
     // Leak the memory. Not all implementations of ScopedMutexLock may
     // be safe to use at static destruction time (windows).
     // halide_profiler_reset();
@@ -12,6 +12,36 @@ WEAK __attribute__((always_inline)) int halide_profiler_set_current_func(halide_
     return 0;
 }
 
+WEAK __attribute__((always_inline)) int halide_profiler_set_thread_func(halide_profiler_thread_state *thread, int func) {
+    // Threads that couldn't claim a slot go unsampled.
+    if (thread) {
+        if (thread->counters_open || thread->events) {
+            // Bill the hardware counters to the Func being left, and
+            // record the switch on the timeline.
+            halide_profiler_thread_switch(thread, func);
+        }
+        volatile int *ptr = &(thread->current_func);
+        asm volatile ("":::);
+        *ptr = func;
+        asm volatile ("":::);
+    }
+    return 0;
+}
+
+WEAK __attribute__((always_inline)) int halide_profiler_set_parallel_func(halide_profiler_thread_state *thread, int func) {
+    if (thread) {
+        thread->parallel_func = func;
+    }
+    return 0;
+}
+
+WEAK __attribute__((always_inline)) int halide_profiler_count_elements(halide_profiler_thread_state *thread, uint64_t elements) {
+    if (thread) {
+        thread->elements += elements;
+    }
+    return 0;
+}
+
 WEAK __attribute__((always_inline)) int halide_profiler_incr_active_threads(halide_profiler_state *state) {
     volatile int *ptr = &(state->active_threads);
     asm volatile ("":::);
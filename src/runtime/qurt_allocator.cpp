@@ -59,4 +59,8 @@ WEAK void halide_free(void *user_context, void *ptr) {
     custom_free(user_context, ptr);
 }
 
+WEAK void halide_set_malloc_pool_size(int64_t max_bytes) {
+    // The default allocator on this platform doesn't pool.
+}
+
 }
@@ -123,11 +123,48 @@ WEAK void halide_profiler_memory_free(void *user_context,
                                       void *pipeline_state,
                                       int func_id,
                                       uint64_t decr);
+// Pools of scratch buffers for allocations inside parallel loops. See
+// scratch_pool.cpp.
+WEAK void *halide_scratch_pool_create(void *user_context, int64_t buffer_bytes);
+WEAK void *halide_scratch_pool_acquire(void *user_context, void *pool);
+WEAK void halide_scratch_pool_release(void *user_context, void *buf);
+WEAK void halide_scratch_pool_destroy(void *user_context, void *pool);
 WEAK int halide_profiler_pipeline_start(void *user_context,
                                         const char *pipeline_name,
                                         int num_funcs,
                                         const uint64_t *func_names);
+// Claim and release a slot in the profiler state through which the
+// calling thread reports the Func it is computing. Claiming returns
+// NULL if every slot is taken.
+WEAK void *halide_profiler_thread_start(void *pipeline_state);
+WEAK void halide_profiler_thread_end(void *user_context, void *thread);
+// halide_do_par_for for a loop launched by a thread with the given
+// profiler slot, which may be NULL. Used by profiled code, so that
+// the chunks the loop is claimed in are billed to the slot's
+// parallel_func.
+WEAK int halide_profiler_do_par_for(void *user_context, int (*f)(void *, int, uint8_t *),
+                                    int min, int size, uint8_t *closure, void *thread);
+// Bill the change in a thread's hardware counters since they were
+// last read to the Func it is computing.
+WEAK void halide_profiler_read_counters(void *thread);
+// Called when a thread reading counters or recording a timeline
+// switches to computing another Func.
+WEAK void halide_profiler_thread_switch(void *thread, int func);
+// The hardware performance counters of the calling thread, in the
+// order listed for halide_profiler_num_counters. Opening them fails
+// where they aren't available. See linux_perf_counters.cpp.
+WEAK int halide_perf_counters_open(int *fds);
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *values);
+WEAK void halide_perf_counters_close(const int *fds);
+WEAK int halide_perf_counters_thread_id();
+// Report the number of chunks the thread pool claimed the iterations
+// of a parallel loop in. They are billed to the Func that launched
+// the loop, if it was launched with halide_profiler_do_par_for.
+WEAK void halide_profiler_record_par_for(uint8_t *closure, uint64_t chunks);
 WEAK int halide_host_cpu_count();
+// Pin the calling thread to the given CPU, or unpin it if cpu is
+// negative. Returns zero on success.
+WEAK int halide_set_current_thread_cpu(int cpu);
 
 WEAK int halide_device_and_host_malloc(void *user_context, struct buffer_t *buf,
                                        const struct halide_device_interface *device_interface);
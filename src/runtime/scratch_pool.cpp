@@ -0,0 +1,90 @@
+#include "HalideRuntime.h"
+#include "scoped_spin_lock.h"
+
+// Scratch pools back allocations that are made inside the body of a
+// parallel loop. Rather than calling halide_malloc and halide_free
+// every iteration, the compiler creates a pool before the loop with
+// an upper bound on the size of the allocation, each iteration
+// acquires a buffer from the pool and releases it back when it's
+// done, and the pool is destroyed after the loop. The pool only ever
+// holds as many buffers as there were iterations running at once,
+// i.e. about one per thread.
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Each buffer has a header just before the pointer handed out. 128
+// bytes keeps the alignment that halide_malloc gives.
+const size_t scratch_header_bytes = 128;
+
+struct ScratchPool;
+
+struct ScratchHeader {
+    ScratchPool *pool;
+    ScratchHeader *next;
+};
+
+struct ScratchPool {
+    volatile int lock;
+    int64_t buffer_bytes;
+    // Buffers not currently acquired.
+    ScratchHeader *free_list;
+};
+
+WEAK ScratchHeader *scratch_header(void *buf) {
+    return (ScratchHeader *)((uint8_t *)buf - scratch_header_bytes);
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK void *halide_scratch_pool_create(void *user_context, int64_t buffer_bytes) {
+    ScratchPool *pool = (ScratchPool *)halide_malloc(user_context, sizeof(ScratchPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->lock = 0;
+    pool->buffer_bytes = buffer_bytes;
+    pool->free_list = NULL;
+    return pool;
+}
+
+WEAK void *halide_scratch_pool_acquire(void *user_context, void *p) {
+    ScratchPool *pool = (ScratchPool *)p;
+    ScratchHeader *header;
+    {
+        ScopedSpinLock lock(&pool->lock);
+        header = pool->free_list;
+        if (header != NULL) {
+            pool->free_list = header->next;
+        }
+    }
+    if (header == NULL) {
+        header = (ScratchHeader *)halide_malloc(user_context, pool->buffer_bytes + scratch_header_bytes);
+        if (header == NULL) {
+            return NULL;
+        }
+        header->pool = pool;
+    }
+    return (uint8_t *)header + scratch_header_bytes;
+}
+
+WEAK void halide_scratch_pool_release(void *user_context, void *buf) {
+    ScratchHeader *header = scratch_header(buf);
+    ScratchPool *pool = header->pool;
+    ScopedSpinLock lock(&pool->lock);
+    header->next = pool->free_list;
+    pool->free_list = header;
+}
+
+WEAK void halide_scratch_pool_destroy(void *user_context, void *p) {
+    ScratchPool *pool = (ScratchPool *)p;
+    while (pool->free_list != NULL) {
+        ScratchHeader *next = pool->free_list->next;
+        halide_free(user_context, pool->free_list);
+        pool->free_list = next;
+    }
+    halide_free(user_context, pool);
+}
+
+}
@@ -1,21 +1,109 @@
+#include "scoped_spin_lock.h"
 
 namespace Halide { namespace Runtime { namespace Internal {
 
+// The work queue and thread pool is weak, so one big work queue is shared by all halide functions
+#define MAX_THREADS 64
+
+// A range of unclaimed loop iterations [begin, end) belonging to one
+// thread. The range is packed into a single 64-bit word so that the
+// owning thread can pop iterations off the front, and other threads
+// can steal from the back, with a single compare-and-swap and without
+// taking the work queue lock. 32-bit targets may have no 64-bit
+// compare-and-swap, so there the range is guarded by a spin lock
+// instead. Each slot is aligned to its own cache line so that threads
+// popping from neighbouring slots don't contend.
+#define TASK_SLOT_ALIGNMENT 64
+struct task_slot {
+    volatile uint64_t range;
+#ifdef BITS_32
+    volatile int lock;
+#endif
+} __attribute__((aligned(TASK_SLOT_ALIGNMENT)));
+
+inline __attribute__((always_inline)) uint64_t pack_range(int begin, int end) {
+    return (uint64_t)(uint32_t)begin | ((uint64_t)(uint32_t)end << 32);
+}
+
+inline __attribute__((always_inline)) int range_begin(uint64_t range) {
+    return (int)(uint32_t)range;
+}
+
+inline __attribute__((always_inline)) int range_end(uint64_t range) {
+    return (int)(uint32_t)(range >> 32);
+}
+
+inline __attribute__((always_inline)) uint64_t load_range(task_slot *slot) {
+#ifdef BITS_32
+    ScopedSpinLock lock(&slot->lock);
+    return slot->range;
+#else
+    return __atomic_load_n(&slot->range, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Replace the range in a slot if it's still old_range. Returns the
+// range that was there.
+inline __attribute__((always_inline)) uint64_t compare_and_swap_range(task_slot *slot, uint64_t old_range,
+                                                                      uint64_t new_range) {
+#ifdef BITS_32
+    ScopedSpinLock lock(&slot->lock);
+    uint64_t prev = slot->range;
+    if (prev == old_range) {
+        slot->range = new_range;
+    }
+    return prev;
+#else
+    return __sync_val_compare_and_swap(&slot->range, old_range, new_range);
+#endif
+}
+
 struct work {
     work *next_job;
     int (*f)(void *, int, uint8_t *);
     void *user_context;
-    int next, max;
     uint8_t *closure;
     int active_workers;
     int exit_status;
-    bool running() { return next < max || active_workers > 0; }
+
+    // How iterations are handed out, and the minimum number of
+    // iterations claimed at once. See halide_par_for_schedule_t.
+    halide_par_for_schedule_t schedule;
+    int grain;
+
+    // The number of chunks the iterations were claimed in. Only
+    // updated once per thread per job.
+    int num_chunks;
+
+    // Whether threads should prefer to steal from threads on their
+    // own NUMA node.
+    bool numa;
+
+    // Slot 0 belongs to the thread that called do_par_for. Slot i + 1
+    // belongs to worker thread i. There is a slot for each thread
+    // that existed when the job was made; worker threads spawned
+    // after that don't participate in it. The slots live on the stack
+    // of the thread that called do_par_for.
+    int num_slots;
+    task_slot *slots;
+
+    bool has_work() {
+        for (int i = 0; i < num_slots; i++) {
+            uint64_t r = load_range(&slots[i]);
+            if (range_begin(r) < range_end(r)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool running() { return active_workers > 0 || has_work(); }
 };
 
-// The work queue and thread pool is weak, so one big work queue is shared by all halide functions
-#define MAX_THREADS 64
 struct work_queue_t {
-    // all fields are protected by this mutex.
+    // all fields are protected by this mutex. The exception is the
+    // task slots inside each job, which are claimed from and stolen
+    // from using atomic operations.
     halide_mutex mutex;
 
     // Singly linked list for job stack
@@ -48,6 +136,21 @@ struct work_queue_t {
     // The desired number threads doing work.
     int desired_num_threads;
 
+    // The policy for handing out iterations of parallel loops, and
+    // the minimum chunk size. A grain of zero means the policy hasn't
+    // been set yet.
+    halide_par_for_schedule_t schedule;
+    int grain;
+
+    // The CPUs worker threads are pinned to, and the NUMA node each
+    // of those CPUs belongs to. Worker thread i uses entry i %
+    // num_affinity_cpus. If there are no entries, threads aren't
+    // pinned. The generation is bumped whenever the affinity changes
+    // so that running workers know to re-pin themselves.
+    int affinity_cpus[MAX_THREADS], affinity_nodes[MAX_THREADS];
+    int num_affinity_cpus, num_numa_nodes, affinity_generation;
+    bool affinity_initialized;
+
     // Global flags indicating the threadpool should shut down, and
     // whether the thread pool has been initialized.
     bool shutdown, initialized;
@@ -88,7 +191,202 @@ WEAK int default_desired_num_threads() {
     return desired_num_threads;
 }
 
-WEAK void worker_thread_already_locked(work *owned_job) {
+WEAK void default_par_for_schedule(halide_par_for_schedule_t *schedule, int *grain) {
+    *schedule = halide_par_for_schedule_dynamic;
+    *grain = 1;
+    const char *schedule_str = getenv("HL_PAR_FOR_SCHEDULE");
+    if (!schedule_str || !*schedule_str) {
+        return;
+    }
+    if (strncmp(schedule_str, "blocked", 7) == 0) {
+        *schedule = halide_par_for_schedule_blocked;
+    } else if (strncmp(schedule_str, "guided", 6) == 0) {
+        *schedule = halide_par_for_schedule_guided;
+    } else if (strncmp(schedule_str, "dynamic", 7) != 0) {
+        halide_print(NULL, "Ignoring unknown value of HL_PAR_FOR_SCHEDULE. "
+                     "Expected dynamic, blocked, or guided.\n");
+    }
+    const char *grain_str = strchr(schedule_str, ':');
+    if (grain_str) {
+        *grain = max(1, atoi(grain_str + 1));
+    }
+}
+
+// Parse a list of CPUs of the form "0-7,16-23;8-15,24-31", where
+// semicolons separate the CPUs of different NUMA nodes.
+WEAK void parse_thread_affinity(const char *str) {
+    work_queue.num_affinity_cpus = 0;
+    work_queue.num_numa_nodes = 1;
+    int node = 0;
+    while (*str) {
+        if (*str == ';') {
+            node = min(node + 1, MAX_THREADS - 1);
+            str++;
+            continue;
+        } else if (*str < '0' || *str > '9') {
+            str++;
+            continue;
+        }
+        int first = 0, last = 0;
+        while (*str >= '0' && *str <= '9') {
+            first = first * 10 + (*str++ - '0');
+        }
+        last = first;
+        if (*str == '-') {
+            str++;
+            last = 0;
+            while (*str >= '0' && *str <= '9') {
+                last = last * 10 + (*str++ - '0');
+            }
+        }
+        for (int cpu = first; cpu <= last && work_queue.num_affinity_cpus < MAX_THREADS; cpu++) {
+            work_queue.affinity_cpus[work_queue.num_affinity_cpus] = cpu;
+            work_queue.affinity_nodes[work_queue.num_affinity_cpus] = node;
+            work_queue.num_affinity_cpus++;
+            work_queue.num_numa_nodes = node + 1;
+        }
+    }
+    work_queue.affinity_generation++;
+}
+
+// The NUMA node of the thread using a task slot. The thread that
+// called do_par_for might be running anywhere, so it gets -1.
+WEAK int slot_numa_node(int slot) {
+    if (slot == 0 || work_queue.num_affinity_cpus == 0) {
+        return -1;
+    }
+    return work_queue.affinity_nodes[(slot - 1) % work_queue.num_affinity_cpus];
+}
+
+// Pop the next chunk of iterations off the front of a task
+// slot. Returns false if the slot is empty.
+WEAK bool claim_tasks(work *job, task_slot *slot, int *begin, int *end) {
+    uint64_t old_range = load_range(slot);
+    while (range_begin(old_range) < range_end(old_range)) {
+        int b = range_begin(old_range), e = range_end(old_range);
+        int chunk = job->grain;
+        if (job->schedule == halide_par_for_schedule_guided) {
+            chunk = max(chunk, (e - b + job->num_slots - 1) / job->num_slots);
+        }
+        chunk = min(chunk, e - b);
+        uint64_t prev = compare_and_swap_range(slot, old_range, pack_range(b + chunk, e));
+        if (prev == old_range) {
+            *begin = b;
+            *end = b + chunk;
+            return true;
+        }
+        old_range = prev;
+    }
+    return false;
+}
+
+// Steal the back half (rounded up) of the iterations in a task
+// slot. Returns false if the slot is empty.
+WEAK bool steal_tasks(task_slot *slot, int *begin, int *end) {
+    uint64_t old_range = load_range(slot);
+    while (range_begin(old_range) < range_end(old_range)) {
+        int b = range_begin(old_range), e = range_end(old_range);
+        int mid = e - (e - b + 1) / 2;
+        uint64_t prev = compare_and_swap_range(slot, old_range, pack_range(b, mid));
+        if (prev == old_range) {
+            *begin = mid;
+            *end = e;
+            return true;
+        }
+        old_range = prev;
+    }
+    return false;
+}
+
+// Run tasks from a job without holding the work queue lock until
+// there is nothing left to claim or steal. my_slot must be empty on
+// entry, or owned by the calling thread, and is always empty on exit.
+WEAK void work_on_job(work *job, int my_slot, uint32_t *rng) {
+    task_slot *mine = &job->slots[my_slot];
+    int chunks = 0;
+    while (true) {
+        int begin = 0, end = 0;
+        if (!claim_tasks(job, mine, &begin, &end)) {
+            // Our own slot is dry. Visit the other slots starting
+            // from a random one, and steal half of the first
+            // non-empty range we find. In NUMA mode, first try only
+            // the threads on our own node.
+            *rng ^= *rng << 13;
+            *rng ^= *rng >> 17;
+            *rng ^= *rng << 5;
+            int first = (int)(*rng % (uint32_t)job->num_slots);
+            int my_node = slot_numa_node(my_slot);
+            bool stole = false;
+            for (int pass = (job->numa && my_node >= 0) ? 0 : 1; pass < 2 && !stole; pass++) {
+                for (int i = 0; i < job->num_slots && !stole; i++) {
+                    int victim = (first + i) % job->num_slots;
+                    if (victim != my_slot &&
+                        (pass == 1 || slot_numa_node(victim) == my_node)) {
+                        stole = steal_tasks(&job->slots[victim], &begin, &end);
+                    }
+                }
+            }
+            if (!stole) {
+                __sync_fetch_and_add(&job->num_chunks, chunks);
+                return;
+            }
+
+            // Put the stolen range in our own slot and claim from it
+            // as usual, so that other thieves can take some of it
+            // back. Nobody else writes to an empty slot, so this swap
+            // always succeeds first time.
+            uint64_t empty = load_range(mine);
+            while (compare_and_swap_range(mine, empty, pack_range(begin, end)) != empty) {
+                empty = load_range(mine);
+            }
+            continue;
+        }
+
+        chunks++;
+        for (int idx = begin; idx < end; idx++) {
+            int result = halide_do_task(job->user_context, job->f, idx, job->closure);
+
+            // If this task failed, set the exit status on the
+            // job. Several threads may fail at once without holding
+            // the lock, so the first failure wins.
+            if (result) {
+                __sync_bool_compare_and_swap(&job->exit_status, 0, result);
+            }
+        }
+    }
+}
+
+// Find a job with unclaimed tasks that the worker using the given
+// slot can participate in, removing exhausted jobs from the stack
+// along the way.
+WEAK work *find_job(int my_slot) {
+    work **prev = &work_queue.jobs;
+    while (*prev) {
+        work *job = *prev;
+        if (!job->has_work()) {
+            *prev = job->next_job;
+        } else if (my_slot < job->num_slots) {
+            return job;
+        } else {
+            prev = &job->next_job;
+        }
+    }
+    return NULL;
+}
+
+WEAK void remove_job(work *job) {
+    for (work **prev = &work_queue.jobs; *prev; prev = &((*prev)->next_job)) {
+        if (*prev == job) {
+            *prev = job->next_job;
+            return;
+        }
+    }
+}
+
+WEAK void worker_thread_already_locked(work *owned_job, int my_slot) {
+    uint32_t rng = (uint32_t)my_slot * 2654435761u + 1;
+    int pinned_generation = 0;
+
     // If I'm a job owner, then I was the thread that called
     // do_par_for, and I should only stay in this function until my
     // job is complete. If I'm a lowly worker thread, I should stay in
@@ -96,10 +394,33 @@ WEAK void worker_thread_already_locked(work *owned_job) {
     while (owned_job != NULL ? owned_job->running()
            : work_queue.running()) {
 
-        if (work_queue.jobs == NULL) {
+        // Worker threads (re-)pin themselves to their CPU whenever the
+        // affinity changes. Job owners belong to the caller, so we
+        // leave them alone.
+        if (!owned_job && pinned_generation != work_queue.affinity_generation) {
+            pinned_generation = work_queue.affinity_generation;
+            int cpu = -1;
+            if (work_queue.num_affinity_cpus > 0) {
+                cpu = work_queue.affinity_cpus[(my_slot - 1) % work_queue.num_affinity_cpus];
+            }
+            halide_set_current_thread_cpu(cpu);
+        }
+
+        // Job owners only work on their own job. Other threads pick
+        // the most recently pushed job that still has tasks.
+        work *job = NULL;
+        if (owned_job) {
+            if (owned_job->has_work()) {
+                job = owned_job;
+            }
+        } else {
+            job = find_job(my_slot);
+        }
+
+        if (job == NULL) {
             if (owned_job) {
-                // There are no jobs pending. Wait for the last worker
-                // to signal that the job is finished.
+                // There are no tasks left to claim. Wait for the last
+                // worker to signal that the job is finished.
                 halide_cond_wait(&work_queue.wakeup_owners, &work_queue.mutex);
             } else if (work_queue.a_team_size <= work_queue.target_a_team_size) {
                 // There are no jobs pending. Wait until more jobs are enqueued.
@@ -113,35 +434,17 @@ WEAK void worker_thread_already_locked(work *owned_job) {
                 work_queue.a_team_size++;
             }
         } else {
-            // Grab the next job.
-            work *job = work_queue.jobs;
-
-            // Claim a task from it.
-            work myjob = *job;
-            job->next++;
-
-            // If there were no more tasks pending for this job,
-            // remove it from the stack.
-            if (job->next == job->max) {
-                work_queue.jobs = job->next_job;
-            }
-
             // Increment the active_worker count so that other threads
             // are aware that this job is still in progress even
-            // though there are no outstanding tasks for it.
+            // though there may be no outstanding tasks for it.
             job->active_workers++;
 
-            // Release the lock and do the task.
+            // Release the lock and claim and steal tasks until the
+            // job runs dry.
             halide_mutex_unlock(&work_queue.mutex);
-            int result = halide_do_task(myjob.user_context, myjob.f, myjob.next,
-                                        myjob.closure);
+            work_on_job(job, my_slot, &rng);
             halide_mutex_lock(&work_queue.mutex);
 
-            // If this task failed, set the exit status on the job.
-            if (result) {
-                job->exit_status = result;
-            }
-
             // We are no longer active on this job
             job->active_workers--;
 
@@ -155,9 +458,11 @@ WEAK void worker_thread_already_locked(work *owned_job) {
 }
 
 
-WEAK void worker_thread(void *) {
+WEAK void worker_thread(void *arg) {
+    // Worker thread i uses task slot i + 1 of every job.
+    int my_slot = (int)(intptr_t)arg + 1;
     halide_mutex_lock(&work_queue.mutex);
-    worker_thread_already_locked(NULL);
+    worker_thread_already_locked(NULL, my_slot);
     halide_mutex_unlock(&work_queue.mutex);
 }
 
@@ -183,6 +488,19 @@ WEAK int default_do_par_for(void *user_context, halide_task_t f,
         work_queue.desired_num_threads = clamp_num_threads(work_queue.desired_num_threads);
         work_queue.threads_created = 0;
 
+        // Likewise for the parallel loop schedule and the thread
+        // affinity.
+        if (!work_queue.grain) {
+            default_par_for_schedule(&work_queue.schedule, &work_queue.grain);
+        }
+        if (!work_queue.affinity_initialized) {
+            const char *affinity_str = getenv("HL_THREAD_AFFINITY");
+            if (affinity_str) {
+                parse_thread_affinity(affinity_str);
+            }
+            work_queue.affinity_initialized = true;
+        }
+
         // Everyone starts on the a team.
         work_queue.a_team_size = work_queue.desired_num_threads;
 
@@ -192,19 +510,80 @@ WEAK int default_do_par_for(void *user_context, halide_task_t f,
     while (work_queue.threads_created < work_queue.desired_num_threads - 1) {
         // We might need to make some new threads, if work_queue.desired_num_threads has
         // increased.
+        intptr_t id = work_queue.threads_created;
         work_queue.threads[work_queue.threads_created++] =
-            halide_spawn_thread(worker_thread, NULL);
+            halide_spawn_thread(worker_thread, (void *)id);
     }
 
     // Make the job.
     work job;
     job.f = f;               // The job should call this function. It takes an index and a closure.
     job.user_context = user_context;
-    job.next = min;          // Start at this index.
-    job.max  = min + size;   // Keep going until one less than this index.
     job.closure = closure;   // Use this closure.
     job.exit_status = 0;     // The job hasn't failed yet
     job.active_workers = 0;  // Nobody is working on this yet
+    job.schedule = work_queue.schedule;
+    job.grain = work_queue.grain;
+    job.num_chunks = 0;
+    job.num_slots = work_queue.threads_created + 1;
+    job.numa = work_queue.num_numa_nodes > 1;
+
+    // alloca only guarantees the stack alignment, so over-allocate
+    // and align the slots by hand.
+    uintptr_t slot_mem = (uintptr_t)__builtin_alloca(job.num_slots * sizeof(task_slot) +
+                                                     TASK_SLOT_ALIGNMENT - 1);
+    job.slots = (task_slot *)((slot_mem + TASK_SLOT_ALIGNMENT - 1) & ~(uintptr_t)(TASK_SLOT_ALIGNMENT - 1));
+    for (int i = 0; i < job.num_slots; i++) {
+        job.slots[i].range = pack_range(0, 0);
+#ifdef BITS_32
+        job.slots[i].lock = 0;
+#endif
+    }
+
+    // In NUMA mode, each node gets a contiguous block of the
+    // iterations, so that a given part of a buffer is produced, and
+    // so first touched, on the same node every time. The block
+    // starts out in the slot of the node's first worker.
+    int numa_slots[MAX_THREADS];
+    if (job.numa && job.schedule != halide_par_for_schedule_blocked) {
+        for (int n = 0; n < work_queue.num_numa_nodes; n++) {
+            numa_slots[n] = 0;
+            for (int i = job.num_slots - 1; i > 0; i--) {
+                if (slot_numa_node(i) == n) {
+                    numa_slots[n] = i;
+                }
+            }
+            if (numa_slots[n] == 0) {
+                // There are no workers on this node yet.
+                job.numa = false;
+            }
+        }
+    }
+
+    if (job.numa && job.schedule != halide_par_for_schedule_blocked) {
+        int num_nodes = work_queue.num_numa_nodes;
+        for (int n = 0; n < num_nodes; n++) {
+            int begin = min + (int)(((int64_t)size * n) / num_nodes);
+            int end = min + (int)(((int64_t)size * (n + 1)) / num_nodes);
+            job.slots[numa_slots[n]].range = pack_range(begin, end);
+        }
+    } else if (job.schedule == halide_par_for_schedule_blocked) {
+        // Deal out one contiguous block of iterations to each thread.
+        for (int i = 0; i < job.num_slots; i++) {
+            int begin = min + (int)(((int64_t)size * i) / job.num_slots);
+            int end = min + (int)(((int64_t)size * (i + 1)) / job.num_slots);
+            job.slots[i].range = pack_range(begin, end);
+        }
+    } else {
+        // All the tasks start out in the owner's slot, and other
+        // threads steal them in progressively smaller pieces.
+        job.slots[0].range = pack_range(min, min + size);
+    }
+
+    // If the profiler is running, we'll report how many chunks the
+    // iterations of this loop were claimed in, in case it was
+    // launched by halide_profiler_do_par_for.
+    bool profiling = halide_profiler_get_state()->started;
 
     if (!work_queue.jobs && size < work_queue.desired_num_threads) {
         // If there's no nested parallelism happening and there are
@@ -234,15 +613,79 @@ WEAK int default_do_par_for(void *user_context, halide_task_t f,
     }
 
     // Do some work myself.
-    worker_thread_already_locked(&job);
+    worker_thread_already_locked(&job, 0);
+
+    // The job lives on this stack frame, so make sure nobody can
+    // find it after we return.
+    remove_job(&job);
 
     halide_mutex_unlock(&work_queue.mutex);
 
+    if (profiling) {
+        halide_profiler_record_par_for(closure, job.num_chunks);
+    }
+
     // Return zero if the job succeeded, otherwise return the exit
     // status of one of the failing jobs (whichever one failed last).
     return job.exit_status;
 }
 
+
+// The producers of async Funcs run on threads of their own rather
+// than on the thread pool, because they block waiting for their
+// consumers to free up space, and a pool thread blocked that way may
+// be the one the consumer is waiting for. A new thread is spawned and
+// joined for each task every time a Fork runs; nothing is cached, so
+// an async Func computed inside a loop pays for thread creation on
+// every iteration.
+struct async_task {
+    void *user_context;
+    halide_task_t f;
+    int idx;
+    uint8_t *closure;
+    int result;
+};
+
+WEAK void async_task_helper(void *arg) {
+    async_task *t = (async_task *)arg;
+    t->result = halide_do_task(t->user_context, t->f, t->idx, t->closure);
+}
+
+WEAK int default_do_async(void *user_context, halide_task_t f,
+                          int min, int size, uint8_t *closure) {
+    if (size <= 1) {
+        return size == 1 ? halide_do_task(user_context, f, min, closure) : 0;
+    }
+    async_task t = {user_context, f, min, closure, 0};
+    halide_thread *thread = halide_spawn_thread(async_task_helper, &t);
+    int result = default_do_async(user_context, f, min + 1, size - 1, closure);
+    halide_join_thread(thread);
+    return t.result ? t.result : result;
+}
+
+// Semaphores are waited on rarely enough that one lock and condition
+// variable shared by all of them is enough, and it means they hold no
+// resources of their own.
+struct semaphore_state {
+    int64_t value;
+    int64_t closed;
+};
+
+struct semaphore_sync_t {
+    halide_mutex mutex;
+    halide_cond changed;
+    bool initialized;
+};
+WEAK semaphore_sync_t semaphore_sync;
+
+WEAK void lock_semaphores() {
+    halide_mutex_lock(&semaphore_sync.mutex);
+    if (!semaphore_sync.initialized) {
+        halide_cond_init(&semaphore_sync.changed);
+        semaphore_sync.initialized = true;
+    }
+}
+
 }}} // namespace Halide::Runtime::Internal
 
 using namespace Halide::Runtime::Internal;
@@ -266,6 +709,29 @@ WEAK int halide_set_num_threads(int n) {
     return old;
 }
 
+WEAK void halide_set_par_for_schedule(halide_par_for_schedule_t schedule, int grain) {
+    halide_mutex_lock(&work_queue.mutex);
+    work_queue.schedule = schedule;
+    work_queue.grain = max(1, grain);
+    halide_mutex_unlock(&work_queue.mutex);
+}
+
+WEAK void halide_set_thread_affinity(int num_cpus, const int *cpus, const int *nodes) {
+    halide_mutex_lock(&work_queue.mutex);
+    work_queue.num_affinity_cpus = 0;
+    work_queue.num_numa_nodes = 1;
+    for (int i = 0; i < num_cpus && i < MAX_THREADS; i++) {
+        int node = nodes ? min(max(nodes[i], 0), MAX_THREADS - 1) : 0;
+        work_queue.affinity_cpus[i] = cpus[i];
+        work_queue.affinity_nodes[i] = node;
+        work_queue.num_numa_nodes = max(work_queue.num_numa_nodes, node + 1);
+        work_queue.num_affinity_cpus++;
+    }
+    work_queue.affinity_generation++;
+    work_queue.affinity_initialized = true;
+    halide_mutex_unlock(&work_queue.mutex);
+}
+
 WEAK void halide_shutdown_thread_pool() {
     if (!work_queue.initialized) return;
 
@@ -291,4 +757,48 @@ WEAK void halide_shutdown_thread_pool() {
     work_queue.initialized = false;
 }
 
+WEAK int halide_do_async(void *user_context, halide_task_t f,
+                         int min, int size, uint8_t *closure) {
+    return default_do_async(user_context, f, min, size, closure);
+}
+
+WEAK int halide_semaphore_init(halide_semaphore_t *sem, int n) {
+    semaphore_state *s = (semaphore_state *)sem;
+    s->value = n;
+    s->closed = 0;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore_t *sem, int n) {
+    semaphore_state *s = (semaphore_state *)sem;
+    lock_semaphores();
+    s->value += n;
+    halide_cond_broadcast(&semaphore_sync.changed);
+    halide_mutex_unlock(&semaphore_sync.mutex);
+    return 0;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore_t *sem, int n) {
+    semaphore_state *s = (semaphore_state *)sem;
+    lock_semaphores();
+    while (s->value < n && !s->closed) {
+        halide_cond_wait(&semaphore_sync.changed, &semaphore_sync.mutex);
+    }
+    int result = -1;
+    if (s->value >= n) {
+        s->value -= n;
+        result = 0;
+    }
+    halide_mutex_unlock(&semaphore_sync.mutex);
+    return result;
+}
+
+WEAK void halide_semaphore_close(void *user_context, void *sem) {
+    semaphore_state *s = (semaphore_state *)sem;
+    lock_semaphores();
+    s->closed = 1;
+    halide_cond_broadcast(&semaphore_sync.changed);
+    halide_mutex_unlock(&semaphore_sync.mutex);
+}
+
 }
@@ -14,6 +14,140 @@ WEAK int halide_trace_file = 0;
 WEAK int halide_trace_file_lock = 0;
 WEAK bool halide_trace_file_initialized = false;
 WEAK bool halide_trace_file_internally_opened = false;
+// Whether HL_TRACE_FILE has been opened before in this process.
+WEAK bool halide_trace_file_ever_opened = false;
+
+// A spin lock that many threads can hold at once in shared mode, or
+// one thread can hold in exclusive mode. A thread waiting for
+// exclusive access keeps new threads from taking shared access, so
+// that it doesn't starve.
+class SharedExclusiveSpinLock {
+    volatile uint32_t lock;
+
+    const static uint32_t exclusive_held_mask = 0x80000000;
+    const static uint32_t exclusive_waiting_mask = 0x40000000;
+    const static uint32_t shared_mask = 0x3fffffff;
+
+public:
+    __attribute__((always_inline)) void acquire_shared() {
+        while (1) {
+            uint32_t x = lock & shared_mask;
+            if (__sync_bool_compare_and_swap(&lock, x, x + 1)) {
+                return;
+            }
+        }
+    }
+
+    __attribute__((always_inline)) void release_shared() {
+        __sync_fetch_and_sub(&lock, 1);
+    }
+
+    __attribute__((always_inline)) void acquire_exclusive() {
+        while (1) {
+            __sync_fetch_and_or(&lock, exclusive_waiting_mask);
+            if (__sync_bool_compare_and_swap(&lock, exclusive_waiting_mask, exclusive_held_mask)) {
+                return;
+            }
+        }
+    }
+
+    __attribute__((always_inline)) void release_exclusive() {
+        __sync_fetch_and_and(&lock, ~exclusive_held_mask);
+    }
+};
+
+// Writes all of a buffer to a file, retrying short writes.
+WEAK bool write_all(int fd, const uint8_t *buf, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, buf, size);
+        if (written <= 0) {
+            return false;
+        }
+        buf += written;
+        size -= written;
+    }
+    return true;
+}
+
+// A buffer in which threads gather binary trace packets, to be written
+// to the trace file in large chunks rather than with a syscall per
+// packet. Threads filling in packets hold its lock shared, and only
+// contend over an atomic increment of the cursor. A thread that finds
+// the buffer full takes the lock exclusively, once the packets being
+// filled in are done, and writes the buffer out.
+class TraceBuffer {
+    SharedExclusiveSpinLock lock;
+    // The number of bytes claimed, and the number claimed by packets
+    // that didn't fit.
+    uint32_t cursor, overage;
+    // The file the packets in the buffer are bound for.
+    int fd;
+    bool ok;
+    uint8_t buf[1024 * 1024];
+
+    // Write out the buffer. Must hold the lock exclusively.
+    void flush_unlocked() {
+        cursor -= overage;
+        if (cursor > 0 && !write_all(fd, buf, cursor)) {
+            ok = false;
+        }
+        cursor = 0;
+        overage = 0;
+    }
+
+public:
+    void init() {
+        cursor = 0;
+        overage = 0;
+        fd = 0;
+        ok = true;
+    }
+
+    // Claim space for a packet bound for the given file, and take the
+    // lock shared. Call release_packet once it's filled in.
+    uint8_t *acquire_packet(int file, uint32_t size) {
+        while (1) {
+            lock.acquire_shared();
+            if (fd == file) {
+                uint32_t start = __sync_fetch_and_add(&cursor, size);
+                if (start + size <= sizeof(buf)) {
+                    return buf + start;
+                }
+                __sync_fetch_and_add(&overage, size);
+            }
+            lock.release_shared();
+            flush(file);
+        }
+    }
+
+    void release_packet() {
+        lock.release_shared();
+    }
+
+    // Write out the buffer, and bind it to the given file from now on.
+    // Returns false if a write to the previous file failed.
+    bool flush(int file) {
+        lock.acquire_exclusive();
+        flush_unlocked();
+        fd = file;
+        bool result = ok;
+        ok = true;
+        lock.release_exclusive();
+        return result;
+    }
+};
+
+WEAK TraceBuffer *halide_trace_buffer = NULL;
+
+// Write the packet that starts each trace file, straight to the file.
+WEAK bool write_trace_file_header(int fd) {
+    halide_trace_packet_t header;
+    memset(&header, 0, sizeof(header));
+    header.id = halide_trace_file_magic;
+    header.parent_id = halide_trace_file_version;
+    header.event = halide_trace_file_header;
+    return write_all(fd, (const uint8_t *)&header, sizeof(header));
+}
 
 WEAK int32_t default_trace(void *user_context, const halide_trace_event *e) {
     static int32_t ids = 1;
@@ -23,7 +157,6 @@ WEAK int32_t default_trace(void *user_context, const halide_trace_event *e) {
     // If we're dumping to a file, use a binary format
     int fd = halide_get_trace_file(user_context);
     if (fd > 0) {
-        // A 48-byte header. The first 6 bytes are metadata, then the rest is a zero-terminated string.
         uint8_t clamped_width = e->type.lanes < 256 ? e->type.lanes : 255;
         uint8_t clamped_dimensions = e->dimensions < 256 ? e->dimensions : 255;
 
@@ -33,47 +166,71 @@ WEAK int32_t default_trace(void *user_context, const halide_trace_event *e) {
         while (bytes*8 < e->type.bits) bytes <<= 1;
 
         // Compute the size of each portion of the tracing packet
-        size_t header_bytes = 48;
+        size_t header_bytes = sizeof(halide_trace_packet_t);
         size_t value_bytes = clamped_width * bytes;
         size_t int_arg_bytes = clamped_dimensions * sizeof(int32_t);
         size_t total_bytes = header_bytes + value_bytes + int_arg_bytes;
-        uint8_t buffer[4096];
         halide_assert(user_context, total_bytes <= 4096 && "Tracing packet too large");
 
-        ((int32_t *)buffer)[0] = my_id;
-        ((int32_t *)buffer)[1] = e->parent_id;
-        buffer[8] = e->event;
-        buffer[9] = e->type.code;
-        buffer[10] = e->type.bits;
-        buffer[11] = clamped_width;
-        buffer[12] = e->value_index;
-        buffer[13] = clamped_dimensions;
+        if (!halide_trace_buffer) {
+            ScopedSpinLock lock(&halide_trace_file_lock);
+            if (!halide_trace_buffer) {
+                TraceBuffer *b = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+                if (b) {
+                    b->init();
+                    __sync_synchronize();
+                    halide_trace_buffer = b;
+                }
+            }
+        }
+
+        // Fall back to writing each packet directly if there's no
+        // memory for the buffer.
+        uint8_t stack_buffer[4096];
+        uint8_t *buffer = stack_buffer;
+        if (halide_trace_buffer) {
+            buffer = halide_trace_buffer->acquire_packet(fd, total_bytes);
+        }
+
+        halide_trace_packet_t *header = (halide_trace_packet_t *)buffer;
+        header->id = my_id;
+        header->parent_id = e->parent_id;
+        header->event = e->event;
+        header->type_code = e->type.code;
+        header->type_bits = e->type.bits;
+        header->lanes = clamped_width;
+        header->value_index = e->value_index;
+        header->dimensions = clamped_dimensions;
 
         // Use up to 33 bytes for the function name
-        size_t i = 14;
-        for (; i < header_bytes-1; i++) {
-            buffer[i] = e->func[i-14];
-            if (buffer[i] == 0) break;
+        size_t i = 0;
+        for (; i < sizeof(header->func) - 1; i++) {
+            header->func[i] = e->func[i];
+            if (header->func[i] == 0) break;
         }
         // Fill the rest with zeros
-        for (; i < header_bytes; i++) {
-            buffer[i] = 0;
+        for (; i < sizeof(header->func); i++) {
+            header->func[i] = 0;
         }
 
         // Next comes the value
-        for (size_t i = 0; i < value_bytes; i++) {
-            buffer[header_bytes + i] = ((uint8_t *)(e->value))[i];
-        }
+        memcpy(buffer + header_bytes, e->value, value_bytes);
 
         // Then the int args
-        for (size_t i = 0; i < int_arg_bytes; i++) {
-            buffer[header_bytes + value_bytes + i] = ((uint8_t *)(e->coordinates))[i];
-        }
-
-        {
+        memcpy(buffer + header_bytes + value_bytes, e->coordinates, int_arg_bytes);
+
+        if (halide_trace_buffer) {
+            halide_trace_buffer->release_packet();
+            if (e->event == halide_trace_end_pipeline) {
+                // Don't leave the trace of a finished pipeline sitting
+                // in memory.
+                bool written = halide_trace_buffer->flush(fd);
+                halide_assert(user_context, written && "Can't write to trace file");
+            }
+        } else {
             ScopedSpinLock lock(&halide_trace_file_lock);
-            size_t written = write(fd, &buffer[0], total_bytes);
-            halide_assert(user_context, written == total_bytes && "Can't write to trace file");
+            bool written = write_all(fd, buffer, total_bytes);
+            halide_assert(user_context, written && "Can't write to trace file");
         }
 
     } else {
@@ -93,7 +250,9 @@ WEAK int32_t default_trace(void *user_context, const halide_trace_event *e) {
                                      "Consume",
                                      "End consume",
                                      "Begin pipeline",
-                                     "End pipeline"};
+                                     "End pipeline",
+                                     "Load region",
+                                     "Store region"};
 
         // Only print out the value on stores and loads.
         bool print_value = (e->event < 2);
@@ -188,7 +347,20 @@ WEAK trace_fn halide_set_custom_trace(trace_fn t) {
     return result;
 }
 
+WEAK int halide_flush_trace(void *user_context) {
+    if (halide_trace_buffer && !halide_trace_buffer->flush(halide_trace_file)) {
+        error(user_context) << "Can't write to trace file\n";
+        return -1;
+    }
+    return 0;
+}
+
 WEAK void halide_set_trace_file(int fd) {
+    // Packets already gathered are bound for the previous file.
+    halide_flush_trace(NULL);
+    if (fd > 0) {
+        write_trace_file_header(fd);
+    }
     halide_trace_file = fd;
     halide_trace_file_initialized = true;
 }
@@ -196,6 +368,7 @@ WEAK void halide_set_trace_file(int fd) {
 extern int errno;
 
 #define O_APPEND 1024
+#define O_TRUNC 512
 #define O_CREAT 64
 #define O_WRONLY 1
 WEAK int halide_get_trace_file(void *user_context) {
@@ -205,10 +378,21 @@ WEAK int halide_get_trace_file(void *user_context) {
     if (!halide_trace_file_initialized) {
         const char *trace_file_name = getenv("HL_TRACE_FILE");
         if (trace_file_name) {
-            int fd = open(trace_file_name, O_APPEND | O_CREAT | O_WRONLY, 0644);
+            // Truncate the file the first time this process opens it,
+            // so that it holds one header followed by the trace of one
+            // process. If tracing was shut down and starts up again,
+            // carry on where the trace left off.
+            bool reopening = halide_trace_file_ever_opened;
+            int fd = open(trace_file_name, (reopening ? O_APPEND : O_TRUNC) | O_CREAT | O_WRONLY, 0644);
             halide_assert(user_context, (fd > 0) && "Failed to open trace file\n");
-            halide_set_trace_file(fd);
+            if (reopening) {
+                halide_trace_file = fd;
+                halide_trace_file_initialized = true;
+            } else {
+                halide_set_trace_file(fd);
+            }
             halide_trace_file_internally_opened = true;
+            halide_trace_file_ever_opened = true;
         } else {
             halide_set_trace_file(0);
         }
@@ -221,6 +405,12 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event *e) {
 }
 
 WEAK int halide_shutdown_trace() {
+    halide_flush_trace(NULL);
+    if (halide_trace_buffer) {
+        ScopedSpinLock lock(&halide_trace_file_lock);
+        free(halide_trace_buffer);
+        halide_trace_buffer = NULL;
+    }
     if (halide_trace_file_internally_opened) {
         int ret = close(halide_trace_file);
         halide_trace_file = 0;
@@ -27,6 +27,8 @@ extern WIN32API void EnterCriticalSection(CriticalSection *);
 extern WIN32API void LeaveCriticalSection(CriticalSection *);
 extern WIN32API int32_t WaitForSingleObject(Thread, int32_t timeout);
 extern WIN32API bool InitOnceExecuteOnce(InitOnce *, bool WIN32API (*f)(InitOnce *, void *, void **), void *, void **);
+extern WIN32API Thread GetCurrentThread();
+extern WIN32API uintptr_t SetThreadAffinityMask(Thread, uintptr_t);
 
 } // extern "C"
 
@@ -122,4 +124,16 @@ WEAK int halide_host_cpu_count() {
     }
 }
 
+WEAK int halide_set_current_thread_cpu(int cpu) {
+    uintptr_t mask;
+    if (cpu < 0) {
+        mask = ~(uintptr_t)0;
+    } else if (cpu < (int)(sizeof(mask) * 8)) {
+        mask = (uintptr_t)1 << cpu;
+    } else {
+        return -1;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) ? 0 : -1;
+}
+
 } // extern "C"
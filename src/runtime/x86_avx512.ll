@@ -0,0 +1,43 @@
+declare <16 x i16> @llvm.x86.avx512.mask.pmovs.dw.512(<16 x i32>, <16 x i16>, i16)
+declare <16 x i16> @llvm.x86.avx512.mask.pmovus.dw.512(<16 x i32>, <16 x i16>, i16)
+declare <32 x i8> @llvm.x86.avx512.mask.pmovs.wb.512(<32 x i16>, <32 x i8>, i32)
+declare <32 x i8> @llvm.x86.avx512.mask.pmovus.wb.512(<32 x i16>, <32 x i8>, i32)
+
+; Unlike the sse and avx2 pack instructions, the avx512 saturating
+; narrowing moves don't interleave 128-bit lanes, so there's no need
+; to fix up the result with a shuffle.
+
+define weak_odr <16 x i16> @packssdwx16(<16 x i32> %arg) nounwind alwaysinline {
+  %1 = tail call <16 x i16> @llvm.x86.avx512.mask.pmovs.dw.512(<16 x i32> %arg, <16 x i16> undef, i16 -1)
+  ret <16 x i16> %1
+}
+
+; vpmovusdw treats its input as unsigned, so clamp negative values to
+; zero first.
+define weak_odr <16 x i16> @packusdwx16(<16 x i32> %arg) nounwind alwaysinline {
+  %1 = icmp sgt <16 x i32> %arg, zeroinitializer
+  %2 = select <16 x i1> %1, <16 x i32> %arg, <16 x i32> zeroinitializer
+  %3 = tail call <16 x i16> @llvm.x86.avx512.mask.pmovus.dw.512(<16 x i32> %2, <16 x i16> undef, i16 -1)
+  ret <16 x i16> %3
+}
+
+define weak_odr <32 x i8> @packsswbx32(<32 x i16> %arg) nounwind alwaysinline {
+  %1 = tail call <32 x i8> @llvm.x86.avx512.mask.pmovs.wb.512(<32 x i16> %arg, <32 x i8> undef, i32 -1)
+  ret <32 x i8> %1
+}
+
+define weak_odr <32 x i8> @packuswbx32(<32 x i16> %arg) nounwind alwaysinline {
+  %1 = icmp sgt <32 x i16> %arg, zeroinitializer
+  %2 = select <32 x i1> %1, <32 x i16> %arg, <32 x i16> zeroinitializer
+  %3 = tail call <32 x i8> @llvm.x86.avx512.mask.pmovus.wb.512(<32 x i16> %2, <32 x i8> undef, i32 -1)
+  ret <32 x i8> %3
+}
+
+declare <16 x i32> @llvm.x86.avx512.mask.pmaddw.d.512(<32 x i16>, <32 x i16>, <16 x i32>, i16)
+
+define weak_odr <16 x i32> @pmaddwdx16(<16 x i16> %a, <16 x i16> %b, <16 x i16> %c, <16 x i16> %d) nounwind alwaysinline {
+  %1 = shufflevector <16 x i16> %a, <16 x i16> %c, <32 x i32> <i32 0, i32 16, i32 1, i32 17, i32 2, i32 18, i32 3, i32 19, i32 4, i32 20, i32 5, i32 21, i32 6, i32 22, i32 7, i32 23, i32 8, i32 24, i32 9, i32 25, i32 10, i32 26, i32 11, i32 27, i32 12, i32 28, i32 13, i32 29, i32 14, i32 30, i32 15, i32 31>
+  %2 = shufflevector <16 x i16> %b, <16 x i16> %d, <32 x i32> <i32 0, i32 16, i32 1, i32 17, i32 2, i32 18, i32 3, i32 19, i32 4, i32 20, i32 5, i32 21, i32 6, i32 22, i32 7, i32 23, i32 8, i32 24, i32 9, i32 25, i32 10, i32 26, i32 11, i32 27, i32 12, i32 28, i32 13, i32 29, i32 14, i32 30, i32 15, i32 31>
+  %3 = tail call <16 x i32> @llvm.x86.avx512.mask.pmaddw.d.512(<32 x i16> %1, <32 x i16> %2, <16 x i32> zeroinitializer, i16 -1)
+  ret <16 x i32> %3
+}
@@ -15,7 +15,12 @@ WEAK CpuFeatures halide_get_cpu_features() {
                            (1ULL << halide_target_feature_avx) |
                            (1ULL << halide_target_feature_f16c) |
                            (1ULL << halide_target_feature_fma) |
-                           (1ULL << halide_target_feature_avx2);
+                           (1ULL << halide_target_feature_avx2) |
+                           (1ULL << halide_target_feature_avx512) |
+                           (1ULL << halide_target_feature_avx512_bw) |
+                           (1ULL << halide_target_feature_avx512_dq) |
+                           (1ULL << halide_target_feature_avx512_vl) |
+                           (1ULL << halide_target_feature_avx512_vnni);
 
     uint64_t available = 0;
 
@@ -50,6 +55,22 @@ WEAK CpuFeatures halide_get_cpu_features() {
         if (have_avx2) {
             available |= (1ULL << halide_target_feature_avx2);
         }
+        const bool have_avx512f = (info2[1] & (1 << 16)) != 0;
+        if (have_avx2 && have_avx512f) {
+            available |= (1ULL << halide_target_feature_avx512);
+            if ((info2[1] & (1 << 17)) != 0) {
+                available |= (1ULL << halide_target_feature_avx512_dq);
+            }
+            if ((info2[1] & (1 << 30)) != 0) {
+                available |= (1ULL << halide_target_feature_avx512_bw);
+            }
+            if ((info2[1] & (1U << 31)) != 0) {
+                available |= (1ULL << halide_target_feature_avx512_vl);
+            }
+            if ((info2[2] & (1 << 11)) != 0) {
+                available |= (1ULL << halide_target_feature_avx512_vnni);
+            }
+        }
     }
     CpuFeatures features = {known, available};
     return features;
@@ -0,0 +1,106 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+// Each test defines the same pipeline twice, realizes one copy with
+// the default schedule and the other with the schedule picked by the
+// auto-scheduler, and checks that they compute the same thing.
+
+Image<uint16_t> make_input(int w, int h) {
+    Image<uint16_t> input(w, h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            input(x, y) = (uint16_t)(rand() & 0xfff);
+        }
+    }
+    return input;
+}
+
+template<typename T>
+bool check_same(const char *name, const Image<T> &a, const Image<T> &b) {
+    for (int y = 0; y < a.height(); y++) {
+        for (int x = 0; x < a.width(); x++) {
+            if (a(x, y) != b(x, y)) {
+                printf("%s: auto-scheduled output(%d, %d) = %f instead of %f\n",
+                       name, x, y, (double)b(x, y), (double)a(x, y));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// A separable blur with a boundary condition.
+Func blur(Image<uint16_t> input, int w, int h) {
+    Func in = BoundaryConditions::repeat_edge(input);
+    Func blur_x("blur_x"), blur_y("blur_y");
+    Var x("x"), y("y");
+    blur_x(x, y) = (in(x - 1, y) + in(x, y) + in(x + 1, y)) / 3;
+    blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+    blur_y.estimate(x, 0, w).estimate(y, 0, h);
+    return blur_y;
+}
+
+// A histogram, which has an update definition, and a Func with no
+// dimensions that sums the whole input.
+Func histogram_equalize(Image<uint16_t> input, int w, int h) {
+    Var x("x"), y("y"), i("i");
+    RDom r(input);
+
+    Func hist("hist");
+    hist(i) = 0;
+    hist(clamp(input(r.x, r.y) >> 4, 0, 255)) += 1;
+
+    Func total("total");
+    total() = 0;
+    total() += cast<int>(input(r.x, r.y));
+
+    Func out("out");
+    out(x, y) = hist(clamp(input(x, y) >> 4, 0, 255)) + total() / (w * h);
+    out.estimate(x, 0, w).estimate(y, 0, h);
+    return out;
+}
+
+// A pipeline whose estimates describe an empty output, so every
+// region the auto-scheduler sees has zero extent.
+Func empty_estimate(Image<uint16_t> input, int w, int h) {
+    Var x("x"), y("y");
+    Func f("f"), g("g");
+    f(x, y) = input(x, y) * 2 + 1;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    g.estimate(x, 0, 0).estimate(y, 0, 0);
+    return g;
+}
+
+template<typename T>
+bool test(const char *name, Func (*make)(Image<uint16_t>, int, int),
+          Image<uint16_t> input, int w, int h) {
+    Target target = get_jit_target_from_environment();
+
+    Func reference = make(input, w, h);
+    Image<T> correct = reference.realize(w, h, target);
+
+    Func scheduled = make(input, w, h);
+    std::string schedule = Pipeline(scheduled).auto_schedule(target);
+    Image<T> out = scheduled.realize(w, h, target);
+
+    if (!check_same(name, correct, out)) {
+        printf("The schedule was:\n%s\n", schedule.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const int w = 1536, h = 1024;
+    Image<uint16_t> input = make_input(w + 1, h);
+
+    if (!test<uint16_t>("blur", blur, input, w, h)) return -1;
+    if (!test<int>("histogram_equalize", histogram_equalize, input, w, h)) return -1;
+    if (!test<uint16_t>("empty_estimate", empty_estimate, input, w, h)) return -1;
+
+    printf("Success!\n");
+    return 0;
+}
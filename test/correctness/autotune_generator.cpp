@@ -0,0 +1,99 @@
+#include "Halide.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+
+using namespace Halide;
+
+namespace {
+
+// A small pipeline with a few unscheduled Funcs for the autotuner to
+// choose schedules for.
+class AutotuneToy : public Generator<AutotuneToy> {
+public:
+    ImageParam input{UInt(16), 2, "input"};
+
+    Func build() {
+        Var x("x"), y("y");
+        Func in = BoundaryConditions::repeat_edge(input);
+        Func blur_x("blur_x"), blur_y("blur_y"), out("out");
+        blur_x(x, y) = (in(x - 1, y) + in(x, y) + in(x + 1, y)) / 3;
+        blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+        out(x, y) = blur_y(x, y) * 2 - in(x, y) / 2;
+        out.estimate(x, 0, 256).estimate(y, 0, 128);
+        return out;
+    }
+};
+
+RegisterGenerator<AutotuneToy> register_autotune_toy{"autotune_toy"};
+
+}  // namespace
+
+int tune(const std::string &log, const std::string &schedule, const char *trials) {
+    const char *argv[] = {"autotune", "-g", "autotune_toy", "-l", log.c_str(),
+                          "-o", schedule.c_str(), "-t", trials, "-n", "1", "target=host"};
+    std::ostringstream messages;
+    int result = Internal::autotune_main(sizeof(argv) / sizeof(argv[0]), (char **)argv, messages);
+    if (result != 0) {
+        std::cerr << messages.str();
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = Internal::dir_make_temp();
+    std::string log = dir + "/autotune_toy.log";
+    std::string schedule = dir + "/autotune_toy.schedule";
+
+    // A short search. Every candidate is checked against the serial
+    // reference schedule, and the chosen one is checked again before
+    // it's reported, so success means it computes the right output.
+    if (tune(log, schedule, "8") != 0) {
+        printf("Autotuning failed\n");
+        return -1;
+    }
+
+    std::ifstream in(schedule);
+    std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (source.empty()) {
+        printf("No schedule was written to %s\n", schedule.c_str());
+        return -1;
+    }
+
+    // The log has a result for the auto-scheduler and for each trial.
+    std::ifstream log_in(log);
+    int results = 0, wrong = 0;
+    std::string line;
+    while (std::getline(log_in, line)) {
+        if (line.compare(0, 3, "ok\t") == 0) {
+            results++;
+        } else if (line.compare(0, 6, "wrong\t") == 0) {
+            wrong++;
+        }
+    }
+    if (results < 2 || wrong > 0) {
+        printf("Expected several successful candidates and no wrong ones in the log, "
+               "got %d and %d\n", results, wrong);
+        return -1;
+    }
+
+    // Resuming from the log with no more trials picks the same best
+    // schedule out of the log, and checks it against a fresh
+    // reference.
+    std::string resumed_schedule = dir + "/autotune_toy_resumed.schedule";
+    if (tune(log, resumed_schedule, "0") != 0) {
+        printf("Resuming the search failed\n");
+        return -1;
+    }
+    std::ifstream resumed_in(resumed_schedule);
+    std::string resumed((std::istreambuf_iterator<char>(resumed_in)), std::istreambuf_iterator<char>());
+    if (resumed != source) {
+        printf("Resuming the search chose a different schedule:\n%s\ninstead of:\n%s\n",
+               resumed.c_str(), source.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+// Returns the digit at the end of a two-character string.
+extern "C" DLLEXPORT int string_digit(const char *s) {
+    return s[1] - '0';
+}
+HalideExtern_1(int, string_digit, const char *);
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+// Pipelines that differ only in a float constant too small to show
+// up when the IR is printed must not share a JIT cache entry.
+bool check_scale(float scale) {
+    Func f;
+    Var x;
+    f(x) = cast<float>(x) * scale;
+    Image<float> out = f.realize(1024);
+    for (int i = 0; i < out.width(); i++) {
+        float correct = (float)i * scale;
+        if (out(i) != correct) {
+            printf("With a scale of %.9g, out(%d) = %.9g instead of %.9g\n",
+                   scale, i, out(i), correct);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Nor may pipelines that differ only in the contents of a string
+// constant that happens to look like a generated name.
+bool check_string(const char *str) {
+    Func f;
+    Var x;
+    f(x) = x + string_digit(Internal::StringImm::make(str));
+    Image<int> out = f.realize(16);
+    for (int i = 0; i < out.width(); i++) {
+        int correct = i + str[1] - '0';
+        if (out(i) != correct) {
+            printf("With the string \"%s\", out(%d) = %d instead of %d\n",
+                   str, i, out(i), correct);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = Internal::dir_make_temp();
+    set_env("HL_JIT_CACHE_DIR", dir.c_str());
+
+    // 1.0000001f and 1.0000002f are adjacent floats. Run each twice,
+    // so that the second run of each comes from the warm cache.
+    const float a = 1.0000001f, b = 1.0000002f;
+    for (int i = 0; i < 2; i++) {
+        if (!check_scale(a)) return -1;
+        if (!check_scale(b)) return -1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (!check_string("c1")) return -1;
+        if (!check_string("c2")) return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
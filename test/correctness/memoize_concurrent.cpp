@@ -0,0 +1,110 @@
+#include <atomic>
+#include <stdio.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+// Counts the tiles actually computed, as opposed to found in the
+// cache. Tiles are computed on many threads at once.
+std::atomic<int> tiles_computed(0);
+
+extern "C" DLLEXPORT int make_tile(int32_t val, buffer_t *out) {
+    if (out->host) {
+        tiles_computed++;
+        for (int32_t y = 0; y < out->extent[1]; y++) {
+            for (int32_t x = 0; x < out->extent[0]; x++) {
+                out->host[x * out->stride[0] + y * out->stride[1]] =
+                    (uint8_t)(val + x + y * 3 + out->min[2]);
+            }
+        }
+    }
+    return 0;
+}
+
+bool check(const Image<uint8_t> &out, int val) {
+    for (int z = 0; z < out.channels(); z++) {
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                uint8_t correct = (uint8_t)(val + x + y * 3 + z + 1);
+                if (out(x, y, z) != correct) {
+                    printf("out(%d, %d, %d) = %d instead of %d\n",
+                           x, y, z, out(x, y, z), correct);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // Many threads look up and store distinct entries in the
+    // memoization cache at once. The tiles all have the same key,
+    // and differ in their bounds, which are hashed along with the key
+    // to choose a shard and bucket. So there are enough entries for
+    // the hash tables of all the cache's shards to grow several
+    // times. Then the cache is shrunk so that the stores also evict.
+    const int tiles = 2048;
+    const int tile_bytes = 8 * 8;
+
+    Param<int> val;
+    Func tile;
+    tile.define_extern("make_tile", {val}, UInt(8), 3);
+
+    Func g;
+    Var x, y, z;
+    g(x, y, z) = tile(x, y, z) + 1;
+    tile.compute_at(g, z).memoize();
+    g.parallel(z);
+
+    Internal::JITSharedRuntime::memoization_cache_set_size(tiles * tile_bytes * 2);
+    val.set(7);
+
+    // Every tile is a distinct entry, so each is computed exactly once.
+    Image<uint8_t> out = g.realize(8, 8, tiles);
+    if (!check(out, 7)) return -1;
+    if (tiles_computed != tiles) {
+        printf("Computed %d tiles on the first run instead of %d\n", (int)tiles_computed, tiles);
+        return -1;
+    }
+
+    // They all fit in the cache, so the second run computes nothing.
+    tiles_computed = 0;
+    out = g.realize(8, 8, tiles);
+    if (!check(out, 7)) return -1;
+    if (tiles_computed != 0) {
+        printf("Computed %d tiles with a warm cache\n", (int)tiles_computed);
+        return -1;
+    }
+
+    // Shrink the cache to an eighth of the tiles. Most tiles must be
+    // recomputed, and storing them evicts others while lookups are
+    // going on. Entries in use can't be evicted, so the cache may
+    // briefly hold a few more than fit.
+    Internal::JITSharedRuntime::memoization_cache_set_size(tiles * tile_bytes / 8);
+    for (int i = 0; i < 3; i++) {
+        tiles_computed = 0;
+        out = g.realize(8, 8, tiles);
+        if (!check(out, 7)) return -1;
+        if (tiles_computed < tiles / 2 || tiles_computed > tiles) {
+            printf("Computed %d tiles with a small cache\n", (int)tiles_computed);
+            return -1;
+        }
+    }
+
+    // A different value of the parameter is a different key.
+    val.set(100);
+    out = g.realize(8, 8, tiles);
+    if (!check(out, 100)) return -1;
+
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    printf("Success!\n");
+    return 0;
+}
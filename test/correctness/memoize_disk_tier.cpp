@@ -0,0 +1,165 @@
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "Halide.h"
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+std::atomic<int> tiles_computed(0);
+
+extern "C" DLLEXPORT int make_disk_tile(int32_t val, buffer_t *out) {
+    if (out->host) {
+        tiles_computed++;
+        for (int32_t y = 0; y < out->extent[1]; y++) {
+            for (int32_t x = 0; x < out->extent[0]; x++) {
+                out->host[x * out->stride[0] + y * out->stride[1]] =
+                    (uint8_t)(val + x + y * 3 + out->min[2]);
+            }
+        }
+    }
+    return 0;
+}
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+const int tiles = 16;
+
+// Define the pipeline afresh, realize it, and check the output. Cache
+// keys are made from the names of the pipeline and the Func, a hash
+// of the definition, and the parameter values, so they are the same
+// every time for the same val and offset.
+bool run(int val, int offset = 0) {
+    Param<int> p("p");
+    Func tile("tile");
+    tile.define_extern("make_disk_tile", {p + offset}, UInt(8), 3);
+
+    Func g("g");
+    Var x, y, z;
+    g(x, y, z) = tile(x, y, z) + 1;
+    tile.compute_at(g, z).memoize();
+
+    p.set(val);
+    Image<uint8_t> out = g.realize(8, 8, tiles);
+    for (int z = 0; z < out.channels(); z++) {
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                uint8_t correct = (uint8_t)(val + offset + x + y * 3 + z + 1);
+                if (out(x, y, z) != correct) {
+                    printf("out(%d, %d, %d) = %d instead of %d\n",
+                           x, y, z, out(x, y, z), correct);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+std::string slot_path(const std::string &dir, int slot) {
+    return dir + "/halide_memo_" + std::to_string(slot) + ".bin";
+}
+
+// Throw away the runtime, and with it the in-memory cache, as if the
+// process had been restarted.
+void restart() {
+    Internal::JITSharedRuntime::release_all();
+}
+
+int main(int argc, char **argv) {
+    // The disk tier is configured when the runtime first uses the
+    // cache.
+    std::string dir = Internal::dir_make_temp();
+    set_env("HL_MEMOIZATION_CACHE_DIR", dir.c_str());
+
+    // Fill the cache. Each tile is written to disk as it's stored.
+    if (!run(7)) return -1;
+    if (tiles_computed != tiles) {
+        printf("Computed %d tiles with an empty cache instead of %d\n", (int)tiles_computed, tiles);
+        return -1;
+    }
+
+    // Keys that land in the same slot replace each other, so there
+    // may be fewer files than tiles.
+    int files = 0, last_slot = -1;
+    for (int slot = 0; slot < 256; slot++) {
+        FILE *f = fopen(slot_path(dir, slot).c_str(), "rb");
+        if (f) {
+            files++;
+            last_slot = slot;
+            fclose(f);
+        }
+    }
+    if (files == 0) {
+        printf("Nothing was written to the disk tier\n");
+        return -1;
+    }
+
+    // After a restart the in-memory cache is empty, so every tile
+    // that has a file is read back from disk.
+    restart();
+    tiles_computed = 0;
+    if (!run(7)) return -1;
+    if (tiles_computed != tiles - files) {
+        printf("Computed %d tiles after a restart instead of %d\n", (int)tiles_computed, tiles - files);
+        return -1;
+    }
+
+    // Corrupt the contents of one tile. Its checksum no longer
+    // matches, so it must be recomputed rather than used.
+    {
+        std::string path = slot_path(dir, last_slot);
+        FILE *f = fopen(path.c_str(), "r+b");
+        if (!f || fseek(f, -1, SEEK_END) != 0) {
+            printf("Couldn't open %s\n", path.c_str());
+            return -1;
+        }
+        int c = fgetc(f);
+        fseek(f, -1, SEEK_END);
+        fputc(c ^ 0xff, f);
+        fclose(f);
+    }
+    restart();
+    tiles_computed = 0;
+    if (!run(7)) return -1;
+    if (tiles_computed != tiles - files + 1) {
+        printf("Computed %d tiles after corrupting one instead of %d\n",
+               (int)tiles_computed, tiles - files + 1);
+        return -1;
+    }
+
+    // A different parameter value is a different set of keys, so it
+    // misses on disk too.
+    restart();
+    tiles_computed = 0;
+    if (!run(100)) return -1;
+    if (tiles_computed != tiles) {
+        printf("Computed %d tiles for a new parameter value instead of %d\n", (int)tiles_computed, tiles);
+        return -1;
+    }
+
+    // So does a different definition of the same Funcs with the same
+    // parameter value, as a new build of the program might have.
+    restart();
+    tiles_computed = 0;
+    if (!run(100, 5)) return -1;
+    if (tiles_computed != tiles) {
+        printf("Computed %d tiles for a new definition instead of %d\n", (int)tiles_computed, tiles);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
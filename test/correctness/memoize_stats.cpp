@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string>
+#include "Halide.h"
+
+using namespace Halide;
+
+// Get the statistics of the memoization cache. The JIT runtime isn't
+// linked into this program, so call it from a pipeline, which shares
+// the runtime with the pipelines that use the cache.
+int get_stats(halide_memoization_cache_stats_t *stats,
+              halide_memoization_cache_func_stats_t *func_stats, int max_funcs) {
+    Param<void *> stats_ptr, func_stats_ptr;
+    Func get("get_stats");
+    get() = Internal::Call::make(Int(32), "halide_memoization_cache_get_stats",
+                                 {stats_ptr, func_stats_ptr, max_funcs}, Internal::Call::Extern);
+    stats_ptr.set(stats);
+    func_stats_ptr.set(func_stats);
+    Image<int> result = get.realize();
+    return result();
+}
+
+int main(int argc, char **argv) {
+    // Two memoized Funcs. Each of them is computed once, and found in
+    // the cache the second time around.
+    Param<int> p("p");
+    Func f("stats_f"), g("stats_g"), out("out");
+    Var x, y;
+    f(x, y) = x * y + p;
+    g(x, y) = f(x, y) * 2 + x;
+    out(x, y) = f(x, y) + g(x, y);
+    f.compute_root().memoize();
+    g.compute_root().memoize();
+
+    p.set(3);
+    for (int i = 0; i < 2; i++) {
+        out.realize(16, 16);
+    }
+
+    const int max_funcs = 8;
+    halide_memoization_cache_stats_t stats;
+    halide_memoization_cache_func_stats_t func_stats[max_funcs];
+    int num_funcs = get_stats(&stats, func_stats, max_funcs);
+
+    if (stats.hits != 2 || stats.misses != 2 || stats.num_entries != 2) {
+        printf("Expected 2 hits, 2 misses and 2 entries, got %d, %d and %d\n",
+               (int)stats.hits, (int)stats.misses, (int)stats.num_entries);
+        return -1;
+    }
+
+    // Each Func is reported under its own name, as embedded in its
+    // cache keys.
+    if (num_funcs != 2) {
+        printf("Expected statistics for 2 Funcs, got %d\n", num_funcs);
+        return -1;
+    }
+    for (const std::string &name : {f.name(), g.name()}) {
+        int found = -1;
+        for (int i = 0; i < num_funcs; i++) {
+            if (name == func_stats[i].name) {
+                found = i;
+            }
+        }
+        if (found < 0) {
+            printf("No statistics for %s. The Funcs reported are:\n", name.c_str());
+            for (int i = 0; i < num_funcs; i++) {
+                printf("  %s\n", func_stats[i].name);
+            }
+            return -1;
+        }
+        const halide_memoization_cache_func_stats_t &s = func_stats[found];
+        if (s.hits != 1 || s.misses != 1 || s.current_bytes != 16 * 16 * 4) {
+            printf("%s had %d hits, %d misses and %d bytes instead of 1, 1 and %d\n",
+                   s.name, (int)s.hits, (int)s.misses, (int)s.current_bytes, 16 * 16 * 4);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
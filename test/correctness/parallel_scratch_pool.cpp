@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+// Heap allocations inside parallel loops take their buffers from a
+// scratch pool that is created before the loop and destroyed after
+// it. Track every allocation to check that the pool reuses buffers
+// and that nothing is leaked, even when the pipeline fails.
+
+std::atomic<int> live_allocations(0);
+std::atomic<int> total_allocations(0);
+
+void *my_malloc(void *user_context, size_t x) {
+    live_allocations++;
+    total_allocations++;
+    void *orig = malloc(x + 32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    live_allocations--;
+    free(((void **)ptr)[-1]);
+}
+
+bool error_occurred = false;
+void my_error(void *user_context, const char *msg) {
+    error_occurred = true;
+}
+
+// Run at the end of lowering, to count the allocations that take
+// their buffer from a scratch pool, and the pools themselves.
+class CountScratchPools : public Internal::IRMutator {
+    using IRMutator::visit;
+
+    void visit(const Internal::Allocate *op) {
+        if (op->free_function == "halide_scratch_pool_destroy") {
+            pools++;
+        } else if (op->free_function == "halide_scratch_pool_release") {
+            pooled++;
+        }
+        IRMutator::visit(op);
+    }
+
+public:
+    int pools = 0, pooled = 0;
+};
+
+bool check_no_leaks(const char *name) {
+    if (live_allocations != 0) {
+        printf("%s: %d allocations were not freed\n", name, (int)live_allocations);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const int rows = 1024;
+    Var x("x"), y("y"), z("z");
+
+    // The size of f's allocation isn't known at compile time, so it
+    // goes on the heap, once per row.
+    Param<int> width("width");
+    width.set(1000);
+
+    {
+        Func f("f"), g("g");
+        f(x, y) = x * y;
+        g(x, y) = f(x, y) + f(x + 1, y);
+        f.compute_at(g, y);
+        g.parallel(y);
+        g.bound(x, 0, width);
+        g.set_custom_allocator(my_malloc, my_free);
+        CountScratchPools counter;
+        g.add_custom_lowering_pass(&counter, nullptr);
+
+        total_allocations = 0;
+        Image<int> out = g.realize(1000, rows);
+
+        // Later passes must keep the pool along with the allocation
+        // that uses it.
+        if (counter.pools != 1 || counter.pooled != 1) {
+            printf("Expected one allocation from one scratch pool after lowering, "
+                   "got %d from %d\n", counter.pooled, counter.pools);
+            return -1;
+        }
+        for (int j = 0; j < rows; j++) {
+            for (int i = 0; i < 1000; i++) {
+                int correct = i * j + (i + 1) * j;
+                if (out(i, j) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", i, j, out(i, j), correct);
+                    return -1;
+                }
+            }
+        }
+        if (!check_no_leaks("parallel")) return -1;
+
+        // One buffer per thread rather than one per row.
+        if (total_allocations >= rows) {
+            printf("Made %d allocations for %d rows\n", (int)total_allocations, rows);
+            return -1;
+        }
+    }
+
+    // Nested parallel loops. The pool wraps the inner one.
+    {
+        Func f("f"), g("g");
+        f(x, y, z) = x + y * z;
+        g(x, y, z) = f(x, y, z) * 2;
+        f.compute_at(g, y);
+        g.parallel(z).parallel(y);
+        g.bound(x, 0, width);
+        g.set_custom_allocator(my_malloc, my_free);
+
+        Image<int> out = g.realize(1000, 64, 16);
+        for (int k = 0; k < 16; k++) {
+            for (int j = 0; j < 64; j++) {
+                for (int i = 0; i < 1000; i++) {
+                    int correct = (i + j * k) * 2;
+                    if (out(i, j, k) != correct) {
+                        printf("out(%d, %d, %d) = %d instead of %d\n", i, j, k, out(i, j, k), correct);
+                        return -1;
+                    }
+                }
+            }
+        }
+        if (!check_no_leaks("nested parallel")) return -1;
+    }
+
+    // A row whose allocation depends on the loop variable uses a pool
+    // of buffers sized for the largest row.
+    {
+        Func f("f"), g("g");
+        f(x, y) = x + y;
+        g(x, y) = f(min(x, y), y);
+        f.compute_at(g, y);
+        g.parallel(y);
+        g.set_custom_allocator(my_malloc, my_free);
+
+        Image<int> out = g.realize(1000, rows);
+        for (int j = 0; j < rows; j++) {
+            for (int i = 0; i < 1000; i++) {
+                int correct = std::min(i, j) + j;
+                if (out(i, j) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", i, j, out(i, j), correct);
+                    return -1;
+                }
+            }
+        }
+        if (!check_no_leaks("varying extent")) return -1;
+    }
+
+    // An assertion fails inside the parallel loop after f's buffer
+    // has been acquired from the pool. The pool and its buffers must
+    // still be freed.
+    {
+        Func f("f"), h("h"), g("g");
+        Var xi("xi"), yi("yi");
+        Param<int> split("split");
+
+        f(x, y) = x + y;
+        h(x, y) = f(x, y);
+        g(x, y) = h(x % split, y % split) + 1;
+        g.tile(x, y, xi, yi, split, split).parallel(y);
+        f.compute_at(g, y);
+        h.compute_at(g, x).bound(x, 0, 10);
+        g.set_custom_allocator(my_malloc, my_free);
+        g.set_error_handler(my_error);
+
+        split.set(11);
+        g.realize(44, 44);
+        if (!error_occurred) {
+            printf("There was supposed to be an error\n");
+            return -1;
+        }
+        if (!check_no_leaks("error exit")) return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
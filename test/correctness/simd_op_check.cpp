@@ -26,7 +26,7 @@ using std::string;
 bool failed = false;
 Var x("x"), y("y");
 
-bool use_ssse3, use_sse41, use_sse42, use_avx, use_avx2;
+bool use_ssse3, use_sse41, use_sse42, use_avx, use_avx2, use_avx512, use_avx512_bw;
 bool use_vsx, use_power_arch_2_07;
 
 string filter = "*";
@@ -53,6 +53,8 @@ bool can_run_code() {
     // compiled code and the host in order to run the code.
     for (Target::Feature f : {Target::SSE41, Target::AVX, Target::AVX2,
                 Target::FMA, Target::FMA4, Target::F16C,
+                Target::AVX512, Target::AVX512_BW, Target::AVX512_DQ,
+                Target::AVX512_VL, Target::AVX512_VNNI,
                 Target::VSX, Target::POWER_ARCH_2_07,
                 Target::ARMv7s, Target::NoNEON, Target::MinGW}) {
         if (target.has_feature(f) != host_target.has_feature(f)) {
@@ -505,9 +507,12 @@ void check_sse_all() {
         check("vpsubq", 8, i64_1 - i64_2);
         check("vpmuludq", 8, u64_1 * u64_2);
 
-        check("vpackssdw", 16, i16_sat(i32_1));
-        check("vpacksswb", 32, i8_sat(i16_1));
-        check("vpackuswb", 32, u8_sat(i16_1));
+        if (!use_avx512_bw) {
+            // With avx512, these use the saturating narrowing moves instead
+            check("vpackssdw", 16, i16_sat(i32_1));
+            check("vpacksswb", 32, i8_sat(i16_1));
+            check("vpackuswb", 32, u8_sat(i16_1));
+        }
 
         check("vpabsb", 32, abs(i8_1));
         check("vpabsw", 16, abs(i16_1));
@@ -530,9 +535,44 @@ void check_sse_all() {
         check("vpminsd", 8, min(i32_1, i32_2));
 
         check("vpcmpeqq", 4, select(i64_1 == i64_2, i64(1), i64(2)));
-        check("vpackusdw", 16, u16(clamp(i32_1, 0, max_u16)));
+        if (!use_avx512_bw) {
+            check("vpackusdw", 16, u16(clamp(i32_1, 0, max_u16)));
+        }
         check("vpcmpgtq", 4, select(i64_1 > i64_2, i64(1), i64(2)));
     }
+
+    // AVX-512
+
+    if (use_avx512) {
+        check("vaddps*zmm", 16, f32_1 + f32_2);
+        check("vmulps*zmm", 16, f32_1 * f32_2);
+        check("vaddpd*zmm", 8, f64_1 + f64_2);
+        check("vmulpd*zmm", 8, f64_1 * f64_2);
+        check("vpaddd*zmm", 16, i32_1 + i32_2);
+        check("vpsubd*zmm", 16, i32_1 - i32_2);
+        check("vpmulld*zmm", 16, i32_1 * i32_2);
+        check("vpaddq*zmm", 8, i64_1 + i64_2);
+        check("vpmaxsd*zmm", 16, max(i32_1, i32_2));
+        check("vpminud*zmm", 16, min(u32_1, u32_2));
+        check("vpabsd*zmm", 16, abs(i32_1));
+    }
+
+    if (use_avx512_bw) {
+        check("vpaddb*zmm", 64, u8_1 + u8_2);
+        check("vpaddw*zmm", 32, u16_1 + u16_2);
+        check("vpmullw*zmm", 32, i16_1 * i16_2);
+        check("vpmaxub*zmm", 64, max(u8_1, u8_2));
+        check("vpminsw*zmm", 32, min(i16_1, i16_2));
+        check("vpavgb*zmm", 64, u8((u16(u8_1) + u16(u8_2) + 1)/2));
+
+        check("vpmaddwd*zmm", 16, i32(i16_1) * 3 + i32(i16_2) * 4);
+        check("vpmaddwd*zmm", 16, i32(i16_1) * 3 - i32(i16_2) * 4);
+
+        check("vpmovsdw", 16, i16_sat(i32_1));
+        check("vpmovusdw", 16, u16_sat(i32_1));
+        check("vpmovswb", 32, i8_sat(i16_1));
+        check("vpmovuswb", 32, u8_sat(i16_1));
+    }
 }
 
 void check_neon_all() {
@@ -1840,7 +1880,9 @@ int main(int argc, char **argv) {
     target = get_target_from_environment();
     target.set_features({Target::NoBoundsQuery, Target::NoAsserts, Target::NoRuntime});
 
-    use_avx2 = target.has_feature(Target::AVX2);
+    use_avx512_bw = target.has_feature(Target::AVX512_BW);
+    use_avx512 = use_avx512_bw || target.has_feature(Target::AVX512);
+    use_avx2 = use_avx512 || target.has_feature(Target::AVX2);
     use_avx = use_avx2 || target.has_feature(Target::AVX);
     use_sse41 = use_avx || target.has_feature(Target::SSE41);
 
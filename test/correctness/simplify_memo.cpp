@@ -0,0 +1,96 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+// Compile each pipeline with and without the simplifier's memo
+// (HL_SIMPLIFY_MEMO=1), and check that the outputs match. The
+// pipelines have many lets, boundary conditions and specializations,
+// which give the memo plenty of repeated Exprs to get wrong.
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+Image<uint8_t> input;
+Var x("x"), y("y"), xi("xi"), yi("yi");
+
+// A blur with a boundary condition, tiled with tails that get
+// shifted inwards.
+Func blur() {
+    Func in = BoundaryConditions::mirror_interior(input);
+    Func blur_x, blur_y;
+    blur_x(x, y) = (in(x - 1, y) + 2 * in(x, y) + in(x + 1, y)) / 4;
+    blur_y(x, y) = (blur_x(x, y - 1) + 2 * blur_x(x, y) + blur_x(x, y + 1)) / 4;
+    blur_y.tile(x, y, xi, yi, 37, 19).vectorize(xi, 8).parallel(y);
+    blur_x.compute_at(blur_y, x).vectorize(x, 8);
+    return blur_y;
+}
+
+// Nested selects and lets over a specialized parameter.
+Param<int> offset("offset");
+Func lets() {
+    Func f, g;
+    Expr a = input(x, y) + offset;
+    Expr b = a * a - x;
+    f(x, y) = select(b > 100, b / 3, select(a < 10, a + y, b - a));
+    g(x, y) = f(x, y) + f(x + offset, y) * 2;
+    f.compute_at(g, y);
+    g.specialize(offset == 0).vectorize(x, 16);
+    g.split(x, x, xi, 13);
+    return g;
+}
+
+// A reduction with a data-dependent index.
+Func histogram() {
+    Func hist, out;
+    RDom r(0, input.width() - 1, 0, input.height());
+    hist(x) = 0;
+    hist(input(r.x, r.y) / 4) += cast<int>(input(r.x + 1, r.y) & 3);
+    out(x, y) = hist(x % 64) + y;
+    hist.compute_root();
+    return out;
+}
+
+template<typename T>
+bool check(const char *name, Func (*make)(), int w, int h) {
+    set_env("HL_SIMPLIFY_MEMO", "0");
+    Image<T> correct = make().realize(w, h);
+    set_env("HL_SIMPLIFY_MEMO", "1");
+    Image<T> out = make().realize(w, h);
+
+    for (int j = 0; j < h; j++) {
+        for (int i = 0; i < w; i++) {
+            if (out(i, j) != correct(i, j)) {
+                printf("%s: output(%d, %d) = %d with the memo, but %d without\n",
+                       name, i, j, (int)out(i, j), (int)correct(i, j));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    input = Image<uint8_t>(300, 200);
+    for (int j = 0; j < input.height(); j++) {
+        for (int i = 0; i < input.width(); i++) {
+            input(i, j) = (uint8_t)rand();
+        }
+    }
+
+    if (!check<uint8_t>("blur", blur, 250, 150)) return -1;
+    offset.set(0);
+    if (!check<int>("lets, offset 0", lets, 250, 150)) return -1;
+    offset.set(3);
+    if (!check<int>("lets, offset 3", lets, 250, 150)) return -1;
+    if (!check<int>("histogram", histogram, 64, 16)) return -1;
+
+    printf("Success!\n");
+    return 0;
+}
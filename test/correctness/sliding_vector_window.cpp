@@ -0,0 +1,94 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+// Vectorized stencils load overlapping vectors on consecutive loop
+// iterations, which get rotated through registers instead of being
+// reloaded. Check that this gets the right answer for a few window
+// sizes and vector widths, including ones where the loop doesn't
+// divide evenly.
+int check_stencil(int taps, int vector_width) {
+    const int W = 203, H = 17;
+    Image<uint16_t> input(W + taps, H + taps);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = (uint16_t)(rand() & 0xfff);
+        }
+    }
+
+    Func f;
+    Var x, y;
+    Expr e = cast<uint16_t>(0);
+    for (int dy = 0; dy < taps; dy++) {
+        for (int dx = 0; dx < taps; dx++) {
+            e += input(x + dx, y + dy) * cast<uint16_t>(dx + 2*dy + 1);
+        }
+    }
+    f(x, y) = e;
+    f.vectorize(x, vector_width);
+
+    Image<uint16_t> out = f.realize(W, H);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            uint16_t correct = 0;
+            for (int dy = 0; dy < taps; dy++) {
+                for (int dx = 0; dx < taps; dx++) {
+                    correct += input(x + dx, y + dy) * (uint16_t)(dx + 2*dy + 1);
+                }
+            }
+            if (out(x, y) != correct) {
+                printf("%dx%d stencil, vector width %d: out(%d, %d) = %d instead of %d\n",
+                       taps, taps, vector_width, x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    set_env("HL_CARRY_VECTOR_WINDOWS", "1");
+
+    for (int taps : {2, 3, 5}) {
+        for (int vector_width : {4, 8, 16}) {
+            if (check_stencil(taps, vector_width) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    // A buffer that is stored to inside the loop can't have its
+    // values carried, because they may be stale by the next
+    // iteration.
+    {
+        Func g;
+        Var x;
+        g(x) = x*x;
+        g(x) += g(x + 1) + g(x + 2);
+        g.vectorize(x, 8);
+        g.update().vectorize(x, 8);
+
+        Image<int> out = g.realize(100);
+        for (int x = 0; x < 100; x++) {
+            int correct = x*x + (x+1)*(x+1) + (x+2)*(x+2);
+            if (out(x) != correct) {
+                printf("g(%d) = %d instead of %d\n", x, out(x), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include "Halide.h"
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace Halide;
+
+// Writes a trace from a parallel pipeline through HL_TRACE_FILE, and
+// reads the packets back from the file, the way util/HalideTraceDump
+// does. Every store has to be there exactly once, however the threads
+// interleaved their packets in the trace buffer.
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+int main(int argc, char **argv) {
+    std::string file = Internal::dir_make_temp() + "/trace.bin";
+
+    // The file is truncated when first opened, so none of this should
+    // survive.
+    {
+        std::ofstream junk(file.c_str(), std::ios::binary);
+        junk << "Not a trace file";
+    }
+    set_env("HL_TRACE_FILE", file.c_str());
+
+    // Enough vector stores from enough threads to fill the trace
+    // buffer more than once.
+    const int W = 256, H = 256, lanes = 4;
+    Func f("f");
+    Var x, y;
+    f(x, y) = x + y * W;
+    f.vectorize(x, lanes).parallel(y).trace_stores();
+    f.realize(W, H);
+
+    // The trace is flushed when the pipeline ends.
+    std::ifstream in(file.c_str(), std::ios::binary);
+    std::vector<int> seen(W * H, 0);
+    int headers = 0, packets = 0, begin_pipelines = 0, end_pipelines = 0;
+    halide_trace_packet_t p;
+    while (in.read((char *)&p, sizeof(p))) {
+        if (packets++ == 0 && p.event != halide_trace_file_header) {
+            printf("The trace doesn't start with a header\n");
+            return -1;
+        }
+        if (p.event == halide_trace_file_header) {
+            if (p.id != halide_trace_file_magic || p.parent_id != halide_trace_file_version) {
+                printf("Bad trace file header\n");
+                return -1;
+            }
+            headers++;
+            continue;
+        }
+
+        int bytes = 1;
+        while (bytes * 8 < p.type_bits) bytes <<= 1;
+        std::vector<int32_t> value(p.lanes * bytes / 4 + 1), coords(p.dimensions);
+        if (!in.read((char *)value.data(), p.lanes * bytes) ||
+            !in.read((char *)coords.data(), p.dimensions * sizeof(int32_t))) {
+            printf("Unexpected end of trace file in the middle of a packet\n");
+            return -1;
+        }
+
+        if (p.event == halide_trace_begin_pipeline) {
+            begin_pipelines++;
+        } else if (p.event == halide_trace_end_pipeline) {
+            end_pipelines++;
+        } else if (p.event == halide_trace_store) {
+            if (strcmp(p.func, "f") != 0 || p.type_code != halide_type_int ||
+                p.type_bits != 32 || p.lanes != lanes || p.dimensions != 2 * lanes) {
+                printf("Unexpected store packet to %s\n", p.func);
+                return -1;
+            }
+            // The coordinates of each dimension come for all lanes
+            // before those of the next dimension.
+            for (int i = 0; i < lanes; i++) {
+                int px = coords[i], py = coords[lanes + i];
+                if (px < 0 || px >= W || py < 0 || py >= H) {
+                    printf("Store to f(%d, %d) is out of bounds\n", px, py);
+                    return -1;
+                }
+                if (value[i] != px + py * W) {
+                    printf("Store of %d to f(%d, %d) instead of %d\n",
+                           value[i], px, py, px + py * W);
+                    return -1;
+                }
+                seen[px + py * W]++;
+            }
+        }
+    }
+
+    if (headers != 1) {
+        printf("Expected one header packet, got %d\n", headers);
+        return -1;
+    }
+    if (begin_pipelines != 1 || end_pipelines != 1) {
+        printf("Expected one begin and one end pipeline packet, got %d and %d\n",
+               begin_pipelines, end_pipelines);
+        return -1;
+    }
+    for (int py = 0; py < H; py++) {
+        for (int px = 0; px < W; px++) {
+            if (seen[px + py * W] != 1) {
+                printf("The store to f(%d, %d) appears %d times in the trace\n",
+                       px, py, seen[px + py * W]);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
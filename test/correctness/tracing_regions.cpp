@@ -0,0 +1,72 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int store_regions = 0, load_regions = 0;
+int store_min[2] = {1000, 1000}, store_max[2] = {-1000, -1000};
+int load_box[4] = {0, 0, 0, 0};
+bool bad_store_extent = false;
+
+int my_trace(void *user_context, const halide_trace_event *ev) {
+    if (ev->event == halide_trace_store_region) {
+        // Region events carry a min and an extent per dimension.
+        if (ev->dimensions != 4 || ev->coordinates[1] != 4 || ev->coordinates[3] != 1) {
+            bad_store_extent = true;
+        }
+        for (int i = 0; i < 2 && ev->dimensions == 4; i++) {
+            int min = ev->coordinates[2*i], max = min + ev->coordinates[2*i+1] - 1;
+            if (min < store_min[i]) store_min[i] = min;
+            if (max > store_max[i]) store_max[i] = max;
+        }
+        store_regions++;
+    } else if (ev->event == halide_trace_load_region) {
+        if (ev->dimensions == 4) {
+            for (int i = 0; i < 4; i++) {
+                load_box[i] = ev->coordinates[i];
+            }
+        }
+        load_regions++;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Func f("f"), g("g");
+    Var x, y;
+    f(x, y) = x + y;
+    g(x, y) = f(x, y) + f(x + 1, y);
+
+    f.compute_root().vectorize(x, 4).trace_regions();
+
+    g.set_custom_trace(&my_trace);
+    g.realize(16, 4);
+
+    // f is computed over [0, 17) x [0, 4) in vectors of four, the
+    // last of which is shifted inwards, so there are five vectors
+    // per row.
+    if (store_regions != 20 || bad_store_extent) {
+        printf("Expected 20 store regions of 4x1, got %d\n", store_regions);
+        return -1;
+    }
+    if (store_min[0] != 0 || store_max[0] != 16 ||
+        store_min[1] != 0 || store_max[1] != 3) {
+        printf("Store regions covered [%d, %d] x [%d, %d]\n",
+               store_min[0], store_max[0], store_min[1], store_max[1]);
+        return -1;
+    }
+
+    // g is not vectorized, so its consumption of f is reported as a
+    // single region.
+    if (load_regions != 1 ||
+        load_box[0] != 0 || load_box[1] != 17 ||
+        load_box[2] != 0 || load_box[3] != 4) {
+        printf("Expected one load region of f over [0, 17) x [0, 4), got %d: "
+               "x min %d extent %d, y min %d extent %d\n",
+               load_regions, load_box[0], load_box[1], load_box[2], load_box[3]);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -17,6 +17,7 @@
 #include "Interval.h"
 #include "Associativity.h"
 #include "Generator.h"
+#include "HoistParallelAllocations.h"
 
 using namespace Halide;
 using namespace Halide::Internal;
@@ -39,6 +40,7 @@ int main(int argc, const char **argv) {
     interval_test();
     associativity_test();
     generator_test();
+    hoist_parallel_allocations_test();
 
     return 0;
 }
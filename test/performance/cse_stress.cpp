@@ -0,0 +1,57 @@
+#include "Halide.h"
+
+#include <cstdio>
+#include "benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// An expression in which every term is used several times, like the
+// index math of a heavily unrolled loop. Without lets its tree form is
+// exponentially large.
+Expr shared_chain(int n) {
+    Expr x = Variable::make(Int(32), "x");
+    Expr e = x;
+    for (int i = 0; i < n; i++) {
+        e = e*e + e + i;
+        e = e*e - e*i;
+    }
+    return e;
+}
+
+int main(int argc, char **argv) {
+    // CSE should take time roughly proportional to the size of the
+    // expression graph.
+    Expr small = shared_chain(250), large = shared_chain(1000);
+    double t_small = benchmark(3, 1, [&]() { common_subexpression_elimination(small); });
+    double t_large = benchmark(3, 1, [&]() { common_subexpression_elimination(large); });
+
+    printf("%g ms to CSE a chain of 250\n", t_small * 1e3);
+    printf("%g ms to CSE a chain of 1000\n", t_large * 1e3);
+
+    if (t_large > t_small * 10) {
+        printf("CSE scaled worse than linearly in the size of the expression\n");
+        return -1;
+    }
+
+    // Lower a vectorized stencil with its inner loops fully unrolled,
+    // which makes very large expressions for CSE to chew on.
+    ImageParam input(Float(32), 2);
+    Func blur;
+    Var x, y, xi, yi;
+    Expr e = 0.0f;
+    for (int dy = -3; dy <= 3; dy++) {
+        for (int dx = -3; dx <= 3; dx++) {
+            e += input(x + dx, y + dy) * (dx*dx + dy + 1);
+        }
+    }
+    blur(x, y) = e;
+    blur.tile(x, y, xi, yi, 64, 8).vectorize(xi, 16).unroll(xi).unroll(yi);
+
+    double t_lower = benchmark(1, 3, [&]() { blur.compile_to_module({input}); });
+
+    printf("%g ms to lower an unrolled stencil\n", t_lower * 1e3);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "Halide.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include "benchmark.h"
+
+using namespace Halide;
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+// Define a fresh copy of a separable blur and JIT-compile it. Each
+// call makes new Funcs, so nothing is reused in-process.
+void compile_blur(const Target &target) {
+    ImageParam input(UInt(16), 2);
+    Func in = BoundaryConditions::repeat_edge(input);
+    Func blur_x, blur_y;
+    Var x, y, xi, yi;
+    blur_x(x, y) = (in(x - 1, y) + in(x, y) + in(x + 1, y)) / 3;
+    blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+    blur_y.tile(x, y, xi, yi, 256, 32).vectorize(xi, 8).parallel(y);
+    blur_x.compute_at(blur_y, x).vectorize(x, 8);
+    blur_y.compile_jit(target);
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+
+    // Without the cache, every process start pays for LLVM.
+    double cold = benchmark(3, 5, [&]() { compile_blur(target); });
+
+    // With it, only the first one does.
+    std::string dir = Internal::dir_make_temp();
+    set_env("HL_JIT_CACHE_DIR", dir.c_str());
+    compile_blur(target);
+    double warm = benchmark(3, 5, [&]() { compile_blur(target); });
+
+    printf("%g ms per jit compilation without the cache\n", cold * 1e3);
+    printf("%g ms per jit compilation from a warm cache\n", warm * 1e3);
+
+    if (warm > cold) {
+        printf("Compiling from a warm cache was slower than compiling from scratch\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
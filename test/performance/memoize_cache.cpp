@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include "Halide.h"
+#include "benchmark.h"
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+extern "C" DLLEXPORT int fill_tile(int32_t val, buffer_t *out) {
+    if (out->host) {
+        for (int32_t y = 0; y < out->extent[1]; y++) {
+            for (int32_t x = 0; x < out->extent[0]; x++) {
+                out->host[x * out->stride[0] + y * out->stride[1]] = (uint8_t)(val + x + y);
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // Measure the memoization cache's lookup and store throughput
+    // with every thread of the thread pool hammering on it at once.
+    // Each iteration of a parallel loop looks up a small memoized
+    // tile, so the time is dominated by the cache.
+    const int tiles = 1 << 14;
+
+    Param<int> val;
+    Func tile;
+    tile.define_extern("fill_tile", {val}, UInt(8), 3);
+
+    Func g;
+    Var x, y, z;
+    g(x, y, z) = tile(x, y, z);
+    tile.compute_at(g, z).memoize();
+    g.parallel(z);
+    g.compile_jit();
+
+    Image<uint8_t> out(4, 4, tiles);
+
+    // All hits: every tile is already in the cache.
+    Internal::JITSharedRuntime::memoization_cache_set_size(tiles * 16 * 4);
+    val.set(0);
+    g.realize(out);
+    double hit_time = benchmark(5, 10, [&]() { g.realize(out); });
+
+    // All misses: a new parameter value each time makes every key
+    // new, so each lookup misses and is followed by a store that
+    // evicts an old entry.
+    int v = 1;
+    double miss_time = benchmark(5, 10, [&]() { val.set(v++); g.realize(out); });
+
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    printf("Cache hits: %f ns per lookup\n", hit_time * 1e9 / tiles);
+    printf("Cache misses: %f ns per lookup and store\n", miss_time * 1e9 / tiles);
+
+    printf("Success!\n");
+    return 0;
+}
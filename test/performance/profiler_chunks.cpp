@@ -0,0 +1,56 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Halide;
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+float chunk = 0;
+void my_print(void *, const char *msg) {
+    const char *line = strstr(msg, "  out: ");
+    const char *c = line ? strstr(line, " chunk: ") : NULL;
+    if (c) {
+        sscanf(c, " chunk: %f", &chunk);
+    }
+}
+
+int main(int argc, char **argv) {
+    // Rows are claimed eight at a time, unless another thread steals
+    // part of a chunk. The schedule is read when the thread pool
+    // starts.
+    set_env("HL_PAR_FOR_SCHEDULE", "dynamic:8");
+
+    // The profiler bills the chunks the rows of out were claimed in
+    // to out, which launched the parallel loop. The loop is launched
+    // from the thread that calls realize.
+    Func out("out");
+    Var x, y;
+    Expr e = cast<float>(x + y);
+    for (int j = 0; j < 50; j++) {
+        e = sin(e);
+    }
+    out(x, y) = e;
+    out.set_custom_print(&my_print);
+    out.parallel(y);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    out.realize(1000, 256, t);
+
+    printf("Average chunk of out: %f rows\n", chunk);
+
+    if (chunk <= 1 || chunk > 8) {
+        printf("Expected the rows of out to be claimed in chunks of 2 to 8 rows\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
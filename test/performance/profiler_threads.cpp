@@ -0,0 +1,53 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int percentage = 0;
+float ms = 0;
+void my_print(void *, const char *msg) {
+    float this_ms;
+    int this_percentage;
+    int val = sscanf(msg, " expensive: %fms (%d", &this_ms, &this_percentage);
+    if (val == 2) {
+        ms = this_ms;
+        percentage = this_percentage;
+    }
+}
+
+int main(int argc, char **argv) {
+    // Two Funcs computed per scanline of a parallel loop, of which
+    // one is much more expensive than the other. The profiler should
+    // bill each thread's time to the Func that thread is computing,
+    // rather than to whichever Func a thread most recently entered.
+    Func expensive("expensive"), cheap("cheap"), out("out");
+    Var x, y;
+
+    Expr e = cast<float>(x + y);
+    for (int j = 0; j < 200; j++) {
+        e = sin(e);
+    }
+    expensive(x, y) = e;
+    cheap(x, y) = expensive(x, y) * 2.0f + 1.0f;
+    out(x, y) = cheap(x, y) + cheap(x + 1, y);
+
+    out.set_custom_print(&my_print);
+    out.compute_root().parallel(y);
+    expensive.compute_at(out, y);
+    cheap.compute_at(out, y);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    Image<float> im = out.realize(1000, 100, t);
+
+    printf("Time spent in expensive: %fms\n", ms);
+
+    if (percentage < 40) {
+        printf("Percentage of runtime spent in expensive: %d\n"
+               "This is suspiciously low. It should be more like 90%%\n",
+               percentage);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "Halide.h"
+#include <fstream>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+// The value of a string field of a trace event, or the empty string.
+std::string field(const std::string &event, const std::string &name) {
+    std::string key = "\"" + name + "\": \"";
+    size_t start = event.find(key);
+    if (start == std::string::npos) return "";
+    start += key.size();
+    return event.substr(start, event.find('"', start) - start);
+}
+
+int main(int argc, char **argv) {
+    std::string dir = dir_make_temp();
+
+    // Events are only recorded if the timeline is also going to be
+    // written at exit. Write it somewhere else, so that the file we
+    // check comes from halide_profiler_write_timeline.
+    set_env("HL_PROFILER_TIMELINE", (dir + "/at_exit.json").c_str());
+    std::string file = dir + "/timeline.json";
+
+    // A parallel pipeline where each row computes its own slice of
+    // the producer.
+    const int rows = 64;
+    Func producer("producer"), consumer("consumer");
+    Var x, y;
+    Expr e = cast<float>(x + y);
+    for (int i = 0; i < 50; i++) {
+        e = sin(e);
+    }
+    producer(x, y) = e;
+    consumer(x, y) = producer(x, y) + producer(x + 1, y);
+    consumer.parallel(y);
+    producer.compute_at(consumer, y);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    consumer.realize(1000, rows, t);
+
+    // Write the timeline from another pipeline, which shares the
+    // runtime of the first.
+    Func write("write_timeline");
+    write() = Call::make(Int(32), "halide_profiler_write_timeline",
+                         {make_zero(Handle()), StringImm::make(file)}, Call::Extern);
+    Image<int> result = write.realize();
+    if (result() != 0) {
+        printf("halide_profiler_write_timeline returned %d\n", result());
+        return -1;
+    }
+
+    // Each event is on a line of its own.
+    std::ifstream in(file.c_str());
+    std::string line;
+    if (!std::getline(in, line) || line.find("{\"traceEvents\": [") != 0) {
+        printf("%s doesn't start with a list of trace events\n", file.c_str());
+        return -1;
+    }
+    int producer_spans = 0, consumer_spans = 0, thread_spans = 0;
+    std::set<std::string> tids;
+    while (std::getline(in, line)) {
+        if (field(line, "ph") != "X") continue;
+        std::string name = field(line, "name"), cat = field(line, "cat");
+        if (name == producer.name()) {
+            producer_spans++;
+        } else if (name == consumer.name()) {
+            consumer_spans++;
+        } else if (cat == "thread") {
+            thread_spans++;
+            size_t tid = line.find("\"tid\": ");
+            tids.insert(line.substr(tid, line.find(',', tid) - tid));
+        }
+    }
+
+    printf("%d producer spans, %d consumer spans, %d thread spans on %d threads\n",
+           producer_spans, consumer_spans, thread_spans, (int)tids.size());
+
+    // Every row computes its own slice of the producer, so there
+    // should be a producer span for each row at least.
+    if (producer_spans < rows) {
+        printf("Expected at least %d spans for the producer\n", rows);
+        return -1;
+    }
+    if (consumer_spans == 0) {
+        printf("There were no spans for the consumer\n");
+        return -1;
+    }
+    if (thread_spans == 0) {
+        printf("There were no spans for the threads running the pipeline\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
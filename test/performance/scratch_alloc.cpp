@@ -0,0 +1,54 @@
+#include "Halide.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include "benchmark.h"
+
+using namespace Halide;
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+// Time a pipeline that allocates a scratch buffer for every tile of
+// its output. The scratch buffers are just over a power of two in
+// size, which is the worst case for the pool's rounding. The tiles
+// are computed serially: in a parallel loop, a heap allocation whose
+// size can be bounded before the loop (as this one can) takes its
+// buffers from a scratch pool made for the loop, and never reaches
+// halide_malloc.
+double time_tiles(const Target &target) {
+    Func f, g;
+    Var x, y, xo, yo, xi, yi;
+    f(x, y) = cast<float>(x * y);
+    g(x, y) = f(x, y) + f(x + 1, y + 1);
+    g.tile(x, y, xo, yo, xi, yi, 256, 256);
+    f.compute_at(g, xo);
+    g.compile_jit(target);
+
+    Image<float> out(4096, 4096);
+    g.realize(out);
+    return benchmark(5, 5, [&]() { g.realize(out); });
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+
+    // The runtime reads HL_MALLOC_POOL_SIZE once, so it's restarted
+    // to turn the pool on.
+    double system_time = time_tiles(target);
+
+    Internal::JITSharedRuntime::release_all();
+    set_env("HL_MALLOC_POOL_SIZE", "268435456");
+    double pool_time = time_tiles(target);
+
+    printf("Per-tile scratch from the system allocator: %f ms\n", system_time * 1e3);
+    printf("Per-tile scratch from the pool: %f ms\n", pool_time * 1e3);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "HalideRuntime.h"
+
+// Prints a binary trace file written by Halide (see HL_TRACE_FILE and
+// halide_trace_packet_t) in the same human-readable format Halide
+// prints traces in when not writing to a file. Reads the file named
+// on the command line, or stdin if none is given.
+
+namespace {
+
+const char *event_types[] = {"Load",
+                             "Store",
+                             "Begin realization",
+                             "End realization",
+                             "Produce",
+                             "Consume",
+                             "End consume",
+                             "Begin pipeline",
+                             "End pipeline",
+                             "Load region",
+                             "Store region"};
+
+template<typename T>
+void print_value(const uint8_t *value, int i) {
+    T v;
+    memcpy(&v, value + i * sizeof(T), sizeof(T));
+    printf("%s", std::to_string(v).c_str());
+}
+
+void print_value(const halide_trace_packet_t &p, int bytes, const uint8_t *value, int i) {
+    if (p.type_code == halide_type_int) {
+        switch (bytes) {
+        case 1: print_value<int8_t>(value, i); return;
+        case 2: print_value<int16_t>(value, i); return;
+        case 4: print_value<int32_t>(value, i); return;
+        case 8: print_value<int64_t>(value, i); return;
+        }
+    } else if (p.type_code == halide_type_uint) {
+        switch (bytes) {
+        case 1: print_value<uint8_t>(value, i); return;
+        case 2: print_value<uint16_t>(value, i); return;
+        case 4: print_value<uint32_t>(value, i); return;
+        case 8: print_value<uint64_t>(value, i); return;
+        }
+    } else if (p.type_code == halide_type_float) {
+        switch (bytes) {
+        case 4: print_value<float>(value, i); return;
+        case 8: print_value<double>(value, i); return;
+        }
+    } else if (p.type_code == halide_type_handle && bytes == sizeof(void *)) {
+        void *v;
+        memcpy(&v, value + i * bytes, bytes);
+        printf("%p", v);
+        return;
+    }
+    printf("?");
+}
+
+void print_packet(const halide_trace_packet_t &p, const uint8_t *value, const int32_t *coords) {
+    int bytes = 1;
+    while (bytes * 8 < p.type_bits) bytes <<= 1;
+
+    if (p.event >= sizeof(event_types) / sizeof(event_types[0])) {
+        printf("Unknown event %d", p.event);
+    } else {
+        printf("%s", event_types[p.event]);
+    }
+    printf(" %s.%d(", p.func, p.value_index);
+    if (p.lanes > 1) {
+        printf("<");
+    }
+    for (int i = 0; i < p.dimensions; i++) {
+        if (i > 0) {
+            if (p.lanes > 1 && (i % p.lanes) == 0) {
+                printf(">, <");
+            } else {
+                printf(", ");
+            }
+        }
+        printf("%d", coords[i]);
+    }
+    printf(p.lanes > 1 ? ">)" : ")");
+
+    // Only print out the value on stores and loads.
+    if (p.event == halide_trace_load || p.event == halide_trace_store) {
+        printf(p.lanes > 1 ? " = <" : " = ");
+        for (int i = 0; i < p.lanes; i++) {
+            if (i > 0) {
+                printf(", ");
+            }
+            print_value(p, bytes, value, i);
+        }
+        if (p.lanes > 1) {
+            printf(">");
+        }
+    }
+    printf("\n");
+}
+
+int run(int argc, char **argv) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: HalideTraceDump [trace_file]\n");
+        return -1;
+    }
+
+    FILE *f = stdin;
+    if (argc == 2) {
+        f = fopen(argv[1], "rb");
+        if (!f) {
+            fprintf(stderr, "Could not open %s\n", argv[1]);
+            return -1;
+        }
+    }
+
+    std::vector<uint8_t> payload;
+    halide_trace_packet_t p;
+    while (fread(&p, sizeof(p), 1, f) == 1) {
+        if (p.event == halide_trace_file_header) {
+            if (p.id != halide_trace_file_magic) {
+                fprintf(stderr, "Corrupt trace file header\n");
+                return -1;
+            }
+            if (p.parent_id > halide_trace_file_version) {
+                fprintf(stderr, "Trace file is version %d, but this reader only understands up to version %d\n",
+                        p.parent_id, (int)halide_trace_file_version);
+                return -1;
+            }
+            continue;
+        }
+
+        int bytes = 1;
+        while (bytes * 8 < p.type_bits) bytes <<= 1;
+        size_t value_bytes = p.lanes * bytes;
+        size_t coord_bytes = p.dimensions * sizeof(int32_t);
+        payload.resize(value_bytes + coord_bytes + sizeof(int32_t));
+        if (fread(payload.data(), 1, value_bytes + coord_bytes, f) != value_bytes + coord_bytes) {
+            fprintf(stderr, "Unexpected EOF mid-packet\n");
+            return -1;
+        }
+        p.func[sizeof(p.func) - 1] = 0;
+
+        std::vector<int32_t> coords(p.dimensions);
+        memcpy(coords.data(), payload.data() + value_bytes, coord_bytes);
+        print_packet(p, payload.data(), coords.data());
+    }
+
+    if (f != stdin) {
+        fclose(f);
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    return run(argc, argv);
+}
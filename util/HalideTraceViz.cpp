@@ -542,6 +542,11 @@ int run(int argc, char **argv) {
             end_counter++;
             continue;
         }
+        // Skip the trace file headers
+        if (p.event == 255) {
+            continue;
+        }
+
         packet_clock++;
 
         // It's a pipeline begin/end event